@@ -0,0 +1,54 @@
+/*! \file Bench.c
+    \brief Benchmark program : bench [-p file] [name ...] runs the named benchmarks, all of them without a name but
+           the ones touching the hardware. -p gives a recording of the drone (RTPiDrone -r) to the benchmarks
+           reading one.
+ */
+#include "Bench.h"
+#include <stdio.h>
+#include <string.h>
+
+volatile float benchSink;
+const char* benchRecord = NULL;
+
+static const struct {
+    const char* name;
+    void (*run)(void);
+    int named;                  // Only when named : it needs the sensors
+} bench[] = {
+    {"baro",        Bench_Baro,         0},
+    {"ahrs",        Bench_AHRS,         0},
+    {"fastmath",    Bench_FastMath,     0},
+    {"filter",      Bench_Filter,       0},
+    {"dispatch",    Bench_Dispatch,     0},
+#ifdef  DRONE_I2CDEV
+    {"i2c",         Bench_I2C,          0},
+    {"i2c-pi",      Bench_I2C_Pi,       1},
+#endif
+};
+
+#define BENCH_N     (sizeof(bench)/sizeof(bench[0]))
+
+int main(int argc, char* argv[])
+{
+    int first = 1;
+    if (argc > 2 && !strcmp(argv[1], "-p")) {
+        benchRecord = argv[2];
+        first = 3;
+    }
+    for (int i=first; i<argc; ++i) {
+        size_t k = 0;
+        while (k < BENCH_N && strcmp(argv[i], bench[k].name)) ++k;
+        if (k == BENCH_N) {
+            fprintf(stderr, "Usage: %s [-p file] [", argv[0]);
+            for (k=0; k<BENCH_N; ++k) fprintf(stderr, "%s%s", k ? " | " : "", bench[k].name);
+            fprintf(stderr, "] ...\n");
+            return -1;
+        }
+    }
+    for (size_t k=0; k<BENCH_N; ++k) {
+        int run = argc == first && !bench[k].named;
+        for (int i=first; i<argc && !run; ++i) run = !strcmp(argv[i], bench[k].name);
+        if (run) bench[k].run();
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*!
+ * \file    Bench.h
+ * \brief   Benchmarks of the computation kernels against the code they replaced : max. deviation and time of both.
+ *          Built as the bench program, out of the flight binary.
+ */
+#ifndef H_BENCH
+#define H_BENCH
+#include <stdint.h>
+
+/*!
+ * \fn      void Bench_Baro(void)
+ * \brief   Integer compensation of MS5611 and getAltitude() against the former pow() formulas, on a sweep of the
+ *          raw values and on the MS5611 conversions of the recording (-p) if any
+ */
+void Bench_Baro(void);
+
+/*!
+ * \fn      void Bench_AHRS(void)
+ * \brief   The attitude estimators on a synthetic flight : time per update and deviation from the true attitude
+ */
+void Bench_AHRS(void);
+
+/*!
+ * \fn      void Bench_FastMath(void)
+ * \brief   The functions of FastMath.h against libm (double) : max. deviation, and time against libm float and double
+ */
+void Bench_FastMath(void);
+
+/*!
+ * \fn      void Bench_Filter(void)
+ * \brief   The filter bank against the former filter (one object per channel) : max. deviation and time of both
+ */
+void Bench_Filter(void);
+
+/*!
+ * \fn      void Bench_Dispatch(void)
+ * \brief   Refresh of the I2C sensors in one cycle : pointer per sensor, switch, and stage in sequence with direct calls
+ */
+void Bench_Dispatch(void);
+
+/*!
+ * \fn      void Bench_I2C(void)
+ * \brief   i2c-dev on a fake node answering as i2c-bcm2835 : ioctl and time of the sensor reads of one cycle
+ */
+void Bench_I2C(void);
+
+/*!
+ * \fn      void Bench_I2C_Pi(void)
+ * \brief   The same cycle on the sensors, with i2c-dev (I2CDEV_PATH) then the bcm2835 library
+ */
+void Bench_I2C_Pi(void);
+
+/*!
+ * \fn      double Bench_ns(uint64_t t0, uint64_t t1, double n)
+ * \brief   Time per call (ns) of n calls between get_nsec_mono() t0 and t1
+ */
+static inline double Bench_ns(uint64_t t0, uint64_t t1, double n)
+{
+    return (t1 - t0) / n;
+}
+
+extern volatile float benchSink;        //!< Results of the timed loops, so that they are kept
+extern const char* benchRecord;         //!< Recording of the drone given by -p, or NULL
+#endif
@@ -0,0 +1,227 @@
+/*! \file Bench_AHRS.c
+    \brief Attitude estimators (-e) on the same synthetic flight : time per update and deviation from the true attitude
+
+    The drone turns at a known angular velocity, the true quaternion is integrated in double with fine steps. Each
+    control cycle gives the estimators the gravity and the magnetic field seen from the body, and the gyro : one
+    sample per cycle (renew), or the samples of the L3G4200D FIFO at 800 Hz (renewSamples).
+ */
+#include "Bench.h"
+#include "RTPiDrone_Quaternion.h"
+#include "RTPiDrone_EKF.h"
+#include "RTPiDrone_Madgwick.h"
+#include "Common.h"
+#include <stdio.h>
+#include <math.h>
+
+#define AHRS_NCYCLE         5000            //!< \private Control cycles (20 s)
+#define AHRS_CYCLE          (0.004)         //!< \private Control period (s)
+#define AHRS_GYRO_PERIOD    (0.00125)       //!< \private Period of the gyro samples of the FIFO mode (s)
+#define AHRS_NGYRO          4               //!< \private Max. gyro samples per cycle
+#define AHRS_MAG_EVERY      4               //!< \private Cycles per magnetic field sample
+#define AHRS_NSTEP          16              //!< \private Steps of the true attitude per gyro period
+#define AHRS_NEST           3               //!< \private Estimators
+
+//! \private Gains of RTPiDrone_AHRS.c
+static float pi[] = {2.5,0.005};
+static float beta = 0.1;
+
+static int Mahony_init(void** Q, float* angle)
+{
+    return Drone_Quaternion_Init((Drone_Quaternion**)Q, angle, pi);
+}
+
+static void Mahony_end(void** Q)
+{
+    Drone_Quaternion_Delete((Drone_Quaternion**)Q);
+}
+
+static void Mahony_renew(void* Q, float dt, float* acc, float* gyr, float* mag)
+{
+    Drone_Quaternion_renew(Q, dt, acc, gyr, mag);
+}
+
+static void Mahony_renewSamples(void* Q, float* acc, float (*gyr)[3], float* dt, int n, float* mag)
+{
+    Drone_Quaternion_renewSamples(Q, acc, gyr, dt, n, mag);
+}
+
+static void Mahony_getAngle(void* Q, float* angle)
+{
+    Drone_Quaternion_getAngle(Q, angle);
+}
+
+static int EKF_init(void** E, float* angle)
+{
+    return Drone_EKF_Init((Drone_EKF**)E, angle);
+}
+
+static void EKF_end(void** E)
+{
+    Drone_EKF_Delete((Drone_EKF**)E);
+}
+
+static void EKF_renew(void* E, float dt, float* acc, float* gyr, float* mag)
+{
+    Drone_EKF_renew(E, dt, acc, gyr, mag);
+}
+
+static void EKF_renewSamples(void* E, float* acc, float (*gyr)[3], float* dt, int n, float* mag)
+{
+    Drone_EKF_renewSamples(E, acc, gyr, dt, n, mag);
+}
+
+static void EKF_getAngle(void* E, float* angle)
+{
+    Drone_EKF_getAngle(E, angle);
+}
+
+static int Madgwick_init(void** M, float* angle)
+{
+    return Drone_Madgwick_Init((Drone_Madgwick**)M, angle, beta);
+}
+
+static void Madgwick_end(void** M)
+{
+    Drone_Madgwick_Delete((Drone_Madgwick**)M);
+}
+
+static void Madgwick_renew(void* M, float dt, float* acc, float* gyr, float* mag)
+{
+    Drone_Madgwick_renew(M, dt, acc, gyr, mag);
+}
+
+static void Madgwick_renewSamples(void* M, float* acc, float (*gyr)[3], float* dt, int n, float* mag)
+{
+    Drone_Madgwick_renewSamples(M, acc, gyr, dt, n, mag);
+}
+
+static void Madgwick_getAngle(void* M, float* angle)
+{
+    Drone_Madgwick_getAngle(M, angle);
+}
+
+//! \private The estimators of RTPiDrone_AHRS.c
+static const struct {
+    const char* name;
+    int  (*init)(void**, float*);
+    void (*end)(void**);
+    void (*renew)(void*, float, float*, float*, float*);
+    void (*renewSamples)(void*, float*, float (*)[3], float*, int, float*);
+    void (*getAngle)(void*, float*);
+    int  magFreshOnly;
+} estimator[AHRS_NEST] = {
+    {"mahony",   Mahony_init,   Mahony_end,   Mahony_renew,   Mahony_renewSamples,   Mahony_getAngle,   0},
+    {"ekf",      EKF_init,      EKF_end,      EKF_renew,      EKF_renewSamples,      EKF_getAngle,      0},
+    {"madgwick", Madgwick_init, Madgwick_end, Madgwick_renew, Madgwick_renewSamples, Madgwick_getAngle, 1},
+};
+
+// Angular velocity of the body (rad/s) at t (s)
+static void Bench_AHRS_rate(double t, double* w)
+{
+    w[0] = 1.5 * sin(2*M_PI*0.5*t);
+    w[1] = 1.0 * sin(2*M_PI*0.3*t + 1.0);
+    w[2] = 0.8 * sin(2*M_PI*0.2*t);
+}
+
+// The true quaternion from t over dt
+static void Bench_AHRS_integrate(double* q, double t, double dt)
+{
+    double h = dt / AHRS_NSTEP, w[3];
+    for (int s=0; s<AHRS_NSTEP; ++s) {
+        Bench_AHRS_rate(t + (s+0.5)*h, w);
+        double d[4] = {
+            -q[1]*w[0] - q[2]*w[1] - q[3]*w[2],
+             q[0]*w[0] + q[2]*w[2] - q[3]*w[1],
+             q[0]*w[1] - q[1]*w[2] + q[3]*w[0],
+             q[0]*w[2] + q[1]*w[1] - q[2]*w[0],
+        };
+        double n = 0;
+        for (int i=0; i<4; ++i) {
+            q[i] += 0.5*h*d[i];
+            n += q[i]*q[i];
+        }
+        for (int i=0; i<4; ++i) q[i] /= sqrt(n);
+    }
+}
+
+// A vector of the earth frame seen from the body
+static void Bench_AHRS_toBody(const double* q, const double* x, float* y)
+{
+    double r[3][3] = {
+        {1 - 2*(q[2]*q[2] + q[3]*q[3]), 2*(q[1]*q[2] - q[0]*q[3]), 2*(q[1]*q[3] + q[0]*q[2])},
+        {2*(q[1]*q[2] + q[0]*q[3]), 1 - 2*(q[1]*q[1] + q[3]*q[3]), 2*(q[2]*q[3] - q[0]*q[1])},
+        {2*(q[1]*q[3] - q[0]*q[2]), 2*(q[2]*q[3] + q[0]*q[1]), 1 - 2*(q[1]*q[1] + q[2]*q[2])},
+    };
+    for (int i=0; i<3; ++i) y[i] = (float)(r[0][i]*x[0] + r[1][i]*x[1] + r[2][i]*x[2]);
+}
+
+static void Bench_AHRS_angle(const double* q, float* angle)
+{
+    angle[0] = (float)(atan2(2*q[2]*q[3] + 2*q[0]*q[1], -2*q[1]*q[1] - 2*q[2]*q[2] + 1) * 180/M_PI);
+    angle[1] = (float)(asin(-2*q[1]*q[3] + 2*q[0]*q[2]) * 180/M_PI);
+    angle[2] = (float)(atan2(2*q[1]*q[2] + 2*q[0]*q[3], -2*q[2]*q[2] - 2*q[3]*q[3] + 1) * 180/M_PI);
+}
+
+static void Bench_AHRS_run(int fifo)
+{
+    static const double gravity[3] = {0, 0, 1}, field[3] = {0.45, 0, -0.9};
+    void* state[AHRS_NEST];
+    float angle[3] = {0, 0, 0};
+    uint64_t time[AHRS_NEST] = {0};
+    double sq[AHRS_NEST][3] = {{0}};
+    float max[AHRS_NEST][3] = {{0}};
+    for (int e=0; e<AHRS_NEST; ++e) {
+        if (estimator[e].init(&state[e], angle)) return;
+    }
+
+    double q[4] = {1, 0, 0, 0}, t = 0, w[3];
+    float acc[3], mag[3];
+    for (int c=0; c<AHRS_NCYCLE; ++c) {
+        // The gyro samples of the cycle : one at its end, or every AHRS_GYRO_PERIOD
+        float gyr[AHRS_NGYRO][3], dt[AHRS_NGYRO];
+        int n = 0;
+        double end = (c+1)*AHRS_CYCLE;
+        while (fifo ? t + AHRS_GYRO_PERIOD <= end + 1e-9 && n < AHRS_NGYRO : !n) {
+            double step = fifo ? AHRS_GYRO_PERIOD : end - t;
+            Bench_AHRS_integrate(q, t, step);
+            t += step;
+            Bench_AHRS_rate(t, w);
+            for (int i=0; i<3; ++i) gyr[n][i] = (float)w[i];
+            dt[n++] = (float)step;
+        }
+        Bench_AHRS_toBody(q, gravity, acc);
+        int magFresh = !(c % AHRS_MAG_EVERY);
+        if (magFresh) Bench_AHRS_toBody(q, field, mag);
+
+        float trueAngle[3];
+        Bench_AHRS_angle(q, trueAngle);
+        for (int e=0; e<AHRS_NEST; ++e) {
+            float* m = magFresh || !estimator[e].magFreshOnly ? mag : NULL;
+            uint64_t start = get_nsec_mono();
+            if (fifo) estimator[e].renewSamples(state[e], acc, gyr, dt, n, m);
+            else estimator[e].renew(state[e], dt[0], acc, gyr[0], m);
+            time[e] += get_nsec_mono() - start;
+            estimator[e].getAngle(state[e], angle);
+            for (int i=0; i<3; ++i) {
+                float d = fabsf(angle[i] - trueAngle[i]);
+                if (d > 180) d = 360 - d;                   // Across +-180 degree
+                sq[e][i] += d*d;
+                if (d > max[e][i]) max[e][i] = d;
+            }
+        }
+    }
+
+    for (int e=0; e<AHRS_NEST; ++e) {
+        printf("AHRS : %-8s %-5s %6.0f ns per update, roll/pitch/yaw RMS %.3f/%.3f/%.3f, max. %.3f/%.3f/%.3f degree\n",
+               estimator[e].name, fifo ? "FIFO" : "cycle", (double)time[e]/AHRS_NCYCLE,
+               sqrt(sq[e][0]/AHRS_NCYCLE), sqrt(sq[e][1]/AHRS_NCYCLE), sqrt(sq[e][2]/AHRS_NCYCLE),
+               max[e][0], max[e][1], max[e][2]);
+        estimator[e].end(&state[e]);
+    }
+}
+
+void Bench_AHRS(void)
+{
+    Bench_AHRS_run(0);
+    Bench_AHRS_run(1);
+}
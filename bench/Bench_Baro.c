@@ -0,0 +1,175 @@
+/*! \file Bench_Baro.c
+    \brief Barometers : the integer compensation of MS5611 and getAltitude() against the former double pow() code
+
+    The sweep covers -20 - 60 degree C. Below 20 degree C the former TEMP is truncated toward zero by the conversion
+    of the double, the new one rounded down by >> 23 : they differ by 1 LSB (0.01 degree C) for every negative dT,
+    and the second order terms take it up to about 1.5 Pa there. The recording (-p file of RTPiDrone -r) gives the
+    deviation on the conversions of a flight, with the PROM of its chip.
+ */
+#include "RTPiDrone_header.h"
+#include "Bench.h"
+#include "RTPiDrone_Bus.h"
+#include "RTPiDrone_I2C_Device_MS5611.h"
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define BARO_NSAMPLE        4096            //!< \private Raw samples, pressures
+#define BARO_NREPEAT        64              //!< \private Passes over the samples for the time
+#define P0                  101325          //!< \private Atmosphere pressure
+#define BARO_MS5611_ADDR    0x76            //!< \private Address of MS5611 in the recording
+#define BARO_MS5611_PROM    8               //!< \private Words of the PROM of MS5611
+
+//! \private PROM of the datasheet example : 20.07 degree C, 1000.09 mbar at D1 9085466, D2 8569150
+static const uint16_t sweepC[8] = {0, 40127, 36924, 23317, 23282, 33464, 28312, 0};
+
+// The former compensation of MS5611, in double with pow()
+static float Bench_MS5611_Former(const uint16_t* C, uint32_t D1, uint32_t D2, float* altitude)
+{
+    int32_t dT = (int32_t) D2 - (int32_t) C[5]*256;
+    int32_t TEMP = 2000 + (int64_t)dT * C[6]/pow(2,23);
+    int64_t OFF = (int64_t) C[2]*pow(2,16) + ((int64_t)C[4]*dT)/pow(2,7);
+    int64_t SENS = (int64_t) C[1]*pow(2,15) + ((int64_t)C[3]*dT)/pow(2,8);
+    if (TEMP < 2000) {
+        int32_t T2 = (int64_t)dT*dT/pow(2,31);
+        int64_t OFF2 = 5 * (TEMP-2000)*(TEMP-2000) / 2;
+        int64_t SENS2 = OFF2 / 2;
+        if (TEMP < -1500) {
+            OFF2 += 7*(TEMP+1500)*(TEMP+1500);
+            SENS2 += 11*(TEMP+1500)*(TEMP+1500)/2;
+        }
+        TEMP -= T2;
+        OFF -= OFF2;
+        SENS -= SENS2;
+    }
+    float RP = (float)((((int64_t)D1*SENS)/pow(2,21) - OFF ) / pow(2,15));
+    *altitude = 44330 * (1 - pow(RP/P0, 1/5.255) );
+    return RP;
+}
+
+/*
+ * The PROM and the pressures of MS5611 in a recording, each D1 with the last D2 as the driver pairs them : the ADC
+ * reads follow its conversions, temperature first then MS5611_TEMP_EVERY pressures (0 : not converted yet).
+ * return the number of pressures, -1 on error
+ */
+static int Bench_Baro_Record(const char* fileName, uint16_t* C, uint32_t** D1, uint32_t** D2)
+{
+    FILE* fp = fopen(fileName, "rb");
+    if (!fp) {
+        perror(fileName);
+        return -1;
+    }
+    Drone_Bus_RecordHeader h;
+    Drone_Bus_Event e;
+    int n = 0, nProm = 0, temperature = 1, nPressure = 0;
+    uint32_t lastD2 = 0;
+    *D1 = *D2 = NULL;
+    if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, DRONE_BUS_RECORD_MAGIC, sizeof(h.magic)) ||
+        h.nEvent > INT32_MAX || !(*D1 = malloc(h.nEvent * sizeof(uint32_t))) || !(*D2 = malloc(h.nEvent * sizeof(uint32_t)))) {
+        fprintf(stderr, "%s : not a recording\n", fileName);
+        n = -1;
+    }
+    for (uint64_t i=0; n>=0 && i<h.nEvent && fread(&e, sizeof(e), 1, fp) == 1; ++i) {
+        if (e.type != DRONE_BUS_EVENT_I2C || e.id != BARO_MS5611_ADDR || e.status != DRONE_BUS_OK) continue;
+        const unsigned char* b = (const unsigned char*)e.data;
+        if (nProm < BARO_MS5611_PROM) {
+            if (e.len == 2) C[nProm++] = 256 * b[0] + b[1];
+            continue;
+        }
+        if (e.len != 3) continue;
+        uint32_t adc = 65536 * b[0] + 256 * b[1] + b[2];
+        if (!adc) continue;
+        if (temperature) {
+            lastD2 = adc;
+            nPressure = 0;
+        } else {
+            (*D1)[n] = adc;
+            (*D2)[n++] = lastD2;
+            ++nPressure;
+        }
+        temperature = nPressure >= MS5611_TEMP_EVERY;
+    }
+    fclose(fp);
+    if (n <= 0) {
+        if (!n) fprintf(stderr, "%s : no MS5611 pressure\n", fileName);
+        free(*D1);
+        free(*D2);
+        return -1;
+    }
+    return n;
+}
+
+// Max. deviation of the pressure and altitude from the former compensation, over n conversions
+static void Bench_Baro_Deviation(const uint16_t* C, const uint32_t* D1, const uint32_t* D2, int n, float* dP, float* dH)
+{
+    *dP = *dH = 0;
+    for (int i=0; i<n; ++i) {
+        float RT, RP, refAltitude;
+        MS5611_compensate(C, D1[i], D2[i], &RT, &RP);
+        float refRP = Bench_MS5611_Former(C, D1[i], D2[i], &refAltitude);
+        if (fabsf(RP - refRP) > *dP) *dP = fabsf(RP - refRP);
+        if (fabsf(getAltitude(RP) - refAltitude) > *dH) *dH = fabsf(getAltitude(RP) - refAltitude);
+    }
+}
+
+void Bench_Baro(void)
+{
+    // -20 - 60 degree C, about 50000 - 110000 Pa
+    static uint32_t D1[BARO_NSAMPLE], D2[BARO_NSAMPLE];
+    static float pressure[BARO_NSAMPLE];
+    for (int i=0; i<BARO_NSAMPLE; ++i) {
+        D2[i] = 8566784 - 1200000 + (uint32_t)((uint64_t)2400000 * (i%64) / 63);
+        D1[i] = 6600000 + (uint32_t)((uint64_t)3000000 * (i/64) / (BARO_NSAMPLE/64 - 1));
+        pressure[i] = 50000.0f + 60000.0f * i / (BARO_NSAMPLE-1);
+    }
+
+    float dP, dH, dAlt = 0, sum = 0;
+    Bench_Baro_Deviation(sweepC, D1, D2, BARO_NSAMPLE, &dP, &dH);
+    for (int i=0; i<BARO_NSAMPLE; ++i) {
+        float d = fabsf(getAltitude(pressure[i]) - (float)(44330 * (1 - pow(pressure[i]/P0, 1/5.255))));
+        if (d > dAlt) dAlt = d;
+    }
+
+    uint64_t t[5];
+    t[0] = get_nsec_mono();
+    for (int k=0; k<BARO_NREPEAT; ++k) {
+        for (int i=0; i<BARO_NSAMPLE; ++i) {
+            float RT, RP;
+            MS5611_compensate(sweepC, D1[i], D2[i], &RT, &RP);
+            sum += getAltitude(RP);
+        }
+    }
+    t[1] = get_nsec_mono();
+    for (int k=0; k<BARO_NREPEAT; ++k) {
+        for (int i=0; i<BARO_NSAMPLE; ++i) {
+            float altitude;
+            Bench_MS5611_Former(sweepC, D1[i], D2[i], &altitude);
+            sum += altitude;
+        }
+    }
+    t[2] = get_nsec_mono();
+    for (int k=0; k<BARO_NREPEAT; ++k) for (int i=0; i<BARO_NSAMPLE; ++i) sum += getAltitude(pressure[i]);
+    t[3] = get_nsec_mono();
+    for (int k=0; k<BARO_NREPEAT; ++k) for (int i=0; i<BARO_NSAMPLE; ++i) sum += 44330 * (1 - pow(pressure[i]/P0, 1/5.255));
+    t[4] = get_nsec_mono();
+    benchSink = sum;
+
+    double n = (double)BARO_NREPEAT * BARO_NSAMPLE;
+    printf("MS5611 : %.0f ns per sample (former %.0f ns), max. deviation on the sweep %.3f Pa, %.4f m\n",
+           Bench_ns(t[0], t[1], n), Bench_ns(t[1], t[2], n), dP, dH);
+    if (benchRecord) {
+        uint16_t C[BARO_MS5611_PROM] = {0};
+        uint32_t *recD1, *recD2;
+        int nRec = Bench_Baro_Record(benchRecord, C, &recD1, &recD2);
+        if (nRec > 0) {
+            Bench_Baro_Deviation(C, recD1, recD2, nRec, &dP, &dH);
+            printf("MS5611 : %d pressures of %s, max. deviation %.3f Pa, %.4f m\n", nRec, benchRecord, dP, dH);
+            free(recD1);
+            free(recD2);
+        }
+    }
+    printf("BMP085 : %.0f ns per altitude (former %.0f ns), max. deviation %.4f m\n",
+           Bench_ns(t[2], t[3], n), Bench_ns(t[3], t[4], n), dAlt);
+}
@@ -0,0 +1,176 @@
+/*! \file Bench_Dispatch.c
+    \brief Refresh of the I2C sensors : the dispatch of one control cycle, through a pointer per sensor (former), a
+           switch on the sensor id, or the sensors of each stage in sequence with direct calls (Drone_I2C_Refresh_FAST/SLOW())
+
+    The loop is the one of RTPiDrone_I2C.c over Drone_Device and Drone_DataExchange, both stages, with the due pattern
+    of the flight : ADXL345 and L3G4200D every cycle, HMC5883L one in 4, the barometers one in 8. The drivers are
+    stubs out of line, as the real ones are in their own files : the time is the dispatch, not the drivers.
+ */
+#include "Bench.h"
+#include "RTPiDrone_Device.h"
+#include "RTPiDrone_DataExchange.h"
+#include "Common.h"
+#include <stdio.h>
+#include <stddef.h>
+
+#define DISPATCH_NCYCLE     1000000         //!< \private Control cycles
+#define DISPATCH_NSENSOR    5               //!< \private ADXL345, L3G4200D, HMC5883L, BMP085, MS5611
+
+//! \private One sensor present, as the former Drone_I2C_Sensor
+typedef struct {
+    Drone_Device*   dev;
+    int             (*refresh)(Drone_Device*, uint64_t*, float*, float*);
+    int             id;
+    uint32_t        value, est, time, fresh;
+} Bench_Dispatch_Sensor;
+
+static Drone_Device device[DISPATCH_NSENSOR];
+static Bench_Dispatch_Sensor sensor[DISPATCH_NSENSOR];
+static Drone_DataExchange data;
+
+// The getFilteredValue() of a driver : takes the due sample, one value through the filter
+#define DISPATCH_DRIVER(X) \
+static __attribute__((noinline, noclone)) int Bench_##X##_getFilteredValue(Drone_Device* dev, uint64_t* lastUpdate, float* value, float* est) \
+{ \
+    atomic_store_explicit(&dev->due, 0, memory_order_relaxed); \
+    dev->sampleTime = ++*lastUpdate; \
+    value[0] = (float)*lastUpdate; \
+    est[0] = 0.5f * (est[0] + value[0]); \
+    return 1; \
+} \
+static int Bench_Refresh_##X(Drone_Device* dev, uint64_t* lastUpdate, float* value, float* est) \
+{ \
+    return Bench_##X##_getFilteredValue(dev, lastUpdate, value, est); \
+}
+DISPATCH_DRIVER(ADXL345)
+DISPATCH_DRIVER(L3G4200D)
+DISPATCH_DRIVER(HMC5883L)
+DISPATCH_DRIVER(BMP085)
+DISPATCH_DRIVER(MS5611)
+
+#define DISPATCH_SENSOR(k, X, v, e, t, f) \
+    sensor[k] = (Bench_Dispatch_Sensor){&device[k], Bench_Refresh_##X, k, offsetof(Drone_DataExchange, v), \
+        offsetof(Drone_DataExchange, e), offsetof(Drone_DataExchange, t), offsetof(Drone_DataExchange, f)}; \
+    device[k].scheduled = 1
+
+__attribute__((noinline)) static void Bench_Dispatch_setup(void)
+{
+    DISPATCH_SENSOR(0, ADXL345,  acc, acc_est, accTime, accFresh);
+    DISPATCH_SENSOR(1, L3G4200D, gyr, gyr_est, gyrTime, gyrFresh);
+    DISPATCH_SENSOR(2, HMC5883L, mag, mag_est, magTime, magFresh);
+    DISPATCH_SENSOR(3, BMP085,   attitude, att_est, attTime, attFresh);
+    DISPATCH_SENSOR(4, MS5611,   attitudeHT, attHT_est, attHTTime, attHTFresh);
+}
+
+// What the Drone_Scheduler marks due in cycle c
+static inline void Bench_Dispatch_due(int c)
+{
+    atomic_store_explicit(&device[0].due, 1, memory_order_relaxed);
+    atomic_store_explicit(&device[1].due, 1, memory_order_relaxed);
+    atomic_store_explicit(&device[2].due, !(c & 3), memory_order_relaxed);
+    atomic_store_explicit(&device[3].due, !(c & 7), memory_order_relaxed);
+    atomic_store_explicit(&device[4].due, (c & 7) == 4, memory_order_relaxed);
+}
+
+// Former : the pointer of the sensor, then its typed wrapper
+__attribute__((noinline)) static int Bench_Dispatch_pointer(uint64_t* lastUpdate, int first, int last)
+{
+    int ret = 0;
+    char* base = (char*)&data;
+    for (int i=first; i<last; ++i) {
+        Bench_Dispatch_Sensor* s = &sensor[i];
+        uint8_t* fresh = (uint8_t*)(base + s->fresh);
+        *fresh = !Drone_Device_IsIdle(s->dev) && s->refresh(s->dev, lastUpdate, (float*)(base + s->value), (float*)(base + s->est));
+        if (*fresh) *(uint64_t*)(base + s->time) = Drone_Device_GetSampleTime(s->dev);
+        ret += *fresh;
+    }
+    return ret;
+}
+
+#define DISPATCH_CASE(k, X) \
+    case k: \
+        return Bench_##X##_getFilteredValue(s->dev, lastUpdate, value, est);
+
+static inline int Bench_Dispatch_refreshSensor(const Bench_Dispatch_Sensor* s, uint64_t* lastUpdate, float* value, float* est)
+{
+    switch (s->id) {
+        DISPATCH_CASE(0, ADXL345)
+        DISPATCH_CASE(1, L3G4200D)
+        DISPATCH_CASE(2, HMC5883L)
+        DISPATCH_CASE(3, BMP085)
+        DISPATCH_CASE(4, MS5611)
+        default:
+            return 0;
+    }
+}
+
+// A switch on the id, a direct call of the driver
+__attribute__((noinline)) static int Bench_Dispatch_switch(uint64_t* lastUpdate, int first, int last)
+{
+    int ret = 0;
+    char* base = (char*)&data;
+    for (int i=first; i<last; ++i) {
+        Bench_Dispatch_Sensor* s = &sensor[i];
+        uint8_t* fresh = (uint8_t*)(base + s->fresh);
+        *fresh = !Drone_Device_IsIdle(s->dev) && Bench_Dispatch_refreshSensor(s, lastUpdate, (float*)(base + s->value), (float*)(base + s->est));
+        if (*fresh) *(uint64_t*)(base + s->time) = Drone_Device_GetSampleTime(s->dev);
+        ret += *fresh;
+    }
+    return ret;
+}
+
+// Drone_I2C_Refresh_FAST/SLOW() : the sensors of the stage in sequence, each a direct call with constant offsets
+#define DISPATCH_STAGE(k, X, v, e, t, f) \
+    if (sensor[k].dev) { \
+        Drone_Device* dev = sensor[k].dev; \
+        data.f = !Drone_Device_IsIdle(dev) && Bench_##X##_getFilteredValue(dev, lastUpdate, (float*)&data.v, (float*)&data.e); \
+        if (data.f) data.t = Drone_Device_GetSampleTime(dev); \
+        ret += data.f; \
+    }
+
+__attribute__((noinline)) static int Bench_Dispatch_fast(uint64_t* lastUpdate)
+{
+    int ret = 0;
+    DISPATCH_STAGE(0, ADXL345,  acc, acc_est, accTime, accFresh)
+    DISPATCH_STAGE(1, L3G4200D, gyr, gyr_est, gyrTime, gyrFresh)
+    return ret;
+}
+
+__attribute__((noinline)) static int Bench_Dispatch_slow(uint64_t* lastUpdate)
+{
+    int ret = 0;
+    DISPATCH_STAGE(2, HMC5883L, mag, mag_est, magTime, magFresh)
+    DISPATCH_STAGE(3, BMP085,   attitude, att_est, attTime, attFresh)
+    DISPATCH_STAGE(4, MS5611,   attitudeHT, attHT_est, attHTTime, attHTFresh)
+    return ret;
+}
+
+static int Bench_Dispatch_stage(uint64_t* lastUpdate, int first, int last)
+{
+    (void)last;
+    return first ? Bench_Dispatch_slow(lastUpdate) : Bench_Dispatch_fast(lastUpdate);
+}
+
+static void Bench_Dispatch_run(const char* name, int (*refresh)(uint64_t*, int, int))
+{
+    uint64_t lastUpdate = 0;
+    int nFresh = 0;
+    uint64_t t0 = get_nsec_mono();
+    for (int c=0; c<DISPATCH_NCYCLE; ++c) {
+        Bench_Dispatch_due(c);
+        nFresh += refresh(&lastUpdate, 0, 2);
+        nFresh += refresh(&lastUpdate, 2, DISPATCH_NSENSOR);
+    }
+    uint64_t t1 = get_nsec_mono();
+    printf("Dispatch : %-28s %5.1f ns per cycle, %.2f refreshes per cycle\n", name,
+           Bench_ns(t0, t1, DISPATCH_NCYCLE), (double)nFresh / DISPATCH_NCYCLE);
+    benchSink = data.acc_est[0] + data.attHT_est;
+}
+
+void Bench_Dispatch(void)
+{
+    Bench_Dispatch_setup();
+    Bench_Dispatch_run("pointer + wrapper (former)", Bench_Dispatch_pointer);
+    Bench_Dispatch_run("switch, direct call", Bench_Dispatch_switch);
+    Bench_Dispatch_run("stage sequence, direct calls", Bench_Dispatch_stage);
+}
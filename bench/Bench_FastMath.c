@@ -0,0 +1,53 @@
+/*! \file Bench_FastMath.c
+    \brief FastMath.h against libm : max. deviation from the double functions, time of both
+ */
+#include "Bench.h"
+#include "FastMath.h"
+#include "Common.h"
+#include <stdio.h>
+#include <math.h>
+
+#define FASTMATH_NCHECK     4096        //!< \private Inputs of each function
+#define FASTMATH_NREPEAT    256         //!< \private Passes over the inputs for the time
+
+void Bench_FastMath(void)
+{
+    static float x[FASTMATH_NCHECK], y[FASTMATH_NCHECK];
+    double dInvSqrt = 0, dAtan2 = 0, dAsin = 0;
+    for (int i=0; i<FASTMATH_NCHECK; ++i) {
+        double a = -M_PI + 2*M_PI*(i+0.5)/FASTMATH_NCHECK;
+        double r = pow(10.0, 3.0*(i%64)/63 - 1.5);
+        x[i] = (float)(r*cos(a));
+        y[i] = (float)(r*sin(a));
+        float v = (float)(r*r);
+        double e = fabs(fastInvSqrt(v) - 1/sqrt((double)v)) * sqrt((double)v);
+        if (e > dInvSqrt) dInvSqrt = e;
+        e = fabs(fastAtan2(y[i], x[i]) - atan2((double)y[i], (double)x[i]));
+        if (e > dAtan2) dAtan2 = e;
+        float s = -1.0f + 2.0f*i/(FASTMATH_NCHECK-1);
+        e = fabs(fastAsin(s) - asin((double)s));
+        if (e > dAsin) dAsin = e;
+    }
+
+    uint64_t t[6];
+    float sum = 0;
+    t[0] = get_nsec_mono();
+    for (int k=0; k<FASTMATH_NREPEAT; ++k) for (int i=0; i<FASTMATH_NCHECK; ++i) sum += fastInvSqrt(y[i]*y[i] + 1.0f);
+    t[1] = get_nsec_mono();
+    for (int k=0; k<FASTMATH_NREPEAT; ++k) for (int i=0; i<FASTMATH_NCHECK; ++i) sum += 1.0f/sqrtf(y[i]*y[i] + 1.0f);
+    t[2] = get_nsec_mono();
+    for (int k=0; k<FASTMATH_NREPEAT; ++k) for (int i=0; i<FASTMATH_NCHECK; ++i) sum += fastAtan2(y[i], x[i]) + fastAsin(y[i]*0.03f);
+    t[3] = get_nsec_mono();
+    for (int k=0; k<FASTMATH_NREPEAT; ++k) for (int i=0; i<FASTMATH_NCHECK; ++i) sum += atan2f(y[i], x[i]) + asinf(y[i]*0.03f);
+    t[4] = get_nsec_mono();
+    for (int k=0; k<FASTMATH_NREPEAT; ++k) for (int i=0; i<FASTMATH_NCHECK; ++i) sum += atan2(y[i], x[i]) + asin(y[i]*0.03);
+    t[5] = get_nsec_mono();
+    benchSink = sum;
+
+    double n = (double)FASTMATH_NREPEAT * FASTMATH_NCHECK;
+    printf("FastMath : max. deviation from libm : fastInvSqrt %.2e (relative), fastAtan2 %.2e rad, fastAsin %.2e rad\n",
+           dInvSqrt, dAtan2, dAsin);
+    printf("FastMath : fastInvSqrt %.1f ns (1/sqrtf %.1f ns), fastAtan2+fastAsin %.1f ns (atan2f+asinf %.1f ns, atan2+asin %.1f ns)\n",
+           Bench_ns(t[0], t[1], n), Bench_ns(t[1], t[2], n), Bench_ns(t[2], t[3], n), Bench_ns(t[3], t[4], n),
+           Bench_ns(t[4], t[5], n));
+}
@@ -0,0 +1,105 @@
+/*! \file Bench_Filter.c
+    \brief The filter bank against the former filter : one Drone_Filter per channel, 3 divisions per sample
+
+    The shapes of the flight : 3 channels (ADXL345, L3G4200D, HMC5883L), 1 channel (barometer), and 10 channels in
+    one bank.
+ */
+#include "Bench.h"
+#include "RTPiDrone_Filter.h"
+#include "Common.h"
+#include <stdio.h>
+#include <math.h>
+
+#define FILTER_NCHECK       4096        //!< \private Samples of each channel
+#define FILTER_NCHANNEL     10          //!< \private Max. channels
+#define FILTER_NREPEAT      16          //!< \private Passes over the samples for the time
+
+static const float A1 = 2.0f * ZETA / OMEGA_N;
+static const float A2 = 1.0f / OMEGA_N / OMEGA_N;
+
+//! \private The former filter of one channel
+typedef struct {
+    uint64_t    N;
+    float estimated_previous[2];
+    float B0, B1, B2;
+} Bench_Filter_Former;
+
+static void Bench_Filter_Former_init(Bench_Filter_Former* f, float dt, float omega_divide)
+{
+    f->N = 0;
+    f->estimated_previous[0] = f->estimated_previous[1] = 0;
+    f->B0 = A2*omega_divide*omega_divide/dt/dt - A1*omega_divide/dt + 1;
+    f->B1 = -2*A2*omega_divide*omega_divide/dt/dt + A1*omega_divide/dt;
+    f->B2 = A2*omega_divide*omega_divide/dt/dt;
+}
+
+static void Bench_Filter_Former_renew(Bench_Filter_Former* f, float rawdata, float *estimated)
+{
+    if (f->N<FILTER_WARMUP) {
+        *estimated = rawdata;
+    } else {
+        *estimated = -f->B1/f->B2*f->estimated_previous[0] - f->B0/f->B2*f->estimated_previous[1] + 1/f->B2*(rawdata);
+    }
+
+    f->estimated_previous[1] = f->estimated_previous[0];
+    f->estimated_previous[0] = *estimated;
+    ++(f->N);
+}
+
+static void Bench_Filter_run(int nChannel)
+{
+    static float x[FILTER_NCHECK][FILTER_NCHANNEL], y[FILTER_NCHECK][FILTER_NCHANNEL], z[FILTER_NCHECK][FILTER_NCHANNEL];
+    for (int k=0; k<FILTER_NCHECK; ++k)
+        for (int c=0; c<nChannel; ++c) x[k][c] = sinf(0.01f*k*(c+1)) + 0.1f*((k*(c+7)) % 13 - 6);
+
+    Bench_Filter_Former ref[FILTER_NCHANNEL];
+    Drone_FilterBank *bank, *cascade;
+    if (Drone_FilterBank_Init(&bank, nChannel, 1) || Drone_FilterBank_Init(&cascade, nChannel, 2)) return;
+    float dt = 0.004f, omega_divide = 1.0f;
+    for (int c=0; c<nChannel; ++c) {
+        Bench_Filter_Former_init(&ref[c], dt, omega_divide);
+        Drone_FilterBank_SetLowPass(bank, c, 0, dt, omega_divide);
+        Drone_FilterBank_SetLowPass(cascade, c, 0, dt, omega_divide);
+        Drone_FilterBank_SetLowPass(cascade, c, 1, dt, omega_divide);
+    }
+
+    // The first pass goes through the warm-up and gives the deviation, the next ones are timed
+    uint64_t t[3] = {0};
+    float sum = 0;
+    double dev = 0;
+    for (int pass=0; pass<=FILTER_NREPEAT; ++pass) {
+        uint64_t start = get_nsec_mono();
+        for (int k=0; k<FILTER_NCHECK; ++k)
+            for (int c=0; c<nChannel; ++c) Bench_Filter_Former_renew(&ref[c], x[k][c], &y[k][c]);
+        uint64_t end = get_nsec_mono();
+        if (pass) t[0] += end - start;
+        start = get_nsec_mono();
+        for (int k=0; k<FILTER_NCHECK; ++k) Drone_FilterBank_renew(bank, x[k], z[k]);
+        end = get_nsec_mono();
+        if (pass) t[1] += end - start;
+        for (int k=0; k<FILTER_NCHECK; ++k) {
+            for (int c=0; c<nChannel; ++c) {
+                if (fabs(z[k][c] - y[k][c]) > dev) dev = fabs(z[k][c] - y[k][c]);
+            }
+        }
+        start = get_nsec_mono();
+        for (int k=0; k<FILTER_NCHECK; ++k) Drone_FilterBank_renew(cascade, x[k], z[k]);
+        end = get_nsec_mono();
+        if (pass) t[2] += end - start;
+        for (int k=0; k<FILTER_NCHECK; ++k) sum += y[k][0] + z[k][0];
+    }
+    benchSink = sum;
+    Drone_FilterBank_Delete(&bank);
+    Drone_FilterBank_Delete(&cascade);
+
+    double n = (double)FILTER_NREPEAT * FILTER_NCHECK * nChannel;
+    printf("Filter : %2d channels, max. deviation from the former filter %.2e, %.2f ns per sample and channel (former %.2f ns), %.2f ns with 2 sections\n",
+           nChannel, dev, Bench_ns(0, t[1], n), Bench_ns(0, t[0], n), Bench_ns(0, t[2], n));
+}
+
+void Bench_Filter(void)
+{
+    Bench_Filter_run(3);
+    Bench_Filter_run(1);
+    Bench_Filter_run(FILTER_NCHANNEL);
+}
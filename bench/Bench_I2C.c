@@ -0,0 +1,151 @@
+/*! \file Bench_I2C.c
+    \brief I2C backends (-i) : ioctl and time of the sensor reads of one control cycle
+
+    One cycle reads the data registers of ADXL345 and L3G4200D, each one a register address and a read with a
+    repeated start (Drone_Bus_I2C_ReadRegister()). The ioctl of the program are wrapped (-Wl,--wrap=ioctl) and
+    counted. Without a bus, i2c-dev runs on a fake node : the wrapper answers I2C_RDWR as i2c-bcm2835 does (a read
+    only as the last message, else EOPNOTSUPP) from register files as i2c-stub's, after one ioctl on /dev/null
+    for the cost of the system call, with no bus time. i2c-stub itself only takes SMBus transfers, not I2C_RDWR.
+
+    "bench i2c-pi", on the Raspberry Pi with the sensors, runs the same cycle on I2CDEV_PATH, then with the
+    bcm2835 library (root), which takes the pins from i2c-bcm2835 until the next boot.
+ */
+#include "RTPiDrone_header.h"
+#include "Bench.h"
+#include "RTPiDrone_Bus.h"
+#include "Common.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define I2C_NCYCLE          2000            //!< \private Control cycles
+#define I2C_ADXL345         0x53            //!< \private Address of ADXL345
+#define I2C_L3G4200D        0x69            //!< \private Address of L3G4200D
+#define I2C_FAKE_NODE       "/dev/null"     //!< \private Opened by the backend, the wrapper answers its I2C_RDWR
+
+int __real_ioctl(int, unsigned long, ...);
+
+static int fakeNode = 0;                    //!< \private I2C_RDWR goes to the fake node
+static unsigned long long nIoctl;           //!< \private I2C_RDWR calls
+static unsigned long long nMsg;             //!< \private Their messages
+
+//! \private Register files of the fake slaves, and their register pointer
+static struct {
+    uint8_t     addr;
+    uint8_t     reg[256];
+    uint8_t     pointer;
+} fakeSlave[] = {{I2C_ADXL345, {0}, 0}, {I2C_L3G4200D, {0}, 0}};
+
+#define I2C_NFAKE   (sizeof(fakeSlave)/sizeof(fakeSlave[0]))
+
+// I2C_RDWR of i2c-bcm2835 on the fake slaves : the first byte written is the register, the others go on from it
+static int Bench_I2C_fake(struct i2c_rdwr_ioctl_data* data)
+{
+    if (data->nmsgs > I2C_RDWR_IOCTL_MAX_MSGS) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (uint32_t i=0; i+1<data->nmsgs; ++i) {
+        if (data->msgs[i].flags & I2C_M_RD) {
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+    }
+    for (uint32_t i=0; i<data->nmsgs; ++i) {
+        struct i2c_msg* m = &data->msgs[i];
+        size_t s = 0;
+        while (s < I2C_NFAKE && fakeSlave[s].addr != m->addr) ++s;
+        if (s == I2C_NFAKE) {
+            errno = ENXIO;
+            return -1;
+        }
+        for (uint16_t k=0; k<m->len; ++k) {
+            if (m->flags & I2C_M_RD) m->buf[k] = fakeSlave[s].reg[fakeSlave[s].pointer++];
+            else if (!k) fakeSlave[s].pointer = m->buf[k];
+            else fakeSlave[s].reg[fakeSlave[s].pointer++] = m->buf[k];
+        }
+    }
+    return data->nmsgs;
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    va_start(ap, request);
+    void* arg = va_arg(ap, void*);
+    va_end(ap);
+    if (request != I2C_RDWR) return __real_ioctl(fd, request, arg);
+    ++nIoctl;
+    nMsg += ((struct i2c_rdwr_ioctl_data*)arg)->nmsgs;
+    if (!fakeNode) return __real_ioctl(fd, request, arg);
+    __real_ioctl(fd, request, arg);                 // Into the kernel and back (ENOTTY on the fake node), as a real call
+    return Bench_I2C_fake(arg);
+}
+
+// The reads of I2C_NCYCLE cycles through the bus in use
+static void Bench_I2C_cycle(const char* name)
+{
+    char acc[6], gyr[6];
+    unsigned long long n0 = nIoctl, m0 = nMsg, nError = 0;
+    uint64_t t0 = get_nsec_mono();
+    for (int c=0; c<I2C_NCYCLE; ++c) {
+        nError += Drone_Bus_I2C_ReadRegister(I2C_ADXL345, 0x32, acc, 6) != DRONE_BUS_OK;
+        nError += Drone_Bus_I2C_ReadRegister(I2C_L3G4200D, 0x28 | 0x80, gyr, 6) != DRONE_BUS_OK;
+    }
+    uint64_t t1 = get_nsec_mono();
+    unsigned long long n = nIoctl - n0;
+    printf("I2C : %-22s %.2f ioctl per cycle, %.2f messages per ioctl, %7.1f us per cycle, %llu errors\n", name,
+           (double)n/I2C_NCYCLE, n ? (double)(nMsg - m0)/n : 0.0, Bench_ns(t0, t1, I2C_NCYCLE)/1000.0, nError);
+    benchSink = acc[0] + gyr[0];
+}
+
+// Both slaves in one I2C_RDWR, as a batching backend would send them
+static void Bench_I2C_batch(const char* name, const char* path)
+{
+    uint8_t regAcc = 0x32, regGyr = 0x28 | 0x80, acc[6], gyr[6];
+    struct i2c_msg m[4] = {
+        {I2C_ADXL345, 0, 1, &regAcc}, {I2C_ADXL345, I2C_M_RD, 6, acc},
+        {I2C_L3G4200D, 0, 1, &regGyr}, {I2C_L3G4200D, I2C_M_RD, 6, gyr},
+    };
+    struct i2c_rdwr_ioctl_data data = {m, 4};
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        perror(path);
+        return;
+    }
+    int ret = ioctl(fd, I2C_RDWR, &data);
+    printf("I2C : %-22s both slaves in one I2C_RDWR : %s\n", name, ret < 0 ? strerror(errno) : "done");
+    close(fd);
+}
+
+static void Bench_I2C_run(const Drone_Bus_Backend* backend, const char* path, const char* name)
+{
+    if (path) Drone_Bus_I2CDev_SetDevice(path);
+    Drone_Bus_SetBackend(backend);
+    if (Drone_Bus_Init()) return;
+    Drone_Bus_I2C_Begin();
+    Drone_Bus_I2C_SetClockDivider(DRONE_BUS_I2C_CLOCK_DIVIDER_626);
+    Bench_I2C_cycle(name);
+    if (path) Bench_I2C_batch(name, path);
+    Drone_Bus_I2C_End();
+    Drone_Bus_Close();
+}
+
+void Bench_I2C(void)
+{
+    fakeNode = 1;
+    Bench_I2C_run(&Drone_Bus_I2CDev, I2C_FAKE_NODE, "i2c-dev fake node");
+    fakeNode = 0;
+}
+
+void Bench_I2C_Pi(void)
+{
+    Bench_I2C_run(&Drone_Bus_I2CDev, I2CDEV_PATH, "i2c-dev " I2CDEV_PATH);
+    Bench_I2C_run(&Drone_Bus_BCM2835, NULL, "bcm2835");
+}
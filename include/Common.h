@@ -8,5 +8,10 @@
 void exchange(char*, int);
 void _usleep(int);
 float getSqrt(float*, int);
+float getAltitude(float);
+uint32_t getChecksum(const void*, int);
 uint64_t get_nsec(void);
+uint64_t get_nsec_mono(void);
+void virtual_clock_start(uint64_t);
+void virtual_clock_set(uint64_t);
 #endif
@@ -0,0 +1,86 @@
+/*!
+ * \file    FastMath.h
+ * \brief   Single-precision approximations for the estimators : no call to the double functions of libm.
+ *
+ * The bounds are the max. deviation from libm in double precision, measured by the bench program (bench fastmath).
+ * With FASTMATH_NEON on a core with NEON (Cortex-A7 of the Pi 2), fastInvSqrt() starts from VRSQRTE.
+ */
+#ifndef H_FASTMATH
+#define H_FASTMATH
+#include "RTPiDrone_header.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#if     defined(FASTMATH_NEON) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define FAST_PI         (3.14159265f)
+#define FAST_DEG_TO_RAD (FAST_PI/180.0f)
+#define FAST_RAD_TO_DEG (180.0f/FAST_PI)
+
+/*!
+ * \fn      float fastInvSqrt(float x)
+ * \brief   1/sqrt(x) for x > 0 : initial guess from the exponent and 2 Newton steps, relative deviation < 4.8e-6
+ */
+static inline float fastInvSqrt(float x)
+{
+#if     defined(FASTMATH_NEON) && defined(__ARM_NEON)
+    float32x2_t v = vdup_n_f32(x);
+    float32x2_t y = vrsqrte_f32(v);
+    y = vmul_f32(y, vrsqrts_f32(vmul_f32(v, y), y));
+    y = vmul_f32(y, vrsqrts_f32(vmul_f32(v, y), y));
+    return vget_lane_f32(y, 0);
+#else
+    uint32_t i;
+    float y, half = 0.5f * x;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86 - (i >> 1);
+    memcpy(&y, &i, sizeof(y));
+    y *= 1.5f - half * y * y;
+    y *= 1.5f - half * y * y;
+    return y;
+#endif
+}
+
+/*!
+ * \fn      float getInvSqrt(float* v, int N)
+ * \brief   1/sqrt(v0*v0 + ... + vN-1*vN-1), 0 if v is zero
+ */
+static inline float getInvSqrt(float* v, int N)
+{
+    float sum = 0.0f;
+    for (int i=0; i<N; ++i) sum += v[i] * v[i];
+    return sum > 0.0f ? fastInvSqrt(sum) : 0.0f;
+}
+
+/*!
+ * \fn      float fastAtan2(float y, float x)
+ * \brief   atan2(y, x) in rad : odd polynomial of degree 11 on [0, 1] and the octant, deviation < 2e-6 rad
+ */
+static inline float fastAtan2(float y, float x)
+{
+    float ax = fabsf(x), ay = fabsf(y);
+    float mx = ax > ay ? ax : ay;
+    if (mx == 0.0f) return 0.0f;
+    float a = (ax < ay ? ax : ay) / mx;
+    float s = a * a;
+    float r = a * (9.999772310e-01f + s * (-3.326228261e-01f + s * (1.935403794e-01f
+                  + s * (-1.164264679e-01f + s * (5.264732242e-02f + s * -1.171912067e-02f)))));
+    if (ay > ax) r = 0.5f * FAST_PI - r;
+    if (x < 0.0f) r = FAST_PI - r;
+    return y < 0.0f ? -r : r;
+}
+
+/*!
+ * \fn      float fastAsin(float x)
+ * \brief   asin(x) in rad, x is clamped to [-1, 1] : atan2(x, sqrt(1 - x*x)), deviation < 2e-6 rad
+ */
+static inline float fastAsin(float x)
+{
+    if (x > 1.0f) x = 1.0f;
+    else if (x < -1.0f) x = -1.0f;
+    return fastAtan2(x, sqrtf((1.0f - x) * (1.0f + x)));
+}
+
+#endif
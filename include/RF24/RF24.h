@@ -32,20 +32,20 @@
 
 #include "compatibility.h"
 
-#define BCM2835_SPI_SPEED_64MHZ BCM2835_SPI_CLOCK_DIVIDER_4
-#define BCM2835_SPI_SPEED_32MHZ BCM2835_SPI_CLOCK_DIVIDER_8
-#define BCM2835_SPI_SPEED_16MHZ BCM2835_SPI_CLOCK_DIVIDER_16
-#define BCM2835_SPI_SPEED_8MHZ BCM2835_SPI_CLOCK_DIVIDER_32
-#define BCM2835_SPI_SPEED_4MHZ BCM2835_SPI_CLOCK_DIVIDER_64
-#define BCM2835_SPI_SPEED_2MHZ BCM2835_SPI_CLOCK_DIVIDER_128
-#define BCM2835_SPI_SPEED_1MHZ BCM2835_SPI_CLOCK_DIVIDER_256
-#define BCM2835_SPI_SPEED_512KHZ BCM2835_SPI_CLOCK_DIVIDER_512
-#define BCM2835_SPI_SPEED_256KHZ BCM2835_SPI_CLOCK_DIVIDER_1024
-#define BCM2835_SPI_SPEED_128KHZ BCM2835_SPI_CLOCK_DIVIDER_2048
-#define BCM2835_SPI_SPEED_64KHZ BCM2835_SPI_CLOCK_DIVIDER_4096
-#define BCM2835_SPI_SPEED_32KHZ BCM2835_SPI_CLOCK_DIVIDER_8192
-#define BCM2835_SPI_SPEED_16KHZ BCM2835_SPI_CLOCK_DIVIDER_16384
-#define BCM2835_SPI_SPEED_8KHZ BCM2835_SPI_CLOCK_DIVIDER_32768
+#define BCM2835_SPI_SPEED_64MHZ DRONE_BUS_SPI_CLOCK_DIVIDER(4)
+#define BCM2835_SPI_SPEED_32MHZ DRONE_BUS_SPI_CLOCK_DIVIDER(8)
+#define BCM2835_SPI_SPEED_16MHZ DRONE_BUS_SPI_CLOCK_DIVIDER(16)
+#define BCM2835_SPI_SPEED_8MHZ DRONE_BUS_SPI_CLOCK_DIVIDER(32)
+#define BCM2835_SPI_SPEED_4MHZ DRONE_BUS_SPI_CLOCK_DIVIDER(64)
+#define BCM2835_SPI_SPEED_2MHZ DRONE_BUS_SPI_CLOCK_DIVIDER(128)
+#define BCM2835_SPI_SPEED_1MHZ DRONE_BUS_SPI_CLOCK_DIVIDER(256)
+#define BCM2835_SPI_SPEED_512KHZ DRONE_BUS_SPI_CLOCK_DIVIDER(512)
+#define BCM2835_SPI_SPEED_256KHZ DRONE_BUS_SPI_CLOCK_DIVIDER(1024)
+#define BCM2835_SPI_SPEED_128KHZ DRONE_BUS_SPI_CLOCK_DIVIDER(2048)
+#define BCM2835_SPI_SPEED_64KHZ DRONE_BUS_SPI_CLOCK_DIVIDER(4096)
+#define BCM2835_SPI_SPEED_32KHZ DRONE_BUS_SPI_CLOCK_DIVIDER(8192)
+#define BCM2835_SPI_SPEED_16KHZ DRONE_BUS_SPI_CLOCK_DIVIDER(16384)
+#define BCM2835_SPI_SPEED_8KHZ DRONE_BUS_SPI_CLOCK_DIVIDER(32768)
 
 /**
  * Power Amplifier level.
@@ -16,11 +16,11 @@
 #include <sys/time.h>
 #include <stddef.h>
 
-#include "bcm2835.h"
+#include "RTPiDrone_Bus.h"
 #include "spi.h"
 #define _SPI spi
-#define RF24_BIT_ORDER BCM2835_SPI_BIT_ORDER_MSBFIRST
-#define RF24_DATA_MODE BCM2835_SPI_MODE0
+#define RF24_BIT_ORDER DRONE_BUS_SPI_MSBFIRST
+#define RF24_DATA_MODE DRONE_BUS_SPI_MODE0
 #define RF24_CLOCK_DIVIDER BCM2835_SPI_SPEED_8MHZ
 
 // GCC a Arduino Missing
@@ -42,8 +42,17 @@
 
 #endif
 
-#define digitalWrite(pin, value) bcm2835_gpio_write(pin, value)
-#define pinMode(pin,value) bcm2835_gpio_fsel(pin,value);
-#define OUTPUT BCM2835_GPIO_FSEL_OUTP
+#define digitalWrite(pin, value) Drone_Bus_GPIO_Write(pin, value)
+#define pinMode(pin,value) Drone_Bus_GPIO_Fsel(pin,value);
+#define OUTPUT DRONE_BUS_GPIO_FSEL_OUTP
+#define HIGH DRONE_BUS_HIGH
+#define LOW DRONE_BUS_LOW
+#define delay(x) Drone_Bus_Delay(x)
+#define delayMicroseconds(x) Drone_Bus_DelayMicroseconds(x)
+
+// GPIO numbers of the RPi header pins
+#define RPI_V2_GPIO_P1_26 7
+#define RPI_BPLUS_GPIO_J8_15 22
+#define RPI_BPLUS_GPIO_J8_24 8
 
 #endif
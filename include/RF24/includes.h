@@ -7,7 +7,7 @@
 #define __RF24_INCLUDES_H__
 
 #define RF24_RPi
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include "RF24_arch_config.h"
 
 
@@ -11,7 +11,7 @@
 #define _SPI_H_INCLUDED
 
 #include <stdio.h>
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 
 class SPI
 {
@@ -36,12 +36,12 @@ public:
 
 uint8_t SPI::transfer(uint8_t _data)
 {
-    return bcm2835_spi_transfer(_data);
+    return Drone_Bus_SPI_Transfer(_data);
 }
 
 void SPI::transfernb(char* tbuf, char* rbuf, uint32_t len)
 {
-    bcm2835_spi_transfernb( tbuf, rbuf, len);
+    Drone_Bus_SPI_TransferNB( tbuf, rbuf, len);
 }
 
 void SPI::transfern(char* buf, uint32_t len)
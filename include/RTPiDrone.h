@@ -25,12 +25,29 @@ void Drone_Start(Drone*);
 
 /*!
  * \fn      int Drone_Calibration(Drone* rpiDrone)
- * \brief   Calibration of I2C devices
+ * \brief   Calibration of I2C devices, from the cache of the last one if a short validation pass agrees with it
  * \public \memberof Drone
  * \return  0 if everything is fine
  */
 int Drone_Calibration(Drone*);
 
+/*!
+ * \fn      void Drone_SetPipelined(Drone* rpiDrone, int pipelined)
+ * \brief   Run the loop as a pipeline of three threads, each on its own core (PIPELINE_CPU_*):
+ *          the acquisition of the sensors, the estimation and PID, then the PWM output and the RF.
+ *          They exchange the data through SPSC rings. Must be called before Drone_Start().
+ * \public \memberof Drone
+ */
+void Drone_SetPipelined(Drone*, int);
+
+/*!
+ * \fn      int Drone_SetEstimator(Drone* rpiDrone, const char* name)
+ * \brief   Estimator of the attitude : "mahony" (default), "ekf" or "madgwick". Must be called before Drone_Calibration().
+ * \public \memberof Drone
+ * \return  0 if the estimator exists
+ */
+int Drone_SetEstimator(Drone*, const char*);
+
 
 /*!
  * \fn      int Drone_End(Drone** rpiDrone)
@@ -4,7 +4,15 @@
 
 typedef struct Drone_AHRS   Drone_AHRS;
 
+enum {
+    DRONE_AHRS_MAHONY,          // Mahony filter (RTPiDrone_Quaternion.c), the default
+    DRONE_AHRS_EKF,             // Extended Kalman filter (RTPiDrone_EKF.c)
+    DRONE_AHRS_MADGWICK,        // Madgwick filter (RTPiDrone_Madgwick.c), 6-axis between the samples of the magnetometer
+    DRONE_AHRS_NESTIMATOR
+};
+
 int Drone_AHRS_Init(Drone_AHRS**);
+int Drone_AHRS_SetEstimator(Drone_AHRS*, const char*);
 void Drone_AHRS_End(Drone_AHRS**);
 void Drone_AHRS_DataInit(Drone_DataExchange*, Drone_AHRS*);
 void Drone_AHRS_ExchangeData(Drone_DataExchange*, Drone_AHRS*);
@@ -0,0 +1,323 @@
+/*!
+ * \file    RTPiDrone_Bus.h
+ * \brief   Bus abstraction (I2C, SPI, GPIO) used by all of the device drivers.
+ *
+ * The functions follow the bcm2835 library one by one, except that an I2C transfer carries the slave address.
+ * The calls are forwarded to a backend: the bcm2835 library on the Raspberry Pi, or a simulated bus with
+ * register-level models of the devices (RTPiDrone_Bus_Sim.c), which allows running and timing the complete
+ * program on a desktop.
+ */
+
+#ifndef H_DRONE_BUS
+#define H_DRONE_BUS
+#include <stdint.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#define DRONE_BUS_OK                    0x00    //!< Success (BCM2835_I2C_REASON_OK)
+#define DRONE_BUS_ERROR_NACK            0x01    //!< Received a NACK (BCM2835_I2C_REASON_ERROR_NACK)
+#define DRONE_BUS_ERROR_CLKT            0x02    //!< Received clock stretch timeout (BCM2835_I2C_REASON_ERROR_CLKT)
+#define DRONE_BUS_ERROR_DATA            0x04    //!< Not all data is sent / received (BCM2835_I2C_REASON_ERROR_DATA)
+
+#define DRONE_BUS_LOW                   0x0     //!< GPIO/chip select level low
+#define DRONE_BUS_HIGH                  0x1     //!< GPIO/chip select level high
+#define DRONE_BUS_GPIO_FSEL_INPT        0x00    //!< GPIO as input
+#define DRONE_BUS_GPIO_FSEL_OUTP        0x01    //!< GPIO as output
+
+#define DRONE_BUS_SPI_CS0               0       //!< SPI chip select 0
+#define DRONE_BUS_SPI_CS1               1       //!< SPI chip select 1
+#define DRONE_BUS_SPI_CS2               2       //!< SPI chip select 1 and 2
+#define DRONE_BUS_SPI_CS_NONE           3       //!< No chip select (handled by a GPIO)
+#define DRONE_BUS_SPI_LSBFIRST          0       //!< SPI bit order LSB first
+#define DRONE_BUS_SPI_MSBFIRST          1       //!< SPI bit order MSB first
+#define DRONE_BUS_SPI_MODE0             0       //!< CPOL = 0, CPHA = 0
+
+#define DRONE_BUS_I2C_CLOCK_DIVIDER_626 626     //!< I2C at 399.3610 kHz
+#define DRONE_BUS_SPI_CLOCK_DIVIDER(d)  (d)     //!< SPI clock divider d (power of 2), same value as the bcm2835 enum
+
+/*!
+ * \struct  Drone_Bus_I2C_Msg
+ * \brief   One message of an I2C transfer: messages after the first one start with a repeated start
+ */
+typedef struct {
+    uint8_t     addr;                                               //!< Slave address
+    uint8_t     isRead;                                             //!< Read len bytes into buf, else write them
+    uint16_t    len;                                                //!< Number of bytes
+    char*       buf;                                                //!< Bytes to write, or received
+} Drone_Bus_I2C_Msg;
+
+/*!
+ * \struct  Drone_Bus_Backend
+ * \brief   Functions implementing the bus. A function pointer may be NULL if the backend has nothing to do.
+ */
+typedef struct {
+    const char* name;                                               //!< Name of the backend
+    int     (*init)(void);                                          //!< Open the backend, return 0 if fine
+    int     (*close)(void);                                         //!< Close the backend, return 0 if fine
+    void    (*tick)(uint64_t);                                      //!< Start of a control cycle at get_nsec() (NULL : nothing to do)
+    void    (*i2c_begin)(void);                                     //!< Start the I2C operations
+    void    (*i2c_end)(void);                                       //!< End the I2C operations
+    void    (*i2c_setClockDivider)(uint16_t);                       //!< Set the I2C clock divider
+    uint8_t (*i2c_write)(uint8_t, const char*, uint32_t);           //!< Write to a slave, return DRONE_BUS_OK if fine
+    uint8_t (*i2c_read)(uint8_t, char*, uint32_t);                  //!< Read from a slave, return DRONE_BUS_OK if fine
+    uint8_t (*i2c_transfer)(Drone_Bus_I2C_Msg*, uint32_t);          //!< Several messages in one transfer (NULL : one by one)
+    void    (*spi_begin)(void);                                     //!< Start the SPI operations
+    void    (*spi_end)(void);                                       //!< End the SPI operations
+    void    (*spi_setBitOrder)(uint8_t);                            //!< Set the SPI bit order
+    void    (*spi_setDataMode)(uint8_t);                            //!< Set the SPI data mode
+    void    (*spi_setClockDivider)(uint16_t);                       //!< Set the SPI clock divider
+    void    (*spi_chipSelect)(uint8_t);                             //!< Select the chip select of the next transfers
+    void    (*spi_setChipSelectPolarity)(uint8_t, uint8_t);         //!< Set the active level of a chip select
+    uint8_t (*spi_transfer)(uint8_t);                               //!< Transfer one byte (one frame)
+    void    (*spi_transfernb)(char*, char*, uint32_t);              //!< Transfer len bytes (one frame)
+    void    (*gpio_fsel)(uint8_t, uint8_t);                         //!< Set the function of a GPIO
+    void    (*gpio_write)(uint8_t, uint8_t);                        //!< Set the level of a GPIO output
+    int     (*gpio_eventRequest)(uint8_t, uint8_t);                 //!< Detect the edges (DRONE_BUS_EDGE_*) of a GPIO input, return 0 if fine
+    int     (*gpio_eventRead)(uint8_t, uint64_t*);                  //!< Edges since the last call (no wait), get_nsec() of the last one
+    int     (*gpio_eventWait)(uint8_t, uint64_t);                   //!< Wait for an edge at most timeout (ns), 1 if there is one
+} Drone_Bus_Backend;
+
+extern const Drone_Bus_Backend Drone_Bus_Sim;                       //!< Simulated bus
+#ifndef DRONE_SIMULATION
+extern const Drone_Bus_Backend Drone_Bus_BCM2835;                   //!< bcm2835 library
+#ifdef  DRONE_I2CDEV
+extern const Drone_Bus_Backend Drone_Bus_I2CDev;                    //!< Linux i2c-dev for I2C, bcm2835 library for the rest
+
+/*!
+ * \fn      void Drone_Bus_I2CDev_SetDevice(const char* path)
+ * \brief   Device node of Drone_Bus_I2CDev (I2CDEV_PATH by default)
+ */
+void Drone_Bus_I2CDev_SetDevice(const char*);
+#endif
+
+int Drone_Bus_GPIOEvent_Request(uint8_t, uint8_t);                  //!< \brief gpio_eventRequest of the Raspberry Pi backends (GPIO character device)
+int Drone_Bus_GPIOEvent_Read(uint8_t, uint64_t*);                   //!< \brief gpio_eventRead of the Raspberry Pi backends
+int Drone_Bus_GPIOEvent_Wait(uint8_t, uint64_t);                    //!< \brief gpio_eventWait of the Raspberry Pi backends
+void Drone_Bus_GPIOEvent_Close(void);                               //!< \brief Release the requested lines
+#endif
+
+/*!
+ * \fn      void Drone_Bus_SetBackend(const Drone_Bus_Backend* backend)
+ * \brief   Choose the backend. Must be called before Drone_Bus_Init().
+ *          The default one is Drone_Bus_BCM2835 (Drone_Bus_Sim when DRONE_SIMULATION is defined).
+ */
+void Drone_Bus_SetBackend(const Drone_Bus_Backend*);
+
+/*!
+ * \fn      const char* Drone_Bus_GetName(void)
+ * \brief   Name of the backend in use
+ */
+const char* Drone_Bus_GetName(void);
+
+/*!
+ * \fn      int Drone_Bus_Init(void)
+ * \brief   Open the backend. Nothing is done if it is already open (as bcm2835_init(), it is called by RF24 too).
+ * \return  0 if everything is fine
+ */
+int Drone_Bus_Init(void);
+
+/*!
+ * \fn      int Drone_Bus_Close(void)
+ * \brief   Close the backend.
+ * \return  0 if everything is fine
+ */
+int Drone_Bus_Close(void);
+
+void Drone_Bus_I2C_Begin(void);                                     //!< \brief Start the I2C operations
+void Drone_Bus_I2C_End(void);                                       //!< \brief End the I2C operations
+void Drone_Bus_I2C_SetClockDivider(uint16_t);                       //!< \brief Set the I2C clock divider
+
+/*!
+ * \fn      uint8_t Drone_Bus_I2C_Write(uint8_t addr, const char* buf, uint32_t len)
+ * \brief   Write len bytes to the slave addr
+ * \return  DRONE_BUS_OK if everything is fine
+ */
+uint8_t Drone_Bus_I2C_Write(uint8_t, const char*, uint32_t);
+
+/*!
+ * \fn      uint8_t Drone_Bus_I2C_Read(uint8_t addr, char* buf, uint32_t len)
+ * \brief   Read len bytes from the slave addr
+ * \return  DRONE_BUS_OK if everything is fine
+ */
+uint8_t Drone_Bus_I2C_Read(uint8_t, char*, uint32_t);
+
+/*!
+ * \fn      uint8_t Drone_Bus_I2C_ReadRegister(uint8_t addr, uint8_t reg, char* buf, uint32_t len)
+ * \brief   Write the register address reg, then read len bytes with a repeated start (one transaction)
+ * \return  DRONE_BUS_OK if everything is fine
+ */
+uint8_t Drone_Bus_I2C_ReadRegister(uint8_t, uint8_t, char*, uint32_t);
+
+/*!
+ * \fn      uint8_t Drone_Bus_I2C_Transfer(Drone_Bus_I2C_Msg* msg, uint32_t n)
+ * \brief   Transfer n messages, in one call of the backend if it can
+ * \return  DRONE_BUS_OK if everything is fine, else the first error
+ */
+uint8_t Drone_Bus_I2C_Transfer(Drone_Bus_I2C_Msg*, uint32_t);
+
+#define DRONE_BUS_PRIORITY_CONTROL      0       //!< Transfers of the control loop, served first (default of each thread)
+#define DRONE_BUS_PRIORITY_BACKGROUND   1       //!< Transfers that can wait (calibration)
+#define DRONE_BUS_NPRIORITY             2       //!< Number of priorities of the bus manager
+
+/*!
+ * \fn      int Drone_Bus_Manager_Start(void)
+ * \brief   Start the bus manager: from now on, one thread owns the bus and does the background I2C transfers, the
+ *          control transfers are done inline under its ownership
+ * \return  0 if everything is fine
+ */
+int Drone_Bus_Manager_Start(void);
+
+/*!
+ * \fn      void Drone_Bus_Manager_End(void)
+ * \brief   Stop the bus manager, the I2C transfers are done again by their own thread
+ */
+void Drone_Bus_Manager_End(void);
+
+int Drone_Bus_Manager_IsActive(void);                               //!< \brief The I2C transfers of this thread go through the manager
+uint8_t Drone_Bus_Manager_Submit(Drone_Bus_I2C_Msg*, uint32_t);     //!< \brief One transfer : inline (control) or queued (background)
+void Drone_Bus_I2C_SetPriority(int);                                //!< \brief Priority of the I2C transfers of the calling thread
+
+void Drone_Bus_SPI_Begin(void);                                     //!< \brief Start the SPI operations
+void Drone_Bus_SPI_End(void);                                       //!< \brief End the SPI operations
+void Drone_Bus_SPI_SetBitOrder(uint8_t);                            //!< \brief Set the SPI bit order
+void Drone_Bus_SPI_SetDataMode(uint8_t);                            //!< \brief Set the SPI data mode
+void Drone_Bus_SPI_SetClockDivider(uint16_t);                       //!< \brief Set the SPI clock divider
+void Drone_Bus_SPI_ChipSelect(uint8_t);                             //!< \brief Select the chip of the next transfers
+void Drone_Bus_SPI_SetChipSelectPolarity(uint8_t, uint8_t);         //!< \brief Set the active level of a chip select
+uint8_t Drone_Bus_SPI_Transfer(uint8_t);                            //!< \brief Transfer one byte, return the received one
+void Drone_Bus_SPI_TransferNB(char*, char*, uint32_t);              //!< \brief Transfer len bytes from tbuf, received in rbuf
+
+void Drone_Bus_GPIO_Fsel(uint8_t, uint8_t);                         //!< \brief Set the function of a GPIO
+void Drone_Bus_GPIO_Write(uint8_t, uint8_t);                        //!< \brief Set the level of a GPIO output
+
+#define DRONE_BUS_NGPIO                 64      //!< Number of GPIO of the edge events
+#define DRONE_BUS_EDGE_RISING           0       //!< The event is the rising edge of the line
+#define DRONE_BUS_EDGE_FALLING          1       //!< The event is the falling edge of the line (active low output)
+
+/*!
+ * \fn      int Drone_Bus_GPIO_EventRequest(uint8_t pin, uint8_t edge)
+ * \brief   Detect the edges (DRONE_BUS_EDGE_RISING or DRONE_BUS_EDGE_FALLING) of the GPIO input pin (data-ready output
+ *          of a sensor)
+ * \return  0 if everything is fine
+ */
+int Drone_Bus_GPIO_EventRequest(uint8_t, uint8_t);
+
+/*!
+ * \fn      int Drone_Bus_GPIO_EventPending(uint8_t pin, uint64_t* t)
+ * \brief   Number of edges of pin since Drone_Bus_GPIO_EventClear(), t (if not NULL) = get_nsec() of the last one.
+ *          Each call is recorded, and served by the recording in replay.
+ */
+int Drone_Bus_GPIO_EventPending(uint8_t, uint64_t*);
+
+void Drone_Bus_GPIO_EventClear(uint8_t);                            //!< \brief Forget the edges of a GPIO (its data have been read)
+
+/*!
+ * \fn      int Drone_Bus_GPIO_EventWait(uint8_t pin, uint64_t timeout)
+ * \brief   Wait for the next edge of pin at most timeout (ns), without taking it: the edges already there do not
+ *          count. Not recorded: 0 at once in replay.
+ * \return  1 if there is an edge
+ */
+int Drone_Bus_GPIO_EventWait(uint8_t, uint64_t);
+void Drone_Bus_Delay(unsigned int);                                 //!< \brief Sleep (ms)
+void Drone_Bus_DelayMicroseconds(uint64_t);                         //!< \brief Sleep (us)
+
+/*!
+ * \fn      void Drone_Bus_Sim_SetLatency(uint32_t i2c, uint32_t i2cByte, uint32_t spi, uint32_t spiByte)
+ * \brief   Time (ns) spent by the simulated bus in each transaction and for each byte transferred.
+ *          Defaults are SIM_I2C_LATENCY, SIM_I2C_BYTE_LATENCY, SIM_SPI_LATENCY and SIM_SPI_BYTE_LATENCY.
+ */
+void Drone_Bus_Sim_SetLatency(uint32_t, uint32_t, uint32_t, uint32_t);
+
+/*!
+ * \fn      void Drone_Bus_Sim_SetFlightTime(uint32_t second)
+ * \brief   Duration, from the first control cycle, after which the simulated remote control turns the switch off (default SIM_FLIGHT_TIME)
+ */
+void Drone_Bus_Sim_SetFlightTime(uint32_t);
+
+#define DRONE_BUS_EVENT_TICK            0       //!< Start of a control cycle (Drone_Bus_Tick())
+#define DRONE_BUS_EVENT_I2C             1       //!< Result of an I2C read, id is the slave address
+#define DRONE_BUS_EVENT_SPI             2       //!< Bytes received in an SPI frame, id is the chip select
+#define DRONE_BUS_EVENT_GPIO            3       //!< New edges of a GPIO (int32_t) and get_nsec() of the last one (uint64_t), id is the GPIO
+#define DRONE_BUS_EVENT_SIZE            36      //!< Bytes kept per event (a RF24 payload and its command)
+
+/*!
+ * \struct  Drone_Bus_Event
+ * \brief   One record of a recording. The file is a Drone_Bus_RecordHeader followed by the events, in the order
+ *          they were received (the order of each device is the order of its driver, whatever the threads).
+ */
+typedef struct {
+    uint64_t t;                                                     //!< get_nsec() when the result was received
+    uint8_t  type;                                                  //!< DRONE_BUS_EVENT_*
+    uint8_t  id;                                                    //!< Slave address or chip select
+    uint8_t  status;                                                //!< Returned DRONE_BUS_* code (I2C)
+    uint8_t  len;                                                   //!< Number of bytes (a longer read is split in several events)
+    char     data[DRONE_BUS_EVENT_SIZE];                            //!< Received bytes
+} Drone_Bus_Event;
+
+/*!
+ * \struct  Drone_Bus_RecordHeader
+ * \brief   Head of a recording file
+ */
+typedef struct {
+    char     magic[8];                                              //!< DRONE_BUS_RECORD_MAGIC
+    uint64_t start;                                                 //!< get_nsec() when the bus was opened
+    uint64_t nEvent;                                                //!< Number of events following
+} Drone_Bus_RecordHeader;
+
+#define DRONE_BUS_RECORD_MAGIC          "RTPDBUS1"                 //!< Tag (and version) of a recording file
+
+/*!
+ * \fn      int Drone_Bus_Record(const char* fileName)
+ * \brief   Record every read of the drivers (any backend) and the control cycles. Must be called before
+ *          Drone_Bus_Init(). The events are kept in memory (BUS_RECORD_SIZE) and written by Drone_Bus_Close().
+ * \return  0 if everything is fine
+ */
+int Drone_Bus_Record(const char*);
+
+/*!
+ * \fn      int Drone_Bus_Record_IsActive(void)
+ * \brief   A recording is in progress
+ */
+int Drone_Bus_Record_IsActive(void);
+
+/*!
+ * \fn      int Drone_Bus_Replay_Open(const char* fileName)
+ * \brief   Select the replay backend, which serves the reads of a recording to the drivers in the same order,
+ *          and start the virtual clock (get_nsec() follows the time stamps of the recording, nothing sleeps).
+ *          Must be called before Drone_Bus_Init().
+ * \return  0 if everything is fine
+ */
+int Drone_Bus_Replay_Open(const char*);
+
+/*!
+ * \fn      int Drone_Bus_Replay_IsActive(void)
+ * \brief   The replay backend is in use
+ */
+int Drone_Bus_Replay_IsActive(void);
+
+/*!
+ * \fn      int Drone_Bus_Replay_IsOver(void)
+ * \brief   The replay has run out of recorded data
+ */
+int Drone_Bus_Replay_IsOver(void);
+
+/*!
+ * \fn      int Drone_Bus_Replay_Tick(uint64_t* now)
+ * \brief   Next control cycle of the recording: sets the virtual clock, and now, to its time stamp
+ * \return  0 if fine, -1 at the end of the recording
+ */
+int Drone_Bus_Replay_Tick(uint64_t*);
+
+/*!
+ * \fn      int Drone_Bus_Tick(uint64_t* now)
+ * \brief   Start of a control cycle: now = get_nsec(). It is recorded, or taken from the recording in replay.
+ * \return  0 if fine, -1 at the end of the replay
+ */
+int Drone_Bus_Tick(uint64_t*);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
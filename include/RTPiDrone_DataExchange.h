@@ -4,15 +4,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#define GYR_NSAMPLE     32              // Depth of the FIFO of L3G4200D
 typedef struct {
     float T;
     float angle[3];
     float acc[3], acc_est[3];
     float gyr[3], gyr_est[3];
+    float gyrSample[GYR_NSAMPLE][3];    // Gyro samples of this cycle, oldest first (L3G4200D_FIFO)
+    float gyrDt[GYR_NSAMPLE];           // Time from the previous sample (s)
+    int   nGyr;
     float mag[3], mag_est[3];
     float attitude, att_est;
     float attitudeHT, attHT_est;
     float temperature, pressure;
+    uint64_t accTime, gyrTime, magTime, attTime, attHTTime;         // get_nsec() of the sample of each sensor
+    uint8_t accFresh, gyrFresh, magFresh, attFresh, attHTFresh;     // New sample in this cycle
     uint32_t power[4];
     float dt, dt_accu;
     //uint32_t controller;
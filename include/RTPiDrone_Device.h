@@ -1,6 +1,7 @@
 #ifndef  H_DRONE_DEVICE
 #define  H_DRONE_DEVICE
 #include <stdint.h>
+#include <stdatomic.h>
 
 /*!
  * Drone_Device type.
@@ -15,6 +16,13 @@ typedef struct {
     void*	getData;	            //!< \private Pointer of real data
     uint64_t    lastUpdate;         //!< \private Last update time
     uint64_t    period;             //!< \private Period for sensor refresh
+    int         scheduled;          //!< \private Non-zero if a Drone_Scheduler decides when the device is refreshed
+    atomic_int  due;                //!< \private Set by the Drone_Scheduler when the device has to be refreshed
+    int         drdyPin;            //!< \private GPIO of the data-ready line, -1 if the device is not event driven
+    uint64_t    drdyTime;           //!< \private get_nsec() of the last data-ready edge
+    uint64_t    drdyPoll;           //!< \private Time given to the last poll of the data-ready line (once per cycle)
+    int         drdyPending;        //!< \private Edges seen by that poll
+    uint64_t    sampleTime;         //!< \private get_nsec() of the sample of the real data
 } Drone_Device;
 
 /*!
@@ -101,5 +109,35 @@ char* Drone_Device_GetName(Drone_Device*);
  */
 void* Drone_Device_GetRefreshedData(Drone_Device*, uint64_t*);
 
+/*!
+ * return 1 (and take the time as last update) if the device has to be refreshed:
+ * either the Drone_Scheduler marked it, or its period is elapsed if it is not scheduled.
+ * \public \memberof Drone_Device
+ */
+int Drone_Device_IsDue(Drone_Device*, uint64_t*);
+
+/*!
+ * return 1 if the Drone_Scheduler did not mark the device: no refresh in this cycle, nothing to call.
+ * Inline, for the loops over many devices.
+ * \public \memberof Drone_Device
+ */
+static inline int Drone_Device_IsIdle(Drone_Device* dev)
+{
+    return dev->scheduled && !atomic_load_explicit(&dev->due, memory_order_relaxed);
+}
+
+/*!
+ * return when the real data were sampled: the data-ready edge if the device has one, else the refresh.
+ * \public \memberof Drone_Device
+ */
+uint64_t Drone_Device_GetSampleTime(Drone_Device*);
+
+/*!
+ * The device is refreshed only once its data-ready line (GPIO pin) has had an edge (DRONE_BUS_EDGE_RISING or
+ * DRONE_BUS_EDGE_FALLING): no read without a new sample.
+ * \public \memberof Drone_Device
+ */
+int Drone_Device_SetDataReady(Drone_Device*, int, uint8_t);
+
 void Drone_Device_SetPeriod(Drone_Device* dev, uint64_t);
 #endif
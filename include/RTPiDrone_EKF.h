@@ -0,0 +1,11 @@
+#ifndef H_DRONE_EKF
+#define H_DRONE_EKF
+
+typedef struct Drone_EKF Drone_EKF;
+
+int Drone_EKF_Init(Drone_EKF**, float*);
+void Drone_EKF_Delete(Drone_EKF**);
+void Drone_EKF_getAngle(Drone_EKF*, float*);
+void Drone_EKF_renew(Drone_EKF*, float, float*, float*, float*);
+void Drone_EKF_renewSamples(Drone_EKF*, float*, float (*)[3], float*, int, float*);
+#endif
@@ -1,18 +1,64 @@
+/*!
+ * \file    RTPiDrone_Filter.h
+ * \brief   Bank of filters : the channels of a device in structure-of-arrays, 4 channels per vector (Vec4.h).
+ *
+ * Each channel goes through nSection biquads in cascade, y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2, the
+ * coefficients are normalized by a0 once. The first FILTER_WARMUP samples (Drone_FilterBank_SetWarmUp()) go through
+ * unfiltered.
+ */
 #ifndef H_DRONE_FILTER
 #define H_DRONE_FILTER
 #include <stdint.h>
 #include <math.h>
 #define OMEGA_N 80*M_PI
 #define ZETA    0.5
+#define FILTER_WARMUP       (500)       //!< Samples going through unfiltered (they fill the history)
 
-typedef struct {
-    uint64_t    N;
-    float estimated_previous[2];
-    float B0, B1, B2;
-} Drone_Filter;
+typedef struct Drone_FilterBank Drone_FilterBank;   //!< Drone_FilterBank type.
 
-void Drone_Filter_init(Drone_Filter*, float, float) ;
-void Drone_Filter_Pure(Drone_Filter*, float) ;
-void Drone_Filter_renew(Drone_Filter*, float, float*) ;
+/*!
+ * \fn      int Drone_FilterBank_Init(Drone_FilterBank** bank, int nChannel, int nSection)
+ * \brief   Bank of nChannel channels, of nSection sections each, all passing the samples through
+ * \return  0 if everything is fine
+ */
+int Drone_FilterBank_Init(Drone_FilterBank**, int, int);
+
+/*!
+ * \fn      void Drone_FilterBank_Delete(Drone_FilterBank** bank)
+ * \brief   Release the bank
+ */
+void Drone_FilterBank_Delete(Drone_FilterBank**);
+
+/*!
+ * \fn      int Drone_FilterBank_SetSection(Drone_FilterBank* bank, int channel, int section, const float* b, const float* a)
+ * \brief   Coefficients b0, b1, b2 and a0, a1, a2 of a section of a channel
+ * \return  0 if everything is fine, -1 if there is no such section or a0 is 0
+ */
+int Drone_FilterBank_SetSection(Drone_FilterBank*, int, int, const float*, const float*);
+
+/*!
+ * \fn      int Drone_FilterBank_SetLowPass(Drone_FilterBank* bank, int channel, int section, float dt, float omega_divide)
+ * \brief   Second order low-pass (OMEGA_N/omega_divide, ZETA) at the sampling period dt on a section of a channel
+ * \return  0 if everything is fine, -1 if there is no such section
+ */
+int Drone_FilterBank_SetLowPass(Drone_FilterBank*, int, int, float, float);
+
+/*!
+ * \fn      void Drone_FilterBank_SetWarmUp(Drone_FilterBank* bank, uint64_t n)
+ * \brief   The first n samples go through unfiltered, FILTER_WARMUP by default
+ */
+void Drone_FilterBank_SetWarmUp(Drone_FilterBank*, uint64_t);
+
+/*!
+ * \fn      void Drone_FilterBank_renew(Drone_FilterBank* bank, const float* rawdata, float* estimated)
+ * \brief   One sample of every channel : rawdata[nChannel] in, estimated[nChannel] out
+ */
+void Drone_FilterBank_renew(Drone_FilterBank*, const float*, float*);
+
+/*!
+ * \fn      void Drone_FilterBank_Pure(Drone_FilterBank* bank, const float* rawdata)
+ * \brief   One sample of every channel, without the output
+ */
+void Drone_FilterBank_Pure(Drone_FilterBank*, const float*);
 
 #endif
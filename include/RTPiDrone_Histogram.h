@@ -0,0 +1,54 @@
+/*!
+ * \file    RTPiDrone_Histogram.h
+ * \brief   Allocation-free log-linear (HDR-style) histogram of durations in nanosecond.
+ *
+ * Values below 2^HISTOGRAM_SUBBITS are counted exactly, above that every power of 2 is split into
+ * 2^(HISTOGRAM_SUBBITS-1) linear buckets, so the relative error of a percentile is below 2^-(HISTOGRAM_SUBBITS-1).
+ */
+
+#ifndef H_DRONE_HISTOGRAM
+#define H_DRONE_HISTOGRAM
+#include <stdio.h>
+#include <stdint.h>
+
+#define HISTOGRAM_SUBBITS   6       //!< 32 buckets per power of 2 (~3% precision)
+#define HISTOGRAM_MAXBIT    40      //!< Values above 2^40 ns (~18 min) are counted in the last bucket
+
+typedef struct Drone_Histogram  Drone_Histogram;    //!< Drone_Histogram type.
+
+/*!
+ * \fn      int Drone_Histogram_Init(Drone_Histogram** h, const char* name)
+ * \brief   Create an empty histogram
+ * \public  \memberof Drone_Histogram
+ * \return  0 if everything is fine
+ */
+int Drone_Histogram_Init(Drone_Histogram**, const char*);
+
+/*!
+ * \fn      void Drone_Histogram_End(Drone_Histogram** h)
+ * \brief   Release the histogram
+ * \public  \memberof Drone_Histogram
+ */
+void Drone_Histogram_End(Drone_Histogram**);
+
+/*!
+ * \fn      void Drone_Histogram_Record(Drone_Histogram* h, uint64_t value)
+ * \brief   Count one value (ns). Constant time, no allocation.
+ * \public  \memberof Drone_Histogram
+ */
+void Drone_Histogram_Record(Drone_Histogram*, uint64_t);
+
+/*!
+ * \fn      uint64_t Drone_Histogram_Percentile(Drone_Histogram* h, double p)
+ * \brief   Upper bound of the bucket containing the p-th percentile (0 < p <= 100)
+ * \public  \memberof Drone_Histogram
+ */
+uint64_t Drone_Histogram_Percentile(Drone_Histogram*, double);
+
+/*!
+ * \fn      void Drone_Histogram_Print(Drone_Histogram* h, FILE* fp)
+ * \brief   Print count, mean, p50, p99, p99.9 and max (us) in one line
+ * \public  \memberof Drone_Histogram
+ */
+void Drone_Histogram_Print(Drone_Histogram*, FILE*);
+#endif
@@ -7,6 +7,7 @@
 #define  H_DRONE_I2C
 
 #include "RTPiDrone_DataExchange.h"
+#include "RTPiDrone_Scheduler.h"
 #include <stdint.h>
 #include <stdbool.h>
 typedef struct Drone_I2C    Drone_I2C;      //!< Drone_I2C type. To control all of the I2C device.
@@ -22,12 +23,21 @@ int Drone_I2C_Init(Drone_I2C**);
 
 /*!
  * \fn      Drone_I2C_Calibration(Drone_I2C* i2c);
- * \brief   Calibrate all I2C devices
+ * \brief   Calibrate all I2C devices, and write the cache of the calibration
  * \public  \memberof Drone_I2C
  * \return  0 if everything is fine
  */
 int Drone_I2C_Calibration(Drone_I2C*);
 
+/*!
+ * \fn      int Drone_I2C_LoadCalibration(Drone_I2C* i2c)
+ * \brief   Calibration from the cache (CALI_CACHE_FILE) of the last full one, if a short validation pass agrees
+ *          with it. Drone_I2C_Calibration() is then not needed. Never with a recording or a replay.
+ * \public  \memberof Drone_I2C
+ * \return  0 if the cache is used
+ */
+int Drone_I2C_LoadCalibration(Drone_I2C*);
+
 
 /*!
  * \fn      Drone_I2C_Start(Drone_I2C* i2c)
@@ -37,6 +47,15 @@ int Drone_I2C_Calibration(Drone_I2C*);
 void Drone_I2C_Start(Drone_I2C*);
 
 
+/*!
+ * \fn      Drone_I2C_Schedule(Drone_I2C* i2c, Drone_Scheduler* sched)
+ * \brief   Put all I2C devices under the control of the scheduler
+ * \public  \memberof Drone_I2C
+ * \return  0 if everything is fine
+ */
+int Drone_I2C_Schedule(Drone_I2C*, Drone_Scheduler*);
+
+
 /*!
  * \fn      Drone_I2C_End(Drone_I2C** i2c)
  * \brief   Switch off all I2C devices
@@ -54,12 +73,36 @@ void Drone_I2C_DataInit(Drone_DataExchange*, Drone_I2C*);
 
 /*!
  * \fn      Drone_I2C_ExchangeData(Drone_DataExchange* data, Drone_I2C* i2c, uint64_t* lastUpdate)
- * \brief   Exchange data between data and i2c
+ * \brief   Exchange data between data and i2c. Each sensor refreshed sets its fresh flag and the time of its sample.
  * \public  \memberof Drone_I2C
  * \return  0 if everything is fine
  */
 int Drone_I2C_ExchangeData(Drone_DataExchange*, Drone_I2C*, uint64_t*, bool);
 
+/*!
+ * \fn      int Drone_I2C_ExchangeMotor(Drone_DataExchange* data, Drone_I2C* i2c, uint64_t* lastUpdate)
+ * \brief   Write data->power to the motors if they are due, and account data->dt_accu (pipelined loop)
+ * \public  \memberof Drone_I2C
+ * \return  1 if the motors are written, 0 if not
+ */
+int Drone_I2C_ExchangeMotor(Drone_DataExchange*, Drone_I2C*, uint64_t*);
+
+/*!
+ * \fn      int Drone_I2C_ExchangeSensor(Drone_DataExchange* data, Drone_I2C* i2c, uint64_t* lastUpdate)
+ * \brief   Refresh the magnetometer and the barometers if they are due (pipelined loop).
+ *          The PWM correction of the magnetometer is left to Drone_I2C_MagCorrection(), where the power is known.
+ * \public  \memberof Drone_I2C
+ * \return  1 if the magnetometer is refreshed, 0 if not
+ */
+int Drone_I2C_ExchangeSensor(Drone_DataExchange*, Drone_I2C*, uint64_t*);
+
+/*!
+ * \fn      void Drone_I2C_MagCorrection(Drone_DataExchange* data)
+ * \brief   Remove the field of the motors (data->power) from data->mag_est
+ * \public  \memberof Drone_I2C
+ */
+void Drone_I2C_MagCorrection(Drone_DataExchange*);
+
 /*!
  * \fn      void HMC5883L_PWM_Calibration(Drone_I2C* i2c)
  * \brief   Calibration HMC5883L with different PWM
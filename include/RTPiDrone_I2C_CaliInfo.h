@@ -1,5 +1,6 @@
 #ifndef H_DRONE_I2C_CALIINFO
 #define H_DRONE_I2C_CALIINFO
+#include <stdint.h>
 
 typedef struct Drone_I2C_CaliInfo  Drone_I2C_CaliInfo;
 
@@ -7,4 +8,6 @@ void Drone_I2C_Cali_Init(Drone_I2C_CaliInfo**, int);//!< \private \memberof Dron
 void Drone_I2C_Cali_Delete(Drone_I2C_CaliInfo**);   //!< \private \memberof Drone_I2C_CaliInfo: Terminate Drone_I2C_CaliInfo
 float* Drone_I2C_Cali_getMean(Drone_I2C_CaliInfo*); //!< \private \memberof Drone_I2C_CaliInfo: Get mean values from calibration
 float* Drone_I2C_Cali_getSD(Drone_I2C_CaliInfo*);   //!< \private \memberof Drone_I2C_CaliInfo: Get standard deviation
+void Drone_I2C_Cali_setIdentity(Drone_I2C_CaliInfo*, const void*, int);  //!< \private \memberof Drone_I2C_CaliInfo: Identity from the factory data of the chip
+uint32_t Drone_I2C_Cali_getIdentity(Drone_I2C_CaliInfo*);   //!< \private \memberof Drone_I2C_CaliInfo: Get the identity, 0 if the chip has none
 #endif
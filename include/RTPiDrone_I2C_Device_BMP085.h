@@ -27,6 +27,19 @@ void BMP085_delete(Drone_I2C_Device_BMP085**);
  */
 Drone_I2C_CaliInfo* BMP085_getCaliInfo(Drone_I2C_Device_BMP085*);
 
+/*!
+ * Set the oversampling setting (0 ultra low power ... 3 ultra high resolution) of the next pressures.
+ * \public \memberof Drone_I2C_Device_BMP085
+ * \return 0 if the setting exists
+ */
+int BMP085_setOSS(Drone_I2C_Device_BMP085*, int);
+
+/*!
+ * Time (ns) of the conversion in progress.
+ * \public \memberof Drone_I2C_Device_BMP085
+ */
+uint64_t BMP085_getConversionTime(Drone_I2C_Device_BMP085*);
+
 int BMP085_getFilteredValue(Drone_I2C_Device_BMP085*, uint64_t*, float*, float*);
 void BMP085_inputFilter(Drone_I2C_Device_BMP085*);
 #endif
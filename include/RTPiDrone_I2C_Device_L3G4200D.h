@@ -26,6 +26,19 @@ void L3G4200D_delete(Drone_I2C_Device_L3G4200D**);
  */
 Drone_I2C_CaliInfo* L3G4200D_getCaliInfo(Drone_I2C_Device_L3G4200D* L3G4200D);
 
+/*!
+ * Die temperature read at the setup (degC, up to an offset proper to the chip) : only its changes mean something.
+ * \public \memberof Drone_I2C_Device_L3G4200D
+ */
+float L3G4200D_getTemperature(Drone_I2C_Device_L3G4200D* L3G4200D);
+
 int L3G4200D_getFilteredValue(Drone_I2C_Device_L3G4200D*, uint64_t*, float*, float*);
+
+/*!
+ * Samples of the last read in FIFO mode (L3G4200D_FIFO), oldest first, with the time from the previous one.
+ * \public \memberof Drone_I2C_Device_L3G4200D
+ * \return number of samples (0 in bypass mode)
+ */
+int L3G4200D_getSamples(Drone_I2C_Device_L3G4200D*, float (*)[3], float*);
 void L3G4200D_inputFilter(Drone_I2C_Device_L3G4200D* L3G4200D);
 #endif
@@ -28,6 +28,26 @@ void MS5611_delete(Drone_I2C_Device_MS5611**);
  */
 Drone_I2C_CaliInfo* MS5611_getCaliInfo(Drone_I2C_Device_MS5611*);
 
+/*!
+ * Set the oversampling ratio (256, 512, 1024, 2048 or 4096) of the next conversions, and their deadline.
+ * \public \memberof Drone_I2C_Device_MS5611
+ * \return 0 if the ratio exists
+ */
+int MS5611_setOSR(Drone_I2C_Device_MS5611*, int);
+
+/*!
+ * Time (ns) of one conversion at the current oversampling ratio.
+ * \public \memberof Drone_I2C_Device_MS5611
+ */
+uint64_t MS5611_getConversionTime(Drone_I2C_Device_MS5611*);
+
+/*!
+ * Compensation of the datasheet in integers (first and second order) : temperature (degree C) and pressure (Pa)
+ * of the raw D1 and D2, with the PROM coefficients C[8].
+ * \public \memberof Drone_I2C_Device_MS5611
+ */
+void MS5611_compensate(const uint16_t*, uint32_t, uint32_t, float*, float*);
+
 int MS5611_getFilteredValue(Drone_I2C_Device_MS5611*, uint64_t*, float*, float*);
 void MS5611_inputFilter(Drone_I2C_Device_MS5611*);
 #endif
@@ -0,0 +1,11 @@
+#ifndef H_DRONE_MADGWICK
+#define H_DRONE_MADGWICK
+
+typedef struct Drone_Madgwick Drone_Madgwick;
+
+int Drone_Madgwick_Init(Drone_Madgwick**, float*, float);
+void Drone_Madgwick_Delete(Drone_Madgwick**);
+void Drone_Madgwick_getAngle(Drone_Madgwick*, float*);
+void Drone_Madgwick_renew(Drone_Madgwick*, float, float*, float*, float*);
+void Drone_Madgwick_renewSamples(Drone_Madgwick*, float*, float (*)[3], float*, int, float*);
+#endif
@@ -0,0 +1,45 @@
+/*!
+ * \file    RTPiDrone_Notch.h
+ * \brief   Dynamic notches on the motor vibration of the gyro (GYRO_NOTCH).
+ *
+ * The control thread gives each gyro sample to Drone_Notch_renew(), or the samples of the L3G4200D FIFO to
+ * Drone_Notch_renewSamples() : the samples go to a ring, at most one set of new coefficients is taken from another
+ * ring, and the samples go through the notches (Drone_FilterBank). The notches reach half of the rate of the
+ * samples : 125 Hz with one sample per control cycle (CONTROL_PERIOD of 4 ms), 400 Hz with L3G4200D_FIFO. The
+ * analysis thread, on NOTCH_CPU at the lowest priority, runs a windowed real FFT over the last NOTCH_FFT_SIZE samples
+ * every NOTCH_HOP samples, follows the NOTCH_NPEAK highest peaks and pushes the notches on them. Nothing locks on
+ * either side. In replay, the analysis runs in the control thread instead, so that the replay stays reproducible.
+ */
+#ifndef H_DRONE_NOTCH
+#define H_DRONE_NOTCH
+#include <stdint.h>
+
+typedef struct Drone_Notch Drone_Notch;     //!< Drone_Notch type.
+
+/*!
+ * \fn      int Drone_Notch_Init(Drone_Notch** notch)
+ * \brief   Create the notches (all passing the samples through) and start the analysis
+ * \return  0 if everything is fine
+ */
+int Drone_Notch_Init(Drone_Notch**);
+
+/*!
+ * \fn      void Drone_Notch_End(Drone_Notch** notch)
+ * \brief   Stop the analysis, print the frequencies and the cost on the control thread (DEBUG)
+ */
+void Drone_Notch_End(Drone_Notch**);
+
+/*!
+ * \fn      void Drone_Notch_renew(Drone_Notch* notch, const float* gyr, uint64_t time, int fresh, float* gyr_notch)
+ * \brief   Control thread : gyro sample taken at time (ns), gyr_notch is the filtered one (the last one if not fresh)
+ */
+void Drone_Notch_renew(Drone_Notch*, const float*, uint64_t, int, float*);
+
+/*!
+ * \fn      void Drone_Notch_renewSamples(Drone_Notch* notch, float (*gyr)[3], float* dt, int n, uint64_t time, float* gyr_notch)
+ * \brief   Control thread : n gyro samples, oldest first, dt[] from the previous one (s), the last one taken at time (ns),
+ *          gyr_notch is the last one filtered (the last output if n is 0)
+ */
+void Drone_Notch_renewSamples(Drone_Notch*, float (*)[3], float*, int, uint64_t, float*);
+
+#endif
@@ -9,4 +9,5 @@ void Drone_Quaternion_SetPI(Drone_Quaternion*, float, float);
 void Drone_Quaternion_getAngle(Drone_Quaternion*, float*);
 void Drone_Quaternion_calculate_MagField_Earth(Drone_Quaternion*, float*);
 void Drone_Quaternion_renew(Drone_Quaternion*, float, float*, float*, float*);
+void Drone_Quaternion_renewSamples(Drone_Quaternion*, float*, float (*)[3], float*, int, float*);
 #endif
@@ -0,0 +1,63 @@
+/*!
+ * \file    RTPiDrone_RingBuffer.h
+ * \brief   Fixed-capacity single-producer/single-consumer ring buffer.
+ *
+ * The producer never allocates, locks or makes a system call: the whole
+ * storage is allocated and pre-faulted by Drone_RingBuffer_Init().
+ */
+
+#ifndef H_DRONE_RINGBUFFER
+#define H_DRONE_RINGBUFFER
+#include <stddef.h>
+#include <stdint.h>
+
+#define DRONE_CACHELINE     64              //!< Size of one cache line (ARM11 uses 32, Cortex-A7/A53 use 64)
+
+typedef struct Drone_RingBuffer Drone_RingBuffer;   //!< Drone_RingBuffer type.
+
+/*!
+ * \fn      int Drone_RingBuffer_Init(Drone_RingBuffer** ring, size_t elemSize, uint32_t capacity)
+ * \brief   Allocate and pre-fault a ring of (at least) capacity elements of elemSize bytes
+ * \public  \memberof Drone_RingBuffer
+ * \return  0 if everything is fine
+ */
+int Drone_RingBuffer_Init(Drone_RingBuffer**, size_t, uint32_t);
+
+/*!
+ * \fn      void Drone_RingBuffer_End(Drone_RingBuffer** ring)
+ * \brief   Release the ring
+ * \public  \memberof Drone_RingBuffer
+ */
+void Drone_RingBuffer_End(Drone_RingBuffer**);
+
+/*!
+ * \fn      int Drone_RingBuffer_Push(Drone_RingBuffer* ring, const void* elem)
+ * \brief   Copy one element into the ring (producer side only).
+ *          Drop policy: if the ring is full, the new element is dropped and the overflow counter is incremented.
+ * \public  \memberof Drone_RingBuffer
+ * \return  0 if the element is queued, -1 if it has been dropped
+ */
+int Drone_RingBuffer_Push(Drone_RingBuffer*, const void*);
+
+/*!
+ * \fn      int Drone_RingBuffer_Pop(Drone_RingBuffer* ring, void* elem)
+ * \brief   Copy the oldest element out of the ring (consumer side only)
+ * \public  \memberof Drone_RingBuffer
+ * \return  0 if one element is copied, -1 if the ring is empty
+ */
+int Drone_RingBuffer_Pop(Drone_RingBuffer*, void*);
+
+/*!
+ * \fn      uint64_t Drone_RingBuffer_GetOverflow(Drone_RingBuffer* ring)
+ * \brief   Number of elements dropped because the ring was full
+ * \public  \memberof Drone_RingBuffer
+ */
+uint64_t Drone_RingBuffer_GetOverflow(Drone_RingBuffer*);
+
+/*!
+ * \fn      uint32_t Drone_RingBuffer_GetCapacity(Drone_RingBuffer* ring)
+ * \brief   Number of elements the ring can hold
+ * \public  \memberof Drone_RingBuffer
+ */
+uint32_t Drone_RingBuffer_GetCapacity(Drone_RingBuffer*);
+#endif
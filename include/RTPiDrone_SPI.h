@@ -6,6 +6,7 @@
 #ifndef  H_DRONE_SPI
 #define  H_DRONE_SPI
 #include "RTPiDrone_DataExchange.h"
+#include "RTPiDrone_Scheduler.h"
 typedef struct Drone_SPI    Drone_SPI;   //!< Drone_SPI type. To control all of the SPI device.
 
 /*!
@@ -17,12 +18,12 @@ typedef struct Drone_SPI    Drone_SPI;   //!< Drone_SPI type. To control all of
 int Drone_SPI_Init(Drone_SPI**);
 
 /*!
- * \fn      int Drone_SPI_Calibration(Drone_SPI* spi)
- * \brief   Calibrate all SPI devices
+ * \fn      int Drone_SPI_Calibration(Drone_SPI* spi, int quick)
+ * \brief   Calibrate all SPI devices, with 1/CALI_CACHE_DIVIDE of the samples if quick (the I2C calibration is cached)
  * \public  \memberof Drone_SPI
  * \return  0 if everything is fine
  */
-int Drone_SPI_Calibration(Drone_SPI*);
+int Drone_SPI_Calibration(Drone_SPI*, int);
 
 /*!
  * \fn      void Drone_SPI_Start(Drone_SPI* spi, Drone_DataExchange* data)
@@ -31,6 +32,14 @@ int Drone_SPI_Calibration(Drone_SPI*);
  */
 void Drone_SPI_Start(Drone_SPI*, Drone_DataExchange*);
 
+/*!
+ * \fn      int Drone_SPI_Schedule(Drone_SPI* spi, Drone_Scheduler* sched)
+ * \brief   Put all SPI devices under the control of the scheduler
+ * \public  \memberof Drone_SPI
+ * \return  0 if everything is fine
+ */
+int Drone_SPI_Schedule(Drone_SPI*, Drone_Scheduler*);
+
 /*!
  * \fn      int Drone_SPI_End(Drone_SPI** spi)
  * \brief   Switch off all SPI devices
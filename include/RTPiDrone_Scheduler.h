@@ -0,0 +1,88 @@
+/*!
+ * \file    RTPiDrone_Scheduler.h
+ * \brief   Multi-rate scheduler deciding in which control cycle every device is refreshed.
+ *
+ * The period of each device is converted into a whole number of control cycles and every device gets a
+ * phase (its slot) such that the estimated bus time per cycle is balanced. At run time, if the devices due
+ * in one cycle would exceed the bus budget, the devices with the longest period are deferred to the next cycle.
+ * A device which has been deferred for a whole period is refreshed anyway, over the budget.
+ */
+
+#ifndef H_DRONE_SCHEDULER
+#define H_DRONE_SCHEDULER
+#include "RTPiDrone_Device.h"
+#include <stdint.h>
+
+/*!
+ * \def     SCHEDULER_I2C_COST(nTrans, nByte)
+ * \brief   Estimated bus time (us) of nTrans I2C transactions carrying nByte bytes (address bytes included)
+ *          at 400 kHz (BCM2835_I2C_CLOCK_DIVIDER_626)
+ */
+#define SCHEDULER_I2C_COST(nTrans, nByte)   ((nTrans)*20 + (nByte)*45/2)
+
+/*!
+ * \enum Drone_Scheduler_Bus
+ * \brief Bus used by a scheduled device. The budget is applied per bus.
+ */
+typedef enum {
+    SCHEDULER_I2C,      /*!< I2C bus */
+    SCHEDULER_SPI,      /*!< SPI bus */
+    SCHEDULER_NBUS      /*!< Number of buses */
+} Drone_Scheduler_Bus;
+
+typedef struct Drone_Scheduler  Drone_Scheduler;    //!< Drone_Scheduler type.
+
+/*!
+ * \fn      int Drone_Scheduler_Init(Drone_Scheduler** sched, uint64_t cyclePeriod)
+ * \brief   Create an empty scheduler for a control loop of period cyclePeriod (ns)
+ * \public  \memberof Drone_Scheduler
+ * \return  0 if everything is fine
+ */
+int Drone_Scheduler_Init(Drone_Scheduler**, uint64_t);
+
+/*!
+ * \fn      void Drone_Scheduler_End(Drone_Scheduler** sched)
+ * \brief   Release the scheduler
+ * \public  \memberof Drone_Scheduler
+ */
+void Drone_Scheduler_End(Drone_Scheduler**);
+
+/*!
+ * \fn      int Drone_Scheduler_Add(Drone_Scheduler* sched, Drone_Device* dev, Drone_Scheduler_Bus bus, uint32_t cost)
+ * \brief   Put a device under the control of the scheduler.
+ * \param   cost Estimated bus time (us) of one refresh of the device
+ * \public  \memberof Drone_Scheduler
+ * \return  0 if everything is fine
+ */
+int Drone_Scheduler_Add(Drone_Scheduler*, Drone_Device*, Drone_Scheduler_Bus, uint32_t);
+
+/*!
+ * \fn      int Drone_Scheduler_Plan(Drone_Scheduler* sched)
+ * \brief   Assign the cycle slot of every device. Must be called once after all Drone_Scheduler_Add().
+ * \public  \memberof Drone_Scheduler
+ * \return  0 if the peak load of every bus fits in its budget
+ */
+int Drone_Scheduler_Plan(Drone_Scheduler*);
+
+/*!
+ * \fn      uint32_t Drone_Scheduler_GetPeak(Drone_Scheduler* sched, Drone_Scheduler_Bus bus)
+ * \brief   Peak bus time per cycle (us) of the last Drone_Scheduler_Plan()
+ * \public  \memberof Drone_Scheduler
+ */
+uint32_t Drone_Scheduler_GetPeak(Drone_Scheduler*, Drone_Scheduler_Bus);
+
+/*!
+ * \fn      uint32_t Drone_Scheduler_GetBudget(Drone_Scheduler* sched, Drone_Scheduler_Bus bus)
+ * \brief   Bus time available per cycle (us)
+ * \public  \memberof Drone_Scheduler
+ */
+uint32_t Drone_Scheduler_GetBudget(Drone_Scheduler*, Drone_Scheduler_Bus);
+
+/*!
+ * \fn      void Drone_Scheduler_NextCycle(Drone_Scheduler* sched)
+ * \brief   Start a new control cycle: mark the devices which have to be refreshed in this cycle.
+ * \public  \memberof Drone_Scheduler
+ */
+void Drone_Scheduler_NextCycle(Drone_Scheduler*);
+
+#endif
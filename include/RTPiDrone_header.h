@@ -15,13 +15,64 @@
 #define KD                  (140.0f)            /*! PID -- D */
 #define PWM_MAX             (3500)              /*! PWM Max value */
 #define PWM_MIN             (1750)              /*! PWM Min value */
+//#define PCA9685PW_ALL_LED                     /*! If defined, equal powers (ESC arming) go to the 16 channels via ALL_LED */
 #define ADXL345_RATE        (400)               /*! ADXL345 data sampling rate */
+//#define ADXL345_FIFO                          /*! If defined, ADXL345 samples at ADXL345_FIFO_RATE and the FIFO is read at ADXL345_RATE */
+#define ADXL345_FIFO_RATE   (1600)              /*! ADXL345 data sampling rate in FIFO stream mode */
 #define L3G4200D_RATE       (400)               /*! L3G4200D data sampling rate */
+//#define L3G4200D_FIFO                         /*! If defined, L3G4200D samples at L3G4200D_FIFO_RATE and the FIFO is read at L3G4200D_RATE */
+#define L3G4200D_FIFO_RATE  (800)               /*! L3G4200D data sampling rate in FIFO stream mode */
 //#define HMC5883L_SINGLEMEASUREMENT
 #define HMC5883L_RATE       (75)
 #define HMC5883L_PERIOD     (1000000000L/HMC5883L_RATE)
-#define BMP085_PeriodLong   (25500000L)
-#define BMP085_PeriodShort  (4500000L)
-#define MS5611_Period       (10000000L)
+//#define I2C_DRDY                              /*! If defined, ADXL345, L3G4200D and HMC5883L are read on the edge of their data-ready line (HMC5883L DRDY is active low) */
+//#define I2C_DRDY_LOCK                         /*! If defined (with I2C_DRDY), the control cycle starts on the data-ready edge of L3G4200D */
+#define DRDY_CHIP           "/dev/gpiochip0"    /*! GPIO character device of the data-ready lines */
+#define DRDY_PIN_ADXL345    (17)                /*! BCM GPIO of ADXL345 INT1 */
+#define DRDY_PIN_L3G4200D   (27)                /*! BCM GPIO of L3G4200D INT2/DRDY */
+#define DRDY_PIN_HMC5883L   (22)                /*! BCM GPIO of HMC5883L DRDY */
+#define DRDY_LOCK_WINDOW    (300000L)           /*! The cycle waits for the edge from CONTROL_PERIOD - DRDY_LOCK_WINDOW (ns) */
+#define BMP085_OSS          (2)                 /*! BMP085 oversampling setting (0 - 3) of the pressure, BMP085_setOSS() at run time */
+#define BMP085_TEMP_EVERY   (8)                 /*! BMP085 converts the temperature once every BMP085_TEMP_EVERY pressures */
+#define MS5611_OSR          (4096)              /*! MS5611 oversampling ratio (256, 512, 1024, 2048 or 4096), MS5611_setOSR() at run time */
+#define MS5611_TEMP_EVERY   (8)                 /*! MS5611 converts the temperature once every MS5611_TEMP_EVERY pressures */
+//#define FASTMATH_NEON                         /*! If defined, fastInvSqrt() uses NEON (Pi 2 and later, -mfpu=neon) */
+//#define VEC4_SCALAR                           /*! If defined, the Mahony filter uses the plain C backend of Vec4.h instead of NEON / SSE */
 #define PWM_CONTROLPERIOD   (2)
+#if     defined(ADXL345_FIFO) && defined(L3G4200D_FIFO)
+#define SCHEDULER_I2C_BUDGET        (3300)      /*! I2C bus time available per control cycle (us), plan peak ~3.1 ms with the FIFOs */
+#elif   defined(ADXL345_FIFO)
+#define SCHEDULER_I2C_BUDGET        (2800)      /*! I2C bus time available per control cycle (us), plan peak ~2.5 ms with the FIFO of ADXL345 */
+#elif   defined(L3G4200D_FIFO)
+#define SCHEDULER_I2C_BUDGET        (2000)      /*! I2C bus time available per control cycle (us), plan peak ~1.6 ms with the FIFO of L3G4200D */
+#else
+#define SCHEDULER_I2C_BUDGET        (1500)      /*! I2C bus time available per control cycle (us) */
+#endif
+#define SCHEDULER_SPI_BUDGET        (1000)      /*! SPI bus time available per control cycle (us) */
+#define DATAEXCHANGE_RINGSIZE       (4096)      /*! Number of records the log ring can hold (~16 s at 250 Hz) */
+#define DATAEXCHANGE_WRITE_PERIOD   (10000000L) /*! Sleep of the log writer when the ring is empty (ns) */
+#define SIM_I2C_LATENCY             (20000)     /*! Simulated bus: time of one I2C transaction (ns) */
+#define SIM_I2C_BYTE_LATENCY        (22500)     /*! Simulated bus: time of one I2C byte at 400 kHz (ns) */
+#define SIM_SPI_LATENCY             (5000)      /*! Simulated bus: time of one SPI transfer (ns) */
+#define SIM_SPI_BYTE_LATENCY        (1000)      /*! Simulated bus: time of one SPI byte at 8 MHz (ns) */
+#define SIM_FLIGHT_TIME             (60)        /*! Simulated bus: the remote control turns the switch off after (s), from the first control cycle */
+#define PIPELINE_CPU_ACQ            (1)         /*! Pipelined loop: core of the sensor acquisition (and of the timing) */
+#define PIPELINE_CPU_EST            (2)         /*! Pipelined loop: core of the estimation and PID */
+#define PIPELINE_CPU_ACT            (3)         /*! Pipelined loop: core of the motors and of the RF */
+#define PIPELINE_RINGSIZE           (16)        /*! Pipelined loop: depth of the queues between the stages */
+//#define GYRO_NOTCH                            /*! If defined, the gyro of the PID goes through notches on the motor vibration, found by a FFT on NOTCH_CPU, below half of the gyro rate (with L3G4200D_FIFO: every sample of the FIFO) */
+#define NOTCH_CPU                   (3)         /*! Gyro notch: core of the FFT (lowest priority) */
+#define NOTCH_FFT_SIZE              (128)       /*! Gyro notch: samples of one FFT (power of 2) */
+#define NOTCH_HOP                   (32)        /*! Gyro notch: new samples between two FFTs */
+#define NOTCH_NPEAK                 (2)         /*! Gyro notch: peaks followed, one notch each */
+#define NOTCH_MIN_FREQ              (30.0f)     /*! Gyro notch: lowest frequency of a notch (Hz) */
+#define NOTCH_Q                     (3.0f)      /*! Gyro notch: quality factor of the notches */
+#define NOTCH_SNR                   (10.0f)     /*! Gyro notch: a peak is above NOTCH_SNR times the median of the spectrum */
+#define CALI_CACHE_FILE             "RTPiDrone_calibration.bin" /*! Cache of the last full calibration of the I2C sensors (remove it to force one) */
+#define CALI_CACHE_DIVIDE           (6)         /*! Calibration cache: the validation pass takes 1/CALI_CACHE_DIVIDE of the samples of a calibration */
+#define CALI_CACHE_DTEMP            (5.0f)      /*! Calibration cache: max. change of the die temperature of L3G4200D, and of the barometer (degC) */
+#define CALI_CACHE_NSIGMA           (5.0f)      /*! Calibration cache: max. change of a mean, in standard errors of the difference */
+#define CALI_CACHE_SDRATIO          (2.0f)      /*! Calibration cache: max. growth of a standard deviation */
+#define BUS_RECORD_SIZE             (262144)    /*! Number of bus events a recording can hold (12 MB, ~3 min of flight) */
+#define I2CDEV_PATH                 "/dev/i2c-1" /*! Device node of the i2c-dev bus backend (-i) */
 #endif
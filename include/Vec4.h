@@ -0,0 +1,247 @@
+/*!
+ * \file    Vec4.h
+ * \brief   4-lane float vectors for the estimators and the filters : NEON on the Pi (2 and later), SSE on x86, plain C otherwise.
+ *
+ * A 3D vector keeps 0 in its last lane. Every backend rounds after each operation and sums the lanes in the same
+ * order, so the results are the same bit for bit on x86; on ARM they may differ by a few ulp where the compiler fuses
+ * a multiply-add, and NEON flushes the denormals to zero. VEC4_SCALAR forces the plain C backend for the comparison.
+ */
+#ifndef H_VEC4
+#define H_VEC4
+#include "RTPiDrone_header.h"
+#include "FastMath.h"
+
+#if     defined(__ARM_NEON) && !defined(VEC4_SCALAR)
+#define VEC4_NEON
+#include <arm_neon.h>
+typedef float32x4_t vec4;
+#elif   defined(__SSE__) && !defined(VEC4_SCALAR)
+#define VEC4_SSE
+#include <xmmintrin.h>
+typedef __m128 vec4;
+#else
+typedef struct {
+    _Alignas(16) float f[4];
+} vec4;
+#endif
+
+//! \brief (a, b, c, d)
+static inline vec4 vec4_set(float a, float b, float c, float d)
+{
+#if     defined(VEC4_NEON)
+    const float f[4] = {a, b, c, d};
+    return vld1q_f32(f);
+#elif   defined(VEC4_SSE)
+    return _mm_setr_ps(a, b, c, d);
+#else
+    vec4 r = {{a, b, c, d}};
+    return r;
+#endif
+}
+
+//! \brief (s, s, s, s)
+static inline vec4 vec4_splat(float s)
+{
+#if     defined(VEC4_NEON)
+    return vdupq_n_f32(s);
+#elif   defined(VEC4_SSE)
+    return _mm_set1_ps(s);
+#else
+    return vec4_set(s, s, s, s);
+#endif
+}
+
+//! \brief 3D vector of p[0..2], 0 in the last lane
+static inline vec4 vec4_load3(const float* p)
+{
+    return vec4_set(p[0], p[1], p[2], 0.0f);
+}
+
+//! \brief p[0..n-1] (n <= 4), 0 in the other lanes, p needs no alignment
+static inline vec4 vec4_load(const float* p, int n)
+{
+    if (n >= 4) {
+#if     defined(VEC4_NEON)
+        return vld1q_f32(p);
+#elif   defined(VEC4_SSE)
+        return _mm_loadu_ps(p);
+#endif
+    }
+    // Lane by lane in the registers : a copy through memory would stall the vector load on the scalar stores
+    return vec4_set(p[0], n > 1 ? p[1] : 0.0f, n > 2 ? p[2] : 0.0f, n > 3 ? p[3] : 0.0f);
+}
+
+//! \brief p[0..3], p is 16-byte aligned
+static inline vec4 vec4_load4(const float* p)
+{
+#if     defined(VEC4_NEON)
+    return vld1q_f32(p);
+#elif   defined(VEC4_SSE)
+    return _mm_load_ps(p);
+#else
+    return vec4_set(p[0], p[1], p[2], p[3]);
+#endif
+}
+
+//! \brief a to p[0..3], p is 16-byte aligned
+static inline void vec4_store4(float* p, vec4 a)
+{
+#if     defined(VEC4_NEON)
+    vst1q_f32(p, a);
+#elif   defined(VEC4_SSE)
+    _mm_store_ps(p, a);
+#else
+    for (int i=0; i<4; ++i) p[i] = a.f[i];
+#endif
+}
+
+//! \brief Lane i of a
+static inline float vec4_get(vec4 a, int i)
+{
+#if     defined(VEC4_NEON) || defined(VEC4_SSE)
+    union { vec4 v; float f[4]; } u = {a};
+    return u.f[i];
+#else
+    return a.f[i];
+#endif
+}
+
+//! \brief Lanes of a to p[0..n-1], p needs no alignment
+static inline void vec4_store(float* p, vec4 a, int n)
+{
+#if     defined(VEC4_NEON)
+    if (n == 4) {
+        vst1q_f32(p, a);
+        return;
+    }
+#elif   defined(VEC4_SSE)
+    if (n == 4) {
+        _mm_storeu_ps(p, a);
+        return;
+    }
+#endif
+    for (int i=0; i<n; ++i) p[i] = vec4_get(a, i);
+}
+
+static inline vec4 vec4_add(vec4 a, vec4 b)
+{
+#if     defined(VEC4_NEON)
+    return vaddq_f32(a, b);
+#elif   defined(VEC4_SSE)
+    return _mm_add_ps(a, b);
+#else
+    for (int i=0; i<4; ++i) a.f[i] += b.f[i];
+    return a;
+#endif
+}
+
+static inline vec4 vec4_sub(vec4 a, vec4 b)
+{
+#if     defined(VEC4_NEON)
+    return vsubq_f32(a, b);
+#elif   defined(VEC4_SSE)
+    return _mm_sub_ps(a, b);
+#else
+    for (int i=0; i<4; ++i) a.f[i] -= b.f[i];
+    return a;
+#endif
+}
+
+static inline vec4 vec4_mul(vec4 a, vec4 b)
+{
+#if     defined(VEC4_NEON)
+    return vmulq_f32(a, b);
+#elif   defined(VEC4_SSE)
+    return _mm_mul_ps(a, b);
+#else
+    for (int i=0; i<4; ++i) a.f[i] *= b.f[i];
+    return a;
+#endif
+}
+
+//! \brief a + b*s, rounded after the product as the other operations
+static inline vec4 vec4_madd(vec4 a, vec4 b, float s)
+{
+    return vec4_add(a, vec4_mul(b, vec4_splat(s)));
+}
+
+//! \brief (a0*b0 + a2*b2) + (a1*b1 + a3*b3)
+static inline float vec4_dot(vec4 a, vec4 b)
+{
+#if     defined(VEC4_NEON)
+    float32x4_t p = vmulq_f32(a, b);
+    float32x2_t s = vadd_f32(vget_low_f32(p), vget_high_f32(p));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#elif   defined(VEC4_SSE)
+    __m128 p = _mm_mul_ps(a, b);
+    __m128 s = _mm_add_ps(p, _mm_movehl_ps(p, p));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1))));
+#else
+    return (a.f[0]*b.f[0] + a.f[2]*b.f[2]) + (a.f[1]*b.f[1] + a.f[3]*b.f[3]);
+#endif
+}
+
+//! \brief a/|a|, 0 if a is zero
+static inline vec4 vec4_normalize(vec4 a)
+{
+    float n = vec4_dot(a, a);
+    return vec4_mul(a, vec4_splat(n > 0.0f ? fastInvSqrt(n) : 0.0f));
+}
+
+//! \brief (a1, a0, a3, a2)
+static inline vec4 vec4_swapPairs(vec4 a)
+{
+#if     defined(VEC4_NEON)
+    return vrev64q_f32(a);
+#elif   defined(VEC4_SSE)
+    return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+#else
+    return vec4_set(a.f[1], a.f[0], a.f[3], a.f[2]);
+#endif
+}
+
+//! \brief (a2, a3, a0, a1)
+static inline vec4 vec4_swapHalves(vec4 a)
+{
+#if     defined(VEC4_NEON)
+    return vextq_f32(a, a, 2);
+#elif   defined(VEC4_SSE)
+    return _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2));
+#else
+    return vec4_set(a.f[2], a.f[3], a.f[0], a.f[1]);
+#endif
+}
+
+//! \brief (a1, a2, a0, a3)
+static inline vec4 vec4_yzx(vec4 a)
+{
+#if     defined(VEC4_NEON)
+    float32x2_t lo = vget_low_f32(a), hi = vget_high_f32(a);
+    return vcombine_f32(vext_f32(lo, hi, 1), vset_lane_f32(vget_lane_f32(lo, 0), hi, 0));
+#elif   defined(VEC4_SSE)
+    return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+#else
+    return vec4_set(a.f[1], a.f[2], a.f[0], a.f[3]);
+#endif
+}
+
+//! \brief (a2, a0, a1, a3)
+static inline vec4 vec4_zxy(vec4 a)
+{
+#if     defined(VEC4_NEON)
+    float32x2_t lo = vget_low_f32(a), hi = vget_high_f32(a);
+    return vcombine_f32(vset_lane_f32(vget_lane_f32(lo, 0), hi, 1), vset_lane_f32(vget_lane_f32(lo, 1), hi, 0));
+#elif   defined(VEC4_SSE)
+    return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+#else
+    return vec4_set(a.f[2], a.f[0], a.f[1], a.f[3]);
+#endif
+}
+
+//! \brief Cross product of the 3D vectors a and b
+static inline vec4 vec4_cross(vec4 a, vec4 b)
+{
+    return vec4_sub(vec4_mul(vec4_yzx(a), vec4_zxy(b)), vec4_mul(vec4_zxy(a), vec4_yzx(b)));
+}
+
+#endif
@@ -6,6 +6,10 @@
 #include <unistd.h>
 #include <time.h>
 #include <math.h>
+#include <stdatomic.h>
+
+static int virtualClock = 0;                    //!< \private get_nsec() returns virtualTime (replay)
+static _Atomic uint64_t virtualTime;            //!< \private Time stamp of the last replayed event
 
 /*!
  * \fn      void exchange(char* buf, int len)
@@ -32,7 +36,7 @@ void exchange(char* buf, int len)
  */
 void _usleep(int micro)
 {
-    if (micro<0) return;
+    if (micro<0 || virtualClock) return;
     struct timespec req = {0, micro * 1000L};
     //req.tv_sec = 0;
     //req.tv_nsec = micro * 1000L;
@@ -50,19 +54,103 @@ float getSqrt(float* v, int N)
 {
     float sum = 0.;
     for (int i=0; i<N; ++i) {
-        sum += pow(v[i],2.0f);
+        sum += v[i] * v[i];
     }
     return sqrtf(sum);
 }
 
+#define ALTITUDE_PMID       80000.0f    //!< \private Middle of the pressure range of getAltitude() (Pa)
+#define ALTITUDE_PHALF      30000.0f    //!< \private Half of the range : 50000 - 110000 Pa, -700 - 5500 m
+#define ALTITUDE_NCOEF      9           //!< \private Chebyshev terms of the altitude, degree 8
+
+//! \private Chebyshev series of 44330*(1-(p/101325)^(1/5.255)) on the range, deviation < 1.1 mm in single precision
+static const float altitudeCoef[ALTITUDE_NCOEF] = {
+    2.189913086e+03f, -3.107541260e+03f, 2.444700928e+02f, -2.867733765e+01f, 3.918253422e+00f,
+    -5.808045268e-01f, 9.058158845e-02f, -1.461571921e-02f, 2.352635609e-03f
+};
+
+/*!
+ * \fn      float getAltitude(float pressure)
+ * \brief   Altitude of the standard atmosphere : 44330*(1-(pressure/101325)^(1/5.255)), in single precision.
+ *          A Chebyshev series (Clenshaw) in the range of the flight, powf() out of it.
+ * \param pressure Pressure (Pa)
+ * \return  Altitude (m)
+ */
+float getAltitude(float pressure)
+{
+    float u = (pressure - ALTITUDE_PMID) * (1.0f / ALTITUDE_PHALF);
+    if (u < -1.0f || u > 1.0f) return 44330.0f * (1.0f - powf(pressure * (1.0f / 101325.0f), 1.0f / 5.255f));
+    float b1 = 0.0f, b2 = 0.0f;
+    for (int i=ALTITUDE_NCOEF-1; i>0; --i) {
+        float b = 2.0f * u * b1 - b2 + altitudeCoef[i];
+        b2 = b1;
+        b1 = b;
+    }
+    return u * b1 - b2 + altitudeCoef[0];
+}
+
+/*!
+ * \fn      uint32_t getChecksum(const void* buf, int len)
+ * \brief   32-bit FNV-1a hash of len bytes
+ * \param buf Pointer of the data
+ * \param len How many bytes the data has.
+ * \return  Hash of the bytes
+ */
+uint32_t getChecksum(const void* buf, int len)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    uint32_t h = 2166136261u;
+    for (int i=0; i<len; ++i) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
 /*!
  * \fn      get_nsec(void)
- * \brief   Get the time stamp (in nanosecond)
+ * \brief   Get the time stamp (in nanosecond). It is the virtual time once virtual_clock_start() is called.
  * \return  Time stamp (in nanosecond)
  */
 uint64_t get_nsec(void)
 {
+    if (virtualClock) return atomic_load_explicit(&virtualTime, memory_order_relaxed);
     struct timespec tv;
     clock_gettime(CLOCK_MONOTONIC_RAW, &tv);
     return ((uint64_t)tv.tv_sec * 1000000000 + tv.tv_nsec);
 }
+
+/*!
+ * \fn      get_nsec_mono(void)
+ * \brief   Get the CLOCK_MONOTONIC time stamp (in nanosecond), the clock used by clock_nanosleep in the loop.
+ *          It is served by the vDSO (no system call) on the RPi kernels, unlike CLOCK_MONOTONIC_RAW.
+ *          It is never virtual : it measures the real cost of the loop stages, replay included.
+ * \return  Time stamp (in nanosecond)
+ */
+uint64_t get_nsec_mono(void)
+{
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return ((uint64_t)tv.tv_sec * 1000000000 + tv.tv_nsec);
+}
+
+/*!
+ * \fn      void virtual_clock_start(uint64_t start)
+ * \brief   From now on, get_nsec() returns a virtual time starting at start, and _usleep() returns at once.
+ *          The time only moves with virtual_clock_set() (replay of a recording).
+ */
+void virtual_clock_start(uint64_t start)
+{
+    atomic_store(&virtualTime, start);
+    virtualClock = 1;
+}
+
+/*!
+ * \fn      void virtual_clock_set(uint64_t t)
+ * \brief   Move the virtual time forward to t. It never goes backward, several threads may replay at once.
+ */
+void virtual_clock_set(uint64_t t)
+{
+    uint64_t now = atomic_load_explicit(&virtualTime, memory_order_relaxed);
+    while (now < t && !atomic_compare_exchange_weak(&virtualTime, &now, t)) ;
+}
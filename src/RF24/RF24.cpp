@@ -532,7 +532,7 @@ void RF24::printDetails(void)
 
 #if defined (RF24_RPi)
     printf("================ SPI Configuration ================\n" );
-    if (csn_pin < BCM2835_SPI_CS_NONE ) {
+    if (csn_pin < DRONE_BUS_SPI_CS_NONE ) {
         printf("CSN Pin  \t = %s\n",rf24_csn_e_str_P[csn_pin]);
     } else {
         printf("CSN Pin  \t = Custom GPIO%d%s\n", csn_pin,
@@ -22,11 +22,11 @@ SPI::SPI()
 void SPI::begin( int busNo )
 {
 
-    if (!bcm2835_init()) {
+    if (Drone_Bus_Init()) {
         return;
     }
 
-    bcm2835_spi_begin();
+    Drone_Bus_SPI_Begin();
 
 }
 
@@ -37,22 +37,22 @@ void SPI::end()
 
 void SPI::setBitOrder(uint8_t bit_order)
 {
-    bcm2835_spi_setBitOrder(bit_order);
+    Drone_Bus_SPI_SetBitOrder(bit_order);
 }
 
 void SPI::setDataMode(uint8_t data_mode)
 {
-    bcm2835_spi_setDataMode(data_mode);
+    Drone_Bus_SPI_SetDataMode(data_mode);
 }
 
 void SPI::setClockDivider(uint16_t spi_speed)
 {
-    bcm2835_spi_setClockDivider(spi_speed);
+    Drone_Bus_SPI_SetClockDivider(spi_speed);
 }
 
 void SPI::chipSelect(int csn_pin)
 {
-    bcm2835_spi_chipSelect(csn_pin);
+    Drone_Bus_SPI_ChipSelect(csn_pin);
 }
 
 SPI::~SPI()
@@ -2,11 +2,15 @@
  * \file    RTPiDrone.c
  * \brief   Realize the struct/functions defined in RTPiDrone.h
  */
+#define _GNU_SOURCE                                 // pthread_setaffinity_np()
 #include "RTPiDrone_header.h"
 #include "RTPiDrone_I2C.h"
 #include "RTPiDrone_SPI.h"
 #include "RTPiDrone_AHRS.h"
 #include "RTPiDrone_DataExchange.h"
+#include "RTPiDrone_Scheduler.h"
+#include "RTPiDrone_Histogram.h"
+#include "RTPiDrone_RingBuffer.h"
 #include "RTPiDrone.h"
 #include "Common.h"
 #include <string.h>
@@ -15,12 +19,29 @@
 #include <stdbool.h>
 #include <time.h>
 #include <pthread.h>
-#include <bcm2835.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "RTPiDrone_Bus.h"
 
 #define LENGTH 128
 #define NUM_CALI_THREADS        2
 #define PERIOD                  CONTROL_PERIOD
 #define BILLION                 1000000000L
+#define N_OVERHEAD_SAMPLE       10000
+
+#ifdef  I2C_DRDY_LOCK
+#ifndef I2C_DRDY
+#error  "I2C_DRDY_LOCK needs I2C_DRDY"
+#endif
+#ifdef  L3G4200D_FIFO
+#define DRDY_LOCK_PERIOD        (1000000000L/L3G4200D_FIFO_RATE)
+#else
+#define DRDY_LOCK_PERIOD        (1000000000L/L3G4200D_RATE)
+#endif
+#if     (CONTROL_PERIOD % DRDY_LOCK_PERIOD)
+#error  "I2C_DRDY_LOCK : CONTROL_PERIOD has to be a multiple of the data period of L3G4200D"
+#endif
+#endif
 
 static int32_t          iStep;
 /*!
@@ -35,6 +56,76 @@ typedef enum {
     xenomai     /*!< kernel with xenomai */
 } kernelType;
 
+/*!
+ * \enum loopStage
+ * \private enum loopStage
+ * \brief Stages of one control cycle timed by Drone_Loop
+ */
+typedef enum {
+    stageAccGyr,    /*!< Read of accelerometer and gyroscope */
+    stageAHRS,      /*!< Drone_AHRS_ExchangeData */
+    stagePWM,       /*!< PWM output, magnetometer and barometers */
+    stageSPI,       /*!< Drone_SPI_ExchangeData */
+    stageSave,      /*!< Drone_DataExchange_SaveFile */
+    stageCycle,     /*!< Whole work of the cycle */
+    stageWakeup,    /*!< Wake-up error of clock_nanosleep */
+    stageMotor,     /*!< PWM output (pipelined loop) */
+    stagePipeline,  /*!< From the start of the cycle to the PWM output (pipelined loop) */
+    nStage          /*!< Number of stages */
+} loopStage;
+
+static const char* stageName[] = {"AccGyr", "AHRS", "PWM/Mag/Bar", "SPI", "SaveFile", "Cycle", "Wakeup", "Motor", "Pipeline"};
+
+/*!
+ * \enum sampleSensor
+ * \private enum sampleSensor
+ * \brief Sensors whose sample age is measured when the estimation uses it
+ */
+typedef enum {
+    sampleAcc,      /*!< ADXL345 */
+    sampleGyr,      /*!< L3G4200D */
+    sampleMag,      /*!< HMC5883L */
+    sampleBar,      /*!< BMP085 */
+    sampleBarHT,    /*!< MS5611 */
+    nSensor         /*!< Number of sensors */
+} sampleSensor;
+
+static const char* sampleName[] = {"Age acc", "Age gyr", "Age mag", "Age BMP085", "Age MS5611"};
+
+/*!
+ * \struct pipeSample
+ * \private
+ * \brief Sensor data of one cycle, from the acquisition to the estimation (pipelined loop)
+ */
+typedef struct {
+    uint64_t            stamp;                      //!< get_nsec_mono() at the start of the cycle
+    uint64_t            time;                       //!< Time of the cycle (get_nsec())
+    Drone_DataExchange  data;                       //!< Sensor data
+} pipeSample;
+
+/*!
+ * \struct pipeCommand
+ * \private
+ * \brief Output of the PID, from the estimation to the actuation (pipelined loop)
+ */
+typedef struct {
+    uint64_t            stamp;                      //!< get_nsec_mono() at the start of the cycle
+    uint64_t            time;                       //!< Time of the cycle (get_nsec())
+    float               dt;                         //!< Duration of the cycle
+    uint32_t            power[4];                   //!< PWM of the motors
+} pipeCommand;
+
+/*!
+ * \struct pipeFeedback
+ * \private
+ * \brief Remote control and motor state, from the actuation back to the estimation (pipelined loop)
+ */
+typedef struct {
+    Drone_Command       comm;                       //!< Last command of the remote control
+    float               dt_accu;                    //!< Time since the last PWM output
+    float               volt;                       //!< Battery
+} pipeFeedback;
+
 /*!
  * \struct Drone
  * \brief Drone type. To make the drone fly, you only need this type.
@@ -47,7 +138,22 @@ struct Drone {
     Drone_SPI*              spi;                    //!< \private All SPI devices
     Drone_AHRS*             ahrs;                   //!< \private attitude and heading reference system (AHRS)
     Drone_DataExchange*     data;                   //!< \private I2C data needed to be exchanged;
+    Drone_Scheduler*        sched;                  //!< \private Decide in which cycle each device is refreshed
+    Drone_Histogram*        stage[nStage];          //!< \private Latency of each stage of the loop
+    uint64_t                stageTime[nStage];      //!< \private Latency of each stage in the current cycle
+    Drone_Histogram*        age[nSensor];           //!< \private Age of the sample of each sensor at the estimation
+    uint64_t                stageOverhead;          //!< \private Cost of the stage timing per cycle (ns)
     uint64_t                lastUpdate;             //!< \private Last time of data update
+    uint64_t                loopTime;               //!< \private Duration of the loop on get_nsec() (virtual in replay)
+    uint64_t                loopWallTime;           //!< \private Real duration of the loop
+    bool                    replay;                 //!< \private The bus replays a recording : nothing sleeps
+    bool                    pipelined;              //!< \private Acquisition, estimation and actuation on their own cores
+    bool                    caliCached;             //!< \private The I2C calibration comes from its cache
+    Drone_RingBuffer*       sampleRing;             //!< \private Acquisition to estimation (pipeSample)
+    Drone_RingBuffer*       commandRing;            //!< \private Estimation to actuation (pipeCommand)
+    Drone_RingBuffer*       feedbackRing;           //!< \private Actuation to estimation (pipeFeedback)
+    atomic_int              stop;                   //!< \private The pipelined loop has to stop
+    uint32_t                nLocked;                //!< \private Cycles started on the data-ready edge of L3G4200D
     struct timespec         pause;
 };
 
@@ -58,6 +164,17 @@ static int generateFileName(char*);             //!< \private \memberof Drone \b
 static void* Calibration_I2C_Thread(void*);     //!< \private \memberof Drone \brief generate a thread for I2C calibration
 static void* Calibration_SPI_Thread(void*);     //!< \private \memberof Drone \brief generate a thread for SPI calibration
 static void Drone_Loop(Drone*);                 //!< \private \memberof Drone \brief Loop for I2C/SPI/AHRS/I2C
+static int Drone_Loop_Wait(Drone*, float);      //!< \private \memberof Drone \brief Sleep until the next cycle
+static void Drone_Loop_Sleep(Drone*);           //!< \private \memberof Drone \brief Sleep until the start of the cycle
+static void Drone_Loop_Pipelined(Drone*);       //!< \private \memberof Drone \brief Acquisition stage of the pipelined loop
+static void* Pipeline_Estimation_Thread(void*); //!< \private \memberof Drone \brief Estimation and PID stage
+static void* Pipeline_Actuation_Thread(void*);  //!< \private \memberof Drone \brief PWM output and RF stage
+static int Pipeline_Wait(Drone*, Drone_RingBuffer*, void*);     //!< \private \memberof Drone \brief Wait for the previous stage
+static void Pipeline_SetCPU(int, const char*);  //!< \private \memberof Drone \brief Move the calling thread to its core
+static void Drone_Loop_Stage(Drone*, loopStage, uint64_t*); //!< \private \memberof Drone \brief Time one stage
+static uint64_t Drone_Loop_StageOverhead(void);     //!< \private \memberof Drone \brief Cost of the stage timing
+static void Drone_Loop_PrintStage(Drone*, FILE*);   //!< \private \memberof Drone \brief Print the latency report
+static void Drone_Loop_SampleAge(Drone*, Drone_DataExchange*);  //!< \private \memberof Drone \brief Age of the samples used by the estimation
 
 static uint64_t currentTime;
 
@@ -74,8 +191,8 @@ int Drone_Init(Drone** rpiDrone)
     printf("%s\n", (*rpiDrone)->logfileName);
 #endif
 
-    if (!bcm2835_init()) {
-        perror("bcm2835_init error");
+    if (Drone_Bus_Init()) {
+        perror("Drone_Bus_Init error");
         return -2;
     }
 
@@ -99,6 +216,26 @@ int Drone_Init(Drone** rpiDrone)
         return -6;
     }
 
+    if (Drone_Scheduler_Init(&(*rpiDrone)->sched, PERIOD)) {
+        perror("Drone Scheduler Init error");
+        return -7;
+    }
+
+    for (int i=0; i<nStage; ++i) {
+        if (Drone_Histogram_Init(&(*rpiDrone)->stage[i], stageName[i])) {
+            perror("Drone Histogram Init error");
+            return -8;
+        }
+    }
+    for (int i=0; i<nSensor; ++i) {
+        if (Drone_Histogram_Init(&(*rpiDrone)->age[i], sampleName[i])) {
+            perror("Drone Histogram Init error");
+            return -8;
+        }
+    }
+    (*rpiDrone)->stageOverhead = Drone_Loop_StageOverhead();
+    (*rpiDrone)->replay = Drone_Bus_Replay_IsActive();
+
     return 0;
 }
 
@@ -109,13 +246,40 @@ void Drone_Start(Drone* rpiDrone)
 #endif
     Drone_SPI_Start(rpiDrone->spi, rpiDrone->data);
     Drone_I2C_Start(rpiDrone->i2c);
+    // Neither sets errno : the reason is printed here, not by perror()
+    int ret = Drone_I2C_Schedule(rpiDrone->i2c, rpiDrone->sched) + Drone_SPI_Schedule(rpiDrone->spi, rpiDrone->sched);
+    if (ret) {
+        fprintf(stderr, "Drone Scheduler error : %d devices left out\n", -ret);
+        return;
+    }
+    if (Drone_Scheduler_Plan(rpiDrone->sched)) {
+        for (int b=0; b<SCHEDULER_NBUS; ++b) {
+            if (Drone_Scheduler_GetPeak(rpiDrone->sched, b) <= Drone_Scheduler_GetBudget(rpiDrone->sched, b)) continue;
+            fprintf(stderr, "Drone Scheduler plan error : bus %d peak load %u us, budget %u us\n", b,
+                    Drone_Scheduler_GetPeak(rpiDrone->sched, b), Drone_Scheduler_GetBudget(rpiDrone->sched, b));
+        }
+        return;
+    }
     rpiDrone->lastUpdate = get_nsec();
-    Drone_Loop(rpiDrone);
+    // A replay is meant to be reproducible, the stages of the pipeline would not be
+    if (rpiDrone->pipelined && !rpiDrone->replay) Drone_Loop_Pipelined(rpiDrone);
+    else Drone_Loop(rpiDrone);
+}
+
+void Drone_SetPipelined(Drone* rpiDrone, int pipelined)
+{
+    rpiDrone->pipelined = pipelined;
+}
+
+int Drone_SetEstimator(Drone* rpiDrone, const char* name)
+{
+    return Drone_AHRS_SetEstimator(rpiDrone->ahrs, name);
 }
 
 int Drone_Calibration(Drone* rpiDrone)
 {
     pthread_t thread_cali[NUM_CALI_THREADS];
+    rpiDrone->caliCached = !Drone_I2C_LoadCalibration(rpiDrone->i2c);
     pthread_create(&thread_cali[0], NULL, Calibration_I2C_Thread, (void*) rpiDrone);
     pthread_create(&thread_cali[1], NULL, Calibration_SPI_Thread, (void*) rpiDrone);
     for (int i=0; i<NUM_CALI_THREADS; ++i) pthread_join(thread_cali[i],NULL);
@@ -126,6 +290,8 @@ int Drone_Calibration(Drone* rpiDrone)
 
 int Drone_End(Drone** rpiDrone)
 {
+    Drone_Scheduler_End(&(*rpiDrone)->sched);         // Before the devices, it prints their names
+
     if (Drone_I2C_End(&(*rpiDrone)->i2c)) {
         perror("Drone I2C End error");
         return -1;
@@ -140,9 +306,22 @@ int Drone_End(Drone** rpiDrone)
     Drone_DataExchange_End(&(*rpiDrone)->data);
     fclose((*rpiDrone)->fLog);
 
-    FILE* forg = fopen((*rpiDrone)->logfileName, "rb");
     char output[LENGTH];
     strcpy(output, (*rpiDrone)->logfileName);
+    strcat(output, ".lat");
+    FILE* flat = fopen(output, "w");
+    if (flat) {
+        Drone_Loop_PrintStage(*rpiDrone, flat);
+        fclose(flat);
+    }
+#ifdef  DEBUG
+    Drone_Loop_PrintStage(*rpiDrone, stdout);
+#endif
+    for (int i=0; i<nStage; ++i) Drone_Histogram_End(&(*rpiDrone)->stage[i]);
+    for (int i=0; i<nSensor; ++i) Drone_Histogram_End(&(*rpiDrone)->age[i]);
+
+    FILE* forg = fopen((*rpiDrone)->logfileName, "rb");
+    strcpy(output, (*rpiDrone)->logfileName);
     strcat(output, ".out");
 
     Drone_DataExchange data;
@@ -160,7 +339,7 @@ int Drone_End(Drone** rpiDrone)
 #ifdef  DEBUG
     puts("End Test");
 #endif
-    return bcm2835_close();
+    return Drone_Bus_Close();
 }
 
 static void getTimeString(char* timeStr)
@@ -215,70 +394,337 @@ static int generateFileName(char* fileName)
 static void* Calibration_I2C_Thread(void* temp)
 {
     Drone* rpiDrone = (Drone*) temp;
-    Drone_I2C_Calibration(rpiDrone->i2c);
+    if (!rpiDrone->caliCached) Drone_I2C_Calibration(rpiDrone->i2c);
     pthread_exit(NULL);
 }
 
 static void* Calibration_SPI_Thread(void* temp)
 {
     Drone* rpiDrone = (Drone*) temp;
-    Drone_SPI_Calibration(rpiDrone->spi);
+    Drone_SPI_Calibration(rpiDrone->spi, rpiDrone->caliCached);
     pthread_exit(NULL);
 }
 
 void Drone_Loop(Drone* rpiDrone)
 {
-    rpiDrone->lastUpdate = get_nsec();
+    Drone_Bus_Tick(&rpiDrone->lastUpdate);
     clock_gettime(CLOCK_MONOTONIC, &rpiDrone->pause);
-#ifndef DEBUG_VALGRIND
-    const float latency = (float)PERIOD/1000000000.0;
-#endif
     float dt;
     iStep = 0;
     int ret;
+    uint64_t stamp;
+    uint64_t loopStart = rpiDrone->lastUpdate, loopWallStart = get_nsec_mono();
     while (rpiDrone->data->comm.switchValue && rpiDrone->data->comm.zeroCount < 100 ) {
         ret = 0;
-        currentTime = get_nsec();
-        rpiDrone->pause.tv_nsec += PERIOD;
-
-        // Normalize the time to account for the second boundary
-        if(rpiDrone->pause.tv_nsec >= BILLION) {
-            rpiDrone->pause.tv_nsec -= BILLION;
-            rpiDrone->pause.tv_sec++;
-        }
+        if (Drone_Bus_Tick(&currentTime)) break;        // End of the replay
+        Drone_Scheduler_NextCycle(rpiDrone->sched);
         dt = (float)(currentTime - rpiDrone->lastUpdate)/BILLION;
         rpiDrone->data->dt = dt;
         rpiDrone->data->T += dt;
+        stamp = get_nsec_mono();
+        uint64_t cycleStart = stamp;
         ret += Drone_I2C_ExchangeData(rpiDrone->data, rpiDrone->i2c, &currentTime, false);
+        Drone_Loop_Stage(rpiDrone, stageAccGyr, &stamp);
+        Drone_Loop_SampleAge(rpiDrone, rpiDrone->data);
         Drone_AHRS_ExchangeData(rpiDrone->data, rpiDrone->ahrs);
+        Drone_Loop_Stage(rpiDrone, stageAHRS, &stamp);
         ret += Drone_I2C_ExchangeData(rpiDrone->data, rpiDrone->i2c, &currentTime, true);
+        Drone_Loop_Stage(rpiDrone, stagePWM, &stamp);
         ret += Drone_SPI_ExchangeData(rpiDrone->data, rpiDrone->spi, &currentTime);
+        Drone_Loop_Stage(rpiDrone, stageSPI, &stamp);
         Drone_DataExchange_SaveFile(rpiDrone->data);
+        Drone_Loop_Stage(rpiDrone, stageSave, &stamp);
+        Drone_Loop_Stage(rpiDrone, stageCycle, &cycleStart);
 
 #ifdef  DEBUG
         if (!(iStep%1000)) Drone_DataExchange_PrintAngle(rpiDrone->data);
 #endif
 
         rpiDrone->lastUpdate = currentTime;
-#ifdef DEBUG_VALGRIND
-        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &rpiDrone->pause, NULL);
+        if (Drone_Loop_Wait(rpiDrone, dt)) break;
+        ++iStep;
+    }
+    rpiDrone->loopTime = rpiDrone->lastUpdate - loopStart;
+    rpiDrone->loopWallTime = get_nsec_mono() - loopWallStart;
+
+#ifdef  DEBUG
+    if (rpiDrone->data->comm.zeroCount >= 100) {
+        puts("No signal!");
+    }
+#endif
+
+}
+
+static int Drone_Loop_Wait(Drone* rpiDrone, float dt)
+{
+    // As fast as possible in replay : the next cycle starts at the recorded time
+    if (rpiDrone->replay) return 0;
+    rpiDrone->pause.tv_nsec += PERIOD;
+
+    // Normalize the time to account for the second boundary
+    if(rpiDrone->pause.tv_nsec >= BILLION) {
+        rpiDrone->pause.tv_nsec -= BILLION;
+        rpiDrone->pause.tv_sec++;
+    }
+    uint64_t stamp = (uint64_t)rpiDrone->pause.tv_sec * BILLION + rpiDrone->pause.tv_nsec;
+#if defined(DEBUG_VALGRIND) || defined(DRONE_SIMULATION)
+    // No motor to protect : a late cycle (desktop scheduling) only shows up in the Wakeup histogram
+    Drone_Loop_Sleep(rpiDrone);
+    Drone_Loop_Stage(rpiDrone, stageWakeup, &stamp);
 #else
-        if (dt-latency < 0.003) {
-            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &rpiDrone->pause, NULL);
-        } else {
+    const float latency = (float)PERIOD/1000000000.0;
+    if (dt-latency < 0.003) {
+        Drone_Loop_Sleep(rpiDrone);
+        Drone_Loop_Stage(rpiDrone, stageWakeup, &stamp);
+    } else {
 #ifdef  DEBUG
-            printf("At %u you get problem for the timing! You got latency = %f !\n", iStep, dt);
+        printf("At %u you get problem for the timing! You got latency = %f !\n", iStep, dt);
+        for (int i=0; i<stageCycle; ++i) printf("%s : %f us\n", stageName[i], rpiDrone->stageTime[i]/1000.0);
 #endif
-            break;
-        }
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+static void Drone_Loop_Sleep(Drone* rpiDrone)
+{
+#ifdef  I2C_DRDY_LOCK
+    // The cycle starts on the data-ready edge of the gyroscope if it comes within DRDY_LOCK_WINDOW of the planned
+    // start : the samples are then always read at the same age, the period follows the clock of L3G4200D
+    struct timespec early = rpiDrone->pause;
+    early.tv_nsec -= DRDY_LOCK_WINDOW;
+    if (early.tv_nsec < 0) {
+        early.tv_nsec += BILLION;
+        early.tv_sec--;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &early, NULL);
+    if (Drone_Bus_GPIO_EventWait(DRDY_PIN_L3G4200D, 2*DRDY_LOCK_WINDOW)) {
+        clock_gettime(CLOCK_MONOTONIC, &rpiDrone->pause);
+        ++rpiDrone->nLocked;
+        return;
+    }
 #endif
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &rpiDrone->pause, NULL);
+}
+
+static void Drone_Loop_Pipelined(Drone* rpiDrone)
+{
+    pthread_t thread_pipe[2];
+    pipeSample sample;
+    uint64_t stamp, cycleStart;
+    float dt;
+    if (Drone_RingBuffer_Init(&rpiDrone->sampleRing, sizeof(pipeSample), PIPELINE_RINGSIZE) ||
+        Drone_RingBuffer_Init(&rpiDrone->commandRing, sizeof(pipeCommand), PIPELINE_RINGSIZE) ||
+        Drone_RingBuffer_Init(&rpiDrone->feedbackRing, sizeof(pipeFeedback), PIPELINE_RINGSIZE)) {
+        perror("Pipeline ring Init error");
+        // The rings not created yet are still NULL
+        if (rpiDrone->sampleRing) Drone_RingBuffer_End(&rpiDrone->sampleRing);
+        if (rpiDrone->commandRing) Drone_RingBuffer_End(&rpiDrone->commandRing);
+        if (rpiDrone->feedbackRing) Drone_RingBuffer_End(&rpiDrone->feedbackRing);
+        return;
+    }
+    // Each stage works on its own copy of the data, rpiDrone->data belongs to the estimation
+    sample.data = *rpiDrone->data;
+    atomic_store(&rpiDrone->stop, 0);
+    pthread_create(&thread_pipe[0], NULL, Pipeline_Estimation_Thread, (void*) rpiDrone);
+    pthread_create(&thread_pipe[1], NULL, Pipeline_Actuation_Thread, (void*) rpiDrone);
+    Pipeline_SetCPU(PIPELINE_CPU_ACQ, "acquisition");
+
+    Drone_Bus_Tick(&rpiDrone->lastUpdate);
+    clock_gettime(CLOCK_MONOTONIC, &rpiDrone->pause);
+    iStep = 0;
+    uint64_t loopStart = rpiDrone->lastUpdate, loopWallStart = get_nsec_mono();
+    while (!atomic_load_explicit(&rpiDrone->stop, memory_order_relaxed)) {
+        if (Drone_Bus_Tick(&currentTime)) break;
+        Drone_Scheduler_NextCycle(rpiDrone->sched);
+        dt = (float)(currentTime - rpiDrone->lastUpdate)/BILLION;
+        sample.data.dt = dt;
+        sample.data.T += dt;
+        stamp = cycleStart = sample.stamp = get_nsec_mono();
+        sample.time = currentTime;
+        Drone_I2C_ExchangeData(&sample.data, rpiDrone->i2c, &currentTime, false);
+        Drone_Loop_Stage(rpiDrone, stageAccGyr, &stamp);
+        Drone_I2C_ExchangeSensor(&sample.data, rpiDrone->i2c, &currentTime);
+        Drone_Loop_Stage(rpiDrone, stagePWM, &stamp);
+        Drone_RingBuffer_Push(rpiDrone->sampleRing, &sample);
+        Drone_Loop_Stage(rpiDrone, stageCycle, &cycleStart);
+
+        rpiDrone->lastUpdate = currentTime;
+        if (Drone_Loop_Wait(rpiDrone, dt)) break;
         ++iStep;
     }
+    atomic_store(&rpiDrone->stop, 1);
+    for (int i=0; i<2; ++i) pthread_join(thread_pipe[i], NULL);
+    rpiDrone->loopTime = rpiDrone->lastUpdate - loopStart;
+    rpiDrone->loopWallTime = get_nsec_mono() - loopWallStart;
 
 #ifdef  DEBUG
+    printf("Pipeline : %llu samples, %llu commands, %llu feedbacks dropped\n",
+           (unsigned long long)Drone_RingBuffer_GetOverflow(rpiDrone->sampleRing),
+           (unsigned long long)Drone_RingBuffer_GetOverflow(rpiDrone->commandRing),
+           (unsigned long long)Drone_RingBuffer_GetOverflow(rpiDrone->feedbackRing));
     if (rpiDrone->data->comm.zeroCount >= 100) {
         puts("No signal!");
     }
 #endif
+    Drone_RingBuffer_End(&rpiDrone->sampleRing);
+    Drone_RingBuffer_End(&rpiDrone->commandRing);
+    Drone_RingBuffer_End(&rpiDrone->feedbackRing);
+}
 
+static void* Pipeline_Estimation_Thread(void* temp)
+{
+    Drone* rpiDrone = (Drone*) temp;
+    Drone_DataExchange* data = rpiDrone->data;
+    pipeSample sample;
+    pipeFeedback feedback;
+    pipeCommand command;
+    uint64_t stamp;
+    int32_t n = 0;
+    Pipeline_SetCPU(PIPELINE_CPU_EST, "estimation");
+    while (!Pipeline_Wait(rpiDrone, rpiDrone->sampleRing, &sample)) {
+        stamp = get_nsec_mono();
+        while (!Drone_RingBuffer_Pop(rpiDrone->feedbackRing, &feedback)) {
+            data->comm = feedback.comm;
+            data->dt_accu = feedback.dt_accu;
+            data->volt = feedback.volt;
+        }
+        data->T = sample.data.T;
+        data->dt = sample.data.dt;
+        memcpy(data->acc, sample.data.acc, sizeof(data->acc));
+        memcpy(data->acc_est, sample.data.acc_est, sizeof(data->acc_est));
+        memcpy(data->gyr, sample.data.gyr, sizeof(data->gyr));
+        memcpy(data->gyr_est, sample.data.gyr_est, sizeof(data->gyr_est));
+        data->accTime = sample.data.accTime;
+        data->gyrTime = sample.data.gyrTime;
+        data->accFresh = sample.data.accFresh;
+        data->gyrFresh = sample.data.gyrFresh;
+        data->nGyr = sample.data.nGyr;
+        memcpy(data->gyrSample, sample.data.gyrSample, sample.data.nGyr*sizeof(data->gyrSample[0]));
+        memcpy(data->gyrDt, sample.data.gyrDt, sample.data.nGyr*sizeof(data->gyrDt[0]));
+        data->magFresh = sample.data.magFresh;
+        if (data->magFresh) {
+            // The correction is applied once per sample, with the power of the motors
+            memcpy(data->mag, sample.data.mag, sizeof(data->mag));
+            memcpy(data->mag_est, sample.data.mag_est, sizeof(data->mag_est));
+            data->magTime = sample.data.magTime;
+            Drone_I2C_MagCorrection(data);
+        }
+        data->attitude = sample.data.attitude;
+        data->att_est = sample.data.att_est;
+        data->attitudeHT = sample.data.attitudeHT;
+        data->attHT_est = sample.data.attHT_est;
+        data->attTime = sample.data.attTime;
+        data->attHTTime = sample.data.attHTTime;
+        data->attFresh = sample.data.attFresh;
+        data->attHTFresh = sample.data.attHTFresh;
+        Drone_Loop_SampleAge(rpiDrone, data);
+        Drone_AHRS_ExchangeData(data, rpiDrone->ahrs);
+        command.stamp = sample.stamp;
+        command.time = sample.time;
+        command.dt = data->dt;
+        memcpy(command.power, data->power, sizeof(command.power));
+        Drone_RingBuffer_Push(rpiDrone->commandRing, &command);
+        Drone_Loop_Stage(rpiDrone, stageAHRS, &stamp);
+        Drone_DataExchange_SaveFile(data);
+        Drone_Loop_Stage(rpiDrone, stageSave, &stamp);
+#ifdef  DEBUG
+        if (!(n%1000)) Drone_DataExchange_PrintAngle(data);
+#endif
+        ++n;
+    }
+    pthread_exit(NULL);
+}
+
+static void* Pipeline_Actuation_Thread(void* temp)
+{
+    Drone* rpiDrone = (Drone*) temp;
+    Drone_DataExchange data = *rpiDrone->data;
+    pipeCommand command;
+    pipeFeedback feedback;
+    uint64_t stamp;
+    Pipeline_SetCPU(PIPELINE_CPU_ACT, "actuation");
+    while (!Pipeline_Wait(rpiDrone, rpiDrone->commandRing, &command)) {
+        stamp = get_nsec_mono();
+        data.dt = command.dt;
+        memcpy(data.power, command.power, sizeof(data.power));
+        Drone_I2C_ExchangeMotor(&data, rpiDrone->i2c, &command.time);
+        Drone_Loop_Stage(rpiDrone, stageMotor, &stamp);
+        Drone_Loop_Stage(rpiDrone, stagePipeline, &command.stamp);
+        Drone_SPI_ExchangeData(&data, rpiDrone->spi, &command.time);
+        feedback.comm = data.comm;
+        feedback.dt_accu = data.dt_accu;
+        feedback.volt = data.volt;
+        Drone_RingBuffer_Push(rpiDrone->feedbackRing, &feedback);
+        Drone_Loop_Stage(rpiDrone, stageSPI, &stamp);
+        if (!data.comm.switchValue || data.comm.zeroCount >= 100) atomic_store(&rpiDrone->stop, 1);
+    }
+    pthread_exit(NULL);
+}
+
+static int Pipeline_Wait(Drone* rpiDrone, Drone_RingBuffer* ring, void* elem)
+{
+    // The stages have their own cores : spin, but let the other threads of a shared core run
+    while (Drone_RingBuffer_Pop(ring, elem)) {
+        if (atomic_load_explicit(&rpiDrone->stop, memory_order_relaxed)) return -1;
+        sched_yield();
+    }
+    return 0;
+}
+
+static void Pipeline_SetCPU(int cpu, const char* name)
+{
+    cpu_set_t cmask;
+    CPU_ZERO(&cmask);
+    CPU_SET(cpu, &cmask);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cmask), &cmask)) {
+        fprintf(stderr, "Pipeline : no CPU %d, the %s stays with the other threads\n", cpu, name);
+    }
+}
+
+static inline void Drone_Loop_Stage(Drone* rpiDrone, loopStage s, uint64_t* stamp)
+{
+    uint64_t now = get_nsec_mono();
+    uint64_t elapsed = now > *stamp ? now - *stamp : 0;
+    rpiDrone->stageTime[s] = elapsed;
+    Drone_Histogram_Record(rpiDrone->stage[s], elapsed);
+    *stamp = now;
+}
+
+static uint64_t Drone_Loop_StageOverhead(void)
+{
+    Drone_Histogram* h;
+    if (Drone_Histogram_Init(&h, "Overhead")) return 0;
+    uint64_t start = get_nsec_mono(), stamp = start, now;
+    for (int i=0; i<N_OVERHEAD_SAMPLE; ++i) {
+        now = get_nsec_mono();
+        Drone_Histogram_Record(h, now - stamp);
+        stamp = now;
+    }
+    Drone_Histogram_End(&h);
+    // One time stamp and one record per stage, plus the start of the cycle
+    return (get_nsec_mono() - start) * (nStage + 1) / N_OVERHEAD_SAMPLE;
+}
+
+static void Drone_Loop_SampleAge(Drone* rpiDrone, Drone_DataExchange* data)
+{
+    const uint64_t sampled[nSensor] = {data->accTime, data->gyrTime, data->magTime, data->attTime, data->attHTTime};
+    uint64_t now = get_nsec();
+    for (int i=0; i<nSensor; ++i) {
+        if (sampled[i] && now > sampled[i]) Drone_Histogram_Record(rpiDrone->age[i], now - sampled[i]);
+    }
+}
+
+static void Drone_Loop_PrintStage(Drone* rpiDrone, FILE* fp)
+{
+    for (int i=0; i<nStage; ++i) Drone_Histogram_Print(rpiDrone->stage[i], fp);
+    for (int i=0; i<nSensor; ++i) Drone_Histogram_Print(rpiDrone->age[i], fp);
+    fprintf(fp, "Timing overhead : %llu ns per cycle\n", (unsigned long long)rpiDrone->stageOverhead);
+    float wall = (float)rpiDrone->loopWallTime/BILLION;
+    fprintf(fp, "Loop%s : %d cycles, %.3f s of flight in %.3f s (%.0f cycles/s)\n", rpiDrone->replay ? " (replay)" : "",
+            iStep, (float)rpiDrone->loopTime/BILLION, wall, wall > 0.0f ? iStep/wall : 0.0f);
+#ifdef  I2C_DRDY_LOCK
+    fprintf(fp, "Loop : %u cycles started on the data-ready edge of L3G4200D\n", rpiDrone->nLocked);
+#endif
 }
@@ -1,25 +1,152 @@
 #include "RTPiDrone_header.h"
 #include "RTPiDrone_AHRS.h"
 #include "RTPiDrone_Quaternion.h"
+#include "RTPiDrone_EKF.h"
+#include "RTPiDrone_Madgwick.h"
 #include "RTPiDrone_PID.h"
+#include "RTPiDrone_Notch.h"
 #include "Common.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*!
+ * \struct Drone_AHRS_Estimator
+ * \brief Functions of one attitude estimator
+ */
+typedef struct {
+    const char* name;                                                       //!< \private Name given to Drone_AHRS_SetEstimator()
+    int  (*init)(void**, float*);                                           //!< \private Creation at the given angles
+    void (*end)(void**);                                                    //!< \private Destruction
+    void (*renew)(void*, float, float*, float*, float*);                    //!< \private One gyro sample over dt, acc, gyr, mag
+    void (*renewSamples)(void*, float*, float (*)[3], float*, int, float*); //!< \private The gyro samples of a cycle
+    void (*getAngle)(void*, float*);                                        //!< \private Roll, pitch and yaw (degree)
+    int  magFreshOnly;                                                      //!< \private The magnetic field is NULL without a new sample
+} Drone_AHRS_Estimator;
 
 static float pi[] = {2.5,0.005};
+static float beta = 0.1;
+
+static int Mahony_init(void** Q, float* angle)
+{
+    return Drone_Quaternion_Init((Drone_Quaternion**)Q, angle, pi);
+}
+
+static void Mahony_end(void** Q)
+{
+    Drone_Quaternion_Delete((Drone_Quaternion**)Q);
+}
+
+static void Mahony_renew(void* Q, float dt, float* acc, float* gyr, float* mag)
+{
+    Drone_Quaternion_renew(Q, dt, acc, gyr, mag);
+}
+
+static void Mahony_renewSamples(void* Q, float* acc, float (*gyr)[3], float* dt, int n, float* mag)
+{
+    Drone_Quaternion_renewSamples(Q, acc, gyr, dt, n, mag);
+}
+
+static void Mahony_getAngle(void* Q, float* angle)
+{
+    Drone_Quaternion_getAngle(Q, angle);
+}
+
+static int EKF_init(void** E, float* angle)
+{
+    return Drone_EKF_Init((Drone_EKF**)E, angle);
+}
+
+static void EKF_end(void** E)
+{
+    Drone_EKF_Delete((Drone_EKF**)E);
+}
+
+static void EKF_renew(void* E, float dt, float* acc, float* gyr, float* mag)
+{
+    Drone_EKF_renew(E, dt, acc, gyr, mag);
+}
+
+static void EKF_renewSamples(void* E, float* acc, float (*gyr)[3], float* dt, int n, float* mag)
+{
+    Drone_EKF_renewSamples(E, acc, gyr, dt, n, mag);
+}
+
+static void EKF_getAngle(void* E, float* angle)
+{
+    Drone_EKF_getAngle(E, angle);
+}
+
+static int Madgwick_init(void** M, float* angle)
+{
+    return Drone_Madgwick_Init((Drone_Madgwick**)M, angle, beta);
+}
+
+static void Madgwick_end(void** M)
+{
+    Drone_Madgwick_Delete((Drone_Madgwick**)M);
+}
+
+static void Madgwick_renew(void* M, float dt, float* acc, float* gyr, float* mag)
+{
+    Drone_Madgwick_renew(M, dt, acc, gyr, mag);
+}
+
+static void Madgwick_renewSamples(void* M, float* acc, float (*gyr)[3], float* dt, int n, float* mag)
+{
+    Drone_Madgwick_renewSamples(M, acc, gyr, dt, n, mag);
+}
+
+static void Madgwick_getAngle(void* M, float* angle)
+{
+    Drone_Madgwick_getAngle(M, angle);
+}
+
+static const Drone_AHRS_Estimator estimator[DRONE_AHRS_NESTIMATOR] = {
+    {"mahony",   Mahony_init,   Mahony_end,   Mahony_renew,   Mahony_renewSamples,   Mahony_getAngle,   0},
+    {"ekf",      EKF_init,      EKF_end,      EKF_renew,      EKF_renewSamples,      EKF_getAngle,      0},
+    {"madgwick", Madgwick_init, Madgwick_end, Madgwick_renew, Madgwick_renewSamples, Madgwick_getAngle, 1},
+};
+
 struct Drone_AHRS {
-    Drone_Quaternion*   Quaternion;
+    const Drone_AHRS_Estimator* est;    // Estimator of the attitude
+    void*               state;          // Its object
     Drone_PID*          PID;
+    uint64_t            gyrTime;        // Time of the last gyro sample integrated
+#ifdef  GYRO_NOTCH
+    Drone_Notch*        notch;          // Notches on the motor vibration, before the D term
+#endif
 };
 
 int Drone_AHRS_Init(Drone_AHRS** AHRS)
 {
     *AHRS = (Drone_AHRS*) calloc(1, sizeof(Drone_AHRS));
+    (*AHRS)->est = &estimator[DRONE_AHRS_MAHONY];
+#ifdef  GYRO_NOTCH
+    if (Drone_Notch_Init(&(*AHRS)->notch)) return -1;
+#endif
     return 0;
 }
 
+int Drone_AHRS_SetEstimator(Drone_AHRS* ahrs, const char* name)
+{
+    for (int i=0; i<DRONE_AHRS_NESTIMATOR; ++i) {
+        if (!strcmp(name, estimator[i].name)) {
+            ahrs->est = &estimator[i];
+            return 0;
+        }
+    }
+    fprintf(stderr, "AHRS : no estimator %s\n", name);
+    return -1;
+}
+
 void Drone_AHRS_End(Drone_AHRS** AHRS)
 {
-    Drone_Quaternion_Delete(&(*AHRS)->Quaternion);
+#ifdef  GYRO_NOTCH
+    if ((*AHRS)->notch) Drone_Notch_End(&(*AHRS)->notch);
+#endif
+    if ((*AHRS)->state) (*AHRS)->est->end(&(*AHRS)->state);
     Drone_PID_Delete(&(*AHRS)->PID);
     free(*AHRS);
     *AHRS = NULL;
@@ -27,23 +154,49 @@ void Drone_AHRS_End(Drone_AHRS** AHRS)
 
 void Drone_AHRS_DataInit(Drone_DataExchange* data, Drone_AHRS* ahrs)
 {
-    Drone_Quaternion_Init(&ahrs->Quaternion, data->angle, pi);
+    ahrs->est->init(&ahrs->state, data->angle);
     Drone_PID_Init(&ahrs->PID);
     for (int i=0; i<1000; ++i) {
-        Drone_Quaternion_renew(ahrs->Quaternion, 0.1, data->acc, data->gyr, data->mag);
+        ahrs->est->renew(ahrs->state, 0.1, data->acc, data->gyr, data->mag);
     }
-    Drone_Quaternion_getAngle(ahrs->Quaternion, data->angle);
+    ahrs->est->getAngle(ahrs->state, data->angle);
 
     data->comm.angle_expect[2] = data->angle[2];
 #ifdef  DEBUG
+    printf("AHRS : %s\n", ahrs->est->name);
     Drone_DataExchange_PrintAngle(data);
 #endif
 }
 
 void Drone_AHRS_ExchangeData(Drone_DataExchange* data, Drone_AHRS* ahrs)
 {
-    Drone_Quaternion_renew(ahrs->Quaternion, data->dt, data->acc_est, data->gyr, data->mag_est);
-    Drone_Quaternion_getAngle(ahrs->Quaternion, data->angle);
+    // The magnetic field of the cycles without a new sample is not given to the estimators asking so
+    float* mag = data->magFresh || !ahrs->est->magFreshOnly ? data->mag_est : NULL;
+#ifdef  L3G4200D_FIFO
+    // Without new samples, the attitude stays : the next read of the FIFO covers this cycle
+    if (data->nGyr) {
+        ahrs->est->renewSamples(ahrs->state, data->acc_est, data->gyrSample, data->gyrDt, data->nGyr, mag);
+    }
+#else
+    // Each gyro sample over the time from the previous one, a cycle without a new sample keeps the attitude
+    if (data->gyrFresh) {
+        float dt = ahrs->gyrTime ? (float)(data->gyrTime - ahrs->gyrTime)/1000000000.0f : data->dt;
+        ahrs->gyrTime = data->gyrTime;
+        ahrs->est->renew(ahrs->state, dt, data->acc_est, data->gyr, mag);
+    }
+#endif
+    ahrs->est->getAngle(ahrs->state, data->angle);
+#ifdef  GYRO_NOTCH
+    // Only the PID : the estimators integrate the gyro, the vibration is harmless to them
+    float gyr[3];
+#ifdef  L3G4200D_FIFO
+    // Every sample of the FIFO : the notches reach L3G4200D_FIFO_RATE/2 instead of half of the control rate
+    Drone_Notch_renewSamples(ahrs->notch, data->gyrSample, data->gyrDt, data->nGyr, data->gyrTime, gyr);
+#else
+    Drone_Notch_renew(ahrs->notch, data->gyr, data->gyrTime, data->gyrFresh, gyr);
+#endif
+    Drone_PID_update(ahrs->PID, data->comm.angle_expect, data->angle, gyr, data->power, data->dt + data->dt_accu, data->comm.power);
+#else
     Drone_PID_update(ahrs->PID, data->comm.angle_expect, data->angle, data->gyr, data->power, data->dt + data->dt_accu, data->comm.power);
+#endif
 }
-
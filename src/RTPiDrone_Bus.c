@@ -0,0 +1,373 @@
+/*! \file RTPiDrone_Bus.c
+    \brief Forward the bus operations to the selected backend
+ */
+#include "RTPiDrone_header.h"
+#include "RTPiDrone_Bus.h"
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef  DRONE_SIMULATION
+static const Drone_Bus_Backend* backend = &Drone_Bus_Sim;         //!< \private Backend in use
+#else
+static const Drone_Bus_Backend* backend = &Drone_Bus_BCM2835;     //!< \private Backend in use
+#endif
+static int isOpen = 0;                                              //!< \private Backend has been opened
+static uint8_t spiCS = DRONE_BUS_SPI_CS0;                           //!< \private Chip select of the SPI frames
+static pthread_mutex_t i2cLock = PTHREAD_MUTEX_INITIALIZER;         //!< \private One I2C transfer at a time (pipelined loop)
+
+static Drone_Bus_Event* record = NULL;                              //!< \private Recorded events (NULL if no recording)
+static atomic_uint nRecord;                                         //!< \private Number of events reserved in record
+static char recordFile[256];                                        //!< \private Where the recording is written
+static uint64_t recordStart;                                        //!< \private get_nsec() at Drone_Bus_Init()
+static atomic_ullong nTick;                                         //!< \private Number of control cycles
+static atomic_ullong nI2CCall;                                      //!< \private Number of calls of the I2C backend
+static atomic_ullong i2cTime;                                       //!< \private Time spent in the I2C backend (ns)
+
+/*!
+ * \struct Bus_I2C_Count
+ * \brief Reads of one slave address. Only the thread doing the transfers (the bus manager) updates them.
+ */
+typedef struct {
+    unsigned long long  nRead;                                      //!< \private Number of read messages
+    unsigned long long  nTransaction;                               //!< \private START ... STOP of these reads
+    uint64_t            time;                                       //!< \private Time of their transfers (ns)
+} Bus_I2C_Count;
+static Bus_I2C_Count i2cCount[128];                                 //!< \private Counters of each slave address
+
+static struct {
+    int         n;                                                  //!< \private Edges since Drone_Bus_GPIO_EventClear()
+    uint64_t    t;                                                  //!< \private get_nsec() of the last one
+} gpioEvent[DRONE_BUS_NGPIO];                                       //!< \private Edges of each GPIO, each one read by one thread
+
+static void Drone_Bus_Record_Add(uint64_t, uint8_t, uint8_t, uint8_t, const char*, uint32_t);    //!< \private \brief Record one event
+static void Drone_Bus_Record_Read(uint8_t, uint8_t, uint8_t, const char*, uint32_t);  //!< \private \brief Record the bytes of one read
+static int Drone_Bus_Record_Save(void);                             //!< \private \brief Write the recording
+static void Drone_Bus_I2C_Count(const Drone_Bus_I2C_Msg*, uint32_t, uint64_t);  //!< \private \brief Count the reads of one transfer
+
+int Drone_Bus_Record(const char* fileName)
+{
+    if (isOpen || record) return -1;
+    if (strlen(fileName) >= sizeof(recordFile)) return -2;
+    record = (Drone_Bus_Event*) malloc(sizeof(Drone_Bus_Event) * BUS_RECORD_SIZE);
+    if (!record) {
+        perror("Bus record allocation");
+        return -3;
+    }
+    strcpy(recordFile, fileName);
+    atomic_init(&nRecord, 0);
+    return 0;
+}
+
+int Drone_Bus_Record_IsActive(void)
+{
+    return record != NULL;
+}
+
+int Drone_Bus_Tick(uint64_t* now)
+{
+    atomic_fetch_add_explicit(&nTick, 1, memory_order_relaxed);
+    if (Drone_Bus_Replay_IsActive()) return Drone_Bus_Replay_Tick(now);
+    *now = get_nsec();
+    if (backend->tick) backend->tick(*now);
+    if (record) Drone_Bus_Record_Add(*now, DRONE_BUS_EVENT_TICK, 0, DRONE_BUS_OK, NULL, 0);
+    return 0;
+}
+
+static void Drone_Bus_Record_Add(uint64_t t, uint8_t type, uint8_t id, uint8_t status, const char* buf, uint32_t len)
+{
+    // Each thread reserves its own slot : the events of one device stay in the order of its driver
+    unsigned int i = atomic_fetch_add_explicit(&nRecord, 1, memory_order_relaxed);
+    if (i >= BUS_RECORD_SIZE) return;
+    Drone_Bus_Event* e = &record[i];
+    e->t = t;
+    e->type = type;
+    e->id = id;
+    e->status = status;
+    e->len = len < DRONE_BUS_EVENT_SIZE ? len : DRONE_BUS_EVENT_SIZE;
+    if (buf) memcpy(e->data, buf, e->len);
+}
+
+static void Drone_Bus_Record_Read(uint8_t type, uint8_t id, uint8_t status, const char* buf, uint32_t len)
+{
+    // A burst (FIFO) may be longer than one event : consecutive events of the same device
+    uint64_t t = get_nsec();
+    uint32_t n = 0;
+    do {
+        uint32_t chunk = len - n < DRONE_BUS_EVENT_SIZE ? len - n : DRONE_BUS_EVENT_SIZE;
+        Drone_Bus_Record_Add(t, type, id, status, buf + n, chunk);
+        n += chunk;
+    } while (n < len);
+}
+
+static int Drone_Bus_Record_Save(void)
+{
+    unsigned int n = atomic_load(&nRecord);
+    Drone_Bus_RecordHeader head = {DRONE_BUS_RECORD_MAGIC, recordStart, n < BUS_RECORD_SIZE ? n : BUS_RECORD_SIZE};
+    FILE* fp = fopen(recordFile, "wb");
+    if (!fp) {
+        perror("Bus record file");
+        return -1;
+    }
+    int ret = fwrite(&head, sizeof(head), 1, fp) != 1 || fwrite(record, sizeof(Drone_Bus_Event), head.nEvent, fp) != head.nEvent;
+    fclose(fp);
+#ifdef  DEBUG
+    printf("Bus : %llu events recorded in %s", (unsigned long long)head.nEvent, recordFile);
+    if (n > BUS_RECORD_SIZE) printf(", %u dropped (BUS_RECORD_SIZE)", n - BUS_RECORD_SIZE);
+    puts("");
+#endif
+    free(record);
+    record = NULL;
+    return ret ? -2 : 0;
+}
+
+void Drone_Bus_SetBackend(const Drone_Bus_Backend* b)
+{
+    if (isOpen) {
+        fprintf(stderr, "Bus : %s is already in use\n", backend->name);
+        return;
+    }
+    backend = b;
+}
+
+const char* Drone_Bus_GetName(void)
+{
+    return backend->name;
+}
+
+int Drone_Bus_Init(void)
+{
+    if (isOpen) return 0;
+    if (backend->init && backend->init()) {
+        perror("Bus init error");
+        return -1;
+    }
+    isOpen = 1;
+    recordStart = get_nsec();
+#ifdef  DEBUG
+    printf("Bus : %s\n", backend->name);
+#endif
+    return 0;
+}
+
+int Drone_Bus_Close(void)
+{
+    if (!isOpen) return 0;
+    isOpen = 0;
+#ifdef  DEBUG
+    unsigned long long tick = atomic_load(&nTick), call = atomic_load(&nI2CCall);
+    printf("Bus : %llu I2C calls of %s in %llu cycles (%.2f per cycle), %.1f us of I2C per cycle\n", call, backend->name, tick,
+           tick ? (double)call/tick : 0.0, tick ? atomic_load(&i2cTime)/1000.0/tick : 0.0);
+    for (int i=0; i<128; ++i) {
+        const Bus_I2C_Count* c = &i2cCount[i];
+        if (c->nRead) printf("Bus : 0x%02X %llu reads, %.2f transactions and %.1f us per read\n", i, c->nRead,
+                             (double)c->nTransaction/c->nRead, c->time/1000.0/c->nRead);
+    }
+#endif
+    int ret = backend->close ? backend->close() : 0;
+    if (record && Drone_Bus_Record_Save()) ret = -1;
+    return ret;
+}
+
+void Drone_Bus_I2C_Begin(void)
+{
+    if (backend->i2c_begin) backend->i2c_begin();
+}
+
+void Drone_Bus_I2C_End(void)
+{
+    if (backend->i2c_end) backend->i2c_end();
+}
+
+void Drone_Bus_I2C_SetClockDivider(uint16_t divider)
+{
+    if (backend->i2c_setClockDivider) backend->i2c_setClockDivider(divider);
+}
+
+uint8_t Drone_Bus_I2C_Write(uint8_t addr, const char* buf, uint32_t len)
+{
+    Drone_Bus_I2C_Msg msg = {addr, 0, len, (char*)buf};
+    return Drone_Bus_I2C_Transfer(&msg, 1);
+}
+
+uint8_t Drone_Bus_I2C_Read(uint8_t addr, char* buf, uint32_t len)
+{
+    Drone_Bus_I2C_Msg msg = {addr, 1, len, buf};
+    return Drone_Bus_I2C_Transfer(&msg, 1);
+}
+
+uint8_t Drone_Bus_I2C_ReadRegister(uint8_t addr, uint8_t reg, char* buf, uint32_t len)
+{
+    Drone_Bus_I2C_Msg msg[2] = {{addr, 0, 1, (char*)&reg}, {addr, 1, len, buf}};
+    return Drone_Bus_I2C_Transfer(msg, 2);
+}
+
+static void Drone_Bus_I2C_Count(const Drone_Bus_I2C_Msg* msg, uint32_t n, uint64_t elapsed)
+{
+    // A read right after a write to the same slave is in the same transaction if the backend does repeated starts
+    uint32_t nRead = 0;
+    for (uint32_t i=0; i<n; ++i) nRead += msg[i].isRead;
+    for (uint32_t i=0; i<n; ++i) {
+        if (!msg[i].isRead) continue;
+        Bus_I2C_Count* c = &i2cCount[msg[i].addr & 0x7F];
+        int afterWrite = i && !msg[i-1].isRead && msg[i-1].addr == msg[i].addr;
+        ++c->nRead;
+        c->nTransaction += (afterWrite && !backend->i2c_transfer) ? 2 : 1;
+        c->time += elapsed / nRead;                                 // Shared by the reads of the transfer
+    }
+}
+
+// Outside of the bus manager, several threads may share the controller : each transfer is atomic on the bus, a
+// register write and its read on the same slave keep working because each slave holds its own register pointer
+uint8_t Drone_Bus_I2C_Transfer(Drone_Bus_I2C_Msg* msg, uint32_t n)
+{
+    if (Drone_Bus_Manager_IsActive()) return Drone_Bus_Manager_Submit(msg, n);
+    pthread_mutex_lock(&i2cLock);
+    uint64_t start = get_nsec_mono();
+    uint8_t ret = DRONE_BUS_OK;
+    uint32_t nCall = n;
+    if (backend->i2c_transfer) {
+        ret = backend->i2c_transfer(msg, n);
+        nCall = 1;
+    } else {
+        // Every message is done even after an error : the replay serves as many reads as were recorded
+        for (uint32_t i=0; i<n; ++i) {
+            uint8_t r = msg[i].isRead ? backend->i2c_read(msg[i].addr, msg[i].buf, msg[i].len)
+                                      : backend->i2c_write(msg[i].addr, msg[i].buf, msg[i].len);
+            if (ret == DRONE_BUS_OK) ret = r;
+        }
+    }
+    uint64_t elapsed = get_nsec_mono() - start;
+    if (atomic_load_explicit(&nTick, memory_order_relaxed)) {      // Only the control loop, not the calibration
+        atomic_fetch_add_explicit(&nI2CCall, nCall, memory_order_relaxed);
+        atomic_fetch_add_explicit(&i2cTime, elapsed, memory_order_relaxed);
+    }
+    Drone_Bus_I2C_Count(msg, n, elapsed);
+    if (record) {
+        for (uint32_t i=0; i<n; ++i) {
+            if (msg[i].isRead) Drone_Bus_Record_Read(DRONE_BUS_EVENT_I2C, msg[i].addr, ret, msg[i].buf, msg[i].len);
+        }
+    }
+    pthread_mutex_unlock(&i2cLock);
+    return ret;
+}
+
+void Drone_Bus_SPI_Begin(void)
+{
+    if (backend->spi_begin) backend->spi_begin();
+}
+
+void Drone_Bus_SPI_End(void)
+{
+    if (backend->spi_end) backend->spi_end();
+}
+
+void Drone_Bus_SPI_SetBitOrder(uint8_t order)
+{
+    if (backend->spi_setBitOrder) backend->spi_setBitOrder(order);
+}
+
+void Drone_Bus_SPI_SetDataMode(uint8_t mode)
+{
+    if (backend->spi_setDataMode) backend->spi_setDataMode(mode);
+}
+
+void Drone_Bus_SPI_SetClockDivider(uint16_t divider)
+{
+    if (backend->spi_setClockDivider) backend->spi_setClockDivider(divider);
+}
+
+void Drone_Bus_SPI_ChipSelect(uint8_t cs)
+{
+    spiCS = cs & 0x03;                                              // As the CS field of the SPI0 register
+    if (backend->spi_chipSelect) backend->spi_chipSelect(cs);
+}
+
+void Drone_Bus_SPI_SetChipSelectPolarity(uint8_t cs, uint8_t active)
+{
+    if (backend->spi_setChipSelectPolarity) backend->spi_setChipSelectPolarity(cs, active);
+}
+
+uint8_t Drone_Bus_SPI_Transfer(uint8_t value)
+{
+    uint8_t ret = backend->spi_transfer(value);
+    if (record) Drone_Bus_Record_Add(get_nsec(), DRONE_BUS_EVENT_SPI, spiCS, DRONE_BUS_OK, (const char*)&ret, 1);
+    return ret;
+}
+
+void Drone_Bus_SPI_TransferNB(char* tbuf, char* rbuf, uint32_t len)
+{
+    backend->spi_transfernb(tbuf, rbuf, len);
+    if (record) Drone_Bus_Record_Read(DRONE_BUS_EVENT_SPI, spiCS, DRONE_BUS_OK, rbuf, len);
+}
+
+void Drone_Bus_GPIO_Fsel(uint8_t pin, uint8_t mode)
+{
+    if (backend->gpio_fsel) backend->gpio_fsel(pin, mode);
+}
+
+void Drone_Bus_GPIO_Write(uint8_t pin, uint8_t on)
+{
+    if (backend->gpio_write) backend->gpio_write(pin, on);
+}
+
+int Drone_Bus_GPIO_EventRequest(uint8_t pin, uint8_t edge)
+{
+    if (pin >= DRONE_BUS_NGPIO) return -1;
+    gpioEvent[pin].n = 0;
+    return backend->gpio_eventRequest ? backend->gpio_eventRequest(pin, edge) : -2;
+}
+
+int Drone_Bus_GPIO_EventPending(uint8_t pin, uint64_t* t)
+{
+    if (pin >= DRONE_BUS_NGPIO) return 0;
+    uint64_t last = 0;
+    int32_t n = backend->gpio_eventRead ? backend->gpio_eventRead(pin, &last) : 0;
+    if (record) {
+        char buf[sizeof(n) + sizeof(last)];
+        memcpy(buf, &n, sizeof(n));
+        memcpy(buf + sizeof(n), &last, sizeof(last));
+        Drone_Bus_Record_Add(get_nsec(), DRONE_BUS_EVENT_GPIO, pin, DRONE_BUS_OK, buf, sizeof(buf));
+    }
+    if (n > 0) {
+        gpioEvent[pin].n += n;
+        gpioEvent[pin].t = last;
+    }
+    if (t) *t = gpioEvent[pin].t;
+    return gpioEvent[pin].n;
+}
+
+void Drone_Bus_GPIO_EventClear(uint8_t pin)
+{
+    if (pin < DRONE_BUS_NGPIO) gpioEvent[pin].n = 0;
+}
+
+int Drone_Bus_GPIO_EventWait(uint8_t pin, uint64_t timeout)
+{
+    if (Drone_Bus_Replay_IsActive() || pin >= DRONE_BUS_NGPIO || !backend->gpio_eventWait) return 0;
+    return backend->gpio_eventWait(pin, timeout);
+}
+
+void Drone_Bus_Delay(unsigned int millis)
+{
+    if (Drone_Bus_Replay_IsActive()) return;
+    struct timespec req = {millis / 1000, (millis % 1000) * 1000000L};
+    nanosleep(&req, NULL);
+}
+
+void Drone_Bus_DelayMicroseconds(uint64_t micros)
+{
+    if (Drone_Bus_Replay_IsActive()) return;                        // The virtual clock would never move
+    // As bcm2835_delayMicroseconds() : sleep for long delays, then busy-wait the last 200 us
+    uint64_t start = get_nsec();
+    if (micros > 450) {
+        uint64_t n = micros - 200;
+        struct timespec req = {n / 1000000, (n % 1000000) * 1000L};
+        nanosleep(&req, NULL);
+    }
+    while (get_nsec() - start < micros * 1000) ;
+}
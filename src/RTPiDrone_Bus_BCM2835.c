@@ -0,0 +1,81 @@
+/*! \file RTPiDrone_Bus_BCM2835.c
+    \brief Bus backend using the bcm2835 library (Raspberry Pi)
+ */
+#include "RTPiDrone_Bus.h"
+#include <bcm2835.h>
+
+static int BCM2835_init(void)
+{
+    return bcm2835_init() ? 0 : -1;
+}
+
+static int BCM2835_close(void)
+{
+    Drone_Bus_GPIOEvent_Close();
+    return bcm2835_close() ? 0 : -1;
+}
+
+static void BCM2835_i2c_begin(void)
+{
+    bcm2835_i2c_begin();
+}
+
+static uint8_t BCM2835_i2c_write(uint8_t addr, const char* buf, uint32_t len)
+{
+    bcm2835_i2c_setSlaveAddress(addr);
+    return bcm2835_i2c_write(buf, len);
+}
+
+static uint8_t BCM2835_i2c_read(uint8_t addr, char* buf, uint32_t len)
+{
+    bcm2835_i2c_setSlaveAddress(addr);
+    return bcm2835_i2c_read(buf, len);
+}
+
+/* A register address followed by the read of the same slave is one transaction with a repeated start */
+static uint8_t BCM2835_i2c_transfer(Drone_Bus_I2C_Msg* msg, uint32_t n)
+{
+    uint8_t ret = BCM2835_I2C_REASON_OK, r;
+    for (uint32_t i=0; i<n; ++i) {
+        bcm2835_i2c_setSlaveAddress(msg[i].addr);
+        if (i+1 < n && !msg[i].isRead && msg[i+1].isRead && msg[i+1].addr == msg[i].addr) {
+            r = bcm2835_i2c_write_read_rs(msg[i].buf, msg[i].len, msg[i+1].buf, msg[i+1].len);
+            ++i;
+        } else {
+            r = msg[i].isRead ? bcm2835_i2c_read(msg[i].buf, msg[i].len) : bcm2835_i2c_write(msg[i].buf, msg[i].len);
+        }
+        if (ret == BCM2835_I2C_REASON_OK) ret = r;
+    }
+    return ret;
+}
+
+static void BCM2835_spi_begin(void)
+{
+    bcm2835_spi_begin();
+}
+
+const Drone_Bus_Backend Drone_Bus_BCM2835 = {
+    .name                       = "bcm2835",
+    .init                       = BCM2835_init,
+    .close                      = BCM2835_close,
+    .i2c_begin                  = BCM2835_i2c_begin,
+    .i2c_end                    = bcm2835_i2c_end,
+    .i2c_setClockDivider        = bcm2835_i2c_setClockDivider,
+    .i2c_write                  = BCM2835_i2c_write,
+    .i2c_read                   = BCM2835_i2c_read,
+    .i2c_transfer               = BCM2835_i2c_transfer,
+    .spi_begin                  = BCM2835_spi_begin,
+    .spi_end                    = bcm2835_spi_end,
+    .spi_setBitOrder            = bcm2835_spi_setBitOrder,
+    .spi_setDataMode            = bcm2835_spi_setDataMode,
+    .spi_setClockDivider        = bcm2835_spi_setClockDivider,
+    .spi_chipSelect             = bcm2835_spi_chipSelect,
+    .spi_setChipSelectPolarity  = bcm2835_spi_setChipSelectPolarity,
+    .spi_transfer               = bcm2835_spi_transfer,
+    .spi_transfernb             = bcm2835_spi_transfernb,
+    .gpio_fsel                  = bcm2835_gpio_fsel,
+    .gpio_write                 = bcm2835_gpio_write,
+    .gpio_eventRequest          = Drone_Bus_GPIOEvent_Request,
+    .gpio_eventRead             = Drone_Bus_GPIOEvent_Read,
+    .gpio_eventWait             = Drone_Bus_GPIOEvent_Wait,
+};
@@ -0,0 +1,96 @@
+/*! \file RTPiDrone_Bus_GPIOEvent.c
+    \brief Edge events of the GPIO inputs with the Linux GPIO character device (uAPI v2), for the Raspberry Pi backends
+
+    Each line is requested on DRDY_CHIP with rising or falling edge detection, its file descriptor is non-blocking: the kernel
+    keeps the edges, with their CLOCK_MONOTONIC time stamp, until they are read.
+ */
+#define _GNU_SOURCE
+#include "RTPiDrone_header.h"
+#include "RTPiDrone_Bus.h"
+#include "Common.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#define GPIOEVENT_BUFFER    16                      //!< \private Edges read per read()
+
+static int lineFd[DRONE_BUS_NGPIO];                 //!< \private File descriptor of each requested line + 1 (0 : not requested)
+static struct {
+    int         n;                                  //!< \private Edges read by Drone_Bus_GPIOEvent_Wait()
+    uint64_t    t;                                  //!< \private Time of the last one
+} carry[DRONE_BUS_NGPIO];                           //!< \private Edges taken out of the kernel but not given yet
+
+static int GPIOEvent_Drain(uint8_t pin, uint64_t* t)
+{
+    struct gpio_v2_line_event e[GPIOEVENT_BUFFER];
+    int n = 0;
+    ssize_t len;
+    while ((len = read(lineFd[pin] - 1, e, sizeof(e))) > 0) {
+        int k = len / sizeof(e[0]);
+        // CLOCK_MONOTONIC of the kernel to the clock of get_nsec()
+        *t = e[k-1].timestamp_ns + get_nsec() - get_nsec_mono();
+        n += k;
+        if (k < GPIOEVENT_BUFFER) break;
+    }
+    return n;
+}
+
+int Drone_Bus_GPIOEvent_Request(uint8_t pin, uint8_t edge)
+{
+    if (lineFd[pin]) return 0;
+    int chip = open(DRDY_CHIP, O_RDONLY);
+    if (chip < 0) {
+        perror(DRDY_CHIP);
+        return -1;
+    }
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = pin;
+    req.num_lines = 1;
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT |
+                       (edge == DRONE_BUS_EDGE_FALLING ? GPIO_V2_LINE_FLAG_EDGE_FALLING : GPIO_V2_LINE_FLAG_EDGE_RISING);
+    strncpy(req.consumer, "RTPiDrone", sizeof(req.consumer) - 1);
+    int ret = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chip);
+    if (ret < 0) {
+        perror("GPIO line request");
+        return -2;
+    }
+    fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+    lineFd[pin] = req.fd + 1;
+    carry[pin].n = 0;
+    return 0;
+}
+
+int Drone_Bus_GPIOEvent_Read(uint8_t pin, uint64_t* t)
+{
+    if (!lineFd[pin]) return 0;
+    int n = carry[pin].n;
+    if (n) *t = carry[pin].t;
+    carry[pin].n = 0;
+    return n + GPIOEvent_Drain(pin, t);
+}
+
+int Drone_Bus_GPIOEvent_Wait(uint8_t pin, uint64_t timeout)
+{
+    if (!lineFd[pin]) return 0;
+    // The edges already there are kept for the next Drone_Bus_GPIOEvent_Read()
+    int n = GPIOEvent_Drain(pin, &carry[pin].t);
+    carry[pin].n += n;
+    struct pollfd p = {lineFd[pin] - 1, POLLIN, 0};
+    struct timespec ts = {timeout / 1000000000L, timeout % 1000000000L};
+    return ppoll(&p, 1, &ts, NULL) > 0 && (p.revents & POLLIN);
+}
+
+void Drone_Bus_GPIOEvent_Close(void)
+{
+    for (int i=0; i<DRONE_BUS_NGPIO; ++i) {
+        if (lineFd[i]) close(lineFd[i] - 1);
+        lineFd[i] = 0;
+    }
+}
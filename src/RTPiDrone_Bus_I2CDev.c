@@ -0,0 +1,141 @@
+/*! \file RTPiDrone_Bus_I2CDev.c
+    \brief Bus backend doing the I2C transfers with the Linux i2c-dev driver (I2C_RDWR), the bcm2835 library for the rest
+
+    The kernel i2c-bcm2835 driver owns the I2C pins : bcm2835_i2c_begin() is never called, and the clock
+    is the one of the device tree (dtparam=i2c_arm_baudrate=400000). One I2C_RDWR ioctl carries the messages
+    of a transfer up to a read, the messages after the first one start with a repeated start. i2c-bcm2835 only
+    takes a read as the last message of an ioctl (EOPNOTSUPP) : the reads of two slaves cannot share an ioctl,
+    each register read is one ioctl, as it is one transaction of the bcm2835 library.
+
+    Built with I2CDEV only, it has not run on the Raspberry Pi yet : "bench i2c-pi" compares it with bcm2835 there.
+ */
+#include "RTPiDrone_header.h"
+#include "RTPiDrone_Bus.h"
+#include "Common.h"
+#include <bcm2835.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+static char path[256] = I2CDEV_PATH;                //!< \private Device node of the bus
+static int fd = -1;                                 //!< \private File descriptor of the bus
+static unsigned long long nCall;                    //!< \private Number of ioctl
+static unsigned long long nMsg;                     //!< \private Number of messages
+static uint64_t callTime;                           //!< \private Time spent in the ioctl (ns)
+
+void Drone_Bus_I2CDev_SetDevice(const char* p)
+{
+    if (strlen(p) >= sizeof(path)) {
+        fprintf(stderr, "i2c-dev : %s is too long\n", p);
+        return;
+    }
+    strcpy(path, p);
+}
+
+static uint8_t I2CDev_status(int err)
+{
+    switch (err) {
+        case ENXIO :
+        case EREMOTEIO :
+            return DRONE_BUS_ERROR_NACK;
+        case ETIMEDOUT :
+            return DRONE_BUS_ERROR_CLKT;
+        default :
+            return DRONE_BUS_ERROR_DATA;
+    }
+}
+
+static int I2CDev_init(void)
+{
+    if (!bcm2835_init()) return -1;
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        perror(path);
+        bcm2835_close();
+        return -2;
+    }
+    return 0;
+}
+
+static int I2CDev_close(void)
+{
+#ifdef  DEBUG
+    printf("i2c-dev : %llu ioctl, %llu messages (%.2f per ioctl), %.1f us per ioctl\n", nCall, nMsg,
+           nCall ? (double)nMsg/nCall : 0.0, nCall ? callTime/1000.0/nCall : 0.0);
+#endif
+    if (fd >= 0) close(fd);
+    fd = -1;
+    Drone_Bus_GPIOEvent_Close();
+    return bcm2835_close() ? 0 : -1;
+}
+
+static uint8_t I2CDev_transfer(Drone_Bus_I2C_Msg* msg, uint32_t n)
+{
+    struct i2c_msg m[I2C_RDWR_IOCTL_MAX_MSGS];
+    uint8_t ret = DRONE_BUS_OK;
+    // The kernel takes at most I2C_RDWR_IOCTL_MAX_MSGS messages per call, a read ends the call
+    for (uint32_t i=0, k; i<n; i+=k) {
+        k = 0;
+        while (k < I2C_RDWR_IOCTL_MAX_MSGS && i+k < n) {
+            if (msg[i + k++].isRead) break;
+        }
+        for (uint32_t j=0; j<k; ++j) {
+            m[j].addr = msg[i+j].addr;
+            m[j].flags = msg[i+j].isRead ? I2C_M_RD : 0;
+            m[j].len = msg[i+j].len;
+            m[j].buf = (uint8_t*)msg[i+j].buf;
+        }
+        struct i2c_rdwr_ioctl_data data = {m, k};
+        uint64_t start = get_nsec_mono();
+        if (ioctl(fd, I2C_RDWR, &data) < 0 && ret == DRONE_BUS_OK) ret = I2CDev_status(errno);
+        callTime += get_nsec_mono() - start;
+        ++nCall;
+        nMsg += k;
+    }
+    return ret;
+}
+
+static uint8_t I2CDev_write(uint8_t addr, const char* buf, uint32_t len)
+{
+    Drone_Bus_I2C_Msg msg = {addr, 0, len, (char*)buf};
+    return I2CDev_transfer(&msg, 1);
+}
+
+static uint8_t I2CDev_read(uint8_t addr, char* buf, uint32_t len)
+{
+    Drone_Bus_I2C_Msg msg = {addr, 1, len, buf};
+    return I2CDev_transfer(&msg, 1);
+}
+
+static void I2CDev_spi_begin(void)
+{
+    bcm2835_spi_begin();
+}
+
+const Drone_Bus_Backend Drone_Bus_I2CDev = {
+    .name                       = "i2c-dev",
+    .init                       = I2CDev_init,
+    .close                      = I2CDev_close,
+    .i2c_write                  = I2CDev_write,
+    .i2c_read                   = I2CDev_read,
+    .i2c_transfer               = I2CDev_transfer,
+    .spi_begin                  = I2CDev_spi_begin,
+    .spi_end                    = bcm2835_spi_end,
+    .spi_setBitOrder            = bcm2835_spi_setBitOrder,
+    .spi_setDataMode            = bcm2835_spi_setDataMode,
+    .spi_setClockDivider        = bcm2835_spi_setClockDivider,
+    .spi_chipSelect             = bcm2835_spi_chipSelect,
+    .spi_setChipSelectPolarity  = bcm2835_spi_setChipSelectPolarity,
+    .spi_transfer               = bcm2835_spi_transfer,
+    .spi_transfernb             = bcm2835_spi_transfernb,
+    .gpio_fsel                  = bcm2835_gpio_fsel,
+    .gpio_write                 = bcm2835_gpio_write,
+    .gpio_eventRequest          = Drone_Bus_GPIOEvent_Request,
+    .gpio_eventRead             = Drone_Bus_GPIOEvent_Read,
+    .gpio_eventWait             = Drone_Bus_GPIOEvent_Wait,
+};
@@ -0,0 +1,216 @@
+/*! \file RTPiDrone_Bus_Manager.c
+    \brief I2C bus manager: one thread owns the I2C bus, serves the background transfers and lends it to the control ones
+
+    A background thread (Drone_Bus_I2C_SetPriority()) submits its transfer to a lock-free queue and sleeps on a
+    semaphore until the manager has done it.
+
+    The control transfers skip that round trip : their thread takes the ownership of the bus from the manager and
+    does the transfer itself, with no semaphore and no context switch. The ownership is a mutex with priority
+    inheritance, held by the manager during each transfer it serves : a control transfer waits for the background
+    transfer in progress and nothing else. The time of that wait is the "I2C control" histogram (DEBUG).
+ */
+#include "RTPiDrone_header.h"
+#include "RTPiDrone_Bus.h"
+#include "RTPiDrone_Histogram.h"
+#include "Common.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+
+#define MANAGER_QUEUESIZE       16      //!< \private Slots per priority, more than the threads using the bus
+
+/*!
+ * \struct Manager_Request
+ * \brief One transfer, on the stack of the waiting thread
+ */
+typedef struct {
+    Drone_Bus_I2C_Msg*  msg;            //!< \private Messages of the transfer
+    uint32_t            n;              //!< \private Number of messages
+    uint8_t             status;         //!< \private Result of the transfer
+    uint64_t            submitted;      //!< \private get_nsec_mono() at the submission
+    uint64_t            busTime;        //!< \private Time of the transfer itself (ns)
+    sem_t               done;           //!< \private Posted by the manager when the transfer is done
+} Manager_Request;
+
+/*!
+ * \struct Manager_Queue
+ * \brief Bounded multi-producer single-consumer queue: each slot carries the turn at which it can be used
+ */
+typedef struct {
+    struct {
+        atomic_size_t       seq;        //!< \private Position of the producer (free) or position+1 (full)
+        Manager_Request*    req;        //!< \private Request of the slot
+    } slot[MANAGER_QUEUESIZE];
+    atomic_size_t   head;               //!< \private Next position of the producers
+    size_t          tail;               //!< \private Next position of the manager
+} Manager_Queue;
+
+static Manager_Queue queue[DRONE_BUS_NPRIORITY];            //!< \private One queue per priority
+static sem_t pending;                                       //!< \private Number of submitted requests
+static pthread_t manager;                                   //!< \private Thread owning the bus
+static atomic_int isActive;                                 //!< \private Transfers go through the manager
+static atomic_int isStopped;                                //!< \private The manager has to leave
+static _Thread_local int priority = DRONE_BUS_PRIORITY_CONTROL;     //!< \private Priority of the calling thread
+static _Thread_local int isManager = 0;                     //!< \private The calling thread owns the bus (the manager, or inline)
+static pthread_mutex_t owner;                               //!< \private Ownership of the bus, held during each transfer
+static Drone_Histogram* waitTime[DRONE_BUS_NPRIORITY];      //!< \private Time from submission to service
+static const char* waitName[DRONE_BUS_NPRIORITY] = {"I2C control", "I2C backgnd"};
+static Drone_Histogram* handoff;                            //!< \private Time added to a queued transfer by the manager
+static uint64_t nInline;                                    //!< \private Control transfers done by their own thread
+static uint64_t nQueued;                                    //!< \private Transfers served by the manager
+static pthread_mutex_t statLock = PTHREAD_MUTEX_INITIALIZER; //!< \private The threads of the queued transfers share handoff
+
+static void Manager_Push(Manager_Queue* q, Manager_Request* r)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        size_t seq = atomic_load_explicit(&q->slot[pos % MANAGER_QUEUESIZE].seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (seq < pos) {                     // Full : only if more threads than slots
+            sched_yield();
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    q->slot[pos % MANAGER_QUEUESIZE].req = r;
+    atomic_store_explicit(&q->slot[pos % MANAGER_QUEUESIZE].seq, pos + 1, memory_order_release);
+}
+
+static Manager_Request* Manager_Pop(Manager_Queue* q)
+{
+    size_t pos = q->tail;
+    if (atomic_load_explicit(&q->slot[pos % MANAGER_QUEUESIZE].seq, memory_order_acquire) != pos + 1) return NULL;
+    Manager_Request* r = q->slot[pos % MANAGER_QUEUESIZE].req;
+    atomic_store_explicit(&q->slot[pos % MANAGER_QUEUESIZE].seq, pos + MANAGER_QUEUESIZE, memory_order_release);
+    q->tail = pos + 1;
+    return r;
+}
+
+static void* Manager_Thread(void* arg)
+{
+    isManager = 1;
+    for (;;) {
+        if (sem_wait(&pending)) {
+            if (errno == EINTR) continue;           // A signal, not a request
+            perror("Bus manager wait");
+            return NULL;
+        }
+        Manager_Request* r = NULL;
+        int p = 0;
+        // A producer may have taken its slot but not published it yet : retry until its request shows up
+        while (!r) {
+            for (p=0; p<DRONE_BUS_NPRIORITY && !r; ++p) r = Manager_Pop(&queue[p]);
+            if (!r) {
+                if (atomic_load(&isStopped)) return NULL;
+                sched_yield();
+            }
+        }
+        pthread_mutex_lock(&owner);
+        uint64_t start = get_nsec_mono();
+        Drone_Histogram_Record(waitTime[p-1], start - r->submitted);
+        r->status = Drone_Bus_I2C_Transfer(r->msg, r->n);
+        r->busTime = get_nsec_mono() - start;
+        pthread_mutex_unlock(&owner);
+        sem_post(&r->done);
+    }
+    return NULL;
+}
+
+int Drone_Bus_Manager_Start(void)
+{
+    if (atomic_load(&isActive)) return 0;
+    for (int p=0; p<DRONE_BUS_NPRIORITY; ++p) {
+        for (size_t i=0; i<MANAGER_QUEUESIZE; ++i) atomic_init(&queue[p].slot[i].seq, i);
+        atomic_init(&queue[p].head, 0);
+        queue[p].tail = 0;
+        if (Drone_Histogram_Init(&waitTime[p], waitName[p])) return -1;
+    }
+    if (Drone_Histogram_Init(&handoff, "I2C handoff")) return -1;
+    if (sem_init(&pending, 0, 0)) {
+        perror("Bus manager semaphore");
+        return -2;
+    }
+    // Priority inheritance : a control transfer waiting for a background one raises the manager to its priority
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    int ret = pthread_mutex_init(&owner, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (ret) {
+        fprintf(stderr, "Bus manager ownership : error %d\n", ret);
+        return -2;
+    }
+    nInline = nQueued = 0;
+    atomic_store(&isStopped, 0);
+    if (pthread_create(&manager, NULL, Manager_Thread, NULL)) {
+        perror("Bus manager thread");
+        return -3;
+    }
+    atomic_store(&isActive, 1);
+    return 0;
+}
+
+void Drone_Bus_Manager_End(void)
+{
+    if (!atomic_load(&isActive)) return;
+    atomic_store(&isActive, 0);                     // The next transfers are done by their own thread
+    atomic_store(&isStopped, 1);
+    sem_post(&pending);
+    pthread_join(manager, NULL);
+    sem_destroy(&pending);
+    pthread_mutex_destroy(&owner);
+#ifdef  DEBUG
+    printf("Bus manager : %llu control transfers inline, %llu queued\n", (unsigned long long)nInline,
+           (unsigned long long)nQueued);
+    Drone_Histogram_Print(handoff, stdout);
+#endif
+    Drone_Histogram_End(&handoff);
+    for (int p=0; p<DRONE_BUS_NPRIORITY; ++p) {
+#ifdef  DEBUG
+        Drone_Histogram_Print(waitTime[p], stdout);
+#endif
+        Drone_Histogram_End(&waitTime[p]);
+    }
+}
+
+int Drone_Bus_Manager_IsActive(void)
+{
+    return !isManager && atomic_load_explicit(&isActive, memory_order_relaxed);
+}
+
+void Drone_Bus_I2C_SetPriority(int p)
+{
+    priority = p < 0 ? 0 : (p >= DRONE_BUS_NPRIORITY ? DRONE_BUS_NPRIORITY-1 : p);
+}
+
+uint8_t Drone_Bus_Manager_Submit(Drone_Bus_I2C_Msg* msg, uint32_t n)
+{
+    uint64_t submitted = get_nsec_mono();
+    if (priority == DRONE_BUS_PRIORITY_CONTROL) {
+        // No control transfer is ever queued : nothing can be ahead of this one but the transfer in progress
+        pthread_mutex_lock(&owner);
+        Drone_Histogram_Record(waitTime[priority], get_nsec_mono() - submitted);
+        ++nInline;
+        isManager = 1;
+        uint8_t ret = Drone_Bus_I2C_Transfer(msg, n);
+        isManager = 0;
+        pthread_mutex_unlock(&owner);
+        return ret;
+    }
+    Manager_Request r = {msg, n, DRONE_BUS_OK, submitted, 0};
+    sem_init(&r.done, 0, 0);
+    Manager_Push(&queue[priority], &r);
+    sem_post(&pending);
+    while (sem_wait(&r.done) && errno == EINTR) ;
+    sem_destroy(&r.done);
+    pthread_mutex_lock(&statLock);
+    ++nQueued;
+    Drone_Histogram_Record(handoff, get_nsec_mono() - submitted - r.busTime);
+    pthread_mutex_unlock(&statLock);
+    return r.status;
+}
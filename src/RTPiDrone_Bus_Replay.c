@@ -0,0 +1,187 @@
+/*! \file RTPiDrone_Bus_Replay.c
+    \brief Bus backend serving the reads of a recording (Drone_Bus_Record()) under a virtual clock
+
+    Each device (I2C address, SPI chip select) and the control cycles are one stream of the recording, replayed
+    in its own order : the calibration threads of the devices may interleave differently from the recording
+    without changing what each driver receives. The writes are not checked.
+ */
+#include "RTPiDrone_header.h"
+#include "RTPiDrone_Bus.h"
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_NSTREAM      (1 + 128 + 4 + DRONE_BUS_NGPIO)    //!< \private Control cycles, I2C addresses, chip selects, GPIO
+
+static Drone_Bus_Event* event = NULL;               //!< \private Events of the recording
+static int32_t* next = NULL;                        //!< \private Index of the next event of the same stream
+static int32_t head[REPLAY_NSTREAM];                //!< \private Next event to serve of each stream (-1 : no more)
+static uint8_t spiCS = DRONE_BUS_SPI_CS0;           //!< \private Chip select of the next frames
+static int isActive = 0;                            //!< \private Replay backend selected
+static volatile int isOver = 0;                     //!< \private A stream ran out of events
+
+static int Replay_Stream(uint8_t type, uint8_t id)
+{
+    if (type == DRONE_BUS_EVENT_I2C) return 1 + (id & 0x7F);
+    if (type == DRONE_BUS_EVENT_SPI) return 1 + 128 + (id & 0x03);
+    if (type == DRONE_BUS_EVENT_GPIO) return 1 + 128 + 4 + id % DRONE_BUS_NGPIO;
+    return 0;
+}
+
+static Drone_Bus_Event* Replay_Next(uint8_t type, uint8_t id)
+{
+    int s = Replay_Stream(type, id);
+    int32_t i = head[s];
+    if (i < 0) {
+        if (!isOver && s) fprintf(stderr, "Replay : no more recorded data (stream %d)\n", s);
+        isOver = 1;
+        return NULL;
+    }
+    head[s] = next[i];
+    virtual_clock_set(event[i].t);
+    return &event[i];
+}
+
+// The data of an event are given back as received, what is missing (end of the recording) is zero
+static void Replay_Copy(const Drone_Bus_Event* e, char* buf, uint32_t len)
+{
+    uint32_t n = e ? (e->len < len ? e->len : len) : 0;
+    if (n) memcpy(buf, e->data, n);
+    memset(buf + n, 0, len - n);
+}
+
+// A read longer than DRONE_BUS_EVENT_SIZE was recorded as consecutive events of its device
+static uint8_t Replay_Read(uint8_t type, uint8_t id, char* buf, uint32_t len)
+{
+    uint8_t status = DRONE_BUS_OK;
+    uint32_t n = 0;
+    do {
+        Drone_Bus_Event* e = Replay_Next(type, id);
+        uint32_t chunk = len - n < DRONE_BUS_EVENT_SIZE ? len - n : DRONE_BUS_EVENT_SIZE;
+        Replay_Copy(e, buf + n, chunk);
+        if (e) status = e->status;
+        n += chunk;
+    } while (n < len);
+    return status;
+}
+
+static uint8_t Replay_i2c_write(uint8_t addr, const char* buf, uint32_t len)
+{
+    return DRONE_BUS_OK;
+}
+
+static uint8_t Replay_i2c_read(uint8_t addr, char* buf, uint32_t len)
+{
+    return Replay_Read(DRONE_BUS_EVENT_I2C, addr, buf, len);
+}
+
+static uint8_t Replay_spi_transfer(uint8_t value)
+{
+    char rx;
+    Replay_Copy(Replay_Next(DRONE_BUS_EVENT_SPI, spiCS), &rx, 1);
+    return (uint8_t)rx;
+}
+
+static void Replay_spi_transfernb(char* tbuf, char* rbuf, uint32_t len)
+{
+    Replay_Read(DRONE_BUS_EVENT_SPI, spiCS, rbuf, len);
+}
+
+static void Replay_spi_chipSelect(uint8_t cs)
+{
+    spiCS = cs & 0x03;
+}
+
+static int Replay_gpio_eventRequest(uint8_t pin, uint8_t edge)
+{
+    return 0;
+}
+
+static int Replay_gpio_eventRead(uint8_t pin, uint64_t* t)
+{
+    char buf[sizeof(int32_t) + sizeof(uint64_t)];
+    int32_t n;
+    Replay_Copy(Replay_Next(DRONE_BUS_EVENT_GPIO, pin), buf, sizeof(buf));
+    memcpy(&n, buf, sizeof(n));
+    memcpy(t, buf + sizeof(n), sizeof(*t));
+    return n;
+}
+
+static int Replay_close(void)
+{
+    free(event);
+    free(next);
+    event = NULL;
+    next = NULL;
+    return 0;
+}
+
+static const Drone_Bus_Backend Drone_Bus_Replay = {
+    .name                       = "replay",
+    .close                      = Replay_close,
+    .i2c_write                  = Replay_i2c_write,
+    .i2c_read                   = Replay_i2c_read,
+    .spi_chipSelect             = Replay_spi_chipSelect,
+    .spi_transfer               = Replay_spi_transfer,
+    .spi_transfernb             = Replay_spi_transfernb,
+    .gpio_eventRequest          = Replay_gpio_eventRequest,
+    .gpio_eventRead             = Replay_gpio_eventRead,
+};
+
+int Drone_Bus_Replay_Open(const char* fileName)
+{
+    Drone_Bus_RecordHeader h;
+    FILE* fp = fopen(fileName, "rb");
+    if (!fp) {
+        perror("Replay file");
+        return -1;
+    }
+    if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, DRONE_BUS_RECORD_MAGIC, sizeof(h.magic)) || h.nEvent > INT32_MAX) {
+        fprintf(stderr, "Replay : %s is not a recording\n", fileName);
+        fclose(fp);
+        return -2;
+    }
+    event = (Drone_Bus_Event*) malloc(sizeof(Drone_Bus_Event) * (h.nEvent + 1));
+    next = (int32_t*) malloc(sizeof(int32_t) * (h.nEvent + 1));
+    if (!event || !next || fread(event, sizeof(Drone_Bus_Event), h.nEvent, fp) != h.nEvent) {
+        perror("Replay read");
+        fclose(fp);
+        Replay_close();
+        return -3;
+    }
+    fclose(fp);
+
+    // Link the events of each stream, from the end
+    for (int s=0; s<REPLAY_NSTREAM; ++s) head[s] = -1;
+    for (int32_t i=(int32_t)h.nEvent-1; i>=0; --i) {
+        int s = Replay_Stream(event[i].type, event[i].id);
+        next[i] = head[s];
+        head[s] = i;
+    }
+#ifdef  DEBUG
+    printf("Replay : %llu events from %s\n", (unsigned long long)h.nEvent, fileName);
+#endif
+    Drone_Bus_SetBackend(&Drone_Bus_Replay);
+    isActive = 1;
+    virtual_clock_start(h.start);
+    return 0;
+}
+
+int Drone_Bus_Replay_IsActive(void)
+{
+    return isActive;
+}
+
+int Drone_Bus_Replay_IsOver(void)
+{
+    return isOver;
+}
+
+int Drone_Bus_Replay_Tick(uint64_t* now)
+{
+    Drone_Bus_Event* e = isOver ? NULL : Replay_Next(DRONE_BUS_EVENT_TICK, 0);
+    if (!e) return -1;
+    *now = e->t;
+    return 0;
+}
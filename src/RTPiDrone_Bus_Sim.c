@@ -0,0 +1,533 @@
+/*! \file RTPiDrone_Bus_Sim.c
+    \brief Simulated bus backend: register-level models of the devices of the drone
+
+    The drone stays level and at rest, each measurement is a constant with a small noise. Every transaction
+    holds its bus (busy-wait, as the polled bcm2835 transfers do) for a configurable time, so that the time
+    spent by the control loop on the buses is close to the one on the Raspberry Pi.
+ */
+#include "RTPiDrone_header.h"
+#include "RTPiDrone_Bus.h"
+#include "Common.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define SIM_NI2C                6               //!< Number of simulated I2C devices
+#define SIM_RF24_FIFO           3               //!< Depth of the RX FIFO of the nRF24L01+
+#define SIM_RF24_PAYLOAD        32              //!< Max payload of the nRF24L01+
+#define SIM_RF24_PERIOD         20000000L       //!< Period of the packets sent by the remote control (ns)
+#define SIM_NDRDY               3               //!< Number of simulated data-ready lines
+#define BILLION                 1000000000L
+
+/*!
+ * \struct Sim_I2C
+ * \brief Model of one I2C device
+ */
+typedef struct Sim_I2C Sim_I2C;
+struct Sim_I2C {
+    uint8_t     addr;                                               //!< \private Slave address
+    void        (*write)(Sim_I2C*, const uint8_t*, uint32_t, uint64_t);  //!< \private Master writes
+    void        (*read)(Sim_I2C*, uint8_t*, uint32_t, uint64_t);    //!< \private Master reads
+    void        (*refresh)(Sim_I2C*, uint64_t);                     //!< \private Update the output registers
+    uint8_t     reg[256];                                           //!< \private Registers
+    uint8_t     ptr;                                                //!< \private Register pointer
+    int         inc;                                                //!< \private Register pointer auto-increment
+    uint8_t     cmd;                                                //!< \private Conversion in progress (BMP085/MS5611)
+    uint64_t    ready;                                              //!< \private End of the conversion, next FIFO sample
+    int         nFifo;                                              //!< \private Entries of the FIFO (ADXL345/L3G4200D)
+    uint32_t    adc;                                                //!< \private Result of the conversion (MS5611)
+};
+
+/*!
+ * \struct Sim_Bus
+ * \brief State shared by the transactions of one bus
+ */
+typedef struct {
+    pthread_mutex_t lock;                       //!< \private Transactions are serialized as on a real bus
+    uint32_t        latency;                    //!< \private Time of one transaction (ns)
+    uint32_t        byteLatency;                //!< \private Time of one byte (ns)
+    uint32_t        seed;                       //!< \private State of the noise generator
+} Sim_Bus;
+
+static Sim_Bus i2cBus = {PTHREAD_MUTEX_INITIALIZER, SIM_I2C_LATENCY, SIM_I2C_BYTE_LATENCY, 2463534242u};
+static Sim_Bus spiBus = {PTHREAD_MUTEX_INITIALIZER, SIM_SPI_LATENCY, SIM_SPI_BYTE_LATENCY, 88675123u};
+static Sim_I2C i2cDev[SIM_NI2C];
+static uint64_t tStart;                         //!< \private Time of the first control cycle (0 : not started)
+static uint64_t flightTime = SIM_FLIGHT_TIME * BILLION;
+static uint8_t  spiCS = DRONE_BUS_SPI_CS0;
+
+static struct {
+    uint8_t     reg[0x20][5];                   //!< \private Registers (5 bytes for the addresses)
+    uint8_t     fifo[SIM_RF24_FIFO][SIM_RF24_PAYLOAD];  //!< \private RX FIFO
+    int         nFifo;                          //!< \private Number of packets in the RX FIFO
+    uint64_t    next;                           //!< \private Time of the next packet of the remote control
+} rf24;
+
+static struct {
+    uint8_t     pin;                            //!< \private GPIO of the line
+    int         isRequested;                    //!< \private Edges are detected
+    uint64_t    next;                           //!< \private Time of the next edge (0 : not started)
+} drdy[SIM_NDRDY] = {{DRDY_PIN_ADXL345}, {DRDY_PIN_L3G4200D}, {DRDY_PIN_HMC5883L}};
+
+static int Sim_Noise(Sim_Bus* bus, int amp)
+{
+    bus->seed ^= bus->seed << 13;
+    bus->seed ^= bus->seed >> 17;
+    bus->seed ^= bus->seed << 5;
+    return (int)(bus->seed % (2 * amp + 1)) - amp;
+}
+
+static void Sim_Wait(uint64_t start, uint64_t duration)
+{
+    while (get_nsec() - start < duration) ;
+}
+
+static void Sim_Put16LE(uint8_t* reg, int16_t v)
+{
+    reg[0] = (uint16_t)v & 0xFF;
+    reg[1] = (uint16_t)v >> 8;
+}
+
+static void Sim_Put16BE(uint8_t* reg, int16_t v)
+{
+    reg[0] = (uint16_t)v >> 8;
+    reg[1] = (uint16_t)v & 0xFF;
+}
+
+/* Register file devices : the first byte written is the register address */
+
+static void Sim_RegWrite(Sim_I2C* d, const uint8_t* buf, uint32_t len, uint64_t now)
+{
+    d->ptr = buf[0];
+    d->inc = 1;
+    for (uint32_t i=1; i<len; ++i) d->reg[d->ptr++] = buf[i];
+}
+
+static void Sim_RegRead(Sim_I2C* d, uint8_t* buf, uint32_t len, uint64_t now)
+{
+    if (d->refresh) d->refresh(d, now);
+    for (uint32_t i=0; i<len; ++i) {
+        buf[i] = d->reg[d->ptr];
+        if (d->inc) ++d->ptr;
+    }
+}
+
+/* FIFO in stream mode : one sample per period, a full FIFO of size entries loses the oldest ones */
+static void Sim_FIFO_Fill(Sim_I2C* d, uint64_t now, uint64_t period, int size)
+{
+    if (!d->ready) d->ready = now;
+    for (; d->ready <= now; d->ready += period) {
+        if (d->nFifo < size) ++d->nFifo;
+    }
+}
+
+static void Sim_ADXL345_refresh(Sim_I2C* d, uint64_t now)
+{
+    if ((d->reg[0x38] & 0xC0) == 0x80) {                            // FIFO_CTL : stream mode
+        Sim_FIFO_Fill(d, now, BILLION / (3200 >> (0x0F - (d->reg[0x2C] & 0x0F))), 33);   // BW_RATE, 32 + the data registers
+        d->reg[0x39] = d->nFifo;                                    // FIFO_STATUS
+        if (d->ptr != 0x32 || !d->nFifo) return;                    // A read of the data registers pops an entry
+        --d->nFifo;
+    }
+    Sim_Put16LE(&d->reg[0x32], Sim_Noise(&i2cBus, 3));              // 4 mg/LSB
+    Sim_Put16LE(&d->reg[0x34], Sim_Noise(&i2cBus, 3));
+    Sim_Put16LE(&d->reg[0x36], 250 + Sim_Noise(&i2cBus, 3));
+}
+
+static void Sim_L3G4200D_write(Sim_I2C* d, const uint8_t* buf, uint32_t len, uint64_t now)
+{
+    d->ptr = buf[0] & 0x7F;                                         // MSB of the sub-address : auto-increment
+    d->inc = buf[0] >> 7;
+    for (uint32_t i=1; i<len; ++i) {
+        d->reg[d->ptr] = buf[i];
+        if (d->inc) ++d->ptr;
+    }
+}
+
+static void Sim_L3G4200D_refresh(Sim_I2C* d, uint64_t now)
+{
+    Sim_Put16LE(&d->reg[0x28], 5 + Sim_Noise(&i2cBus, 4));         // Zero-rate level + noise
+    Sim_Put16LE(&d->reg[0x2A], -3 + Sim_Noise(&i2cBus, 4));
+    Sim_Put16LE(&d->reg[0x2C], 2 + Sim_Noise(&i2cBus, 4));
+}
+
+static void Sim_L3G4200D_read(Sim_I2C* d, uint8_t* buf, uint32_t len, uint64_t now)
+{
+    // CTRL_REG5.FIFO_EN and FIFO_CTRL_REG in stream mode
+    int fifo = (d->reg[0x24] & 0x40) && (d->reg[0x2E] & 0xE0) == 0x40;
+    if (!fifo) {
+        Sim_RegRead(d, buf, len, now);
+        return;
+    }
+    Sim_FIFO_Fill(d, now, BILLION / (100 << (d->reg[0x20] >> 6)), 32);   // CTRL_REG1.DR
+    d->reg[0x2F] = (d->nFifo & 0x1F) | (d->nFifo == 32 ? 0x40 : 0x00) | (d->nFifo ? 0x00 : 0x20);    // FIFO_SRC_REG
+    for (uint32_t i=0; i<len; ++i) {
+        if (d->ptr == 0x28 && d->nFifo) {                           // Each sample read pops an entry
+            Sim_L3G4200D_refresh(d, now);
+            --d->nFifo;
+        }
+        buf[i] = d->reg[d->ptr];
+        if (d->inc && ++d->ptr == 0x2E) d->ptr = 0x28;              // Rolls back from OUT_Z_H to OUT_X_L
+    }
+}
+
+static void Sim_HMC5883L_refresh(Sim_I2C* d, uint64_t now)
+{
+    Sim_Put16BE(&d->reg[0x03], 100 + Sim_Noise(&i2cBus, 2));       // X, Z, Y
+    Sim_Put16BE(&d->reg[0x05], -300 + Sim_Noise(&i2cBus, 2));
+    Sim_Put16BE(&d->reg[0x07], -150 + Sim_Noise(&i2cBus, 2));
+}
+
+static void Sim_PCA9685PW_write(Sim_I2C* d, const uint8_t* buf, uint32_t len, uint64_t now)
+{
+    d->ptr = buf[0];
+    d->inc = d->reg[0x00] & 0x20;                                   // MODE1.AI
+    for (uint32_t i=1; i<len; ++i) {
+        d->reg[d->ptr] = buf[i];
+        if (d->ptr >= 0xFA && d->ptr <= 0xFD) {                     // ALL_LED : the same register of each channel
+            for (int n=0; n<16; ++n) d->reg[0x06 + 4*n + d->ptr - 0xFA] = buf[i];
+        }
+        if (d->inc) ++d->ptr;
+    }
+}
+
+static void Sim_BMP085_write(Sim_I2C* d, const uint8_t* buf, uint32_t len, uint64_t now)
+{
+    static const uint64_t convTime[] = {4500000L, 7500000L, 13500000L, 25500000L};
+    Sim_RegWrite(d, buf, len, now);
+    if (len > 1 && buf[0] == 0xF4) {
+        d->cmd = buf[1];
+        d->ready = now + (buf[1] == 0x2E ? convTime[0] : convTime[buf[1]>>6]);
+    }
+}
+
+static void Sim_BMP085_refresh(Sim_I2C* d, uint64_t now)
+{
+    if (!d->cmd || now < d->ready) return;
+    if (d->cmd == 0x2E) {
+        Sim_Put16BE(&d->reg[0xF6], 27898 + Sim_Noise(&i2cBus, 2)); // Example of the datasheet
+    } else {
+        int oss = d->cmd >> 6;
+        uint32_t up = ((23843 << oss) + Sim_Noise(&i2cBus, 8)) << (8 - oss);
+        d->reg[0xF6] = up >> 16;
+        d->reg[0xF7] = up >> 8;
+        d->reg[0xF8] = up;
+    }
+    d->cmd = 0;
+}
+
+static void Sim_MS5611_write(Sim_I2C* d, const uint8_t* buf, uint32_t len, uint64_t now)
+{
+    static const uint64_t convTime[] = {600000L, 1170000L, 2280000L, 4540000L, 9040000L};
+    uint8_t cmd = buf[0];
+    d->ptr = cmd;
+    if ((cmd & 0xE0) == 0x40) {                                     // Conversion D1 (0x4x) or D2 (0x5x)
+        d->cmd = cmd;
+        d->ready = now + convTime[((cmd & 0x0F) >> 1) % 5];
+        d->adc = 0;
+    }
+}
+
+static void Sim_MS5611_read(Sim_I2C* d, uint8_t* buf, uint32_t len, uint64_t now)
+{
+    memset(buf, 0, len);
+    if (d->ptr == 0x00) {                                           // ADC read : 0 if the conversion is not done
+        if (d->cmd && now >= d->ready) {
+            d->adc = (d->cmd & 0x10) ? 8569150 + Sim_Noise(&i2cBus, 20) : 9085466 + Sim_Noise(&i2cBus, 50);
+            d->cmd = 0;
+        }
+        for (uint32_t i=0; i<len && i<3; ++i) buf[i] = d->adc >> (16 - 8*i);
+        d->adc = 0;
+    } else if ((d->ptr & 0xF0) == 0xA0) {                           // PROM read
+        for (uint32_t i=0; i<len && i<2; ++i) buf[i] = d->reg[(d->ptr & 0x0E) + i];
+    }
+}
+
+static void Sim_I2C_Setup(void)
+{
+    memset(i2cDev, 0, sizeof(i2cDev));
+    Sim_I2C* d = &i2cDev[0];
+    d->addr = 0x53;                                                 // ADXL345
+    d->write = Sim_RegWrite;
+    d->read = Sim_RegRead;
+    d->refresh = Sim_ADXL345_refresh;
+    d->reg[0x00] = 0xE5;
+
+    d = &i2cDev[1];
+    d->addr = 0x69;                                                 // L3G4200D
+    d->write = Sim_L3G4200D_write;
+    d->read = Sim_L3G4200D_read;
+    d->refresh = Sim_L3G4200D_refresh;
+    d->reg[0x0F] = 0xD3;
+    d->reg[0x26] = (uint8_t)-25;                                    // OUT_TEMP : 25 degC, -1 LSB/degC
+
+    d = &i2cDev[2];
+    d->addr = 0x1E;                                                 // HMC5883L
+    d->write = Sim_RegWrite;
+    d->read = Sim_RegRead;
+    d->refresh = Sim_HMC5883L_refresh;
+    memcpy(&d->reg[0x0A], "H43", 3);
+
+    d = &i2cDev[3];
+    d->addr = 0x77;                                                 // BMP085, calibration of the datasheet
+    d->write = Sim_BMP085_write;
+    d->read = Sim_RegRead;
+    d->refresh = Sim_BMP085_refresh;
+    static const int16_t bmp[] = {408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868};
+    for (int i=0; i<11; ++i) Sim_Put16BE(&d->reg[0xAA + 2*i], bmp[i]);
+    d->reg[0xD0] = 0x55;
+
+    d = &i2cDev[4];
+    d->addr = 0x76;                                                 // MS5611, PROM of the datasheet
+    d->write = Sim_MS5611_write;
+    d->read = Sim_MS5611_read;
+    static const uint16_t prom[] = {0, 40127, 36924, 23317, 23282, 33464, 28312, 0};
+    for (int i=0; i<8; ++i) Sim_Put16BE(&d->reg[2*i], prom[i]);
+
+    d = &i2cDev[5];
+    d->addr = 0x40;                                                 // PCA9685PW
+    d->write = Sim_PCA9685PW_write;
+    d->read = Sim_RegRead;
+    d->reg[0x00] = 0x11;
+    d->reg[0x01] = 0x04;
+    d->reg[0xFE] = 0x1E;
+}
+
+static Sim_I2C* Sim_I2C_Find(uint8_t addr)
+{
+    for (int i=0; i<SIM_NI2C; ++i) {
+        if (i2cDev[i].addr == addr) return &i2cDev[i];
+    }
+    return NULL;
+}
+
+/* One START ... STOP : the messages after the first one only cost their bytes (repeated start) */
+static uint8_t Sim_i2c_transfer(Drone_Bus_I2C_Msg* msg, uint32_t n)
+{
+    uint64_t now = get_nsec();
+    uint64_t duration = i2cBus.latency;
+    uint8_t ret = DRONE_BUS_OK;
+    pthread_mutex_lock(&i2cBus.lock);
+    for (uint32_t i=0; i<n; ++i) {
+        Sim_I2C* d = Sim_I2C_Find(msg[i].addr);
+        if (d && msg[i].isRead) d->read(d, (uint8_t*)msg[i].buf, msg[i].len, now);
+        else if (d && msg[i].len) d->write(d, (const uint8_t*)msg[i].buf, msg[i].len, now);
+        duration += (uint64_t)i2cBus.byteLatency * (d ? msg[i].len+1 : 1);
+        if (!d && ret == DRONE_BUS_OK) ret = DRONE_BUS_ERROR_NACK;
+    }
+    Sim_Wait(now, duration);
+    pthread_mutex_unlock(&i2cBus.lock);
+    return ret;
+}
+
+static uint8_t Sim_i2c_write(uint8_t addr, const char* buf, uint32_t len)
+{
+    Drone_Bus_I2C_Msg msg = {addr, 0, len, (char*)buf};
+    return Sim_i2c_transfer(&msg, 1);
+}
+
+static uint8_t Sim_i2c_read(uint8_t addr, char* buf, uint32_t len)
+{
+    Drone_Bus_I2C_Msg msg = {addr, 1, len, buf};
+    return Sim_i2c_transfer(&msg, 1);
+}
+
+/* nRF24L01+ on CS0 */
+
+static void Sim_RF24_Receive(uint64_t now)
+{
+    while (now >= rf24.next) {
+        if (rf24.nFifo < SIM_RF24_FIFO) {
+            uint8_t* p = rf24.fifo[rf24.nFifo++];
+            memset(p, 0, SIM_RF24_PAYLOAD);
+            p[0] = 0x22;                                            // Neutral direction, minimum power
+            p[3] = (!tStart || now - tStart < flightTime) ? 0x40 : 0x00;    // Switch
+            rf24.reg[0x07][0] |= 0x40;                              // STATUS.RX_DR
+        }
+        rf24.next += SIM_RF24_PERIOD;
+    }
+    uint8_t* status = &rf24.reg[0x07][0];
+    *status = (*status & ~0x0E) | (rf24.nFifo ? 0x02 : 0x0E);        // RX_P_NO : pipe 1 or empty
+    rf24.reg[0x17][0] = (rf24.reg[0x17][0] & ~0x03) | (rf24.nFifo ? 0 : 0x01) | (rf24.nFifo == SIM_RF24_FIFO ? 0x02 : 0);
+}
+
+static void Sim_RF24_Frame(const uint8_t* tx, uint8_t* rx, uint32_t len, uint64_t now)
+{
+    Sim_RF24_Receive(now);
+    uint8_t cmd = tx[0];
+    rx[0] = rf24.reg[0x07][0];
+    if (cmd < 0x20) {                                               // R_REGISTER
+        for (uint32_t i=1; i<len; ++i) rx[i] = rf24.reg[cmd][(i-1) % 5];
+    } else if (cmd < 0x40) {                                        // W_REGISTER
+        uint8_t r = cmd & 0x1F;
+        if (r == 0x07) rf24.reg[r][0] &= ~(len > 1 ? tx[1] & 0x70 : 0);     // Write 1 to clear the interrupts
+        else for (uint32_t i=1; i<len && i<=5; ++i) rf24.reg[r][i-1] = tx[i];
+        memset(rx+1, 0, len-1);
+    } else if (cmd == 0x61) {                                       // R_RX_PAYLOAD
+        for (uint32_t i=1; i<len; ++i) rx[i] = rf24.nFifo && i <= SIM_RF24_PAYLOAD ? rf24.fifo[0][i-1] : 0;
+        if (rf24.nFifo) memmove(rf24.fifo[0], rf24.fifo[1], --rf24.nFifo * SIM_RF24_PAYLOAD);
+    } else if (cmd == 0x60) {                                       // R_RX_PL_WID
+        if (len > 1) rx[1] = rf24.reg[0x12][0];
+    } else {
+        if (cmd == 0xE2) rf24.nFifo = 0;                            // FLUSH_RX
+        else if (cmd == 0xA0 || cmd == 0xB0) rf24.reg[0x07][0] |= 0x20;    // W_TX_PAYLOAD : sent at once (TX_DS)
+        memset(rx+1, 0, len > 1 ? len-1 : 0);
+    }
+    Sim_RF24_Receive(now);
+}
+
+/* MCP3008 on CS1 */
+
+static void Sim_MCP3008_Frame(const uint8_t* tx, uint8_t* rx, uint32_t len, uint64_t now)
+{
+    memset(rx, 0, len);
+    if (len < 3) return;
+    int value = (tx[1] & 0x70) ? 0 : 798 + Sim_Noise(&spiBus, 1);  // Channel 0 : 3.9 V on 5 V reference
+    rx[1] = (value >> 8) & 0x03;
+    rx[2] = value & 0xFF;
+}
+
+static void Sim_spi_frame(const uint8_t* tx, uint8_t* rx, uint32_t len)
+{
+    uint64_t now = get_nsec();
+    pthread_mutex_lock(&spiBus.lock);
+    if (spiCS == DRONE_BUS_SPI_CS0) Sim_RF24_Frame(tx, rx, len, now);
+    else if (spiCS == DRONE_BUS_SPI_CS1) Sim_MCP3008_Frame(tx, rx, len, now);
+    else memset(rx, 0, len);
+    Sim_Wait(now, spiBus.latency + (uint64_t)spiBus.byteLatency * len);
+    pthread_mutex_unlock(&spiBus.lock);
+}
+
+static uint8_t Sim_spi_transfer(uint8_t value)
+{
+    uint8_t rx;
+    Sim_spi_frame(&value, &rx, 1);
+    return rx;
+}
+
+static void Sim_spi_transfernb(char* tbuf, char* rbuf, uint32_t len)
+{
+    if (len) Sim_spi_frame((const uint8_t*)tbuf, (uint8_t*)rbuf, len);
+}
+
+static void Sim_spi_chipSelect(uint8_t cs)
+{
+    spiCS = cs;
+}
+
+/* Data-ready lines of ADXL345 (INT1), L3G4200D (DRDY/INT2) and HMC5883L (DRDY) : one edge per output data period */
+
+static int Sim_DRDY_Find(uint8_t pin)
+{
+    for (int i=0; i<SIM_NDRDY; ++i) {
+        if (drdy[i].pin == pin) return i;
+    }
+    return -1;
+}
+
+// Period of the edges from the registers of the device, 0 if its line is not enabled
+static uint64_t Sim_DRDY_Period(int i)
+{
+    const uint8_t* reg = i2cDev[i].reg;
+    uint64_t rate = 0;
+    pthread_mutex_lock(&i2cBus.lock);
+    switch (i) {
+        case 0 :                                                    // INT_ENABLE.DATA_READY, BW_RATE
+            if (reg[0x2E] & 0x80) rate = 3200 >> (0x0F - (reg[0x2C] & 0x0F));
+            break;
+        case 1 :                                                    // CTRL_REG3.I2_DRDY, CTRL_REG1.DR
+            if (reg[0x22] & 0x08) rate = 100 << (reg[0x20] >> 6);
+            break;
+        case 2 :                                                    // Always on, 75 Hz
+            rate = 75;
+            break;
+    }
+    pthread_mutex_unlock(&i2cBus.lock);
+    return rate ? BILLION / rate : 0;
+}
+
+static int Sim_gpio_eventRequest(uint8_t pin, uint8_t edge)
+{
+    int i = Sim_DRDY_Find(pin);
+    if (i < 0) return -1;
+    drdy[i].isRequested = 1;
+    drdy[i].next = 0;
+    return 0;
+}
+
+static int Sim_gpio_eventRead(uint8_t pin, uint64_t* t)
+{
+    int i = Sim_DRDY_Find(pin);
+    if (i < 0 || !drdy[i].isRequested) return 0;
+    uint64_t period = Sim_DRDY_Period(i), now = get_nsec();
+    if (!period) return 0;
+    if (!drdy[i].next) drdy[i].next = now + period;
+    int n = 0;
+    for (; drdy[i].next <= now; drdy[i].next += period, ++n) *t = drdy[i].next;
+    return n;
+}
+
+static int Sim_gpio_eventWait(uint8_t pin, uint64_t timeout)
+{
+    int i = Sim_DRDY_Find(pin);
+    if (i < 0 || !drdy[i].isRequested) return 0;
+    uint64_t period = Sim_DRDY_Period(i), now = get_nsec();
+    if (!period || !drdy[i].next) return 0;
+    // First edge after now, the ones not read yet stay for Sim_gpio_eventRead()
+    uint64_t edge = drdy[i].next;
+    if (edge <= now) edge += ((now - edge) / period + 1) * period;
+    if (edge - now > timeout) return 0;
+    struct timespec ts = {(edge - now) / BILLION, (edge - now) % BILLION};
+    while (nanosleep(&ts, &ts)) ;
+    return 1;
+}
+
+static int Sim_init(void)
+{
+    tStart = 0;
+    Sim_I2C_Setup();
+    memset(&rf24, 0, sizeof(rf24));
+    rf24.reg[0x00][0] = 0x08;                                       // CONFIG
+    rf24.reg[0x06][0] = 0x0E;                                       // RF_SETUP
+    rf24.reg[0x07][0] = 0x0E;                                       // STATUS
+    rf24.reg[0x17][0] = 0x11;                                       // FIFO_STATUS
+    rf24.next = get_nsec();
+    for (int i=0; i<SIM_NDRDY; ++i) drdy[i].isRequested = 0;
+    return 0;
+}
+
+static void Sim_tick(uint64_t now)
+{
+    pthread_mutex_lock(&spiBus.lock);
+    if (!tStart) tStart = now;                                      // The flight time counts from the first cycle
+    pthread_mutex_unlock(&spiBus.lock);
+}
+
+void Drone_Bus_Sim_SetLatency(uint32_t i2c, uint32_t i2cByte, uint32_t spi, uint32_t spiByte)
+{
+    i2cBus.latency = i2c;
+    i2cBus.byteLatency = i2cByte;
+    spiBus.latency = spi;
+    spiBus.byteLatency = spiByte;
+}
+
+void Drone_Bus_Sim_SetFlightTime(uint32_t second)
+{
+    flightTime = second * BILLION;
+}
+
+const Drone_Bus_Backend Drone_Bus_Sim = {
+    .name                       = "simulation",
+    .init                       = Sim_init,
+    .tick                       = Sim_tick,
+    .i2c_write                  = Sim_i2c_write,
+    .i2c_read                   = Sim_i2c_read,
+    .i2c_transfer               = Sim_i2c_transfer,
+    .spi_chipSelect             = Sim_spi_chipSelect,
+    .spi_transfer               = Sim_spi_transfer,
+    .spi_transfernb             = Sim_spi_transfernb,
+    .gpio_eventRequest          = Sim_gpio_eventRequest,
+    .gpio_eventRead             = Sim_gpio_eventRead,
+    .gpio_eventWait             = Sim_gpio_eventWait,
+};
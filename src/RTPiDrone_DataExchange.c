@@ -1,48 +1,65 @@
+#include "RTPiDrone_header.h"
 #include "RTPiDrone_DataExchange.h"
+#include "RTPiDrone_RingBuffer.h"
 #include "Common.h"
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #define LINESIZE        512
 #define LINETEMPSIZE    128
 
-typedef struct __DataChain {
-    Drone_DataExchange data;
-    struct __DataChain *next;
-} DataChain;
-
 static char LINE[LINESIZE], LINETEMP[LINETEMPSIZE];
 static float T_temp;
-static DataChain *dataStart, *dataEnd;
-static pthread_mutex_t  mutex;
-static pthread_cond_t   cond;
+static Drone_RingBuffer *dataRing;                  //!< \private Records waiting to be written by writeData
 static pthread_t        pid;
-static int              global_thread;
-static int              iStop;
+static int              pidStarted;                 //!< \private writeData is running and must be joined
+static atomic_int       iStop;
 static void* writeData(void*);
 
 int Drone_DataExchange_Init(Drone_DataExchange** data, FILE* f)
 {
+    pidStarted = 0;
     *data = (Drone_DataExchange*)calloc(1, sizeof(Drone_DataExchange));
-    dataStart = (DataChain*) calloc(1, sizeof(DataChain));
-    dataEnd = dataStart;
-    pthread_cond_init(&cond,NULL);
-    pthread_mutex_init(&mutex,NULL);
-    pthread_create(&pid, NULL, writeData, (void*)f);
+    if (*data == NULL) {
+        perror("Data exchange Init error");
+        return -1;
+    }
+    if (Drone_RingBuffer_Init(&dataRing, sizeof(Drone_DataExchange), DATAEXCHANGE_RINGSIZE)) {
+        perror("Data ring Init error");
+        free(*data);
+        *data = NULL;
+        return -2;
+    }
+    atomic_store(&iStop, 0);
+    if (pthread_create(&pid, NULL, writeData, (void*)f)) {
+        perror("Data writer thread error");
+        Drone_RingBuffer_End(&dataRing);
+        free(*data);
+        *data = NULL;
+        return -3;
+    }
+    pidStarted = 1;
     return 0;
 }
 
 void Drone_DataExchange_End(Drone_DataExchange** data)
 {
-    iStop = -1;
-    pthread_cond_signal(&cond);
-    pthread_join(pid,NULL);
-    pthread_cond_destroy(&cond);
-    pthread_mutex_destroy(&mutex);
-    free(dataStart);
-    dataStart = dataEnd = NULL;
+    atomic_store(&iStop, -1);
+    if (pidStarted) {
+        pthread_join(pid,NULL);
+        pidStarted = 0;
+    }
+    if (dataRing) {
+#ifdef  DEBUG
+        printf("Data ring : %llu records dropped (capacity %u)\n",
+               (unsigned long long)Drone_RingBuffer_GetOverflow(dataRing), Drone_RingBuffer_GetCapacity(dataRing));
+#endif
+        Drone_RingBuffer_End(&dataRing);
+    }
     free(*data);
-    data = NULL;
+    *data = NULL;
 }
 
 void Drone_DataExchange_Print(Drone_DataExchange* data)
@@ -105,11 +122,7 @@ void Drone_DataExchange_PrintTextFile(Drone_DataExchange* data, FILE *fp)
 
 void Drone_DataExchange_SaveFile(Drone_DataExchange* data)
 {
-    dataEnd->data = *data;
-    dataEnd->next = (DataChain*) calloc(1, sizeof(DataChain));
-    dataEnd = dataEnd->next;
-    global_thread = 1;
-    pthread_cond_signal(&cond);
+    Drone_RingBuffer_Push(dataRing, data);
 }
 
 void Drone_DataExchange_PrintFile(Drone_DataExchange* data, FILE *fp)
@@ -120,19 +133,16 @@ void Drone_DataExchange_PrintFile(Drone_DataExchange* data, FILE *fp)
 static void* writeData(void* fp)
 {
     FILE* f = (FILE*)fp;
-    while (!iStop) {
-        pthread_mutex_lock(&mutex);
-        if (!global_thread) pthread_cond_wait(&cond, &mutex);
-    
-        while (dataStart != dataEnd) {
-            Drone_DataExchange_PrintFile(&dataStart->data, f);
-            DataChain *dataTemp = dataStart->next;
-            free(dataStart);
-            dataStart = dataTemp;        
+    Drone_DataExchange record;
+    const struct timespec pause = {0, DATAEXCHANGE_WRITE_PERIOD};
+    int stop;
+    do {
+        stop = atomic_load(&iStop);
+        while (!Drone_RingBuffer_Pop(dataRing, &record)) {
+            Drone_DataExchange_PrintFile(&record, f);
         }
-        global_thread = 0;
-        pthread_mutex_unlock(&mutex);
-    }
+        if (!stop) nanosleep(&pause, NULL);
+    } while (!stop);
     fflush(f);
     pthread_exit(NULL);
 }
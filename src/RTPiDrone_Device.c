@@ -1,7 +1,7 @@
 #include "RTPiDrone_header.h"
 #include "RTPiDrone_Device.h"
+#include "RTPiDrone_Bus.h"
 #include "Common.h"
-#include <bcm2835.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -67,6 +67,7 @@ void Drone_Device_Create(Drone_Device* dev)
     Drone_Device_SetRealFunction(dev, dummyFunction);
     Drone_Device_SetEndFunction(dev, dummyEndFunction);
     dev->getData = NULL;
+    dev->drdyPin = -1;
 }
 
 int Drone_Device_Init(Drone_Device* dev)
@@ -100,17 +101,64 @@ char* Drone_Device_GetName(Drone_Device* dev)
     return dev->name;
 }
 
-void* Drone_Device_GetRefreshedData(Drone_Device* dev, uint64_t* time)
+/*!
+ * function : no new sample since the last refresh (data-ready line), the line is polled once per time (cycle)
+ * \private \memberof Drone_Device
+ */
+static inline int Drone_Device_NotReady(Drone_Device* dev, uint64_t* time)
 {
-    if (*time-dev->lastUpdate > dev->period) {
+    if (dev->drdyPin < 0) return 0;
+    if (!dev->drdyPending && *time != dev->drdyPoll) {
+        dev->drdyPoll = *time;
+        dev->drdyPending = Drone_Bus_GPIO_EventPending(dev->drdyPin, &dev->drdyTime);
+    }
+    return !dev->drdyPending;
+}
+
+int Drone_Device_IsDue(Drone_Device* dev, uint64_t* time)
+{
+    // A due refresh waits for the data-ready edge, due is kept until then
+    if (Drone_Device_NotReady(dev, time)) return 0;
+    // In the pipelined loop, due is set by the acquisition thread and taken by the actuation one
+    if (dev->scheduled ? atomic_exchange_explicit(&dev->due, 0, memory_order_relaxed) : (*time-dev->lastUpdate > dev->period)) {
         dev->lastUpdate = *time;
+        return 1;
+    }
+    return 0;
+}
+
+void* Drone_Device_GetRefreshedData(Drone_Device* dev, uint64_t* time)
+{
+    if (Drone_Device_IsDue(dev, time)) {
+        if (dev->drdyPin >= 0) {
+            Drone_Bus_GPIO_EventClear(dev->drdyPin);
+            dev->drdyPending = 0;
+        }
         if (dev->rawdata_func(dev)<0) return NULL;
+        dev->sampleTime = dev->drdyPin >= 0 ? dev->drdyTime : *time;
         dev->data_func(dev);
         return dev->getData;
     }
     return NULL;
 }
 
+uint64_t Drone_Device_GetSampleTime(Drone_Device* dev)
+{
+    return dev->sampleTime;
+}
+
+int Drone_Device_SetDataReady(Drone_Device* dev, int pin, uint8_t edge)
+{
+    if (Drone_Bus_GPIO_EventRequest(pin, edge)) {
+        fprintf(stderr, "%s : no data-ready event on GPIO %d\n", dev->name, pin);
+        return -1;
+    }
+    dev->drdyPin = pin;
+    dev->drdyPoll = 0;
+    dev->drdyPending = 0;
+    return 0;
+}
+
 void Drone_Device_SetPeriod(Drone_Device* dev, uint64_t time)
 {
     dev->period = time;
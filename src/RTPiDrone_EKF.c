@@ -0,0 +1,226 @@
+/*! \file RTPiDrone_EKF.c
+    \brief Extended Kalman filter of the attitude, an alternative to the Mahony filter of RTPiDrone_Quaternion.c
+
+    The state is the quaternion and the angular velocity of the drone, the measurements are the angular velocity
+    (L3G4200D), the direction of the gravity (ADXL345) and the one of the magnetic field (HMC5883L). The matrices
+    have the size of the state and live in the object; P is symmetric, only its upper triangle is computed and then
+    mirrored. The 9 measurements have independent noises, so they are applied one at a time: each of them is a
+    scalar update, without the inverse of the innovation covariance.
+ */
+#include "RTPiDrone_EKF.h"
+#include "Common.h"
+#include "FastMath.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define EKF_NSTATE      7           //!< \private q0, q1, q2, q3, wx, wy, wz
+#define EKF_PQ_INITIAL  (0.001f)    //!< \private Initial variance of the quaternion
+#define EKF_PW_INITIAL  (0.010f)    //!< \private Initial variance of the angular velocity
+#define EKF_QQ          (1e-5f)     //!< \private Process noise of the quaternion (1/s)
+#define EKF_QW          (50.0f)     //!< \private Process noise of the angular velocity ((rad/s)^2/s)
+#define EKF_RA          (0.05f)     //!< \private Noise of the normalized acceleration
+#define EKF_RW          (1e-4f)     //!< \private Noise of the angular velocity ((rad/s)^2)
+#define EKF_RM          (0.05f)     //!< \private Noise of the normalized magnetic field
+
+struct Drone_EKF {
+    float x[EKF_NSTATE];                    //!< \private State
+    float P[EKF_NSTATE][EKF_NSTATE];        //!< \private Covariance of the state
+};
+
+static void Drone_EKF_predict(Drone_EKF*, float);                       //!< \private Propagation of the state and of P over dt
+static void Drone_EKF_correct(Drone_EKF*, float*, float, float);        //!< \private Scalar update with P*H', H*P*H'+R and the innovation
+static void Drone_EKF_updateGyro(Drone_EKF*, float*);                   //!< \private Angular velocity measured
+static void Drone_EKF_updateDirection(Drone_EKF*, float*, float*);      //!< \private Gravity and magnetic field measured
+
+int Drone_EKF_Init(Drone_EKF** E, float* angle)
+{
+    *E = calloc(1, sizeof(Drone_EKF));
+    float dCos[3], dSin[3];
+    for (int i=0; i<3; ++i) {
+        dCos[i] = cosf(angle[i]*FAST_DEG_TO_RAD * 0.5f);
+        dSin[i] = sinf(angle[i]*FAST_DEG_TO_RAD * 0.5f);
+    }
+
+    (*E)->x[0] = dCos[0] * dCos[1] * dCos[2] + dSin[0] * dSin[1] * dSin[2];
+    (*E)->x[1] = dSin[0] * dCos[1] * dCos[2] - dCos[0] * dSin[1] * dSin[2];
+    (*E)->x[2] = dCos[0] * dSin[1] * dCos[2] + dSin[0] * dCos[1] * dSin[2];
+    (*E)->x[3] = dCos[0] * dCos[1] * dSin[2] - dSin[0] * dSin[1] * dCos[2];
+
+    for (int i=0; i<4; ++i) (*E)->P[i][i] = EKF_PQ_INITIAL;
+    for (int i=4; i<EKF_NSTATE; ++i) (*E)->P[i][i] = EKF_PW_INITIAL;
+
+    return 0;
+}
+
+void Drone_EKF_Delete(Drone_EKF** E)
+{
+    free(*E);
+    *E = NULL;
+}
+
+void Drone_EKF_getAngle(Drone_EKF* E, float* angle)
+{
+    const float* q = E->x;
+    angle[0] = fastAtan2(2*q[2]*q[3] + 2*q[0]*q[1], -2*q[1]*q[1] - 2*q[2]*q[2] + 1) * FAST_RAD_TO_DEG; // roll
+    angle[1] = fastAsin(-2*q[1]*q[3] + 2*q[0]*q[2]) * FAST_RAD_TO_DEG; // pitch
+    angle[2] = fastAtan2(2*q[1]*q[2] + 2*q[0]*q[3], -2*q[2]*q[2] - 2*q[3]*q[3] + 1) * FAST_RAD_TO_DEG; // yaw
+}
+
+void Drone_EKF_renew(Drone_EKF* E, float deltaT, float* accl, float* gyro, float* magn)
+{
+    Drone_EKF_predict(E, deltaT);
+    Drone_EKF_updateGyro(E, gyro);
+    Drone_EKF_updateDirection(E, accl, magn);
+}
+
+void Drone_EKF_renewSamples(Drone_EKF* E, float* accl, float (*gyro)[3], float* deltaT, int n, float* magn)
+{
+    // Each gyro sample over its own interval, the gravity and the magnetic field once per cycle
+    for (int k=0; k<n; ++k) {
+        Drone_EKF_predict(E, deltaT[k]);
+        Drone_EKF_updateGyro(E, gyro[k]);
+    }
+    Drone_EKF_updateDirection(E, accl, magn);
+}
+
+static void Drone_EKF_symmetrize(Drone_EKF* E)
+{
+    for (int i=1; i<EKF_NSTATE; ++i)
+        for (int j=0; j<i; ++j) E->P[i][j] = E->P[j][i];
+}
+
+static void Drone_EKF_normalize(Drone_EKF* E)
+{
+    float invNorm = getInvSqrt(E->x, 4);
+    for (int i=0; i<4; ++i) E->x[i] *= invNorm;
+}
+
+static void Drone_EKF_predict(Drone_EKF* E, float deltaT)
+{
+    const float h = deltaT*0.5f;
+    const float* q = E->x;
+    const float* w = E->x + 4;
+    // F = [A B; 0 I] : A = dq'/dq, B = dq'/dw of q' = q + dt/2 * q x (0, w)
+    const float A[4][4] = {
+        {1,        -h*w[0],  -h*w[1],  -h*w[2]},
+        {h*w[0],    1,        h*w[2],  -h*w[1]},
+        {h*w[1],   -h*w[2],   1,        h*w[0]},
+        {h*w[2],    h*w[1],  -h*w[0],   1     },
+    };
+    const float B[4][3] = {
+        {-h*q[1],  -h*q[2],  -h*q[3]},
+        { h*q[0],  -h*q[3],   h*q[2]},
+        { h*q[3],   h*q[0],  -h*q[1]},
+        {-h*q[2],   h*q[1],   h*q[0]},
+    };
+
+    float qp[4];
+    for (int i=0; i<4; ++i) {
+        qp[i] = 0;
+        for (int k=0; k<4; ++k) qp[i] += A[i][k] * q[k];
+    }
+    for (int i=0; i<4; ++i) E->x[i] = qp[i];
+    Drone_EKF_normalize(E);
+
+    // F*P*F' : M = A*Pqq + B*Pwq, N = A*Pqw + B*Pww, then Pqq = M*A' + N*B', Pqw = N, Pww stays
+    float M[4][4], N[4][3];
+    for (int i=0; i<4; ++i) {
+        for (int j=0; j<EKF_NSTATE; ++j) {
+            float s = 0;
+            for (int k=0; k<4; ++k) s += A[i][k] * E->P[k][j];
+            for (int k=0; k<3; ++k) s += B[i][k] * E->P[4+k][j];
+            if (j < 4) M[i][j] = s;
+            else N[i][j-4] = s;
+        }
+    }
+    for (int i=0; i<4; ++i) {
+        for (int j=i; j<4; ++j) {
+            float s = 0;
+            for (int k=0; k<4; ++k) s += M[i][k] * A[j][k];
+            for (int k=0; k<3; ++k) s += N[i][k] * B[j][k];
+            E->P[i][j] = s;
+        }
+        for (int j=0; j<3; ++j) E->P[i][4+j] = N[i][j];
+    }
+    for (int i=0; i<4; ++i) E->P[i][i] += EKF_QQ * deltaT;
+    for (int i=4; i<EKF_NSTATE; ++i) E->P[i][i] += EKF_QW * deltaT;
+    Drone_EKF_symmetrize(E);
+}
+
+static void Drone_EKF_correct(Drone_EKF* E, float* PHt, float S, float y)
+{
+    // K = P*H'/S, x += K*y, P -= K*H*P = P*H'*(P*H')'/S
+    for (int i=0; i<EKF_NSTATE; ++i) E->x[i] += PHt[i] / S * y;
+    for (int i=0; i<EKF_NSTATE; ++i)
+        for (int j=i; j<EKF_NSTATE; ++j) E->P[i][j] -= PHt[i] * PHt[j] / S;
+    Drone_EKF_symmetrize(E);
+}
+
+static void Drone_EKF_updateGyro(Drone_EKF* E, float* gyro)
+{
+    // H is a row of the identity : P*H' is a column of P
+    float PHt[EKF_NSTATE];
+    for (int m=0; m<3; ++m) {
+        for (int i=0; i<EKF_NSTATE; ++i) PHt[i] = E->P[i][4+m];
+        Drone_EKF_correct(E, PHt, PHt[4+m] + EKF_RW, gyro[m] - E->x[4+m]);
+    }
+}
+
+static void Drone_EKF_updateDirection(Drone_EKF* E, float* accl, float* magn)
+{
+    float aInvNorm = getInvSqrt(accl, 3);
+    float mInvNorm = getInvSqrt(magn, 3);
+    if (aInvNorm == 0 || mInvNorm == 0) return;
+    float a[3], m[3];
+    for (int i=0; i<3; ++i) {
+        a[i] = accl[i] * aInvNorm;
+        m[i] = magn[i] * mInvNorm;
+    }
+
+    // Linearization point of the 6 measurements
+    float q[4];
+    for (int i=0; i<4; ++i) q[i] = E->x[i];
+
+    // Magnetic field on the earth frame : its horizontal part along x
+    float hx = 2 * (m[0]*(0.5f - q[2]*q[2] - q[3]*q[3]) + m[1]*(q[1]*q[2] - q[0]*q[3]) + m[2]*(q[1]*q[3] + q[0]*q[2]));
+    float hy = 2 * (m[0]*(q[1]*q[2] + q[0]*q[3]) + m[1]*(0.5f - q[1]*q[1] - q[3]*q[3]) + m[2]*(q[2]*q[3] - q[0]*q[1]));
+    float bx = sqrtf(hx*hx + hy*hy);
+    float bz = 2 * (m[0]*(q[1]*q[3] - q[0]*q[2]) + m[1]*(q[2]*q[3] + q[0]*q[1]) + m[2]*(0.5f - q[1]*q[1] - q[2]*q[2]));
+
+    // Expected gravity and magnetic field on the body frame, and their derivatives by q
+    const float z[6] = {a[0], a[1], a[2], m[0], m[1], m[2]};
+    const float hq[6] = {
+        2*(q[1]*q[3] - q[0]*q[2]),
+        2*(q[0]*q[1] + q[2]*q[3]),
+        q[0]*q[0] - q[1]*q[1] - q[2]*q[2] + q[3]*q[3],
+        2*(bx*(0.5f - q[2]*q[2] - q[3]*q[3]) + bz*(q[1]*q[3] - q[0]*q[2])),
+        2*(bx*(q[1]*q[2] - q[0]*q[3]) + bz*(q[0]*q[1] + q[2]*q[3])),
+        2*(bx*(q[0]*q[2] + q[1]*q[3]) + bz*(0.5f - q[1]*q[1] - q[2]*q[2])),
+    };
+    const float H[6][4] = {
+        {-2*q[2],               2*q[3],                 -2*q[0],                2*q[1]},
+        { 2*q[1],               2*q[0],                  2*q[3],                2*q[2]},
+        { 2*q[0],              -2*q[1],                 -2*q[2],                2*q[3]},
+        {-2*bz*q[2],            2*bz*q[3],              -4*bx*q[2] - 2*bz*q[0], -4*bx*q[3] + 2*bz*q[1]},
+        {-2*bx*q[3] + 2*bz*q[1], 2*bx*q[2] + 2*bz*q[0],  2*bx*q[1] + 2*bz*q[3], -2*bx*q[0] + 2*bz*q[2]},
+        { 2*bx*q[2],            2*bx*q[3] - 4*bz*q[1],   2*bx*q[0] - 4*bz*q[2],  2*bx*q[1]},
+    };
+    const float R[6] = {EKF_RA, EKF_RA, EKF_RA, EKF_RM, EKF_RM, EKF_RM};
+
+    float PHt[EKF_NSTATE];
+    for (int n=0; n<6; ++n) {
+        // H is zero on the angular velocity : P*H' from the first 4 columns of P
+        float S = R[n];
+        float y = z[n] - hq[n];
+        for (int i=0; i<EKF_NSTATE; ++i) {
+            PHt[i] = 0;
+            for (int k=0; k<4; ++k) PHt[i] += E->P[i][k] * H[n][k];
+        }
+        for (int k=0; k<4; ++k) {
+            S += H[n][k] * PHt[k];
+            y -= H[n][k] * (E->x[k] - q[k]);        // Same linearization for all of them
+        }
+        Drone_EKF_correct(E, PHt, S, y);
+    }
+    Drone_EKF_normalize(E);
+}
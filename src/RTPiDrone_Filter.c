@@ -1,31 +1,123 @@
 #include "RTPiDrone_Filter.h"
+#include "Vec4.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 const static float A1 = 2.0f * ZETA / OMEGA_N;
 const static float A2 = 1.0f / OMEGA_N / OMEGA_N;
-void Drone_Filter_init(Drone_Filter* f, float dt, float omega_divide)
+
+//! One section of 4 channels : the lane i of each member is the channel 4*group + i
+typedef struct {
+    _Alignas(16) float b0[4];   //!< \private b0/a0
+    float b1[4], b2[4];         //!< \private b1/a0, b2/a0
+    float na1[4], na2[4];       //!< \private -a1/a0, -a2/a0
+    float x1[4], x2[4];         //!< \private Last inputs
+    float y1[4], y2[4];         //!< \private Last outputs
+} Drone_FilterBank_Section;
+
+struct Drone_FilterBank {
+    uint64_t    N;                          //!< \private Samples so far
+    uint64_t    warmUp;                     //!< \private Samples going through unfiltered
+    int         nChannel, nSection, nGroup; //!< \private nGroup = vectors of 4 channels
+    Drone_FilterBank_Section section[];     //!< \private nSection sections of the group 0, then of the group 1...
+};
+
+int Drone_FilterBank_Init(Drone_FilterBank** bank, int nChannel, int nSection)
 {
-    f->B0 = A2*omega_divide*omega_divide/dt/dt - A1*omega_divide/dt + 1;
-    f->B1 = -2*A2*omega_divide*omega_divide/dt/dt + A1*omega_divide/dt;
-    f->B2 = A2*omega_divide*omega_divide/dt/dt;
+    int nGroup = (nChannel + 3) / 4;
+    size_t size = sizeof(Drone_FilterBank) + sizeof(Drone_FilterBank_Section) * nGroup * nSection;
+    *bank = aligned_alloc(16, (size + 15) / 16 * 16);
+    if (!*bank) {
+        perror("Filter bank allocation");
+        return -1;
+    }
+    memset(*bank, 0, size);
+    (*bank)->nChannel = nChannel;
+    (*bank)->nSection = nSection;
+    (*bank)->nGroup = nGroup;
+    (*bank)->warmUp = FILTER_WARMUP;
+    for (int k=0; k<nGroup*nSection; ++k)
+        for (int i=0; i<4; ++i) (*bank)->section[k].b0[i] = 1.0f;
+    return 0;
 }
 
-void Drone_Filter_Pure(Drone_Filter* f, float rawdata)
+void Drone_FilterBank_Delete(Drone_FilterBank** bank)
 {
-    float estimated;
-    Drone_Filter_renew(f, rawdata, &estimated);
+    free(*bank);
+    *bank = NULL;
 }
 
-void Drone_Filter_renew(Drone_Filter* f, float rawdata, float *estimated)
+int Drone_FilterBank_SetSection(Drone_FilterBank* bank, int channel, int section, const float* b, const float* a)
 {
-    if (f->N<500) {
-        *estimated = rawdata;
-    } else {
-        *estimated = -f->B1/f->B2*f->estimated_previous[0] - f->B0/f->B2*f->estimated_previous[1] + 1/f->B2*(rawdata);
-    }
+    if (channel < 0 || channel >= bank->nChannel || section < 0 || section >= bank->nSection || a[0] == 0) return -1;
+    Drone_FilterBank_Section* s = &bank->section[channel/4 * bank->nSection + section];
+    int i = channel % 4;
+    s->b0[i] = b[0]/a[0];
+    s->b1[i] = b[1]/a[0];
+    s->b2[i] = b[2]/a[0];
+    s->na1[i] = -a[1]/a[0];
+    s->na2[i] = -a[2]/a[0];
+    return 0;
+}
+
+int Drone_FilterBank_SetLowPass(Drone_FilterBank* bank, int channel, int section, float dt, float omega_divide)
+{
+    // a0 y + a1 y1 + a2 y2 = x, from the continuous second order by backward differences
+    const float b[3] = {1.0f, 0.0f, 0.0f};
+    const float a[3] = {
+        A2*omega_divide*omega_divide/dt/dt,
+        -2*A2*omega_divide*omega_divide/dt/dt + A1*omega_divide/dt,
+        A2*omega_divide*omega_divide/dt/dt - A1*omega_divide/dt + 1,
+    };
+    return Drone_FilterBank_SetSection(bank, channel, section, b, a);
+}
 
-    f->estimated_previous[1] = f->estimated_previous[0];
-    f->estimated_previous[0] = *estimated;
-    ++(f->N);
+void Drone_FilterBank_SetWarmUp(Drone_FilterBank* bank, uint64_t n)
+{
+    bank->warmUp = n;
 }
 
+void Drone_FilterBank_Pure(Drone_FilterBank* bank, const float* rawdata)
+{
+    float estimated[bank->nChannel];
+    Drone_FilterBank_renew(bank, rawdata, estimated);
+}
 
+/*!
+ * function : the sections of a group in cascade on x, the output is the input during the warm-up (history only)
+ * \private \memberof Drone_FilterBank
+ */
+static inline vec4 Drone_FilterBank_group(Drone_FilterBank_Section* s, int nSection, vec4 x, int warmUp)
+{
+    for (int k=0; k<nSection; ++k, ++s) {
+        vec4 x1 = vec4_load4(s->x1), y1 = vec4_load4(s->y1);
+        vec4 y = x;
+        if (!warmUp) {
+            // y1, the output of the previous sample, comes last : one multiply and one add on the recurrence
+            y = vec4_add(vec4_mul(vec4_load4(s->b0), x), vec4_mul(vec4_load4(s->na2), vec4_load4(s->y2)));
+            y = vec4_add(y, vec4_add(vec4_mul(vec4_load4(s->b1), x1), vec4_mul(vec4_load4(s->b2), vec4_load4(s->x2))));
+            y = vec4_add(y, vec4_mul(vec4_load4(s->na1), y1));
+        }
+        vec4_store4(s->x2, x1);
+        vec4_store4(s->x1, x);
+        vec4_store4(s->y2, y1);
+        vec4_store4(s->y1, y);
+        x = y;
+    }
+    return x;
+}
 
+void Drone_FilterBank_renew(Drone_FilterBank* bank, const float* rawdata, float* estimated)
+{
+    // The channels go straight from rawdata to the vectors and back to estimated : no copy through memory, whose
+    // scalar stores would stall the vector load. The warm-up is a separate copy of the loop.
+    int warmUp = bank->N < bank->warmUp;
+    Drone_FilterBank_Section* s = bank->section;
+    for (int c=0; c<bank->nChannel; c+=4, s+=bank->nSection) {
+        int n = bank->nChannel - c < 4 ? bank->nChannel - c : 4;
+        vec4 x = vec4_load(rawdata + c, n);
+        x = warmUp ? Drone_FilterBank_group(s, bank->nSection, x, 1) : Drone_FilterBank_group(s, bank->nSection, x, 0);
+        vec4_store(estimated + c, x, n);
+    }
+    ++(bank->N);
+}
@@ -0,0 +1,87 @@
+/*! \file RTPiDrone_Histogram.c
+    \brief Log-linear histogram of durations
+ */
+#include "RTPiDrone_Histogram.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HISTOGRAM_NAMESIZE  16
+#define HISTOGRAM_HALF      (1 << (HISTOGRAM_SUBBITS-1))
+#define HISTOGRAM_NBUCKET   ((HISTOGRAM_MAXBIT - HISTOGRAM_SUBBITS + 3) * HISTOGRAM_HALF)
+
+/*!
+ * \struct Drone_Histogram
+ * \brief Drone_Histogram structure
+ */
+struct Drone_Histogram {
+    char        name[HISTOGRAM_NAMESIZE];       //!< \private Name printed in the report
+    uint64_t    count;                          //!< \private Number of values
+    uint64_t    sum;                            //!< \private Sum of values
+    uint64_t    max;                            //!< \private Largest value
+    uint32_t    bucket[HISTOGRAM_NBUCKET];      //!< \private Counts
+};
+
+static uint32_t Drone_Histogram_Index(uint64_t);        //!< \private \memberof Drone_Histogram: bucket of a value
+static uint64_t Drone_Histogram_UpperBound(uint32_t);   //!< \private \memberof Drone_Histogram: largest value of a bucket
+
+int Drone_Histogram_Init(Drone_Histogram** h, const char* name)
+{
+    *h = (Drone_Histogram*) calloc(1, sizeof(Drone_Histogram));
+    if (!*h) return -1;
+    strncpy((*h)->name, name, HISTOGRAM_NAMESIZE-1);
+    return 0;
+}
+
+void Drone_Histogram_End(Drone_Histogram** h)
+{
+    free(*h);
+    *h = NULL;
+}
+
+void Drone_Histogram_Record(Drone_Histogram* h, uint64_t value)
+{
+    ++h->bucket[Drone_Histogram_Index(value)];
+    ++h->count;
+    h->sum += value;
+    if (value > h->max) h->max = value;
+}
+
+uint64_t Drone_Histogram_Percentile(Drone_Histogram* h, double p)
+{
+    if (!h->count) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (uint32_t i=0; i<HISTOGRAM_NBUCKET; ++i) {
+        seen += h->bucket[i];
+        if (seen >= rank) {
+            uint64_t v = Drone_Histogram_UpperBound(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+void Drone_Histogram_Print(Drone_Histogram* h, FILE* fp)
+{
+    fprintf(fp, "%-12s n=%-9llu mean=%9.2f p50=%9.2f p99=%9.2f p99.9=%9.2f max=%9.2f (us)\n", h->name,
+            (unsigned long long)h->count, h->count ? (double)h->sum/h->count/1000.0 : 0.0,
+            Drone_Histogram_Percentile(h, 50.0)/1000.0, Drone_Histogram_Percentile(h, 99.0)/1000.0,
+            Drone_Histogram_Percentile(h, 99.9)/1000.0, h->max/1000.0);
+}
+
+static uint32_t Drone_Histogram_Index(uint64_t v)
+{
+    if (v < (1ULL << HISTOGRAM_SUBBITS)) return (uint32_t)v;
+    uint32_t msb = 63 - __builtin_clzll(v);
+    if (msb > HISTOGRAM_MAXBIT) return HISTOGRAM_NBUCKET - 1;
+    uint32_t shift = msb - HISTOGRAM_SUBBITS + 1;
+    return (shift << (HISTOGRAM_SUBBITS-1)) + (uint32_t)(v >> shift);
+}
+
+static uint64_t Drone_Histogram_UpperBound(uint32_t i)
+{
+    if (i < (1U << HISTOGRAM_SUBBITS)) return i;
+    uint32_t shift = (i >> (HISTOGRAM_SUBBITS-1)) - 1;
+    return (((uint64_t)(i - (shift << (HISTOGRAM_SUBBITS-1))) + 1) << shift) - 1;
+}
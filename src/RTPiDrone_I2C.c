@@ -16,46 +16,185 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <time.h>
-#include <stdatomic.h>
 #include <sched.h>
 #include <pthread.h>
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include <gsl/gsl_statistics.h>
-#define RAD_TO_DEG      (180/M_PI)
+#define RAD_TO_DEG      ((float)(180/M_PI))
 #define FILENAMESIZE            64
 #define N_SAMPLE_CALIBRATION    3000
-#define NUM_CALI_THREADS        5
-#define NDATA_ADXL345           3
-#define NDATA_L3G4200D          3
-#define NDATA_HMC5883L          3
-#define NDATA_BMP085            1
-#define NDATA_MS5611            1
+#define I2C_CALI_NDATA          3               // Calibration values of each sensor : the real data of the driver
+#define CALI_CACHE_MAGIC        "RTPDCAL2"      // Tag (and version) of the calibration cache
+#ifdef  ADXL345_FIFO
+#define ADXL345_FIFO_READ       (CONTROL_PERIOD > 1000000000L/ADXL345_RATE ? CONTROL_PERIOD : 1000000000L/ADXL345_RATE)
+#define ADXL345_FIFO_DEPTH      ((ADXL345_FIFO_RATE * (long long)ADXL345_FIFO_READ + 999999999LL) / 1000000000LL)
+#define COST_ADXL345            SCHEDULER_I2C_COST(1 + ADXL345_FIFO_DEPTH, 4 + 9*ADXL345_FIFO_DEPTH)    // FIFO_STATUS, then the entries
+#else
+#define COST_ADXL345            SCHEDULER_I2C_COST(2, 9)
+#endif
+#ifdef  L3G4200D_FIFO
+#define L3G4200D_FIFO_READ      (CONTROL_PERIOD > 1000000000L/L3G4200D_RATE ? CONTROL_PERIOD : 1000000000L/L3G4200D_RATE)
+#define L3G4200D_FIFO_DEPTH     ((L3G4200D_FIFO_RATE * (long long)L3G4200D_FIFO_READ + 999999999LL) / 1000000000LL)
+#define COST_L3G4200D           SCHEDULER_I2C_COST(4, 7 + 6*L3G4200D_FIFO_DEPTH)     // FIFO_SRC_REG, then one burst
+#else
+#define COST_L3G4200D           SCHEDULER_I2C_COST(2, 9)
+#endif
+#define COST_HMC5883L           SCHEDULER_I2C_COST(2, 9)
+#define COST_BMP085             SCHEDULER_I2C_COST(3, 9)        // Read, then the next conversion
+#define COST_MS5611             SCHEDULER_I2C_COST(3, 8)        // Read, then the next conversion
+#define COST_PCA9685PW          SCHEDULER_I2C_COST(1, 16)       // The 4 outputs in one burst
+/*!
+ * \enum Drone_I2C_SensorId
+ * \brief Sensors of the registry, in the order of sensorInfo
+ */
+typedef enum {
+    I2C_ADXL345,                        /*!< 3-axis accelerometer */
+    I2C_L3G4200D,                       /*!< 3-axis gyroscope */
+    I2C_HMC5883L,                       /*!< 3-axis digital compass */
+    I2C_BMP085,                         /*!< Barometric pressure/temperature/altitude */
+    I2C_MS5611,                         /*!< Barometric pressure/temperature/altitude, high resolution */
+    I2C_NSENSOR
+} Drone_I2C_SensorId;
+
+/*!
+ * \enum Drone_I2C_Stage
+ * \brief Step of Drone_I2C_ExchangeData() refreshing the sensor
+ */
+typedef enum {
+    I2C_STAGE_FAST,                     /*!< Before the AHRS : accelerometer, gyroscope */
+    I2C_STAGE_SLOW                      /*!< With the motors : magnetometer, barometers */
+} Drone_I2C_Stage;
+
+/*!
+ * \struct Drone_I2C_SensorInfo
+ * \brief Static description of one sensor : its driver and where its data go in Drone_DataExchange
+ */
+typedef struct {
+    const char*         name;                                       //!< \private Name of the driver
+    int                 (*create)(Drone_Device**);                  //!< \private Setup of the driver
+    void                (*remove)(Drone_Device**);                  //!< \private Remove of the driver
+    Drone_I2C_CaliInfo* (*caliInfo)(Drone_Device*);                 //!< \private Calibration information
+    int                 (*caliStep)(Drone_Device*);                 //!< \private One calibration sample, 0 if taken
+    int                 nCali;                                      //!< \private Calibration samples
+    Drone_I2C_Stage     stage;                                      //!< \private Step of the refresh
+    int                 bus;                                        //!< \private Bus of the Drone_Scheduler
+    uint32_t            cost;                                       //!< \private Bus time of one refresh (us)
+    size_t              fresh;                                      //!< \private Offset of its fresh flag in Drone_DataExchange
+    int                 optional;                                   //!< \private The drone flies without it
+    int                 cached;                                     //!< \private The cache keeps its calibration (else the validation pass is its calibration)
+} Drone_I2C_SensorInfo;
+
+/*!
+ * \struct Drone_I2C_Sensor
+ * \brief One sensor present, for the setup, the calibration and the scheduler
+ */
+typedef struct {
+    Drone_Device*       dev;                                        //!< \private Device of the driver
+    const Drone_I2C_SensorInfo* info;                               //!< \private Description
+} Drone_I2C_Sensor;
+
+/*!
+ * \struct Drone_I2C_CacheEntry
+ * \brief Calibration of one sensor in the cache
+ */
+typedef struct {
+    char        name[16];                                           //!< \private Name of the driver
+    uint32_t    identity;                                           //!< \private Drone_I2C_Cali_getIdentity()
+    int32_t     nSample;                                            //!< \private Samples of the calibration
+    float       mean[I2C_CALI_NDATA];                               //!< \private Mean of the real data
+    float       sd[I2C_CALI_NDATA];                                 //!< \private Standard deviation of the real data
+} Drone_I2C_CacheEntry;
+
+/*!
+ * \struct Drone_I2C_Cache
+ * \brief Calibration cache (CALI_CACHE_FILE), written by a full calibration. It holds for the same sensors, in the
+ * same order, with the same identification registers, at about the same die temperature of L3G4200D and the same
+ * temperature of the barometer.
+ */
+typedef struct {
+    char        magic[8];                                           //!< \private CALI_CACHE_MAGIC
+    int32_t     nSensor;                                            //!< \private Sensors present
+    float       temperature;                                        //!< \private Temperature of the barometer, Drone_I2C_Thermometer() (degC)
+    float       dieTemperature;                                     //!< \private Die temperature of L3G4200D, L3G4200D_getTemperature() (degC)
+    Drone_I2C_CacheEntry entry[I2C_NSENSOR];                        //!< \private The sensors present, in the order of Drone_I2C
+    uint32_t    check;                                              //!< \private getChecksum() of the bytes before
+} Drone_I2C_Cache;
+
 /*!
  * \struct tempCali
  * \brief Private tempCali type
  * This structure allow to generate a single thread for calibration of a single device.
  */
 typedef struct {
-    Drone_I2C*      i2c;
+    Drone_Device*   dev;
     Drone_I2C_CaliInfo*  i2c_cali;
-    int (*func)(Drone_I2C*);
+    int (*func)(Drone_Device*);
     float* data;
     int nSample;
     int nData;
     char* name;
 } tempCali;
 
-static atomic_int i2c_stat = 0;                     //!< \private Drone_I2C: Indicate if I2C is occupied
-static int Calibration_Single_L3G4200D(Drone_I2C*); //!< \private \memberof Drone_I2C: Calibration step for L3G4200D
-static int Calibration_Single_ADXL345(Drone_I2C*);  //!< \private \memberof Drone_I2C: Calibration step for ADXL345
-static int Calibration_Single_HMC5883L(Drone_I2C*); //!< \private \memberof Drone_I2C: Calibration step for HMC5883L
-static int Calibration_Single_BMP085(Drone_I2C*);   //!< \private \memberof Drone_I2C: Calibration step for BMP085
-static int Calibration_Single_MS5611(Drone_I2C*);   //!< \private \memberof Drone_I2C: Calibration step for MS5611
+static int Calibration_Single_L3G4200D(Drone_Device*); //!< \private \memberof Drone_I2C: Calibration step for L3G4200D
+static int Calibration_Single_ADXL345(Drone_Device*);  //!< \private \memberof Drone_I2C: Calibration step for ADXL345
+static int Calibration_Single_HMC5883L(Drone_Device*); //!< \private \memberof Drone_I2C: Calibration step for HMC5883L
+static int Calibration_Single_BMP085(Drone_Device*);   //!< \private \memberof Drone_I2C: Calibration step for BMP085
+static int Calibration_Single_MS5611(Drone_Device*);   //!< \private \memberof Drone_I2C: Calibration step for MS5611
 static void* Calibration_Single_Thread(void*);      //!< \private \memberof tempCali: Template for calibration
 static int PCA9685PW_ESC_Init(Drone_I2C*);          //!< \private \memberof Drone_I2C: Initialization of ESC
 static void Drone_I2C_MagPWMCorrection(uint32_t*, float*);
 
+/*
+ * The typed calls of each driver behind the Drone_Device of the registry, for the setup and the calibration.
+ * The loop calls the drivers directly (Drone_I2C_Refresh_FAST/SLOW()).
+ */
+#define I2C_SENSOR_CALLS(X) \
+static int I2C_Create_##X(Drone_Device** dev) \
+{ \
+    Drone_I2C_Device_##X* d = NULL; \
+    int ret = X##_setup(&d); \
+    *dev = (Drone_Device*)d; \
+    return ret; \
+} \
+static void I2C_Remove_##X(Drone_Device** dev) \
+{ \
+    Drone_I2C_Device_##X* d = (Drone_I2C_Device_##X*)*dev; \
+    X##_delete(&d); \
+    *dev = NULL; \
+} \
+static Drone_I2C_CaliInfo* I2C_CaliInfo_##X(Drone_Device* dev) \
+{ \
+    return X##_getCaliInfo((Drone_I2C_Device_##X*)dev); \
+}
+I2C_SENSOR_CALLS(ADXL345)
+I2C_SENSOR_CALLS(L3G4200D)
+I2C_SENSOR_CALLS(HMC5883L)
+I2C_SENSOR_CALLS(BMP085)
+I2C_SENSOR_CALLS(MS5611)
+
+/*
+ * The sensors : a new one is a line here. Its calibration samples, stage, bus cost, its value, estimate, time and
+ * fresh flag in Drone_DataExchange, optional, cached. The barometers are not cached : their reference altitude
+ * follows the weather.
+ */
+#define I2C_SENSOR_LIST(X) \
+    X(ADXL345,  N_SAMPLE_CALIBRATION,    I2C_STAGE_FAST, COST_ADXL345,  acc, acc_est, accTime, accFresh, 0, 1) \
+    X(L3G4200D, N_SAMPLE_CALIBRATION,    I2C_STAGE_FAST, COST_L3G4200D, gyr, gyr_est, gyrTime, gyrFresh, 0, 1) \
+    X(HMC5883L, N_SAMPLE_CALIBRATION/5,  I2C_STAGE_SLOW, COST_HMC5883L, mag, mag_est, magTime, magFresh, 0, 1) \
+    X(BMP085,   N_SAMPLE_CALIBRATION/10, I2C_STAGE_SLOW, COST_BMP085,   attitude, att_est, attTime, attFresh, 0, 0) \
+    X(MS5611,   N_SAMPLE_CALIBRATION/10, I2C_STAGE_SLOW, COST_MS5611,   attitudeHT, attHT_est, attHTTime, attHTFresh, 1, 0)
+
+#define I2C_SENSOR_INFO(X, n, stage, cost, v, e, t, f, opt, cached) \
+    [I2C_##X] = {#X, I2C_Create_##X, I2C_Remove_##X, I2C_CaliInfo_##X, Calibration_Single_##X, n, \
+                 stage, SCHEDULER_I2C, cost, offsetof(Drone_DataExchange, f), opt, cached},
+
+//! \private Description of the sensors, in the order of Drone_I2C_SensorId
+static const Drone_I2C_SensorInfo sensorInfo[I2C_NSENSOR] = {
+    I2C_SENSOR_LIST(I2C_SENSOR_INFO)
+};
+
 static float magFitFunc(uint32_t, const float*);
 
 static const float magCorr[][3][3] = {
@@ -87,44 +226,51 @@ static const float magCorr[][3][3] = {
  * \brief Drone_I2C structure
  */
 struct Drone_I2C {
-    Drone_I2C_Device_ADXL345*       ADXL345;    //!< \private ADXL345 : 3-axis accelerometer
-    Drone_I2C_Device_L3G4200D*      L3G4200D;   //!< \private L3G4200D : 3-axis gyroscope
-    Drone_I2C_Device_HMC5883L*      HMC5883L;   //!< \private HMC5883L : 3-axis digital compass
-    Drone_I2C_Device_BMP085*        BMP085;     //!< \private BMP085 : Barometric Pressure/Temperature/Altitude
+    Drone_I2C_Sensor                sensor[I2C_NSENSOR];    //!< \private Sensors present, the fast stage first
+    int                             nSensor;                //!< \private Number of sensors present
+    Drone_Device*                   dev[I2C_NSENSOR];       //!< \private Device of each sensor, NULL if missing
     Drone_I2C_Device_PCA9685PW*     PCA9685PW;  //!< \private PCA9685PW : Pulse Width Modulator
-    Drone_I2C_Device_MS5611*        MS5611;
 };
 
 static float magFitFunc(uint32_t power, const float* t)
 {
-    return t[0]*sqrtf((float)power) + pow(power,0.25)*t[1] + t[2];
+    float s = sqrtf((float)power);
+    return t[0]*s + sqrtf(s)*t[1] + t[2];
+}
+
+/* Setup of the sensors of one stage, in the order of the table */
+static int Drone_I2C_AddStage(Drone_I2C* i2c, Drone_I2C_Stage stage)
+{
+    for (int id=0; id<I2C_NSENSOR; ++id) {
+        const Drone_I2C_SensorInfo* info = &sensorInfo[id];
+        if (info->stage != stage) continue;
+        if (info->create(&i2c->dev[id])) {
+            perror(info->name);
+            if (!info->optional) return -1 - id;
+            fprintf(stderr, "%s is missing : the drone flies without it\n", info->name);
+            if (i2c->dev[id]) info->remove(&i2c->dev[id]);
+            continue;
+        }
+        Drone_I2C_Sensor* s = &i2c->sensor[i2c->nSensor++];
+        s->dev = i2c->dev[id];
+        s->info = info;
+    }
+    return 0;
 }
 
 int Drone_I2C_Init(Drone_I2C** i2c)
 {
     *i2c = (Drone_I2C*)calloc(1,sizeof(Drone_I2C));
-    bcm2835_i2c_begin();
-    bcm2835_i2c_setClockDivider(BCM2835_I2C_CLOCK_DIVIDER_626);
-    if (ADXL345_setup(&(*i2c)->ADXL345)) {
-        perror("Init ADXL345");
-        return -1;
+    Drone_Bus_I2C_Begin();
+    Drone_Bus_I2C_SetClockDivider(DRONE_BUS_I2C_CLOCK_DIVIDER_626);
+    if (Drone_Bus_Manager_Start()) {
+        perror("Init I2C bus manager");
+        return -7;
     }
-    if (L3G4200D_setup(&(*i2c)->L3G4200D)) {
-        perror("Init L3G4200D");
-        return -2;
-    }
-    if (HMC5883L_setup(&(*i2c)->HMC5883L)) {
-        perror("Init HMC5883L");
-        return -3;
-    }
-    if (BMP085_setup(&(*i2c)->BMP085)) {
-        perror("Init BMP085");
-        return -4;
-    }
-    if (MS5611_setup(&(*i2c)->MS5611)) {
-        perror("Init MS5611");
-        return -5; 
-    }   
+    int ret = Drone_I2C_AddStage(*i2c, I2C_STAGE_FAST);
+    if (ret) return ret;
+    ret = Drone_I2C_AddStage(*i2c, I2C_STAGE_SLOW);
+    if (ret) return ret;
     if (PCA9685PW_setup(&(*i2c)->PCA9685PW)) {
         perror("Init PCA9685PW");
         return -6;
@@ -133,41 +279,157 @@ int Drone_I2C_Init(Drone_I2C** i2c)
     return 0;
 }
 
-int Drone_I2C_Calibration(Drone_I2C* i2c)
+/* All sensors at once, 1/divide of the samples of their calibration : the result of sensor[i] goes to cali[i] */
+static void Drone_I2C_Sample(Drone_I2C* i2c, Drone_I2C_CaliInfo** cali, int divide)
+{
+    pthread_t thread_i2c[I2C_NSENSOR];
+    tempCali temp[I2C_NSENSOR];
+    for (int i=0; i<i2c->nSensor; ++i) {
+        Drone_I2C_Sensor* s = &i2c->sensor[i];
+        temp[i] = (tempCali) {s->dev, cali[i], s->info->caliStep,
+                              Drone_Device_GetData(s->dev), s->info->nCali/divide, I2C_CALI_NDATA,
+                              Drone_Device_GetName(s->dev)
+                             };
+        pthread_create(&thread_i2c[i], NULL, Calibration_Single_Thread, (void*) &temp[i]);
+    }
+
+    for (int i=0; i<i2c->nSensor; ++i) pthread_join(thread_i2c[i],NULL);
+}
+
+/* The barometer giving the temperature of the board : BMP085, else MS5611. return its id, -1 without any */
+static int Drone_I2C_Thermometer(Drone_I2C* i2c)
+{
+    if (i2c->dev[I2C_BMP085]) return I2C_BMP085;
+    if (i2c->dev[I2C_MS5611]) return I2C_MS5611;
+    return -1;
+}
+
+/* Temperature (degC) in the calibration of the barometer, 0 without any */
+static float Drone_I2C_Temperature(Drone_I2C* i2c)
+{
+    int id = Drone_I2C_Thermometer(i2c);
+    return id < 0 ? 0.0f : Drone_I2C_Cali_getMean(sensorInfo[id].caliInfo(i2c->dev[id]))[1];
+}
+
+/* The cache of the sensors as they are : their identity, the temperatures, and their calibration */
+static void Drone_I2C_FillCache(Drone_I2C* i2c, Drone_I2C_Cache* c)
+{
+    memset(c, 0, sizeof(Drone_I2C_Cache));
+    memcpy(c->magic, CALI_CACHE_MAGIC, sizeof(c->magic));
+    c->nSensor = i2c->nSensor;
+    c->temperature = Drone_I2C_Temperature(i2c);
+    c->dieTemperature = L3G4200D_getTemperature((Drone_I2C_Device_L3G4200D*)i2c->dev[I2C_L3G4200D]);
+    for (int i=0; i<i2c->nSensor; ++i) {
+        Drone_I2C_Sensor* s = &i2c->sensor[i];
+        Drone_I2C_CaliInfo* cali = s->info->caliInfo(s->dev);
+        Drone_I2C_CacheEntry* e = &c->entry[i];
+        strncpy(e->name, s->info->name, sizeof(e->name) - 1);
+        e->identity = Drone_I2C_Cali_getIdentity(cali);
+        e->nSample = s->info->nCali;
+        memcpy(e->mean, Drone_I2C_Cali_getMean(cali), sizeof(e->mean));
+        memcpy(e->sd, Drone_I2C_Cali_getSD(cali), sizeof(e->sd));
+    }
+    c->check = getChecksum(c, offsetof(Drone_I2C_Cache, check));
+}
+
+/* Written aside, then renamed : a restart by the watchdog never leaves half a cache */
+static int Drone_I2C_SaveCache(Drone_I2C* i2c)
+{
+    Drone_I2C_Cache c;
+    Drone_I2C_FillCache(i2c, &c);
+    FILE* fp = fopen(CALI_CACHE_FILE ".tmp", "wb");
+    if (!fp) return -1;
+    int ret = fwrite(&c, sizeof(c), 1, fp) != 1;
+    ret += fclose(fp);
+    if (ret) return -2;
+    return rename(CALI_CACHE_FILE ".tmp", CALI_CACHE_FILE) ? -3 : 0;
+}
+
+/* The same sensors as the cache, at about the same die temperature. return NULL if so, else why not */
+static const char* Drone_I2C_CheckCache(const Drone_I2C_Cache* c, const Drone_I2C_Cache* now)
+{
+    if (memcmp(c->magic, CALI_CACHE_MAGIC, sizeof(c->magic))) return "other version";
+    if (c->check != getChecksum(c, offsetof(Drone_I2C_Cache, check))) return "corrupted";
+    if (c->nSensor != now->nSensor) return "other sensors";
+    for (int i=0; i<now->nSensor; ++i) {
+        if (strncmp(c->entry[i].name, now->entry[i].name, sizeof(c->entry[i].name))) return "other sensors";
+        if (c->entry[i].identity != now->entry[i].identity) return "other chip";
+    }
+    if (fabsf(c->dieTemperature - now->dieTemperature) > CALI_CACHE_DTEMP) return "temperature of L3G4200D";
+    return NULL;
+}
+
+/*
+ * The validation pass against the cache : the cached sensors keep their mean (within CALI_CACHE_NSIGMA standard
+ * errors of the difference) and their noise (at most CALI_CACHE_SDRATIO times), the barometer its temperature.
+ * return NULL if the cache holds, else why not
+ */
+static const char* Drone_I2C_ValidateCache(Drone_I2C* i2c, const Drone_I2C_Cache* c, Drone_I2C_CaliInfo** cali)
+{
+    int thermometer = Drone_I2C_Thermometer(i2c);
+    for (int i=0; i<i2c->nSensor; ++i) {
+        const Drone_I2C_SensorInfo* info = i2c->sensor[i].info;
+        const Drone_I2C_CacheEntry* e = &c->entry[i];
+        const float* mean = Drone_I2C_Cali_getMean(cali[i]);
+        const float* sd = Drone_I2C_Cali_getSD(cali[i]);
+        if (thermometer >= 0 && info == &sensorInfo[thermometer] && fabsf(mean[1] - c->temperature) > CALI_CACHE_DTEMP) return "temperature";
+        if (!info->cached) continue;
+        float n = (float)(info->nCali/CALI_CACHE_DIVIDE);
+        for (int j=0; j<I2C_CALI_NDATA; ++j) {
+            if (sd[j] > CALI_CACHE_SDRATIO * e->sd[j]) return "noise";
+            if (fabsf(mean[j] - e->mean[j]) > CALI_CACHE_NSIGMA * e->sd[j] * sqrtf(1.0f/n + 1.0f/e->nSample)) return "bias";
+        }
+    }
+    return NULL;
+}
+
+int Drone_I2C_LoadCalibration(Drone_I2C* i2c)
 {
-    pthread_t thread_i2c[NUM_CALI_THREADS];
-    tempCali accTemp = {i2c, ADXL345_getCaliInfo(i2c->ADXL345), Calibration_Single_ADXL345,
-                        Drone_Device_GetData((Drone_Device*)(i2c->ADXL345)), N_SAMPLE_CALIBRATION, 3,
-                        Drone_Device_GetName((Drone_Device*)(i2c->ADXL345))
-                       };
-    pthread_create(&thread_i2c[0], NULL, Calibration_Single_Thread, (void*) &accTemp);
-
-    tempCali gyrTemp = {i2c, L3G4200D_getCaliInfo(i2c->L3G4200D), Calibration_Single_L3G4200D,
-                        Drone_Device_GetData((Drone_Device*)(i2c->L3G4200D)), N_SAMPLE_CALIBRATION, 3,
-                        Drone_Device_GetName((Drone_Device*)(i2c->L3G4200D))
-                       };
-    pthread_create(&thread_i2c[1], NULL, Calibration_Single_Thread, (void*) &gyrTemp);
-
-    tempCali magTemp = {i2c, HMC5883L_getCaliInfo(i2c->HMC5883L), Calibration_Single_HMC5883L,
-                        Drone_Device_GetData((Drone_Device*)(i2c->HMC5883L)), N_SAMPLE_CALIBRATION/5, 3,
-                        Drone_Device_GetName((Drone_Device*)(i2c->HMC5883L))
-                       };
-    pthread_create(&thread_i2c[2], NULL, Calibration_Single_Thread, (void*) &magTemp);
-
-    tempCali barTemp = {i2c, BMP085_getCaliInfo(i2c->BMP085), Calibration_Single_BMP085,
-                        Drone_Device_GetData((Drone_Device*)(i2c->BMP085)), N_SAMPLE_CALIBRATION/10, 3,
-                        Drone_Device_GetName((Drone_Device*)(i2c->BMP085))
-                       };
-    pthread_create(&thread_i2c[3], NULL, Calibration_Single_Thread, (void*) &barTemp);
-
-    tempCali bar2Temp = {i2c, MS5611_getCaliInfo(i2c->MS5611), Calibration_Single_MS5611,
-                        Drone_Device_GetData((Drone_Device*)(i2c->MS5611)), N_SAMPLE_CALIBRATION/10, 3,
-                        Drone_Device_GetName((Drone_Device*)(i2c->MS5611))
-                       };
-    pthread_create(&thread_i2c[4], NULL, Calibration_Single_Thread, (void*) &bar2Temp);
-
-    for (int i=0; i<NUM_CALI_THREADS; ++i) pthread_join(thread_i2c[i],NULL);
+    // A recording, and its replay, go through the full calibration : they never depend on the file of the drone
+    if (Drone_Bus_Record_IsActive() || Drone_Bus_Replay_IsActive()) return -1;
+    Drone_I2C_Cache c, now;
+    FILE* fp = fopen(CALI_CACHE_FILE, "rb");
+    if (!fp) return -1;
+    int ret = fread(&c, sizeof(c), 1, fp) != 1;
+    fclose(fp);
+    Drone_I2C_FillCache(i2c, &now);
+    const char* why = ret ? "truncated" : Drone_I2C_CheckCache(&c, &now);
+    if (why) {
+        fprintf(stderr, "Calibration cache : %s, full calibration\n", why);
+        return -2;
+    }
+
+#ifdef  DEBUG
+    uint64_t start = get_nsec_mono();
+#endif
+    Drone_I2C_CaliInfo* cali[I2C_NSENSOR];
+    for (int i=0; i<i2c->nSensor; ++i) Drone_I2C_Cali_Init(&cali[i], I2C_CALI_NDATA);
+    Drone_I2C_Sample(i2c, cali, CALI_CACHE_DIVIDE);
+    why = Drone_I2C_ValidateCache(i2c, &c, cali);
+    for (int i=0; i<i2c->nSensor && !why; ++i) {
+        Drone_I2C_Sensor* s = &i2c->sensor[i];
+        Drone_I2C_CaliInfo* dev = s->info->caliInfo(s->dev);
+        memcpy(Drone_I2C_Cali_getMean(dev), s->info->cached ? c.entry[i].mean : Drone_I2C_Cali_getMean(cali[i]), sizeof(float)*I2C_CALI_NDATA);
+        memcpy(Drone_I2C_Cali_getSD(dev), s->info->cached ? c.entry[i].sd : Drone_I2C_Cali_getSD(cali[i]), sizeof(float)*I2C_CALI_NDATA);
+    }
+    for (int i=0; i<i2c->nSensor; ++i) Drone_I2C_Cali_Delete(&cali[i]);
+    if (why) {
+        fprintf(stderr, "Calibration cache : %s has changed, full calibration\n", why);
+        return -3;
+    }
+#ifdef  DEBUG
+    printf("Calibration cache : valid at %.1f degC, L3G4200D %+.0f degC (cached at %.1f degC, %+.0f degC), validation in %.2f s\n",
+           Drone_I2C_Temperature(i2c), now.dieTemperature, c.temperature, c.dieTemperature, (get_nsec_mono() - start)/1e9);
+#endif
+    return 0;
+}
 
+int Drone_I2C_Calibration(Drone_I2C* i2c)
+{
+    Drone_I2C_CaliInfo* cali[I2C_NSENSOR];
+    for (int i=0; i<i2c->nSensor; ++i) cali[i] = i2c->sensor[i].info->caliInfo(i2c->sensor[i].dev);
+    Drone_I2C_Sample(i2c, cali, 1);
+    if (!Drone_Bus_Replay_IsActive() && Drone_I2C_SaveCache(i2c)) perror("Calibration cache");
     return 0;
 }
 
@@ -180,99 +442,98 @@ void Drone_I2C_Start(Drone_I2C* i2c)
 #endif
 }
 
+int Drone_I2C_Schedule(Drone_I2C* i2c, Drone_Scheduler* sched)
+{
+    int ret = 0;
+    for (int i=0; i<i2c->nSensor; ++i) {
+        ret += Drone_Scheduler_Add(sched, i2c->sensor[i].dev, i2c->sensor[i].info->bus, i2c->sensor[i].info->cost);
+    }
+    ret += Drone_Scheduler_Add(sched, (Drone_Device*)i2c->PCA9685PW, SCHEDULER_I2C, COST_PCA9685PW);
+    return ret;
+}
+
 int Drone_I2C_End(Drone_I2C** i2c)
 {
     // Clean the file structures
     PCA9685PW_delete(&(*i2c)->PCA9685PW);
-    ADXL345_delete(&(*i2c)->ADXL345);
-    L3G4200D_delete(&(*i2c)->L3G4200D);
-    HMC5883L_delete(&(*i2c)->HMC5883L);
-    MS5611_delete(&(*i2c)->MS5611);
-    BMP085_delete(&(*i2c)->BMP085);
+    for (int i=0; i<(*i2c)->nSensor; ++i) {
+        (*i2c)->sensor[i].info->remove(&(*i2c)->sensor[i].dev);
+    }
 
-    bcm2835_i2c_end();
+    Drone_Bus_Manager_End();
+    Drone_Bus_I2C_End();
     free(*i2c);
     *i2c = NULL;
     return 0;
 }
 
-static int Calibration_Single_ADXL345(Drone_I2C* i2c)
+static int Calibration_Single_ADXL345(Drone_Device* dev)
 {
-    while (i2c_stat) sched_yield() ;
-    atomic_fetch_add_explicit(&i2c_stat, 1, memory_order_seq_cst);
-    int ret = Drone_Device_GetRawData((Drone_Device*)(i2c->ADXL345));
-    atomic_fetch_sub(&i2c_stat, 1);
-    ret += Drone_Device_GetRealData((Drone_Device*)(i2c->ADXL345));
-    ADXL345_inputFilter(i2c->ADXL345);
+    int ret = Drone_Device_GetRawData(dev);
+    ret += Drone_Device_GetRealData(dev);
+    ADXL345_inputFilter((Drone_I2C_Device_ADXL345*)dev);
     _usleep(3000);
     return ret;
 }
 
-static int Calibration_Single_L3G4200D(Drone_I2C* i2c)
+static int Calibration_Single_L3G4200D(Drone_Device* dev)
 {
-    while (i2c_stat) sched_yield() ;
-    atomic_fetch_add_explicit(&i2c_stat, 1, memory_order_seq_cst);
-    int ret = Drone_Device_GetRawData((Drone_Device*)(i2c->L3G4200D));
-    atomic_fetch_sub(&i2c_stat, 1);
-    ret += Drone_Device_GetRealData((Drone_Device*)(i2c->L3G4200D));
-    L3G4200D_inputFilter(i2c->L3G4200D);
+    int ret = Drone_Device_GetRawData(dev);
+    ret += Drone_Device_GetRealData(dev);
+    L3G4200D_inputFilter((Drone_I2C_Device_L3G4200D*)dev);
     _usleep(3000);
     return ret;
 }
 
-static int Calibration_Single_HMC5883L(Drone_I2C* i2c)
+static int Calibration_Single_HMC5883L(Drone_Device* dev)
 {
-    while (i2c_stat) sched_yield() ;
-    atomic_fetch_add_explicit(&i2c_stat, 1, memory_order_seq_cst);
-    int ret = Drone_Device_GetRawData((Drone_Device*)(i2c->HMC5883L));
-    atomic_fetch_sub(&i2c_stat, 1);
-    ret += Drone_Device_GetRealData((Drone_Device*)(i2c->HMC5883L));
-    HMC5883L_inputFilter(i2c->HMC5883L);
+    int ret = Drone_Device_GetRawData(dev);
+    ret += Drone_Device_GetRealData(dev);
+    HMC5883L_inputFilter((Drone_I2C_Device_HMC5883L*)dev);
     _usleep(HMC5883L_PERIOD/1000);
     return ret;
 }
 
-static int Calibration_Single_BMP085(Drone_I2C* i2c)
+static int Calibration_Single_BMP085(Drone_Device* dev)
 {
-    static const int sleepTime[] = {25500, 4500};
-    int ret, ret2;
-    for (int i=0; i<2; ++i) {
-        while (i2c_stat) sched_yield() ;
-        atomic_fetch_add_explicit(&i2c_stat, 1, memory_order_seq_cst);
-        ret = Drone_Device_GetRawData((Drone_Device*)(i2c->BMP085));
-        atomic_fetch_sub(&i2c_stat, 1);
-        ret2 = Drone_Device_GetRealData((Drone_Device*)(i2c->BMP085));
-        _usleep(sleepTime[ret]);
+    int ret;
+    // Until a new pressure : a temperature gives no altitude
+    for (int i=0; i<3; ++i) {
+        ret = Drone_Device_GetRawData(dev);
+        _usleep(BMP085_getConversionTime((Drone_I2C_Device_BMP085*)dev)/1000);
+        if (!ret) break;
     }
-    BMP085_inputFilter(i2c->BMP085);
-    return ret2;
+    if (ret) return ret;
+    ret = Drone_Device_GetRealData(dev);
+    BMP085_inputFilter((Drone_I2C_Device_BMP085*)dev);
+    return ret;
 }
 
-static int Calibration_Single_MS5611(Drone_I2C* i2c)
+static int Calibration_Single_MS5611(Drone_Device* dev)
 {
-    static const int sleepTime2 = 10000;
     int ret;
-    for (int i=0; i<2; ++i) {
-        while (i2c_stat) sched_yield() ;
-        atomic_fetch_add_explicit(&i2c_stat, 1, memory_order_seq_cst);
-        ret = Drone_Device_GetRawData((Drone_Device*)(i2c->MS5611));
-        atomic_fetch_sub(&i2c_stat, 1);
-        ret += Drone_Device_GetRealData((Drone_Device*)(i2c->MS5611));
-        _usleep(sleepTime2);
+    // Until a new pressure : a temperature, or a conversion not done yet, gives no altitude
+    for (int i=0; i<3; ++i) {
+        ret = Drone_Device_GetRawData(dev);
+        _usleep(MS5611_getConversionTime((Drone_I2C_Device_MS5611*)dev)/1000);
+        if (!ret) break;
     }
-    MS5611_inputFilter(i2c->MS5611);
+    if (ret) return ret;
+    ret = Drone_Device_GetRealData(dev);
+    MS5611_inputFilter((Drone_I2C_Device_MS5611*)dev);
     return ret;
 }
 
 static void* Calibration_Single_Thread(void* temp)
 {
-    Drone_I2C* i2c = ((tempCali*)temp)->i2c;
+    Drone_Device* dev = ((tempCali*)temp)->dev;
     Drone_I2C_CaliInfo* cali = ((tempCali*)temp)->i2c_cali;
     struct timespec tp1, tp2;
-    int (*f)(Drone_I2C*) = ((tempCali*)temp)->func;
+    int (*f)(Drone_Device*) = ((tempCali*)temp)->func;
     int nSample = ((tempCali*)temp)->nSample;
     int nData = ((tempCali*)temp)->nData;
     char* name = ((tempCali*)temp)->name;
+    Drone_Bus_I2C_SetPriority(DRONE_BUS_PRIORITY_BACKGROUND);
     char fileName[FILENAMESIZE];
     strcpy(fileName, name);
     strcat(fileName, "_calibration.log");
@@ -288,7 +549,7 @@ static void* Calibration_Single_Thread(void* temp)
     for (int i=0; i<nSample; ++i) {
         clock_gettime(CLOCK_REALTIME, &tp1);
         startTime = tp1.tv_sec*1000000000 + tp1.tv_nsec;
-        if (!f(i2c)) {
+        if (!f(dev)) {
             clock_gettime(CLOCK_REALTIME, &tp2);
             procesTime = tp2.tv_sec*1000000000 + tp2.tv_nsec - startTime;
             deltaT = (float)procesTime/1000000000.0;
@@ -335,43 +596,94 @@ static void* Calibration_Single_Thread(void* temp)
 
 void Drone_I2C_DataInit(Drone_DataExchange* data, Drone_I2C* i2c)
 {
-    Drone_I2C_CaliInfo* c = ADXL345_getCaliInfo(i2c->ADXL345);
+    Drone_I2C_CaliInfo* c = sensorInfo[I2C_ADXL345].caliInfo(i2c->dev[I2C_ADXL345]);
     for (int i=0; i<3; ++i) {
         data->acc[i] = data->acc_est[i] = Drone_I2C_Cali_getMean(c)[i];
         data->gyr[i] = 0.0f;
     }
-    c = HMC5883L_getCaliInfo(i2c->HMC5883L);
+    c = sensorInfo[I2C_HMC5883L].caliInfo(i2c->dev[I2C_HMC5883L]);
     for (int i=0; i<3; ++i) {
         data->mag[i] = data->mag_est[i] = Drone_I2C_Cali_getMean(c)[i];
     }
-    c = BMP085_getCaliInfo(i2c->BMP085);
+    c = sensorInfo[I2C_BMP085].caliInfo(i2c->dev[I2C_BMP085]);
     data->attitude = data->attitudeHT = data->att_est = data->attHT_est = 0.0f;
     data->temperature = Drone_I2C_Cali_getMean(c)[1];
     data->pressure = Drone_I2C_Cali_getMean(c)[2];
-    data->angle[0] = atan2(data->acc[1], data->acc[2]) * RAD_TO_DEG;      // roll
-    data->angle[1] = -atan2(data->acc[0], getSqrt(data->acc, 3)) * RAD_TO_DEG; //pitch
-    data->angle[2] = acos(data->mag[1]/getSqrt(data->mag, 2)) * RAD_TO_DEG;    // yaw
+    data->angle[0] = atan2f(data->acc[1], data->acc[2]) * RAD_TO_DEG;      // roll
+    data->angle[1] = -atan2f(data->acc[0], getSqrt(data->acc, 3)) * RAD_TO_DEG; //pitch
+    data->angle[2] = acosf(data->mag[1]/getSqrt(data->mag, 2)) * RAD_TO_DEG;    // yaw
     for (int i=0; i<4; ++i) data->power[i] = PWM_MIN;
+    // A missing sensor is never fresh
+    for (int id=0; id<I2C_NSENSOR; ++id) ((uint8_t*)data)[sensorInfo[id].fresh] = 0;
 }
 
+/*
+ * Refresh of one sensor of the list if it is in the stage and present : idle, it costs one load, due, one direct call
+ * of its driver, which gives the time of its sample with its data. The stage is a constant : the other sensors
+ * are no code.
+ */
+#define I2C_SENSOR_REFRESH(X, n, st, cost, v, e, t, f, opt, cached) \
+    if (st == stage && i2c->dev[I2C_##X]) { \
+        Drone_Device* dev = i2c->dev[I2C_##X]; \
+        data->f = !Drone_Device_IsIdle(dev) && \
+                  X##_getFilteredValue((Drone_I2C_Device_##X*)dev, lastUpdate, (float*)&data->v, (float*)&data->e); \
+        if (data->f) data->t = Drone_Device_GetSampleTime(dev); \
+        ret += data->f; \
+    }
+
+/*
+ * Drone_I2C_Refresh_FAST() and Drone_I2C_Refresh_SLOW() : the sensors of the stage, in the order of the list.
+ * return the number of refreshed sensors.
+ */
+#define I2C_STAGE_REFRESH(S) \
+static int Drone_I2C_Refresh_##S(Drone_DataExchange* data, Drone_I2C* i2c, uint64_t* lastUpdate) \
+{ \
+    const Drone_I2C_Stage stage = I2C_STAGE_##S; \
+    int ret = 0; \
+    I2C_SENSOR_LIST(I2C_SENSOR_REFRESH) \
+    return ret; \
+}
+I2C_STAGE_REFRESH(FAST)
+I2C_STAGE_REFRESH(SLOW)
+
 int Drone_I2C_ExchangeData(Drone_DataExchange* data, Drone_I2C* i2c, uint64_t* lastUpdate, bool step)
 {
     int ret = 0;
     if (!step) {
-        ADXL345_getFilteredValue(i2c->ADXL345, lastUpdate, data->acc, data->acc_est);
-        L3G4200D_getFilteredValue(i2c->L3G4200D, lastUpdate, data->gyr, data->gyr_est);
+        Drone_I2C_Refresh_FAST(data, i2c, lastUpdate);
+        if (data->gyrFresh) {
+            data->nGyr = L3G4200D_getSamples((Drone_I2C_Device_L3G4200D*)i2c->dev[I2C_L3G4200D], data->gyrSample, data->gyrDt);
+        } else data->nGyr = 0;
     } else {
         ret = PCA9685PW_write(i2c->PCA9685PW, data->power, lastUpdate);
         if (!ret) data->dt_accu += data->dt;
         else data->dt_accu = 0.0f;
-        ret += HMC5883L_getFilteredValue(i2c->HMC5883L, lastUpdate, data->mag, data->mag_est);
-        if (ret) Drone_I2C_MagPWMCorrection(data->power, data->mag_est);
-        ret += BMP085_getFilteredValue(i2c->BMP085, lastUpdate, &data->attitude, &data->att_est);
-        ret += MS5611_getFilteredValue(i2c->MS5611, lastUpdate, &data->attitudeHT, &data->attHT_est);
+        int fresh = Drone_I2C_Refresh_SLOW(data, i2c, lastUpdate);
+        if (ret + data->magFresh) Drone_I2C_MagPWMCorrection(data->power, data->mag_est);
+        ret += fresh;
     }
     return ret;
 }
 
+int Drone_I2C_ExchangeMotor(Drone_DataExchange* data, Drone_I2C* i2c, uint64_t* lastUpdate)
+{
+    int ret = PCA9685PW_write(i2c->PCA9685PW, data->power, lastUpdate);
+    if (!ret) data->dt_accu += data->dt;
+    else data->dt_accu = 0.0f;
+    return ret;
+}
+
+int Drone_I2C_ExchangeSensor(Drone_DataExchange* data, Drone_I2C* i2c, uint64_t* lastUpdate)
+{
+    Drone_I2C_Refresh_SLOW(data, i2c, lastUpdate);
+    return data->magFresh;
+}
+
+void Drone_I2C_MagCorrection(Drone_DataExchange* data)
+{
+    Drone_I2C_MagPWMCorrection(data->power, data->mag_est);
+}
+
 void HMC5883L_PWM_Calibration(Drone_I2C* i2c)
 {
     char fileName[FILENAMESIZE], num[FILENAMESIZE];
@@ -395,7 +707,7 @@ void HMC5883L_PWM_Calibration(Drone_I2C* i2c)
                 for (int k=0; k<nSample; ++k) {
                     _usleep(6000);
                     lastUpdate = get_nsec();
-                    f = (float*)Drone_Device_GetRefreshedData((Drone_Device*)i2c->HMC5883L, &lastUpdate);
+                    f = (float*)Drone_Device_GetRefreshedData(i2c->dev[I2C_HMC5883L], &lastUpdate);
                     if (f) {
                         for (int l=0; l<3; ++l) {
                             data[l][k] = f[l];
@@ -1,10 +1,12 @@
 #include "RTPiDrone_I2C_CaliInfo.h"
+#include "Common.h"
 #include <stdlib.h>
 
 struct Drone_I2C_CaliInfo {
     int   nItem;
     float *mean;
     float *sd;
+    uint32_t identity;
 };
 
 void Drone_I2C_Cali_Init(Drone_I2C_CaliInfo** i2c_cal, int N)
@@ -32,3 +34,13 @@ float* Drone_I2C_Cali_getSD(Drone_I2C_CaliInfo* i2c_cal)
 {
     return i2c_cal->sd;
 }
+
+void Drone_I2C_Cali_setIdentity(Drone_I2C_CaliInfo* i2c_cal, const void* buf, int len)
+{
+    i2c_cal->identity = getChecksum(buf, len);
+}
+
+uint32_t Drone_I2C_Cali_getIdentity(Drone_I2C_CaliInfo* i2c_cal)
+{
+    return i2c_cal->identity;
+}
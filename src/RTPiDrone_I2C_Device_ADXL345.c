@@ -2,19 +2,24 @@
 #include "RTPiDrone_I2C_Device_ADXL345.h"
 #include "RTPiDrone_Device.h"
 #include "RTPiDrone_Filter.h"
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 
 #define NITEM                   3
 #define ADXL345_ADDR            0x53            // 3 Axis Accelerometer         Analog Devices ADXL345 
+#define ADXL345_DEVID           0x00            // 0xE5
 #define ADXL345_POWER_CTL       0x2D
 #define ADXL345_DATA_FORMAT     0x31
 #define ADXL345_BW_RATE         0x2C
 #define ADXL345_FIFO_CTL        0x38
+#define ADXL345_FIFO_STATUS     0x39
+#define ADXL345_INT_ENABLE      0x2E
+#define ADXL345_INT_MAP         0x2F
 #define ADXL345_DATAX0          0x32
+#define ADXL345_FIFO_SIZE       33              // Entries of the FIFO : 32, and one more in the data registers
 
-#define ADXL345_UNIT            0.004           // Unit of ADXL345 is 4mg
+#define ADXL345_UNIT            0.004f          // Unit of ADXL345 is 4mg
 
 #ifndef ADXL345_RANGE
 #define ADXL345_RANGE           8
@@ -22,13 +27,26 @@
 #ifndef ADXL345_RATE
 #define ADXL345_RATE            400
 #endif
+#ifdef  ADXL345_FIFO
+#define ADXL345_ODR             ADXL345_FIFO_RATE
+#else
+#define ADXL345_ODR             ADXL345_RATE
+#endif
 
 struct Drone_I2C_Device_ADXL345 {
     Drone_Device dev;           //!< \private I2C device prototype
     int16_t rawData[NITEM];             //!< \private Raw data
     float   realData[NITEM];            //!< \private Real data
     Drone_I2C_CaliInfo* cali;       //!< \private Calibration information
-    Drone_Filter    filter[NITEM];
+    Drone_FilterBank*   filter;         //!< \private Low-pass of the 3 axes
+#ifdef  ADXL345_FIFO
+    int16_t fifo[ADXL345_FIFO_SIZE][NITEM];     //!< \private Samples drained from the FIFO
+    int     nFifo;                              //!< \private Number of samples in fifo
+    Drone_FilterBank*   decimation;             //!< \private Anti-aliasing filter at the output data rate
+    uint64_t nDrain;                            //!< \private Number of reads of the FIFO
+    uint64_t nSample;                           //!< \private Number of samples drained
+    uint64_t nFull;                             //!< \private Number of reads finding the FIFO full (samples lost)
+#endif
 };
 
 static int ADXL345_init(void*);        //!< \private \memberof Drone_I2C_Device_ADXL345 function : Initialization of ADXL345
@@ -53,19 +71,28 @@ int ADXL345_setup(Drone_I2C_Device_ADXL345** axdl345)
     Drone_I2C_Cali_Init(&(*axdl345)->cali, NITEM);
     float period = CONTROL_PERIOD > (1000000000L/ADXL345_RATE) ? (float)CONTROL_PERIOD : (float)(1000000000L/ADXL345_RATE);
     period /= 1000000000.0f;
+    if (Drone_FilterBank_Init(&(*axdl345)->filter, NITEM, 1)) return -1;
+#ifdef  ADXL345_FIFO
+    if (Drone_FilterBank_Init(&(*axdl345)->decimation, NITEM, 1)) return -1;
+#endif
     for (int i=0; i<NITEM; ++i) {
-        Drone_Filter_init(&(*axdl345)->filter[i], period, 1.0f);
+        Drone_FilterBank_SetLowPass((*axdl345)->filter, i, 0, period, 1.0f);
+#ifdef  ADXL345_FIFO
+        Drone_FilterBank_SetLowPass((*axdl345)->decimation, i, 0, 1.0f/ADXL345_ODR, 1.0f);
+#endif
     }
+#ifdef  I2C_DRDY
+    if (Drone_Device_SetDataReady(&(*axdl345)->dev, DRDY_PIN_ADXL345, DRONE_BUS_EDGE_RISING)) return -1;
+#endif
     return ADXL345_init(&(*axdl345)->dev) + Drone_Device_Init(&(*axdl345)->dev);
 }
 
 static int ADXL345_init(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(ADXL345_ADDR);
     char regaddr[2];
     regaddr[0] = ADXL345_POWER_CTL;                     // Standby
     regaddr[1] = 0x00;
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(ADXL345_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("ADXL345 Init 1 fail : Standby");
         return -1;
     }
@@ -82,13 +109,13 @@ static int ADXL345_init(void* i2c_dev)
             regaddr[1] = 0x0A;
             break;
     }
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(ADXL345_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("ADXL345 Init 2 fail : Range");
         return -2;
     }
 
     regaddr[0] = ADXL345_BW_RATE;                       // Sampling rate
-    switch (ADXL345_RATE) {
+    switch (ADXL345_ODR) {
         case 100 :
             regaddr[1] = 0x0A;
             break;
@@ -108,45 +135,121 @@ static int ADXL345_init(void* i2c_dev)
             regaddr[1] = 0x0F;
             break;
     }
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(ADXL345_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("ADXL345 Init 3 fail : Sampling rate");
         return -3;
     }
 
+#ifdef  ADXL345_FIFO
+    regaddr[0] = ADXL345_FIFO_CTL;                      // Stream mode
+    regaddr[1] = 0x80;
+
+    if (Drone_Bus_I2C_Write(ADXL345_ADDR, regaddr,2) != DRONE_BUS_OK) {
+        perror("ADXL345 Init 4 fail : stream");
+        return -4;
+    }
+#else
     regaddr[0] = ADXL345_FIFO_CTL;                      // by-Pass mode
     regaddr[1] = 0x00;
 
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(ADXL345_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("ADXL345 Init 4 fail : by-pass");
         return -4;
     }
+#endif
+
+#ifdef  I2C_DRDY
+    regaddr[0] = ADXL345_INT_MAP;                       // All interrupts on INT1
+    regaddr[1] = 0x00;
+
+    if (Drone_Bus_I2C_Write(ADXL345_ADDR, regaddr,2) != DRONE_BUS_OK) {
+        perror("ADXL345 Init 5 fail : interrupt map");
+        return -5;
+    }
+
+    regaddr[0] = ADXL345_INT_ENABLE;                    // DATA_READY only
+    regaddr[1] = 0x80;
+
+    if (Drone_Bus_I2C_Write(ADXL345_ADDR, regaddr,2) != DRONE_BUS_OK) {
+        perror("ADXL345 Init 6 fail : interrupt enable");
+        return -6;
+    }
+#endif
 
     regaddr[0] = ADXL345_POWER_CTL;                     // Switch ON
     regaddr[1] = 0x08;
 
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
-        perror("ADXL345 Init 5 fail : Switch on");
-        return -5;
+    if (Drone_Bus_I2C_Write(ADXL345_ADDR, regaddr,2) != DRONE_BUS_OK) {
+        perror("ADXL345 Init 7 fail : Switch on");
+        return -7;
+    }
+
+    char id;
+    if (Drone_Bus_I2C_ReadRegister(ADXL345_ADDR, ADXL345_DEVID, &id, 1) != DRONE_BUS_OK) {
+        perror("ADXL345 Init 8 fail : DEVID");
+        return -8;
     }
+    Drone_I2C_Cali_setIdentity(((Drone_I2C_Device_ADXL345*)i2c_dev)->cali, &id, 1);    // The part : no serial number
 #ifdef  DEBUG
     puts("ADXL345 initialization is done");
 #endif
     return 0;
 }
 
+#ifdef  ADXL345_FIFO
+/* The data registers only give the oldest entry of the FIFO : one 6-byte read per entry, all in one transfer */
 static int ADXL345_getRawValue(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(ADXL345_ADDR);
-    char regaddr = ADXL345_DATAX0;
-    if (bcm2835_i2c_write(&regaddr,1) != BCM2835_I2C_REASON_OK) {
+    Drone_I2C_Device_ADXL345* dev = (Drone_I2C_Device_ADXL345*)i2c_dev;
+    static char regaddr = ADXL345_DATAX0;
+    Drone_Bus_I2C_Msg msg[2*ADXL345_FIFO_SIZE];
+    char status;
+    dev->nFifo = 0;
+    if (Drone_Bus_I2C_ReadRegister(ADXL345_ADDR, ADXL345_FIFO_STATUS, &status, 1) != DRONE_BUS_OK) {
         perror("ADXL345 getRaw Error 1");
         return -1;
     }
-    char* acc = (char*)((Drone_I2C_Device_ADXL345*)i2c_dev)->rawData;
-    if ( bcm2835_i2c_read(acc, 6) != BCM2835_I2C_REASON_OK ) {
+    int n = status & 0x3F;
+    if (n >= ADXL345_FIFO_SIZE) {
+        n = ADXL345_FIFO_SIZE;
+        ++dev->nFull;
+    }
+
+    // Register address then read with a repeated start for each entry : the read pops the entry
+    for (int i=0; i<n; ++i) {
+        msg[2*i] = (Drone_Bus_I2C_Msg){ADXL345_ADDR, 0, 1, &regaddr};
+        msg[2*i+1] = (Drone_Bus_I2C_Msg){ADXL345_ADDR, 1, 6, (char*)dev->fifo[i]};
+    }
+    if (n && Drone_Bus_I2C_Transfer(msg, 2*n) != DRONE_BUS_OK) {
         perror("ADXL345 getRaw Error 2");
         return -2;
     }
+    dev->nFifo = n;
+    for (int i=0; n && i<NITEM; ++i) dev->rawData[i] = dev->fifo[n-1][i];
+    ++dev->nDrain;
+    dev->nSample += n;
+    return 0;
+}
+
+static int ADXL345_convertRawToReal(void* i2c_dev)
+{
+    // Decimation : every sample goes through the filter, the last output is the value of this read
+    Drone_I2C_Device_ADXL345* dev = (Drone_I2C_Device_ADXL345*)i2c_dev;
+    for (int j=0; j<dev->nFifo; ++j) {
+        float sample[NITEM];
+        for (int i=0; i<NITEM; ++i) sample[i] = dev->fifo[j][i] * ADXL345_UNIT;
+        Drone_FilterBank_renew(dev->decimation, sample, dev->realData);
+    }
+    return 0;
+}
+#else
+static int ADXL345_getRawValue(void* i2c_dev)
+{
+    char* acc = (char*)((Drone_I2C_Device_ADXL345*)i2c_dev)->rawData;
+    if (Drone_Bus_I2C_ReadRegister(ADXL345_ADDR, ADXL345_DATAX0, acc, 6) != DRONE_BUS_OK) {
+        perror("ADXL345 getRaw Error 1");
+        return -1;
+    }
     return 0;
 }
 
@@ -158,10 +261,21 @@ static int ADXL345_convertRawToReal(void* i2c_dev)
     }
     return 0;
 }
+#endif
 
 void ADXL345_delete(Drone_I2C_Device_ADXL345** axdl345)
 {
+#if defined(ADXL345_FIFO) && defined(DEBUG)
+    printf("ADXL345 : %llu samples at %d Hz in %llu reads (%.1f per read), FIFO full %llu times\n",
+           (unsigned long long)(*axdl345)->nSample, ADXL345_ODR, (unsigned long long)(*axdl345)->nDrain,
+           (*axdl345)->nDrain ? (double)(*axdl345)->nSample/(*axdl345)->nDrain : 0.0,
+           (unsigned long long)(*axdl345)->nFull);
+#endif
     Drone_I2C_Cali_Delete(&(*axdl345)->cali);
+    Drone_FilterBank_Delete(&(*axdl345)->filter);
+#ifdef  ADXL345_FIFO
+    Drone_FilterBank_Delete(&(*axdl345)->decimation);
+#endif
     Drone_Device_End(&(*axdl345)->dev);
     free(*axdl345);
     *axdl345 = NULL;
@@ -171,10 +285,8 @@ int ADXL345_getFilteredValue(Drone_I2C_Device_ADXL345* ADXL345, uint64_t* lastUp
 {
     float* f = (float*)Drone_Device_GetRefreshedData((Drone_Device*)ADXL345, lastUpdate);
     if (f) {
-        for (int i=0; i<NITEM; ++i) {
-            data[i] = f[i];
-            Drone_Filter_renew(&ADXL345->filter[i], f[i], &data_filter[i]);
-        }
+        for (int i=0; i<NITEM; ++i) data[i] = f[i];
+        Drone_FilterBank_renew(ADXL345->filter, f, data_filter);
         return 1;
     }
     return 0;
@@ -182,7 +294,5 @@ int ADXL345_getFilteredValue(Drone_I2C_Device_ADXL345* ADXL345, uint64_t* lastUp
 
 void ADXL345_inputFilter(Drone_I2C_Device_ADXL345* ADXL345)
 {
-    for (int i=0; i<NITEM; ++i) {
-        Drone_Filter_Pure(&ADXL345->filter[i], ADXL345->realData[i]);
-    }
+    Drone_FilterBank_Pure(ADXL345->filter, ADXL345->realData);
 }
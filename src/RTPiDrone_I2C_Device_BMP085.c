@@ -3,14 +3,18 @@
 #include "RTPiDrone_Device.h"
 #include "RTPiDrone_I2C_CaliInfo.h"
 #include "Common.h"
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <math.h>
 #define BMP085_ADDR             0x77            // Barometer + Thermometer      Bosch BMP085
 #define BMP085_AC1              0xAA
-#define OSRS                    3               // oversampling_setting : 3 means ultra high resolution
+#define BMP085_CTRL             0xF4
+#define BMP085_ADC              0xF6
+#define BMP085_UT               0x2E
+#define BMP085_UP               0x34
+#define BMP085_NOSS             4               // oversampling_setting : 0 ultra low power ... 3 ultra high resolution
 #define P0                      101325          // atmosphere pressure
 
 // Need to read them at the beginning of measurement (or simply save them, then user can load them to estimate temperature
@@ -32,7 +36,17 @@ typedef struct {
 }
 BMP085_Parameters;
 
-static uint64_t BMP085_Trigger_Switch = 0;
+/*!
+ * \enum BMP085_Conversion
+ * \brief Conversion in progress in the BMP085
+ */
+typedef enum {
+    BMP085_PRESSURE,                    /*!< UP */
+    BMP085_TEMPERATURE                  /*!< UT */
+} BMP085_Conversion;
+
+static const uint64_t BMP085_TempTime = 4500000L;                                           // Max. of the datasheet (ns)
+static const uint64_t BMP085_PressTime[BMP085_NOSS] = {4500000L, 7500000L, 13500000L, 25500000L};
 
 //#pragma pack( push, 1 )
 struct Drone_I2C_Device_BMP085 {
@@ -44,18 +58,19 @@ struct Drone_I2C_Device_BMP085 {
     float   RP;                      //!< \private Real Pressure
     BMP085_Parameters Para_BMP085;   //!< \private Parameter of BMP085
     Drone_I2C_CaliInfo* cali;        //!< \private Calibration information
-    Drone_Filter    filter;
+    Drone_FilterBank*   filter;      //!< \private Low-pass of the altitude
+    BMP085_Conversion conv;          //!< \private Conversion in progress
+    int     oss;                     //!< \private Oversampling setting of the next pressures (0 - 3)
+    int     convOss;                 //!< \private Oversampling setting of the pressure in progress
+    int     upOss;                   //!< \private Oversampling setting of UP
+    int     nPressure;               //!< \private Pressures converted since the last temperature
 };
 //#pragma pack( pop )
 
 static int BMP085_init(void*);        //!< \private \memberof Drone_I2C_Device_BMP085 function : Initialization of BMP085
-static int BMP085_Trigger_UTemp(void); //!< \private \memberof Drone_I2C_Device_BMP085 function : Trigger temp. measurement
-static int BMP085_Trigger_UPressure(void); //!< \private \memberof Drone_I2C_Device_BMP085 function : Trigger pres. measurement
-static int BMP085_getRawTemp(long*);
-static int BMP085_getRawPressure(long*);
+static int BMP085_Trigger(Drone_I2C_Device_BMP085*, BMP085_Conversion); //!< \private \memberof Drone_I2C_Device_BMP085 function : Start a conversion
 static int BMP085_getRawValue(void*);
 static int BMP085_convertRawToReal(void*);
-const static uint64_t BMP085_Period[] = {BMP085_PeriodLong, BMP085_PeriodShort};
 
 Drone_I2C_CaliInfo* BMP085_getCaliInfo(Drone_I2C_Device_BMP085* BMP085)
 {
@@ -71,151 +86,135 @@ int BMP085_setup(Drone_I2C_Device_BMP085** BMP085)
     Drone_Device_SetRawFunction(&(*BMP085)->dev, BMP085_getRawValue);
     Drone_Device_SetRealFunction(&(*BMP085)->dev, BMP085_convertRawToReal);
     Drone_Device_SetDataPointer(&(*BMP085)->dev, (void*)&(*BMP085)->altitude);
-    Drone_Device_SetPeriod(&(*BMP085)->dev, BMP085_Period[0]+BMP085_Period[1]);
+    if (BMP085_setOSS(*BMP085, BMP085_OSS)) return -5;
     Drone_I2C_Cali_Init(&(*BMP085)->cali, 3);
-    Drone_Filter* filter = &(*BMP085)->filter;
-    Drone_Filter_init(filter, 0.03, 2.0f);
+    if (Drone_FilterBank_Init(&(*BMP085)->filter, 1, 1)) return -6;
+    Drone_FilterBank_SetLowPass((*BMP085)->filter, 0, 0, 0.03, 2.0f);
 
-    return BMP085_init(&(*BMP085)->dev)+Drone_Device_Init(&(*BMP085)->dev);
+    return BMP085_init(*BMP085);
 }
 
-static int BMP085_init(void* i2c_dev)
+int BMP085_setOSS(Drone_I2C_Device_BMP085* BMP085, int oss)
 {
-    bcm2835_i2c_setSlaveAddress(BMP085_ADDR);
-    BMP085_Parameters* Para_BMP085 = &((Drone_I2C_Device_BMP085*)i2c_dev)->Para_BMP085;
-    char* buf = (char*) Para_BMP085;
-    char regaddr = BMP085_AC1;
-    if (bcm2835_i2c_write(&regaddr,1) != BCM2835_I2C_REASON_OK) {
-        perror("BMP085 getPara Error 1");
+    if (oss < 0 || oss >= BMP085_NOSS) {
+        fprintf(stderr, "BMP085 : no oversampling setting %d\n", oss);
         return -1;
     }
-    if (bcm2835_i2c_read(buf, 22) != BCM2835_I2C_REASON_OK) {
+    // Takes effect from the next pressure, the one in progress keeps its own setting
+    BMP085->oss = oss;
+    return 0;
+}
+
+uint64_t BMP085_getConversionTime(Drone_I2C_Device_BMP085* BMP085)
+{
+    return BMP085->conv == BMP085_PRESSURE ? BMP085_PressTime[BMP085->convOss] : BMP085_TempTime;
+}
+
+static int BMP085_init(void* i2c_dev)
+{
+    Drone_I2C_Device_BMP085* BMP085 = (Drone_I2C_Device_BMP085*)i2c_dev;
+    BMP085_Parameters* Para_BMP085 = &BMP085->Para_BMP085;
+    char* buf = (char*) Para_BMP085;
+    if (Drone_Bus_I2C_ReadRegister(BMP085_ADDR, BMP085_AC1, buf, 22) != DRONE_BUS_OK) {
         perror("Parameters of BMP085 are not correctly loaded");
         return -2;
     }
 
     exchange(buf, 22);
+    Drone_I2C_Cali_setIdentity(BMP085->cali, buf, 22);     // The factory calibration is proper to the chip
 #ifdef  DEBUG
     printf("ACN : %d\t%d\t%d\t", Para_BMP085->AC1, Para_BMP085->AC2, Para_BMP085->AC3);
     printf("%d\t%d\t%d\n", Para_BMP085->AC4, Para_BMP085->AC5, Para_BMP085->AC6);
     printf("B and M : %d\t%d\t%d\t%d\t%d\n", Para_BMP085->B1, Para_BMP085->B2, Para_BMP085->MB, Para_BMP085->MC, Para_BMP085->MD);
 #endif
-    BMP085_Trigger_UTemp();
-    _usleep(5000);
-    return 0;
-}
-
-static int BMP085_Trigger_UTemp(void)
-{
-    bcm2835_i2c_setSlaveAddress(BMP085_ADDR);
-    char regaddr[] = {0xF4,0x2E};
-    return bcm2835_i2c_write(regaddr,2);
-}
-
-static int BMP085_Trigger_UPressure(void)
-{
-    bcm2835_i2c_setSlaveAddress(BMP085_ADDR);
-    char regaddr[] = {0xF4, (0x34+(OSRS<<6))};
-    return bcm2835_i2c_write(regaddr,2);
-}
-
-static int BMP085_getRawTemp(long* UT)
-{
-    bcm2835_i2c_setSlaveAddress(BMP085_ADDR);
-    char regaddr = 0xF6;
-    char databuf[2];
-    if (bcm2835_i2c_write(&regaddr,1) != BCM2835_I2C_REASON_OK) {
-        perror("BMP085 getRawTemp 1");
-        return -1;
-    }
-    if ( bcm2835_i2c_read(databuf, 2) != BCM2835_I2C_REASON_OK) {
-        perror("BMP085 getRawTemp 2");
+    // The temperature first : the pressure needs it. Its result is read by the first refresh.
+    if (BMP085_Trigger(BMP085, BMP085_TEMPERATURE)) {
+        perror("BMP085 trigger");
         return -2;
     }
-    *UT = (long)(databuf[0]<<8) + databuf[1];
-    return 0;
+    return Drone_Device_Init(&BMP085->dev);
 }
 
-static int BMP085_getRawPressure(long* UP)
+static int BMP085_Trigger(Drone_I2C_Device_BMP085* BMP085, BMP085_Conversion conv)
 {
-    bcm2835_i2c_setSlaveAddress(BMP085_ADDR);
-    char regaddr = 0xF6;
-    char databuf[3];
-    if (bcm2835_i2c_write(&regaddr,1) != BCM2835_I2C_REASON_OK) {
-        perror("BMP085 getRawPressure 1");
-        return -1;
-    }
-    if (bcm2835_i2c_read(databuf, 3) != BCM2835_I2C_REASON_OK) {
-        perror("BMP085 getRawPressure 2");
-        return -2;
-    }
-    *UP = ((long)(databuf[0]<<16) + (long)(databuf[1]<<8) + databuf[2]) >> (8-OSRS);
-    return 0;
+    char regaddr[] = {BMP085_CTRL, conv == BMP085_PRESSURE ? BMP085_UP + (BMP085->oss<<6) : BMP085_UT};
+    BMP085->conv = conv;
+    BMP085->convOss = BMP085->oss;
+    Drone_Device_SetPeriod(&BMP085->dev, BMP085_getConversionTime(BMP085));
+    return Drone_Bus_I2C_Write(BMP085_ADDR, regaddr, 2);
 }
 
+/*
+ * One step of the conversions : read the result of the one in progress, start the next one at once.
+ * return 0 with a new pressure, -1 on error, -2 with a temperature only
+ */
 static int BMP085_getRawValue(void* i2c_dev)
 {
-    if ( !((BMP085_Trigger_Switch++)& 0x1) ) {
-        long* UT = &((Drone_I2C_Device_BMP085*)i2c_dev)->UT;
-        if (!BMP085_getRawTemp(UT) && !BMP085_Trigger_UPressure()) {
-            Drone_Device_SetPeriod(&((Drone_I2C_Device_BMP085*)i2c_dev)->dev, BMP085_Period[0]);
-            return 0;
-        } else {
-            return -1;
-        }
+    Drone_I2C_Device_BMP085* BMP085 = (Drone_I2C_Device_BMP085*)i2c_dev;
+    unsigned char databuf[3];
+    uint32_t len = BMP085->conv == BMP085_PRESSURE ? 3 : 2;
+    if (Drone_Bus_I2C_ReadRegister(BMP085_ADDR, BMP085_ADC, (char*)databuf, len) != DRONE_BUS_OK) {
+        perror("BMP085 getRawValue");
+        return -1;
+    }
+
+    if (BMP085->conv == BMP085_PRESSURE) {
+        BMP085->UP = (((long)databuf[0]<<16) + ((long)databuf[1]<<8) + databuf[2]) >> (8-BMP085->convOss);
+        BMP085->upOss = BMP085->convOss;
+        ++BMP085->nPressure;
     } else {
-        long* UP = &((Drone_I2C_Device_BMP085*)i2c_dev)->UP;
-        if (!BMP085_getRawPressure(UP) && !BMP085_Trigger_UTemp()) {
-            Drone_Device_SetPeriod(&((Drone_I2C_Device_BMP085*)i2c_dev)->dev, BMP085_Period[1]);
-            return 1;
-        } else {
-            return -2;
-        }
+        BMP085->UT = ((long)databuf[0]<<8) + databuf[1];
+        BMP085->nPressure = 0;
     }
-    return 0;
+
+    // The temperature drifts slowly : it is converted once every BMP085_TEMP_EVERY pressures
+    BMP085_Conversion next = (!BMP085->UT || BMP085->nPressure >= BMP085_TEMP_EVERY) ? BMP085_TEMPERATURE : BMP085_PRESSURE;
+    int ret = BMP085->conv == BMP085_PRESSURE ? 0 : -2;
+    if (BMP085_Trigger(BMP085, next)) return -1;
+    return ret;
 }
 
+// The integer compensation of the datasheet, the altitude in single precision
 static int BMP085_convertRawToReal(void* i2c_dev)
 {
     Drone_I2C_Device_BMP085 *dev = (Drone_I2C_Device_BMP085*)i2c_dev;
-    long* UT = &dev->UT;
+    if (!dev->UT || !dev->UP) return -1;
     BMP085_Parameters* Para_BMP085 = &dev->Para_BMP085;
-    static long X1, X2, B5;
-    if ( (BMP085_Trigger_Switch)& 0x1 ) {
-        X1 = ((*UT - Para_BMP085->AC6) * Para_BMP085->AC5) >>15;
-        X2 = (Para_BMP085->MC <<11) / (X1+Para_BMP085->MD);
-        B5 = X1+X2;
-        dev->RT = ((float)((B5+8)>>4))/10.0;
-    } else {
-        long* UP = &dev->UP;
-        long B6 = B5 - 4000;
-        X1 = (Para_BMP085->B2*((B6*B6)>>12))>>11;
-        X2 = (Para_BMP085->AC2 * B6) >>11;
-        long X3 = X1 + X2;
-        long B3 = ( (( (long)Para_BMP085->AC1 * 4 + X3 ) << OSRS) + 2 ) / 4;
-        X1 = (Para_BMP085->AC3 * B6) >>13;
-        X2 = (Para_BMP085->B1 * (B6*B6)>>12)>>16;
-        X3 = ((X1+X2)+2)>>2;
-        long B4 = (Para_BMP085->AC4 * ((unsigned long)X3 + 32768)) >>15;
-        unsigned long B7 = ((unsigned long)(*UP) - B3) * (50000 >> OSRS);
-
-        long RRP;
-        if (B7 < 0x80000000) RRP = (B7 * 2) / B4 ;
-        else RRP = (B7 / B4) * 2 ;
-
-        X1 = (RRP>>8)*(RRP>>8);
-        X1 = (X1 * 3038) >>16;
-        X2 = (-7357 * RRP) >> 16;
-
-        dev->RP = (float)(((X1 + X2 + 3791)>>4) + RRP);
-        dev->altitude = 44330 * (1 - pow(dev->RP/P0, 1/5.255) );
-    }
+    int oss = dev->upOss;
+
+    long X1 = ((dev->UT - Para_BMP085->AC6) * Para_BMP085->AC5) >>15;
+    long X2 = ((long)Para_BMP085->MC * 2048) / (X1+Para_BMP085->MD);
+    long B5 = X1+X2;
+    dev->RT = ((float)((B5+8)>>4))/10.0;
+
+    long B6 = B5 - 4000;
+    X1 = (Para_BMP085->B2*((B6*B6)>>12))>>11;
+    X2 = (Para_BMP085->AC2 * B6) >>11;
+    long X3 = X1 + X2;
+    long B3 = ( (( (long)Para_BMP085->AC1 * 4 + X3 ) << oss) + 2 ) / 4;
+    X1 = (Para_BMP085->AC3 * B6) >>13;
+    X2 = (Para_BMP085->B1 * ((B6*B6)>>12))>>16;
+    X3 = ((X1+X2)+2)>>2;
+    long B4 = (Para_BMP085->AC4 * ((unsigned long)X3 + 32768)) >>15;
+    unsigned long B7 = ((unsigned long)dev->UP - B3) * (50000 >> oss);
+
+    long RRP;
+    if (B7 < 0x80000000) RRP = (B7 * 2) / B4 ;
+    else RRP = (B7 / B4) * 2 ;
+
+    X1 = (RRP>>8)*(RRP>>8);
+    X1 = (X1 * 3038) >>16;
+    X2 = (-7357 * RRP) >> 16;
+
+    dev->RP = (float)(((X1 + X2 + 3791)>>4) + RRP);
+    dev->altitude = getAltitude(dev->RP);
     return 0;
 }
 
 void BMP085_delete(Drone_I2C_Device_BMP085** BMP085)
 {
     Drone_I2C_Cali_Delete(&(*BMP085)->cali);
+    Drone_FilterBank_Delete(&(*BMP085)->filter);
     Drone_Device_End(&(*BMP085)->dev);
     free(*BMP085);
     *BMP085 = NULL;
@@ -227,7 +226,7 @@ int BMP085_getFilteredValue(Drone_I2C_Device_BMP085* BMP085, uint64_t* lastUpdat
     if (f!=NULL) {
         *data = *f-Drone_I2C_Cali_getMean(BMP085->cali)[0];
         float filtered;
-        Drone_Filter_renew(&BMP085->filter, *f, &filtered);
+        Drone_FilterBank_renew(BMP085->filter, f, &filtered);
         *data_filter = filtered - Drone_I2C_Cali_getMean(BMP085->cali)[0];
         return 1;
     }
@@ -236,6 +235,6 @@ int BMP085_getFilteredValue(Drone_I2C_Device_BMP085* BMP085, uint64_t* lastUpdat
 
 void BMP085_inputFilter(Drone_I2C_Device_BMP085* BMP085)
 {
-    Drone_Filter_Pure(&BMP085->filter, BMP085->altitude);
+    Drone_FilterBank_Pure(BMP085->filter, &BMP085->altitude);
 }
 
@@ -3,7 +3,7 @@
 #include "RTPiDrone_Device.h"
 #include "RTPiDrone_Filter.h"
 #include "Common.h"
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -13,8 +13,9 @@
 #define HMC5883L_CONF_REG_A     0x00
 #define HMC5883L_CONF_REG_B     0x01
 #define HMC5883L_DATA_X_MSB     0x03
+#define HMC5883L_ID_A           0x0A            // "H43" in ID A, B, C
 
-#define HMC5883L_RESOLUTION     0.92
+#define HMC5883L_RESOLUTION     0.92f
 #ifndef HMC5883L_RATE
 #define HMC5883L_RATE           75
 #endif
@@ -26,7 +27,7 @@ struct Drone_I2C_Device_HMC5883L {
     float   mag_offset[NITEM];          //!< \private The offset due to the structure of drone
     float   mag_gain[NITEM];            //!< \private The gain in three axis
     Drone_I2C_CaliInfo* cali;       //!< \private Calibration information
-    Drone_Filter    filter[NITEM];
+    Drone_FilterBank*   filter;         //!< \private Low-pass of the 3 axes
 };
 
 static int HMC5883L_init(void*);        //!< \private \memberof Drone_I2C_Device_HMC5883L function : Initialization of HMC5883L
@@ -58,15 +59,18 @@ int HMC5883L_setup(Drone_I2C_Device_HMC5883L** HMC5883L)
     (*HMC5883L)->mag_gain[0] = 1.000000;
     (*HMC5883L)->mag_gain[1] = 0.992958;
     (*HMC5883L)->mag_gain[2] = 1.128000;
+    if (Drone_FilterBank_Init(&(*HMC5883L)->filter, NITEM, 1)) return -1;
     for (int i=0; i<NITEM; ++i) {
-        Drone_Filter_init(&(*HMC5883L)->filter[i], 0.006, 1.0f );
+        Drone_FilterBank_SetLowPass((*HMC5883L)->filter, i, 0, 0.006, 1.0f);
     }
+#ifdef  I2C_DRDY
+    if (Drone_Device_SetDataReady(&(*HMC5883L)->dev, DRDY_PIN_HMC5883L, DRONE_BUS_EDGE_FALLING)) return -1;
+#endif
     return HMC5883L_init(&(*HMC5883L)->dev) + Drone_Device_Init(&(*HMC5883L)->dev);
 }
 
 static int HMC5883L_init(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(HMC5883L_ADDR);
     char regaddr[2];
     regaddr[0] = HMC5883L_MODE_REG;
 #ifdef  HMC5883L_SINGLEMEASUREMENT
@@ -74,7 +78,7 @@ static int HMC5883L_init(void* i2c_dev)
 #else
     regaddr[1] = 0x00;              // Continuous-Measurement mode
 #endif
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(HMC5883L_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("HMC5883L Init 1 fail : Continue mode");
         return -1;
     }
@@ -105,17 +109,24 @@ static int HMC5883L_init(void* i2c_dev)
             regaddr[1] += 0x18;
             break;
     }
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(HMC5883L_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("HMC5883L Init 2 fail : Range");
         return -2;
     }
 
     regaddr[0] = HMC5883L_CONF_REG_B;           // Range
     regaddr[1] = 0x20;                          // +- 1.3 Ga
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(HMC5883L_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("HMC5883L Init 3 fail : Range");
         return -3;
     }
+
+    char id[3];
+    if (Drone_Bus_I2C_ReadRegister(HMC5883L_ADDR, HMC5883L_ID_A, id, 3) != DRONE_BUS_OK) {
+        perror("HMC5883L Init 5 fail : Identification");
+        return -5;
+    }
+    Drone_I2C_Cali_setIdentity(((Drone_I2C_Device_HMC5883L*)i2c_dev)->cali, id, 3);    // The part : no serial number
 #ifdef  HMC5883L_SINGLEMEASUREMENT
     if (HMC5883L_singleMeasurement()) {
         perror("HMC5883L single trig");
@@ -128,17 +139,11 @@ static int HMC5883L_init(void* i2c_dev)
 
 static int HMC5883L_getRawValue(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(HMC5883L_ADDR);
-    char regaddr = HMC5883L_DATA_X_MSB;
-    if (bcm2835_i2c_write(&regaddr,1) != BCM2835_I2C_REASON_OK) {
+    char* mag = (char*)((Drone_I2C_Device_HMC5883L*)i2c_dev)->rawData;
+    if (Drone_Bus_I2C_ReadRegister(HMC5883L_ADDR, HMC5883L_DATA_X_MSB, mag, 6) != DRONE_BUS_OK) {
         perror("HMC5883L getRaw Error 1");
         return -1;
     }
-    char* mag = (char*)((Drone_I2C_Device_HMC5883L*)i2c_dev)->rawData;
-    if ( bcm2835_i2c_read(mag, 6) != BCM2835_I2C_REASON_OK ) {
-        perror("HMC5883L getRaw Error 2");
-        return -2;
-    }
 
     exchange((char*) mag, 6);
 
@@ -161,6 +166,7 @@ static int HMC5883L_convertRawToReal(void* i2c_dev)
 void HMC5883L_delete(Drone_I2C_Device_HMC5883L** HMC5883L)
 {
     Drone_I2C_Cali_Delete(&(*HMC5883L)->cali);
+    Drone_FilterBank_Delete(&(*HMC5883L)->filter);
     Drone_Device_End(&(*HMC5883L)->dev);
     free(*HMC5883L);
     *HMC5883L = NULL;
@@ -170,10 +176,8 @@ int HMC5883L_getFilteredValue(Drone_I2C_Device_HMC5883L* HMC5883L, uint64_t* las
 {
     float* f = (float*)Drone_Device_GetRefreshedData((Drone_Device*)HMC5883L, lastUpdate);
     if (f != NULL) {
-        for (int i=0; i<NITEM; ++i) {
-            data[i] = f[i];
-            Drone_Filter_renew(&HMC5883L->filter[i], f[i], &data_filter[i]);
-        }
+        for (int i=0; i<NITEM; ++i) data[i] = f[i];
+        Drone_FilterBank_renew(HMC5883L->filter, f, data_filter);
         return 1;
     }
     return 0;
@@ -182,11 +186,10 @@ int HMC5883L_getFilteredValue(Drone_I2C_Device_HMC5883L* HMC5883L, uint64_t* las
 #ifdef HMC5883L_SINGLEMEASUREMENT
 static int HMC5883L_singleMeasurement(void)
 {
-    bcm2835_i2c_setSlaveAddress(HMC5883L_ADDR);
     char regaddr[2];
     regaddr[0] = HMC5883L_MODE_REG;
     regaddr[1] = 0x01;                              // Single measurement mode
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(HMC5883L_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("HMC5883L Single Measurement Error");
         return -1;
     }
@@ -196,8 +199,6 @@ static int HMC5883L_singleMeasurement(void)
 
 void HMC5883L_inputFilter(Drone_I2C_Device_HMC5883L* HMC5883L)
 {
-    for (int i=0; i<NITEM; ++i) {
-        Drone_Filter_Pure(&HMC5883L->filter[i], HMC5883L->realData[i]);
-    }
+    Drone_FilterBank_Pure(HMC5883L->filter, HMC5883L->realData);
 }
 
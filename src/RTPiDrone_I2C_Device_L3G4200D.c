@@ -3,19 +3,24 @@
 #include "RTPiDrone_Device.h"
 #include "RTPiDrone_I2C_CaliInfo.h"
 #include "RTPiDrone_Filter.h"
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 
 #define NITEM                   3
 #define L3G4200D_ADDR           0x69            // 3 Axis Gyro                  ST Microelectronics L3G4200D
+#define L3G4200D_WHO_AM_I       0x0F            // 0xD3
 #define L3G4200D_CTRL_REG1      0x20
 #define L3G4200D_CTRL_REG2      0x21
 #define L3G4200D_CTRL_REG3      0x22
 #define L3G4200D_CTRL_REG4      0x23
 #define L3G4200D_CTRL_REG5      0x24
 #define L3G4200D_OUT_X_L_7B     0xA8
+#define L3G4200D_FIFO_CTRL_REG  0x2E
+#define L3G4200D_FIFO_SRC_REG   0x2F
+#define L3G4200D_OUT_TEMP       0x26            // -1 LSB/degC, offset proper to the chip
+#define L3G4200D_FIFO_SIZE      32
 #define L3G4200D_UNIT           0.00875     // Unit of L3G4200D when range = 250 dps
 
 #define DEG_TO_RAD              (M_PI/180)  // Convert degree to rad
@@ -26,13 +31,32 @@
 #ifndef L3G4200D_RATE
 #define L3G4200D_RATE            400
 #endif
+#ifdef  L3G4200D_FIFO
+#define L3G4200D_ODR             L3G4200D_FIFO_RATE
+#else
+#define L3G4200D_ODR             L3G4200D_RATE
+#endif
 
 struct Drone_I2C_Device_L3G4200D {
     Drone_Device dev;           //!< \private I2C device prototype
     int16_t rawData[NITEM];             //!< \private Raw data
     float   realData[NITEM];            //!< \private Real data
     Drone_I2C_CaliInfo* cali;       //!< \private Calibration information
-    Drone_Filter    filter[NITEM];
+    Drone_FilterBank*   filter;         //!< \private Low-pass of the 3 axes
+    float   temperature;                //!< \private Die temperature at the setup (degC, up to an offset)
+#ifdef  L3G4200D_FIFO
+    int16_t fifo[L3G4200D_FIFO_SIZE][NITEM];    //!< \private Samples of the last read, oldest first
+    int     nFifo;                              //!< \private Number of samples in fifo
+    float   sampleDt[L3G4200D_FIFO_SIZE];       //!< \private Time from the previous sample (s)
+    uint64_t sampleTime;                        //!< \private Reconstructed time of the last sample
+    uint64_t readTime;                          //!< \private Time of the last read
+    float   samplePeriod;                       //!< \private Estimated period of the samples (ns)
+    uint64_t periodTime;                        //!< \private Time between the reads used by the estimation
+    uint64_t periodSample;                      //!< \private Samples of these reads
+    uint64_t nRead;                             //!< \private Number of reads of the FIFO
+    uint64_t nSample;                           //!< \private Number of samples read
+    uint64_t nOverrun;                          //!< \private Number of reads finding the FIFO overrun
+#endif
 };
 
 static int L3G4200D_init(void*);        //!< \private \memberof Drone_I2C_Device_L3G4200D function : Initialization of L3G4200D
@@ -44,6 +68,11 @@ Drone_I2C_CaliInfo* L3G4200D_getCaliInfo(Drone_I2C_Device_L3G4200D* L3G4200D)
     return L3G4200D->cali;
 }
 
+float L3G4200D_getTemperature(Drone_I2C_Device_L3G4200D* L3G4200D)
+{
+    return L3G4200D->temperature;
+}
+
 int L3G4200D_setup(Drone_I2C_Device_L3G4200D** L3G4200D)
 {
     *L3G4200D = (Drone_I2C_Device_L3G4200D*) calloc(1,sizeof(Drone_I2C_Device_L3G4200D));
@@ -57,19 +86,25 @@ int L3G4200D_setup(Drone_I2C_Device_L3G4200D** L3G4200D)
     Drone_I2C_Cali_Init(&(*L3G4200D)->cali, NITEM);
     float period = CONTROL_PERIOD > (1000000000L/L3G4200D_RATE) ? (float)CONTROL_PERIOD : (float)(1000000000L/L3G4200D_RATE);
     period /= 1000000000.0f;
+    if (Drone_FilterBank_Init(&(*L3G4200D)->filter, NITEM, 1)) return -1;
     for (int i=0; i<NITEM; ++i) {
-        Drone_Filter_init(&(*L3G4200D)->filter[i], period, 1.0f );
+        Drone_FilterBank_SetLowPass((*L3G4200D)->filter, i, 0, period, 1.0f);
     }
+#ifdef  L3G4200D_FIFO
+    (*L3G4200D)->samplePeriod = 1000000000.0f/L3G4200D_ODR;
+#endif
 
+#ifdef  I2C_DRDY
+    if (Drone_Device_SetDataReady(&(*L3G4200D)->dev, DRDY_PIN_L3G4200D, DRONE_BUS_EDGE_RISING)) return -1;
+#endif
     return L3G4200D_init(&(*L3G4200D)->dev) + Drone_Device_Init(&(*L3G4200D)->dev);
 }
 
 static int L3G4200D_init(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(L3G4200D_ADDR);
     char regaddr[2];
     regaddr[0] = L3G4200D_CTRL_REG1;
-    switch(L3G4200D_RATE) {
+    switch(L3G4200D_ODR) {
         case 100:
             regaddr[1] = 0x2F;
             break;
@@ -84,7 +119,7 @@ static int L3G4200D_init(void* i2c_dev)
             break;
     }
 
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(L3G4200D_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("L3G4200D Init 1 fail : Rate");
         return -1;
     }
@@ -92,15 +127,19 @@ static int L3G4200D_init(void* i2c_dev)
     regaddr[0] = L3G4200D_CTRL_REG2;            // Filter related
     regaddr[1] = 0x04;
 
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(L3G4200D_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("L3G4200D Init 2 fail : Filter");
         return -2;
     }
 
     regaddr[0] = L3G4200D_CTRL_REG3;            // Interrupt related
+#ifdef  I2C_DRDY
+    regaddr[1] = 0x08;                          // bit 3 : Data Ready on DRDY/INT2
+#else
     regaddr[1] = 0x00;
+#endif
 
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(L3G4200D_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("L3G4200D Init 3 fail : Interrupt");
         return -3;
     }
@@ -118,37 +157,128 @@ static int L3G4200D_init(void* i2c_dev)
             break;
     }
 
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(L3G4200D_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("L3G4200D Init 4 fail : Range");
         return -4;
     }
 
+#ifdef  L3G4200D_FIFO
+    regaddr[0] = L3G4200D_FIFO_CTRL_REG;            // Stream mode
+    regaddr[1] = 0x40;
+
+    if (Drone_Bus_I2C_Write(L3G4200D_ADDR, regaddr,2) != DRONE_BUS_OK) {
+        perror("L3G4200D Init 5 fail : Stream");
+        return -5;
+    }
+
+    regaddr[0] = L3G4200D_CTRL_REG5;                // FIFO enabled : the burst read rolls back from OUT_Z_H to OUT_X_L
+    regaddr[1] = 0x40;
+#else
     regaddr[0] = L3G4200D_CTRL_REG5;                // FIFO related
     regaddr[1] = 0x00;
+#endif
 
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(L3G4200D_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("L3G4200D Init 5 fail : FIFO");
         return -5;
     }
+
+    Drone_I2C_Device_L3G4200D* L3G4200D = (Drone_I2C_Device_L3G4200D*)i2c_dev;
+    char id, temp;
+    if (Drone_Bus_I2C_ReadRegister(L3G4200D_ADDR, L3G4200D_WHO_AM_I, &id, 1) != DRONE_BUS_OK) {
+        perror("L3G4200D Init 6 fail : WHO_AM_I");
+        return -6;
+    }
+    Drone_I2C_Cali_setIdentity(L3G4200D->cali, &id, 1);                // The part : no serial number
+    if (Drone_Bus_I2C_ReadRegister(L3G4200D_ADDR, L3G4200D_OUT_TEMP, &temp, 1) != DRONE_BUS_OK) {
+        perror("L3G4200D Init 7 fail : Temperature");
+        return -7;
+    }
+    L3G4200D->temperature = -(float)(int8_t)temp;
 #ifdef  DEBUG
     puts("L3G4200D initialization is done");
 #endif
     return 0;
 }
 
+#ifdef  L3G4200D_FIFO
 static int L3G4200D_getRawValue(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(L3G4200D_ADDR);
-    char regaddr = L3G4200D_OUT_X_L_7B;
-    if (bcm2835_i2c_write(&regaddr,1) != BCM2835_I2C_REASON_OK) {
+    Drone_I2C_Device_L3G4200D* dev = (Drone_I2C_Device_L3G4200D*)i2c_dev;
+    char src;
+    dev->nFifo = 0;
+    if (Drone_Bus_I2C_ReadRegister(L3G4200D_ADDR, L3G4200D_FIFO_SRC_REG, &src, 1) != DRONE_BUS_OK) {
         perror("L3G4200D getRaw Error 1");
         return -1;
     }
-    char* gyc = (char*)((Drone_I2C_Device_L3G4200D*)i2c_dev)->rawData;
-    if ( bcm2835_i2c_read(gyc, 6) != BCM2835_I2C_REASON_OK ) {
+    int n = src & 0x1F;
+    if (src & 0x40) {                               // OVRN : the FIFO is full, the oldest samples are lost
+        n = L3G4200D_FIFO_SIZE;
+        ++dev->nOverrun;
+    }
+    if (!n) return 0;
+
+    // All of the samples in one burst
+    if (Drone_Bus_I2C_ReadRegister(L3G4200D_ADDR, L3G4200D_OUT_X_L_7B, (char*)dev->fifo, 6*n) != DRONE_BUS_OK) {
         perror("L3G4200D getRaw Error 2");
         return -2;
     }
+    dev->nFifo = n;
+    for (int i=0; i<NITEM; ++i) dev->rawData[i] = dev->fifo[n-1][i];
+    ++dev->nRead;
+    dev->nSample += n;
+    return 0;
+}
+
+/* The samples follow each other at the output data rate, the last one is at most one period before the read */
+static void L3G4200D_sampleTime(Drone_I2C_Device_L3G4200D* dev)
+{
+    uint64_t now = dev->dev.lastUpdate;
+    int n = dev->nFifo;
+    if (!n) return;
+    if (dev->readTime && now > dev->readTime && n < L3G4200D_FIFO_SIZE) {   // The actual rate is not the nominal one
+        dev->periodTime += now - dev->readTime;
+        dev->periodSample += n;
+        if (dev->periodSample >= L3G4200D_FIFO_SIZE) dev->samplePeriod = (float)dev->periodTime / dev->periodSample;
+    }
+    dev->readTime = now;
+    uint64_t t = dev->sampleTime;
+    float period = dev->samplePeriod;
+    if (now < t || now - t > (n+1)*period) t = now - n*period;     // First read, overrun or calibration
+    for (int j=0; j<n; ++j) {
+        uint64_t next = t + period;
+        if (next > now) next = now;
+        dev->sampleDt[j] = (float)(next - t)/1000000000.0f;
+        t = next;
+    }
+    dev->sampleTime = t;
+}
+
+static float L3G4200D_convert(int16_t raw)
+{
+    float real = raw * (float)(L3G4200D_UNIT * DEG_TO_RAD);
+    if (L3G4200D_RANGE == 500) real *= 2;
+    else if (L3G4200D_RANGE == 2000) real *= 8;
+    return real;
+}
+
+static int L3G4200D_convertRawToReal(void* i2c_dev)
+{
+    Drone_I2C_Device_L3G4200D* dev = (Drone_I2C_Device_L3G4200D*)i2c_dev;
+    for (int i=0; i<NITEM; ++i) {
+        dev->realData[i] = L3G4200D_convert(dev->rawData[i]);
+    }
+    L3G4200D_sampleTime(dev);
+    return 0;
+}
+#else
+static int L3G4200D_getRawValue(void* i2c_dev)
+{
+    char* gyc = (char*)((Drone_I2C_Device_L3G4200D*)i2c_dev)->rawData;
+    if (Drone_Bus_I2C_ReadRegister(L3G4200D_ADDR, L3G4200D_OUT_X_L_7B, gyc, 6) != DRONE_BUS_OK) {
+        perror("L3G4200D getRaw Error 1");
+        return -1;
+    }
     return 0;
 }
 
@@ -156,16 +286,25 @@ static int L3G4200D_convertRawToReal(void* i2c_dev)
 {
     Drone_I2C_Device_L3G4200D* dev = (Drone_I2C_Device_L3G4200D*)i2c_dev;
     for (int i=0; i<NITEM; ++i) {
-        dev->realData[i] = dev->rawData[i] * L3G4200D_UNIT * DEG_TO_RAD;
+        dev->realData[i] = dev->rawData[i] * (float)(L3G4200D_UNIT * DEG_TO_RAD);
         if (L3G4200D_RANGE == 500) dev->realData[i] *= 2;
         else if (L3G4200D_RANGE == 2000) dev->realData[i] *= 8;
     }
     return 0;
 }
+#endif
 
 void L3G4200D_delete(Drone_I2C_Device_L3G4200D** L3G4200D)
 {
+#if defined(L3G4200D_FIFO) && defined(DEBUG)
+    printf("L3G4200D : %llu samples at %.1f Hz (%d Hz nominal) in %llu reads (%.1f per read), FIFO overrun %llu times\n",
+           (unsigned long long)(*L3G4200D)->nSample, 1000000000.0f/(*L3G4200D)->samplePeriod, L3G4200D_ODR,
+           (unsigned long long)(*L3G4200D)->nRead,
+           (*L3G4200D)->nRead ? (double)(*L3G4200D)->nSample/(*L3G4200D)->nRead : 0.0,
+           (unsigned long long)(*L3G4200D)->nOverrun);
+#endif
     Drone_I2C_Cali_Delete(&(*L3G4200D)->cali);
+    Drone_FilterBank_Delete(&(*L3G4200D)->filter);
     Drone_Device_End(&(*L3G4200D)->dev);
     free(*L3G4200D);
     *L3G4200D = NULL;
@@ -175,21 +314,34 @@ int L3G4200D_getFilteredValue(Drone_I2C_Device_L3G4200D* L3G4200D, uint64_t* las
 {
     float* f = (float*)Drone_Device_GetRefreshedData((Drone_Device*)L3G4200D, lastUpdate);
     if (f) {
-        float filtered;
+        float filtered[NITEM];
+        Drone_FilterBank_renew(L3G4200D->filter, f, filtered);
         for (int i=0; i<NITEM; ++i) {
             data[i] = f[i]-Drone_I2C_Cali_getMean(L3G4200D->cali)[i];
-            Drone_Filter_renew(&L3G4200D->filter[i], f[i], &filtered);
-            data_filter[i] = filtered - Drone_I2C_Cali_getMean(L3G4200D->cali)[i];
+            data_filter[i] = filtered[i] - Drone_I2C_Cali_getMean(L3G4200D->cali)[i];
         }
         return 1;
     }
     return 0;
 }
 
-void L3G4200D_inputFilter(Drone_I2C_Device_L3G4200D* L3G4200D)
+int L3G4200D_getSamples(Drone_I2C_Device_L3G4200D* L3G4200D, float (*data)[3], float* dt)
 {
-    for (int i=0; i<NITEM; ++i) {
-        Drone_Filter_Pure(&L3G4200D->filter[i], L3G4200D->realData[i]);
+#ifdef  L3G4200D_FIFO
+    for (int j=0; j<L3G4200D->nFifo; ++j) {
+        for (int i=0; i<NITEM; ++i) {
+            data[j][i] = L3G4200D_convert(L3G4200D->fifo[j][i]) - Drone_I2C_Cali_getMean(L3G4200D->cali)[i];
+        }
+        dt[j] = L3G4200D->sampleDt[j];
     }
+    return L3G4200D->nFifo;
+#else
+    return 0;
+#endif
+}
+
+void L3G4200D_inputFilter(Drone_I2C_Device_L3G4200D* L3G4200D)
+{
+    Drone_FilterBank_Pure(L3G4200D->filter, L3G4200D->realData);
 }
 
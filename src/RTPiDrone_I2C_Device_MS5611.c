@@ -3,7 +3,7 @@
 #include "RTPiDrone_Device.h"
 #include "RTPiDrone_I2C_CaliInfo.h"
 #include "Common.h"
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -15,7 +15,7 @@
 #define MS5611_D1               0x48
 #define MS5611_D2               0x58
 #define MS5611_ADC              0x00
-#define OSR_4096                10000
+#define MS5611_NOSR             5               // OSR 256, 512, 1024, 2048, 4096
 #define P0                      101325          // atmosphere pressure
 
 // Need to read them at the beginning of measurement (or simply save them, then user can load them to estimate temperature
@@ -26,24 +26,36 @@ typedef struct {
     uint16_t C[MS5611_PROM_SIZE];
 } MS5611_Parameters;
 
-static uint64_t MS5611_Trigger_Switch = 0;
+/*!
+ * \enum MS5611_Conversion
+ * \brief Conversion in progress in the MS5611
+ */
+typedef enum {
+    MS5611_PRESSURE,                    /*!< D1 */
+    MS5611_TEMPERATURE                  /*!< D2 */
+} MS5611_Conversion;
+
+static const uint64_t MS5611_ConvTime[MS5611_NOSR] = {600000L, 1170000L, 2280000L, 4540000L, 9040000L};   // Max. of the datasheet (ns)
 
 //#pragma pack( push, 1 )
 struct Drone_I2C_Device_MS5611 {
     Drone_Device dev;                //!< \private I2C device prototype
-    uint32_t D1;                         //!< \private Raw Temperature
-    uint32_t D2;                         //!< \private Raw Pressure
+    uint32_t D1;                         //!< \private Raw Pressure
+    uint32_t D2;                         //!< \private Raw Temperature
     float   altitude;                //!< \private Altitude
     float   RT;                      //!< \private Real Temperature
     float   RP;                      //!< \private Real Pressure
     MS5611_Parameters Para_MS5611;   //!< \private Parameter of MS5611
     Drone_I2C_CaliInfo* cali;        //!< \private Calibration information
-    Drone_Filter    filter;
+    Drone_FilterBank*   filter;      //!< \private Low-pass of the altitude
+    MS5611_Conversion conv;          //!< \private Conversion in progress
+    int     osr;                     //!< \private Index of the oversampling ratio (0 : 256, ... 4 : 4096)
+    int     nPressure;               //!< \private Pressures converted since the last temperature
 };
 //#pragma pack( pop )
 
 static int MS5611_init(void*);        //!< \private \memberof Drone_I2C_Device_MS5611 function : Initialization of MS5611
-static int MS5611_Trigger_D(void); //!< \private \memberof Drone_I2C_Device_MS5611 function : Trigger temp. measurement
+static int MS5611_Trigger(Drone_I2C_Device_MS5611*, MS5611_Conversion); //!< \private \memberof Drone_I2C_Device_MS5611 function : Start a conversion
 static int MS5611_getRawData(void*);
 static int MS5611_getRealData(void*);
 static int MS5611_Reset(void);
@@ -62,20 +74,37 @@ int MS5611_setup(Drone_I2C_Device_MS5611** MS5611)
     Drone_Device_SetRawFunction(&(*MS5611)->dev, MS5611_getRawData);
     Drone_Device_SetRealFunction(&(*MS5611)->dev, MS5611_getRealData);
     Drone_Device_SetDataPointer(&(*MS5611)->dev, (void*)&(*MS5611)->altitude);
-    Drone_Device_SetPeriod(&(*MS5611)->dev, MS5611_Period);
+    if (MS5611_setOSR(*MS5611, MS5611_OSR)) return -5;
     Drone_I2C_Cali_Init(&(*MS5611)->cali, 3);
-    Drone_Filter* filter = &(*MS5611)->filter;
-    Drone_Filter_init(filter, 0.03, 4.0f);
+    if (Drone_FilterBank_Init(&(*MS5611)->filter, 1, 1)) return -6;
+    Drone_FilterBank_SetLowPass((*MS5611)->filter, 0, 0, 0.03, 4.0f);
 
     return MS5611_init(*MS5611);
 }
 
+int MS5611_setOSR(Drone_I2C_Device_MS5611* MS5611, int osr)
+{
+    for (int i=0; i<MS5611_NOSR; ++i) {
+        if (osr == 256 << i) {
+            // Takes effect from the next conversion, the one in progress keeps its own time
+            MS5611->osr = i;
+            Drone_Device_SetPeriod(&MS5611->dev, MS5611_ConvTime[i]);
+            return 0;
+        }
+    }
+    fprintf(stderr, "MS5611 : no OSR %d\n", osr);
+    return -1;
+}
+
+uint64_t MS5611_getConversionTime(Drone_I2C_Device_MS5611* MS5611)
+{
+    return MS5611_ConvTime[MS5611->osr];
+}
+
 static int MS5611_init(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(MS5611_ADDR);
     Drone_I2C_Device_MS5611* MS5611 = (Drone_I2C_Device_MS5611*)i2c_dev;
 
-    char regaddr = MS5611_RESET;
     if (MS5611_Reset()) {
         perror("MS5611 reset Error 1");
         return -1;
@@ -85,99 +114,110 @@ static int MS5611_init(void* i2c_dev)
 
     MS5611_Parameters* Para_MS5611 = &MS5611->Para_MS5611;
     for (int i=0; i<MS5611_PROM_SIZE; ++i) {
-        regaddr = MS5611_PROM + i*2;
         char* buf = (char*)&Para_MS5611->C[i];
-        if (bcm2835_i2c_write(&regaddr,1) != BCM2835_I2C_REASON_OK) {
-            perror("MS5611 getPara Error 1");
-            return -2;
-        }
-        if (bcm2835_i2c_read(buf, 2) != BCM2835_I2C_REASON_OK) {
+        if (Drone_Bus_I2C_ReadRegister(MS5611_ADDR, MS5611_PROM + i*2, buf, 2) != DRONE_BUS_OK) {
             perror("Parameters of MS5611 are not correctly loaded");
             return -3;
         }
     }
 
     exchange((char*)Para_MS5611->C, MS5611_PROM_SIZE*2);
+    Drone_I2C_Cali_setIdentity(MS5611->cali, Para_MS5611->C, MS5611_PROM_SIZE*2);     // The PROM is proper to the chip
 #ifdef  DEBUG
     for (int i=0; i<MS5611_PROM_SIZE; ++i) {
         printf("%u\t", MS5611->Para_MS5611.C[i]);
     }
     puts("");
 #endif
-    _usleep(5000);
 
-    if (MS5611_Trigger_D()) {
+    // The temperature first : the pressure needs it. Its result is read by the first refresh.
+    if (MS5611_Trigger(MS5611, MS5611_TEMPERATURE)) {
         perror("D trigger");
         return -4;
     }
-    _usleep(OSR_4096);
-    for (int i=0; i<10; ++i) {
-        if (MS5611_getRawData(MS5611) & MS5611_getRealData(MS5611)) {
-            perror("get real data 1");
-            return -5;
-        }
-        _usleep(OSR_4096);
-    }
-    return 0;
+    return Drone_Device_Init(&MS5611->dev);
 }
 
 static int MS5611_Reset(void) {
-    bcm2835_i2c_setSlaveAddress(MS5611_ADDR);
     char regaddr = MS5611_RESET;
-    return bcm2835_i2c_write(&regaddr,1);
+    return Drone_Bus_I2C_Write(MS5611_ADDR, &regaddr,1);
+}
+
+static int MS5611_Trigger(Drone_I2C_Device_MS5611* MS5611, MS5611_Conversion conv)
+{
+    char regaddr = (conv == MS5611_PRESSURE ? MS5611_D1 : MS5611_D2) - 8 + 2*MS5611->osr;
+    MS5611->conv = conv;
+    Drone_Device_SetPeriod(&MS5611->dev, MS5611_ConvTime[MS5611->osr]);
+    return Drone_Bus_I2C_Write(MS5611_ADDR, &regaddr,1);
 }
 
+/*
+ * One step of the conversions : read the result of the one in progress, start the next one.
+ * return 0 with a new pressure, -1 on error, -2 with a temperature only, -3 if the conversion was not done
+ */
 static int MS5611_getRawData(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(MS5611_ADDR);
     Drone_I2C_Device_MS5611* MS5611 = (Drone_I2C_Device_MS5611*)i2c_dev;
-    char buf[] = {0,0,0};
-    char regaddr = MS5611_ADC;
-    if (bcm2835_i2c_write(&regaddr,1) != BCM2835_I2C_REASON_OK) {
-        perror("get D1 error 2");
+    unsigned char buf[] = {0,0,0};
+    if (Drone_Bus_I2C_ReadRegister(MS5611_ADDR, MS5611_ADC, (char*)buf, 3) != DRONE_BUS_OK) {
+        perror("get D1 error");
         return -1;
     }
-    if (bcm2835_i2c_read(buf, 3) != BCM2835_I2C_REASON_OK) {
-        perror("get D1 error 3");
-        return -2;
+    uint32_t adc = 65536 * buf[0] + 256 * buf[1] + buf[2];
+    if (!adc) {
+        // Read too early : the result of this conversion is lost, it starts again
+        return MS5611_Trigger(MS5611, MS5611->conv) ? -1 : -3;
     }
 
-    if (!(MS5611_Trigger_Switch&1)) {
-        MS5611->D1 = 65536 * buf[0] + 256 * buf[1] + buf[2];
+    if (MS5611->conv == MS5611_PRESSURE) {
+        MS5611->D1 = adc;
+        ++MS5611->nPressure;
+    } else {
+        MS5611->D2 = adc;
+        MS5611->nPressure = 0;
     }
-    else {
-        MS5611->D2 = 65536 * buf[0] + 256 * buf[1] + buf[2];
-    }
-
-    MS5611_Trigger_Switch++;
 
-    return MS5611_Trigger_D();
+    // The temperature drifts slowly : it is converted once every MS5611_TEMP_EVERY pressures
+    MS5611_Conversion next = (!MS5611->D2 || MS5611->nPressure >= MS5611_TEMP_EVERY) ? MS5611_TEMPERATURE : MS5611_PRESSURE;
+    int ret = MS5611->conv == MS5611_PRESSURE ? 0 : -2;
+    if (MS5611_Trigger(MS5611, next)) return -1;
+    return ret;
 }
 
-static int MS5611_getRealData(void* i2c_dev)
+// The integer compensation of the datasheet (first and second order), the pressure with 4 more bits
+void MS5611_compensate(const uint16_t* C, uint32_t D1, uint32_t D2, float* RT, float* RP)
 {
-    Drone_I2C_Device_MS5611* MS5611 = (Drone_I2C_Device_MS5611*)i2c_dev;
-    int32_t dT = (int32_t) MS5611->D2 - (int32_t) MS5611->Para_MS5611.C[5]*256;
-    int32_t TEMP = 2000 + dT * MS5611->Para_MS5611.C[6]/pow(2,23);
-    int64_t OFF = (int64_t) MS5611->Para_MS5611.C[2]*pow(2,16) + ((int64_t)MS5611->Para_MS5611.C[4]*dT)/pow(2,7);
-    int64_t SENS = (int64_t) MS5611->Para_MS5611.C[1]*pow(2,15) + ((int64_t)MS5611->Para_MS5611.C[3]*dT)/pow(2,8);
-    
+    int32_t dT = (int32_t) D2 - ((int32_t) C[5] << 8);
+    int32_t TEMP = 2000 + (int32_t)(((int64_t)dT * C[6]) >> 23);
+    int64_t OFF = ((int64_t) C[2] << 16) + (((int64_t) C[4] * dT) >> 7);
+    int64_t SENS = ((int64_t) C[1] << 15) + (((int64_t) C[3] * dT) >> 8);
+
     if (TEMP < 2000) {
-        int32_t T2 = dT*dT/pow(2,31);
-        int64_t OFF2 = 5 * (TEMP-2000)*(TEMP-2000) / 2;
-        int64_t SENS2 = OFF2 / 2;
+        int32_t T2 = (int32_t)(((int64_t)dT * dT) >> 31);
+        int64_t d = (int64_t)(TEMP-2000) * (TEMP-2000);
+        int64_t OFF2 = (5 * d) >> 1;
+        int64_t SENS2 = (5 * d) >> 2;
         if (TEMP < -1500) {
-            OFF2 += 7*(TEMP+1500)*(TEMP+1500);
-            SENS2 += 11*(TEMP+1500)*(TEMP+1500)/2;
+            d = (int64_t)(TEMP+1500) * (TEMP+1500);
+            OFF2 += 7 * d;
+            SENS2 += (11 * d) >> 1;
         }
         TEMP -= T2;
         OFF -= OFF2;
         SENS -= SENS2;
     }
 
-    MS5611->RT = (float)TEMP/100;
-    MS5611->RP = (float)((((int64_t)MS5611->D1*SENS)/pow(2,21) - OFF ) / pow(2,15));
-    MS5611->altitude = 44330 * (1 - pow(MS5611->RP/P0, 1/5.255) );
+    int64_t P = ((((int64_t) D1 * SENS) >> 21) - OFF) >> 11;               // 1/16 Pa
+    *RT = (float)TEMP/100;
+    *RP = (float)P * (1.0f/16);
+}
+
+static int MS5611_getRealData(void* i2c_dev)
+{
+    Drone_I2C_Device_MS5611* MS5611 = (Drone_I2C_Device_MS5611*)i2c_dev;
+    if (!MS5611->D1 || !MS5611->D2) return -1;
+    MS5611_compensate(MS5611->Para_MS5611.C, MS5611->D1, MS5611->D2, &MS5611->RT, &MS5611->RP);
+    MS5611->altitude = getAltitude(MS5611->RP);
 
     //printf("%f\t%f\t%f\n", MS5611->RT, MS5611->RP, MS5611->altitude);
 
@@ -185,17 +225,10 @@ static int MS5611_getRealData(void* i2c_dev)
 }
 
 
-static int MS5611_Trigger_D(void)
-{
-    bcm2835_i2c_setSlaveAddress(MS5611_ADDR);
-    char regaddr = !(MS5611_Trigger_Switch&1) ? MS5611_D1 : MS5611_D2;
-    return bcm2835_i2c_write(&regaddr,1);
-}
-
-
 void MS5611_delete(Drone_I2C_Device_MS5611** MS5611)
 {
     Drone_I2C_Cali_Delete(&(*MS5611)->cali);
+    Drone_FilterBank_Delete(&(*MS5611)->filter);
     Drone_Device_End(&(*MS5611)->dev);
     free(*MS5611);
     *MS5611 = NULL;
@@ -208,7 +241,7 @@ int MS5611_getFilteredValue(Drone_I2C_Device_MS5611* MS5611, uint64_t* lastUpdat
     if (f!=NULL) {
         *data = *f-Drone_I2C_Cali_getMean(MS5611->cali)[0];
         float filtered;
-        Drone_Filter_renew(&MS5611->filter, *f, &filtered);
+        Drone_FilterBank_renew(MS5611->filter, f, &filtered);
         *data_filter = filtered - Drone_I2C_Cali_getMean(MS5611->cali)[0];
         return 1;
     }
@@ -217,7 +250,7 @@ int MS5611_getFilteredValue(Drone_I2C_Device_MS5611* MS5611, uint64_t* lastUpdat
 
 void MS5611_inputFilter(Drone_I2C_Device_MS5611* MS5611)
 {
-    Drone_Filter_Pure(&MS5611->filter, MS5611->altitude);
+    Drone_FilterBank_Pure(MS5611->filter, &MS5611->altitude);
 }
 
 
@@ -2,7 +2,7 @@
 #include "RTPiDrone_I2C_Device_PCA9685PW.h"
 #include "RTPiDrone_Device.h"
 #include "Common.h"
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -11,6 +11,7 @@
 #define PCA9685PW_MODE1                 0x00
 #define PCA9685PW_MODE2                 0x01
 #define PCA9685PW__OUTDRV               0x04
+#define PCA9685PW__AI                   0x20
 #define PCA9685PW__SLEEP                0x10
 #define PCA9685PW__RESTART              0x80
 #define PCA9685PW_PRE_SCALE             0xFE
@@ -21,6 +22,8 @@
 #define PCA9685PW_LED0_ON_L             0x06
 
 #define PCA9685PW_NMOTOR                4
+#define PCA9685PW_BURST                 (2 + 4 * (PCA9685PW_NMOTOR-1))  // From the OFF register of the first motor to the last
+#define PCA9685PW_NMEASURE              10
 #define PCA9685PW_POWER_ZERO            PWM_MIN
 #ifndef PCA9685PW_FREQ
 #define PCA9685PW_FREQ                  400
@@ -33,6 +36,8 @@
 struct Drone_I2C_Device_PCA9685PW {
     Drone_Device dev;                                                           //!< \private I2C device prototype
     uint32_t PWM_CHANNEL[PCA9685PW_NMOTOR];                                     //!< \private PWM Value
+    uint64_t nOutput;                                                           //!< \private Number of PWM outputs
+    int64_t  burstSaving;                                                       //!< \private Bus time saved by one burst (ns)
 };
 
 static int PCA9685PW_init(void*);
@@ -41,6 +46,11 @@ static int PCA9685PW_PWMReset(void*);
 static int PCA9685PW_Read(void*);
 static int pca9685PWMWriteSingleOff(const int, const uint32_t);
 static int pca9685PWMWriteMultiOff(const int*, const uint32_t*);
+static int pca9685PWMWriteBurstOff(const uint32_t*);
+#ifdef  PCA9685PW_ALL_LED
+static int pca9685PWMWriteAllOff(const uint32_t);
+#endif
+static int64_t pca9685PWMBurstSaving(void);
 static int pca9685PWMReadSingleOff(const int, uint32_t*);
 static int pca9685PWMReadMultiOff(const int*, uint32_t*);
 static int baseReg(const int);
@@ -57,11 +67,20 @@ int PCA9685PW_setup(Drone_I2C_Device_PCA9685PW** PCA9685PW)
     //Drone_Device_SetEndFunction(&(*PCA9685PW)->dev, PCA9685PW_PWMReset);
     Drone_Device_SetDataPointer(&(*PCA9685PW)->dev, (void*)(*PCA9685PW)->PWM_CHANNEL);
     Drone_Device_SetPeriod(&(*PCA9685PW)->dev, 1000000000L/PCA9685PW_FREQ * PWM_CONTROLPERIOD);
-    return PCA9685PW_init(&(*PCA9685PW)->dev) + Drone_Device_Init(&(*PCA9685PW)->dev);
+    int ret = PCA9685PW_init(&(*PCA9685PW)->dev) + Drone_Device_Init(&(*PCA9685PW)->dev);
+    if (!ret) (*PCA9685PW)->burstSaving = pca9685PWMBurstSaving();
+    return ret;
 }
 
 void PCA9685PW_delete(Drone_I2C_Device_PCA9685PW** PCA9685PW)
 {
+#ifdef  DEBUG
+    if ((*PCA9685PW)->nOutput) {
+        printf("PCA9685PW : %llu outputs in one burst, %.1f us of bus saved per output (%.1f ms in all)\n",
+               (unsigned long long)(*PCA9685PW)->nOutput, (*PCA9685PW)->burstSaving/1000.0,
+               (double)(*PCA9685PW)->nOutput*(*PCA9685PW)->burstSaving/1000000.0);
+    }
+#endif
     PCA9685PW_PWMReset(NULL);
     Drone_Device_End(&(*PCA9685PW)->dev);
     free(*PCA9685PW);
@@ -83,16 +102,15 @@ static int PCA9685PW_Read(void* i2c_dev)
 
 static int PCA9685PW_init(void* i2c_dev)
 {
-    bcm2835_i2c_setSlaveAddress(PCA9685PW_ADDR);
-    char regaddr[] = {PCA9685PW_MODE1, 0x20};
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    char regaddr[] = {PCA9685PW_MODE1, PCA9685PW__AI};          // Auto-increment, kept by PCA9685PWMFreq()
+    if (Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("PCA9685PW init error 1");
         return -1;
     }
 
     regaddr[0] = PCA9685PW_MODE2;
     regaddr[1] = PCA9685PW__OUTDRV;
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("PCA9685PW init error 1");
         return -2;
     }
@@ -107,42 +125,37 @@ static int PCA9685PW_init(void* i2c_dev)
 
 static int PCA9685PWMFreq(void)
 {
-    bcm2835_i2c_setSlaveAddress(PCA9685PW_ADDR);
     int freq = (PCA9685PW_FREQ > 1526 ? 1526 : (PCA9685PW_FREQ < 24 ? 24 : PCA9685PW_FREQ));
     int prescale = (int)(25000000.0f / (4096 * freq) - 0.5f);
     char regaddr[] = {PCA9685PW_MODE1, 0}, databuf[] = {0,0};
-    if (bcm2835_i2c_write(regaddr,1) != BCM2835_I2C_REASON_OK) {
-        perror("PCA9685PWMFreq error 1");
-        return -1;
-    }
-    if (bcm2835_i2c_read(databuf, 1) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_ReadRegister(PCA9685PW_ADDR, PCA9685PW_MODE1, databuf, 1) != DRONE_BUS_OK) {
         perror("PCA9685PWMFreq error 2");
         return -2;
     }
 
     regaddr[1] = (databuf[0] & 0x7F) | PCA9685PW__SLEEP;                // Go to sleep
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("PCA9685PWMFreq error 3");
         return -3;
     }
 
     regaddr[0] = PCA9685PW_PRE_SCALE;                   // Set frequency
     regaddr[1] = prescale & 0xFF;
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("PCA9685PWMFreq error 4");
         return -4;
     }
 
     regaddr[0] = PCA9685PW_MODE1;                       // Restore the setting
     regaddr[1] = databuf[0];
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("PCA9685PWMFreq error 5");
         return -5;
     }
     _usleep(5000);
 
     regaddr[1] = databuf[0] | PCA9685PW__RESTART;       // Restart
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
+    if (Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,2) != DRONE_BUS_OK) {
         perror("PCA9685PWMFreq error 6");
         return -6;
     }
@@ -151,34 +164,11 @@ static int PCA9685PWMFreq(void)
 
 static int PCA9685PW_PWMReset(void* P)                           // == All turn off
 {
-    bcm2835_i2c_setSlaveAddress(PCA9685PW_ADDR);
-
-    char regaddr[] = {PCA9685PW_ALL_LED_ON_L, 0x00};           // Restore the setting
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
-        perror("PCA9685PW reset error 1");
+    char regaddr[] = {PCA9685PW_ALL_LED_ON_L, 0x00, 0x00, 0x00, 0x00};   // ALL_LED_ON_L to ALL_LED_OFF_H
+    if (Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,5) != DRONE_BUS_OK) {
+        perror("PCA9685PW reset error");
         return -1;
     }
-
-    regaddr[0] = PCA9685PW_ALL_LED_ON_H;                       // Restore the setting
-    regaddr[1] = 0x00;
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
-        perror("PCA9685PW reset error 2");
-        return -2;
-    }
-
-    regaddr[0] = PCA9685PW_ALL_LED_OFF_L;                       // Restore the setting
-    regaddr[1] = 0x00;
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
-        perror("PCA9685PW reset error 3");
-        return -3;
-    }
-
-    regaddr[0] = PCA9685PW_ALL_LED_OFF_H;                       // Restore the setting
-    regaddr[1] = 0x00;
-    if (bcm2835_i2c_write(regaddr,2) != BCM2835_I2C_REASON_OK) {
-        perror("PCA9685PW reset error 4");
-        return -4;
-    }
 #ifdef  DEBUG
     puts("PCA9685PW reset!");
 #endif
@@ -188,12 +178,11 @@ static int PCA9685PW_PWMReset(void* P)                           // == All turn
 static int pca9685PWMWriteSingleOff(const int pin, const uint32_t off)
 {
     char regaddr[] = {baseReg(pin)+2, off&0xFF, off >> 8};
-    return bcm2835_i2c_write(regaddr,3);
+    return Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,3);
 }
 
 static int pca9685PWMWriteMultiOff(const int* pin, const uint32_t* data)
 {
-    bcm2835_i2c_setSlaveAddress(PCA9685PW_ADDR);
     int ret = 0;
     for (int i=0; i<PCA9685PW_NMOTOR; ++i) {
         ret += pca9685PWMWriteSingleOff(pin[i], data[i]);
@@ -201,6 +190,38 @@ static int pca9685PWMWriteMultiOff(const int* pin, const uint32_t* data)
     return ret;
 }
 
+static int pca9685PWMWriteBurstOff(const uint32_t* data)
+{
+    // The ON registers between the motors are written too, with 0 as set by PCA9685PW_PWMReset()
+    char regaddr[1 + PCA9685PW_BURST] = {baseReg(nChannel[0])+2};
+    for (int i=0; i<PCA9685PW_NMOTOR; ++i) {
+        regaddr[1 + 4*i] = data[i] & 0xFF;
+        regaddr[2 + 4*i] = data[i] >> 8;
+    }
+    return Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr, sizeof(regaddr));
+}
+
+#ifdef  PCA9685PW_ALL_LED
+static int pca9685PWMWriteAllOff(const uint32_t off)
+{
+    char regaddr[] = {PCA9685PW_ALL_LED_OFF_L, off&0xFF, off >> 8};
+    return Drone_Bus_I2C_Write(PCA9685PW_ADDR, regaddr,3);
+}
+#endif
+
+static int64_t pca9685PWMBurstSaving(void)
+{
+    // Output the reset state (0) both ways
+    static const uint32_t off[PCA9685PW_NMOTOR] = {0};
+    uint64_t start = get_nsec_mono();
+    for (int i=0; i<PCA9685PW_NMEASURE; ++i) pca9685PWMWriteMultiOff(nChannel, off);
+    uint64_t single = get_nsec_mono() - start;
+    start = get_nsec_mono();
+    for (int i=0; i<PCA9685PW_NMEASURE; ++i) pca9685PWMWriteBurstOff(off);
+    uint64_t burst = get_nsec_mono() - start;
+    return ((int64_t)single - (int64_t)burst) / PCA9685PW_NMEASURE;
+}
+
 static int baseReg(const int pin)
 {
     return PCA9685PW_LED0_ON_L + pin * 4;
@@ -208,24 +229,17 @@ static int baseReg(const int pin)
 
 static int pca9685PWMReadSingleOff(const int pin, uint32_t* off)
 {
-    char regaddr[] = {baseReg(pin)+2, 0};
-    if (bcm2835_i2c_write(regaddr,1) != BCM2835_I2C_REASON_OK) {
-        perror("PCA9685PW read error 1");
+    char databuf[2];
+    if (Drone_Bus_I2C_ReadRegister(PCA9685PW_ADDR, baseReg(pin)+2, databuf, 2) != DRONE_BUS_OK) {
+        perror("PCA9685PW read error");
         return -1;
     }
-
-    if ( bcm2835_i2c_read(regaddr, 2) != BCM2835_I2C_REASON_OK) {
-        perror("PCA9685PW read error 2");
-        return -2;
-    }
-
-    *off = (regaddr[0] + ((int)regaddr[1]<<8)) & 0xFFF;
+    *off = (databuf[0] + ((int)databuf[1]<<8)) & 0xFFF;
     return 0;
 }
 
 static int pca9685PWMReadMultiOff(const int* pin, uint32_t* data)
 {
-    bcm2835_i2c_setSlaveAddress(PCA9685PW_ADDR);
     int ret = 0;
     for (int i=0; i<PCA9685PW_NMOTOR; ++i) {
         ret += pca9685PWMReadSingleOff(pin[i], &data[i]);
@@ -235,14 +249,16 @@ static int pca9685PWMReadMultiOff(const int* pin, uint32_t* data)
 
 int PCA9685PW_writeOnly(Drone_I2C_Device_PCA9685PW* PCA9685PW, const uint32_t* data)
 {
-    return pca9685PWMWriteMultiOff(nChannel, data);
+#ifdef  PCA9685PW_ALL_LED
+    if (data[0] == data[1] && data[1] == data[2] && data[2] == data[3]) return pca9685PWMWriteAllOff(data[0]);
+#endif
+    ++PCA9685PW->nOutput;
+    return pca9685PWMWriteBurstOff(data);
 }
 
 int PCA9685PW_write(Drone_I2C_Device_PCA9685PW* PCA9685PW, const uint32_t* data, uint64_t* time)
 {
-    Drone_Device* dev = &PCA9685PW->dev;
-    if (*time-dev->lastUpdate > dev->period) {
-        dev->lastUpdate = *time;
+    if (Drone_Device_IsDue(&PCA9685PW->dev, time)) {
         PCA9685PW_writeOnly(PCA9685PW, data);
         return 1;
     }
@@ -0,0 +1,131 @@
+/*! \file RTPiDrone_Madgwick.c
+    \brief Madgwick filter of the attitude : the gyro integration is corrected by one gradient descent step
+
+    The step minimizes the error between the measured directions of the gravity and of the magnetic field and
+    the ones expected from the quaternion, its size is beta (rad/s). Without a magnetic field (NULL), only the
+    gravity is used (6-axis) : the yaw then follows the gyro until the next sample of the magnetometer.
+ */
+#include "RTPiDrone_Madgwick.h"
+#include "Common.h"
+#include "FastMath.h"
+#include <math.h>
+#include <stdlib.h>
+
+struct Drone_Madgwick {
+    float q[4];                 //!< \private Quaternion
+    float beta;                 //!< \private Gain of the correction (rad/s)
+};
+
+static void Drone_Madgwick_gradient(Drone_Madgwick*, float*, float*, float*);  //!< \private Normalized gradient of the error
+static void Drone_Madgwick_integrate(Drone_Madgwick*, float, float*, float*);  //!< \private One gyro sample and the correction over dt
+
+int Drone_Madgwick_Init(Drone_Madgwick** M, float* angle, float beta)
+{
+    *M = calloc(1, sizeof(Drone_Madgwick));
+    float dCos[3], dSin[3];
+    for (int i=0; i<3; ++i) {
+        dCos[i] = cosf(angle[i]*FAST_DEG_TO_RAD * 0.5f);
+        dSin[i] = sinf(angle[i]*FAST_DEG_TO_RAD * 0.5f);
+    }
+
+    (*M)->q[0] = dCos[0] * dCos[1] * dCos[2] + dSin[0] * dSin[1] * dSin[2];
+    (*M)->q[1] = dSin[0] * dCos[1] * dCos[2] - dCos[0] * dSin[1] * dSin[2];
+    (*M)->q[2] = dCos[0] * dSin[1] * dCos[2] + dSin[0] * dCos[1] * dSin[2];
+    (*M)->q[3] = dCos[0] * dCos[1] * dSin[2] - dSin[0] * dSin[1] * dCos[2];
+
+    (*M)->beta = beta;
+
+    return 0;
+}
+
+void Drone_Madgwick_Delete(Drone_Madgwick** M)
+{
+    free(*M);
+    *M = NULL;
+}
+
+void Drone_Madgwick_getAngle(Drone_Madgwick* M, float* angle)
+{
+    const float* q = M->q;
+    angle[0] = fastAtan2(2*q[2]*q[3] + 2*q[0]*q[1], -2*q[1]*q[1] - 2*q[2]*q[2] + 1) * FAST_RAD_TO_DEG; // roll
+    angle[1] = fastAsin(-2*q[1]*q[3] + 2*q[0]*q[2]) * FAST_RAD_TO_DEG; // pitch
+    angle[2] = fastAtan2(2*q[1]*q[2] + 2*q[0]*q[3], -2*q[2]*q[2] - 2*q[3]*q[3] + 1) * FAST_RAD_TO_DEG; // yaw
+}
+
+void Drone_Madgwick_renew(Drone_Madgwick* M, float deltaT, float* accl, float* gyro, float* magn)
+{
+    float s[4];
+    Drone_Madgwick_gradient(M, accl, magn, s);
+    Drone_Madgwick_integrate(M, deltaT, gyro, s);
+}
+
+void Drone_Madgwick_renewSamples(Drone_Madgwick* M, float* accl, float (*gyro)[3], float* deltaT, int n, float* magn)
+{
+    // One correction per cycle, each gyro sample over its own interval
+    float s[4];
+    Drone_Madgwick_gradient(M, accl, magn, s);
+    for (int k=0; k<n; ++k) Drone_Madgwick_integrate(M, deltaT[k], gyro[k], s);
+}
+
+static void Drone_Madgwick_gradient(Drone_Madgwick* M, float* accl, float* magn, float* s)
+{
+    const float* q = M->q;
+    for (int i=0; i<4; ++i) s[i] = 0;
+    float invNorm = getInvSqrt(accl, 3);
+    if (invNorm == 0) return;
+    float a[3] = {accl[0]*invNorm, accl[1]*invNorm, accl[2]*invNorm};
+
+    // Gravity : error f = expected - measured, s = J'f
+    const float fg[3] = {
+        2*(q[1]*q[3] - q[0]*q[2]) - a[0],
+        2*(q[0]*q[1] + q[2]*q[3]) - a[1],
+        1 - 2*(q[1]*q[1] + q[2]*q[2]) - a[2],
+    };
+    const float Jg[3][4] = {
+        {-2*q[2],   2*q[3],  -2*q[0],   2*q[1]},
+        { 2*q[1],   2*q[0],   2*q[3],   2*q[2]},
+        { 0,       -4*q[1],  -4*q[2],   0     },
+    };
+    for (int n=0; n<3; ++n)
+        for (int k=0; k<4; ++k) s[k] += Jg[n][k] * fg[n];
+
+    invNorm = magn ? getInvSqrt(magn, 3) : 0;
+    if (invNorm != 0) {
+        float m[3] = {magn[0]*invNorm, magn[1]*invNorm, magn[2]*invNorm};
+        // Magnetic field on the earth frame : its horizontal part along x
+        float hx = 2 * (m[0]*(0.5f - q[2]*q[2] - q[3]*q[3]) + m[1]*(q[1]*q[2] - q[0]*q[3]) + m[2]*(q[1]*q[3] + q[0]*q[2]));
+        float hy = 2 * (m[0]*(q[1]*q[2] + q[0]*q[3]) + m[1]*(0.5f - q[1]*q[1] - q[3]*q[3]) + m[2]*(q[2]*q[3] - q[0]*q[1]));
+        float bx = sqrtf(hx*hx + hy*hy);
+        float bz = 2 * (m[0]*(q[1]*q[3] - q[0]*q[2]) + m[1]*(q[2]*q[3] + q[0]*q[1]) + m[2]*(0.5f - q[1]*q[1] - q[2]*q[2]));
+        const float fb[3] = {
+            2*(bx*(0.5f - q[2]*q[2] - q[3]*q[3]) + bz*(q[1]*q[3] - q[0]*q[2])) - m[0],
+            2*(bx*(q[1]*q[2] - q[0]*q[3]) + bz*(q[0]*q[1] + q[2]*q[3])) - m[1],
+            2*(bx*(q[0]*q[2] + q[1]*q[3]) + bz*(0.5f - q[1]*q[1] - q[2]*q[2])) - m[2],
+        };
+        const float Jb[3][4] = {
+            {-2*bz*q[2],             2*bz*q[3],              -4*bx*q[2] - 2*bz*q[0], -4*bx*q[3] + 2*bz*q[1]},
+            {-2*bx*q[3] + 2*bz*q[1], 2*bx*q[2] + 2*bz*q[0],   2*bx*q[1] + 2*bz*q[3], -2*bx*q[0] + 2*bz*q[2]},
+            { 2*bx*q[2],             2*bx*q[3] - 4*bz*q[1],   2*bx*q[0] - 4*bz*q[2],  2*bx*q[1]},
+        };
+        for (int n=0; n<3; ++n)
+            for (int k=0; k<4; ++k) s[k] += Jb[n][k] * fb[n];
+    }
+
+    invNorm = getInvSqrt(s, 4);
+    for (int k=0; k<4; ++k) s[k] *= invNorm;
+}
+
+static void Drone_Madgwick_integrate(Drone_Madgwick* M, float deltaT, float* gyro, float* s)
+{
+    float* q = M->q;
+    float qDot[4] = {
+        0.5f*(-q[1]*gyro[0] - q[2]*gyro[1] - q[3]*gyro[2]) - M->beta*s[0],
+        0.5f*( q[0]*gyro[0] + q[2]*gyro[2] - q[3]*gyro[1]) - M->beta*s[1],
+        0.5f*( q[0]*gyro[1] - q[1]*gyro[2] + q[3]*gyro[0]) - M->beta*s[2],
+        0.5f*( q[0]*gyro[2] + q[1]*gyro[1] - q[2]*gyro[0]) - M->beta*s[3],
+    };
+    for (int i=0; i<4; ++i) q[i] += qDot[i] * deltaT;
+
+    float invNorm = getInvSqrt(q, 4);
+    for (int i=0; i<4; ++i) q[i] *= invNorm;
+}
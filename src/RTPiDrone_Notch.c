@@ -0,0 +1,377 @@
+/*! \file RTPiDrone_Notch.c
+    \brief Dynamic notches on the gyro : FFT on a spare core, notches on the control thread
+
+    The spectrum is the sum over the 3 axes of a real FFT (Hann window) of NOTCH_FFT_SIZE samples, the sampling
+    frequency comes from their time stamps : the notches stay below half of it. A peak is a local max. above NOTCH_SNR times the median of the
+    spectrum, its frequency is interpolated on the parabola of its 3 bins. Each notch follows the nearest peak, and
+    goes back to passing the samples through when it has lost its peak for NOTCH_HOLD analyses.
+ */
+#define _GNU_SOURCE                                 // SCHED_IDLE, pthread_setaffinity_np()
+#include "RTPiDrone_header.h"
+#include "RTPiDrone_Notch.h"
+#include "RTPiDrone_Filter.h"
+#include "RTPiDrone_RingBuffer.h"
+#include "RTPiDrone_Histogram.h"
+#include "RTPiDrone_Bus.h"
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define NOTCH_NBIN          (NOTCH_FFT_SIZE/2)  //!< \private Bins below the Nyquist frequency
+#define NOTCH_SMOOTH        (0.5f)              //!< \private Weight of the new frequency of a peak
+#define NOTCH_HOLD          (8)                 //!< \private Analyses a notch stays without its peak
+#define NOTCH_SLEEP         (5000000L)          //!< \private Sleep of the analysis between two drains of the ring (ns)
+#define NOTCH_NCOEF         (4)                 //!< \private Sets of coefficients the ring can hold
+#ifdef  L3G4200D_FIFO
+#define NOTCH_NSAMPLE       (4*NOTCH_FFT_SIZE)  //!< \private Samples the ring can hold, the FIFO gives ~3 per cycle
+#else
+#define NOTCH_NSAMPLE       (NOTCH_FFT_SIZE)    //!< \private Samples the ring can hold
+#endif
+
+#if     (NOTCH_FFT_SIZE & (NOTCH_FFT_SIZE - 1)) || NOTCH_FFT_SIZE < 8
+#error  "NOTCH_FFT_SIZE has to be a power of 2"
+#endif
+
+/*!
+ * \struct notchSample
+ * \private
+ * \brief Gyro sample, from the control thread to the analysis
+ */
+typedef struct {
+    float               gyr[3];                     //!< Angular velocity
+    uint64_t            time;                       //!< Time of the sample (get_nsec())
+} notchSample;
+
+/*!
+ * \struct notchCoef
+ * \private
+ * \brief Coefficients of the notches, from the analysis to the control thread
+ */
+typedef struct {
+    float               freq[NOTCH_NPEAK];          //!< Frequency of each notch (Hz), 0 passes the samples through
+    float               b[NOTCH_NPEAK][3];          //!< Numerator of each notch
+    float               a[NOTCH_NPEAK][3];          //!< Denominator of each notch
+} notchCoef;
+
+struct Drone_Notch {
+    Drone_FilterBank*   bank;                       //!< \private 3 axes, one section per notch (control thread)
+    float               last[3];                    //!< \private Last output
+    uint64_t            nSample;                    //!< \private Samples filtered
+    float               freq[NOTCH_NPEAK];          //!< \private Frequencies of the notches applied
+    uint64_t            nCoef;                      //!< \private Sets of coefficients applied
+    Drone_Histogram*    cost;                       //!< \private Time of Drone_Notch_renew() on the control thread
+    Drone_RingBuffer*   sampleRing;                 //!< \private Control thread to analysis (notchSample)
+    Drone_RingBuffer*   coefRing;                   //!< \private Analysis to control thread (notchCoef)
+    int                 replay;                     //!< \private The analysis runs in the control thread
+    pthread_t           thread;                     //!< \private Analysis
+    atomic_int          stop;                       //!< \private The analysis has to stop
+    float               hist[NOTCH_FFT_SIZE][3];    //!< \private Last samples (circular)
+    uint64_t            histTime[NOTCH_FFT_SIZE];   //!< \private Their time
+    uint64_t            nHist;                      //!< \private Samples received by the analysis
+    uint32_t            nNew;                       //!< \private Samples since the last FFT
+    float               window[NOTCH_FFT_SIZE];     //!< \private Hann window
+    float               twiddle[NOTCH_NBIN][2];     //!< \private exp(-2 pi i k / NOTCH_FFT_SIZE)
+    float               track[NOTCH_NPEAK];         //!< \private Frequency followed by each notch (Hz), 0 : none
+    int                 miss[NOTCH_NPEAK];          //!< \private Analyses since its peak was last seen
+    uint64_t            nFFT;                       //!< \private Analyses
+    uint64_t            fftTime;                    //!< \private Their time (ns)
+};
+
+static uint64_t Drone_Notch_coef(Drone_Notch*);            //!< \private Analysis in replay, then the new coefficients if any, its time (ns)
+static void* Drone_Notch_Thread(void*);                     //!< \private Analysis on NOTCH_CPU
+static void Drone_Notch_drain(Drone_Notch*);                //!< \private New samples to the history, FFT every NOTCH_HOP
+static void Drone_Notch_analyze(Drone_Notch*);              //!< \private Spectrum, peaks and coefficients
+static void Drone_Notch_fft(Drone_Notch*, float (*)[2]);    //!< \private Complex FFT of NOTCH_NBIN points, in place
+static void Drone_Notch_track(Drone_Notch*, float*, int);   //!< \private Peaks to the notches
+
+int Drone_Notch_Init(Drone_Notch** notch)
+{
+    *notch = (Drone_Notch*) calloc(1, sizeof(Drone_Notch));
+    if (Drone_FilterBank_Init(&(*notch)->bank, 3, NOTCH_NPEAK) ||
+        Drone_RingBuffer_Init(&(*notch)->sampleRing, sizeof(notchSample), NOTCH_NSAMPLE) ||
+        Drone_RingBuffer_Init(&(*notch)->coefRing, sizeof(notchCoef), NOTCH_NCOEF) ||
+        Drone_Histogram_Init(&(*notch)->cost, "Notch")) {
+        perror("Notch Init error");
+        return -1;
+    }
+    Drone_FilterBank_SetWarmUp((*notch)->bank, 0);         // The notches pass the samples through until a peak is found
+    for (int i=0; i<NOTCH_FFT_SIZE; ++i) (*notch)->window[i] = 0.5f - 0.5f*cosf(2*(float)M_PI*i/NOTCH_FFT_SIZE);
+    for (int k=0; k<NOTCH_NBIN; ++k) {
+        (*notch)->twiddle[k][0] = cosf(2*(float)M_PI*k/NOTCH_FFT_SIZE);
+        (*notch)->twiddle[k][1] = -sinf(2*(float)M_PI*k/NOTCH_FFT_SIZE);
+    }
+
+    // A replay is meant to be reproducible : each FFT at its sample, in the control thread
+    (*notch)->replay = Drone_Bus_Replay_IsActive();
+    atomic_init(&(*notch)->stop, 0);
+    if (!(*notch)->replay && pthread_create(&(*notch)->thread, NULL, Drone_Notch_Thread, (void*) *notch)) {
+        perror("Notch thread error");
+        return -2;
+    }
+    return 0;
+}
+
+void Drone_Notch_End(Drone_Notch** notch)
+{
+    if (!(*notch)->replay) {
+        atomic_store(&(*notch)->stop, 1);
+        pthread_join((*notch)->thread, NULL);
+    }
+#ifdef  DEBUG
+    printf("Notch : %llu FFT of %d samples, %.1f us each, %llu sets of coefficients applied, %llu samples dropped, notches at",
+           (unsigned long long)(*notch)->nFFT, NOTCH_FFT_SIZE,
+           (*notch)->nFFT ? (double)(*notch)->fftTime/(*notch)->nFFT/1000.0 : 0.0, (unsigned long long)(*notch)->nCoef,
+           (unsigned long long)Drone_RingBuffer_GetOverflow((*notch)->sampleRing));
+    for (int s=0; s<NOTCH_NPEAK; ++s) printf(" %.1f", (*notch)->freq[s]);
+    puts(" Hz");
+    Drone_Histogram_Print((*notch)->cost, stdout);
+#endif
+    Drone_Histogram_End(&(*notch)->cost);
+    Drone_RingBuffer_End(&(*notch)->sampleRing);
+    Drone_RingBuffer_End(&(*notch)->coefRing);
+    Drone_FilterBank_Delete(&(*notch)->bank);
+    free(*notch);
+    *notch = NULL;
+}
+
+void Drone_Notch_renew(Drone_Notch* notch, const float* gyr, uint64_t time, int fresh, float* gyr_notch)
+{
+    if (!fresh && notch->nSample) {
+        memcpy(gyr_notch, notch->last, sizeof(notch->last));
+        return;
+    }
+    // Bounded : one push, at most one set of coefficients, 3 axes through NOTCH_NPEAK sections
+    uint64_t start = get_nsec_mono();
+    notchSample sample = {{gyr[0], gyr[1], gyr[2]}, time};
+    Drone_RingBuffer_Push(notch->sampleRing, &sample);
+    uint64_t analysis = Drone_Notch_coef(notch);
+    Drone_FilterBank_renew(notch->bank, gyr, notch->last);
+    ++notch->nSample;
+    memcpy(gyr_notch, notch->last, sizeof(notch->last));
+    Drone_Histogram_Record(notch->cost, get_nsec_mono() - start - analysis);
+}
+
+void Drone_Notch_renewSamples(Drone_Notch* notch, float (*gyr)[3], float* dt, int n, uint64_t time, float* gyr_notch)
+{
+    if (!n) {
+        memcpy(gyr_notch, notch->last, sizeof(notch->last));
+        return;
+    }
+    // Bounded : n pushes, at most one set of coefficients, n samples through the notches
+    uint64_t start = get_nsec_mono();
+    uint64_t t = time;                                  // The last sample is taken at time, each one dt[] after the previous
+    for (int j=n-1; j>0; --j) t -= (uint64_t)(dt[j]*1e9f);
+    for (int j=0; j<n; ++j) {
+        if (j) t += (uint64_t)(dt[j]*1e9f);
+        notchSample sample = {{gyr[j][0], gyr[j][1], gyr[j][2]}, t};
+        Drone_RingBuffer_Push(notch->sampleRing, &sample);
+    }
+    uint64_t analysis = Drone_Notch_coef(notch);
+    for (int j=0; j<n; ++j) Drone_FilterBank_renew(notch->bank, gyr[j], notch->last);
+    notch->nSample += n;
+    memcpy(gyr_notch, notch->last, sizeof(notch->last));
+    Drone_Histogram_Record(notch->cost, get_nsec_mono() - start - analysis);
+}
+
+static uint64_t Drone_Notch_coef(Drone_Notch* notch)
+{
+    uint64_t analysis = 0;
+    if (notch->replay) {
+        uint64_t stamp = get_nsec_mono();
+        Drone_Notch_drain(notch);
+        analysis = get_nsec_mono() - stamp;
+    }
+    notchCoef coef;
+    if (!Drone_RingBuffer_Pop(notch->coefRing, &coef)) {
+        for (int s=0; s<NOTCH_NPEAK; ++s) {
+            for (int i=0; i<3; ++i) Drone_FilterBank_SetSection(notch->bank, i, s, coef.b[s], coef.a[s]);
+        }
+        memcpy(notch->freq, coef.freq, sizeof(notch->freq));
+        ++notch->nCoef;
+    }
+    return analysis;
+}
+
+static void* Drone_Notch_Thread(void* temp)
+{
+    Drone_Notch* notch = (Drone_Notch*) temp;
+    cpu_set_t cmask;
+    CPU_ZERO(&cmask);
+    CPU_SET(NOTCH_CPU, &cmask);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cmask), &cmask)) {
+        fprintf(stderr, "Notch : no CPU %d, the analysis stays with the other threads\n", NOTCH_CPU);
+    }
+    // Below every other thread : the control loops are SCHED_FIFO, the FFT only takes what they leave
+    struct sched_param sp = {0};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp)) perror("Notch SCHED_IDLE");
+    const struct timespec pause = {0, NOTCH_SLEEP};
+    while (!atomic_load(&notch->stop)) {
+        Drone_Notch_drain(notch);
+        nanosleep(&pause, NULL);
+    }
+    pthread_exit(NULL);
+}
+
+static void Drone_Notch_drain(Drone_Notch* notch)
+{
+    notchSample sample;
+    while (!Drone_RingBuffer_Pop(notch->sampleRing, &sample)) {
+        int i = notch->nHist % NOTCH_FFT_SIZE;
+        memcpy(notch->hist[i], sample.gyr, sizeof(sample.gyr));
+        notch->histTime[i] = sample.time;
+        ++notch->nHist;
+        if (++notch->nNew >= NOTCH_HOP && notch->nHist >= NOTCH_FFT_SIZE) {
+            notch->nNew = 0;
+            Drone_Notch_analyze(notch);
+        }
+    }
+}
+
+static void Drone_Notch_analyze(Drone_Notch* notch)
+{
+    uint64_t start = get_nsec_mono();
+    int first = notch->nHist % NOTCH_FFT_SIZE;                          // Oldest sample
+    uint64_t span = notch->histTime[(first + NOTCH_FFT_SIZE - 1) % NOTCH_FFT_SIZE] - notch->histTime[first];
+    if (!span) return;
+    float fs = (NOTCH_FFT_SIZE - 1) * 1e9f / span;
+
+    // Real FFT of each axis : the even samples as the real part, the odd ones as the imaginary part
+    float power[NOTCH_NBIN] = {0};
+    float z[NOTCH_NBIN][2];
+    for (int axis=0; axis<3; ++axis) {
+        float mean = 0;
+        for (int i=0; i<NOTCH_FFT_SIZE; ++i) mean += notch->hist[i][axis];
+        mean /= NOTCH_FFT_SIZE;
+        for (int i=0; i<NOTCH_FFT_SIZE; ++i) {
+            z[i/2][i%2] = (notch->hist[(first + i) % NOTCH_FFT_SIZE][axis] - mean) * notch->window[i];
+        }
+        Drone_Notch_fft(notch, z);
+        for (int k=1; k<NOTCH_NBIN; ++k) {
+            const float* c = z[NOTCH_NBIN - k];
+            float er = 0.5f*(z[k][0] + c[0]), ei = 0.5f*(z[k][1] - c[1]);   // Even samples
+            float orr = 0.5f*(z[k][1] + c[1]), oi = -0.5f*(z[k][0] - c[0]); // Odd samples
+            float xr = er + notch->twiddle[k][0]*orr - notch->twiddle[k][1]*oi;
+            float xi = ei + notch->twiddle[k][0]*oi + notch->twiddle[k][1]*orr;
+            power[k] += xr*xr + xi*xi;
+        }
+    }
+
+    // Noise floor : median of the bins from NOTCH_MIN_FREQ
+    int kmin = (int)ceilf(NOTCH_MIN_FREQ * NOTCH_FFT_SIZE / fs);
+    if (kmin < 2) kmin = 2;
+    float sorted[NOTCH_NBIN];
+    int n = 0;
+    for (int k=kmin; k<NOTCH_NBIN; ++k) {
+        int j = n++;
+        for (; j>0 && sorted[j-1] > power[k]; --j) sorted[j] = sorted[j-1];
+        sorted[j] = power[k];
+    }
+    float noise = n ? sorted[n/2] : 0;
+
+    // The NOTCH_NPEAK highest local max.
+    int peak[NOTCH_NPEAK], nPeak = 0;
+    for (int k=kmin; k<NOTCH_NBIN-1; ++k) {
+        if (power[k] <= power[k-1] || power[k] < power[k+1] || power[k] <= NOTCH_SNR*noise) continue;
+        int j = nPeak < NOTCH_NPEAK ? nPeak++ : NOTCH_NPEAK;
+        for (; j>0 && power[peak[j-1]] < power[k]; --j) {
+            if (j < NOTCH_NPEAK) peak[j] = peak[j-1];
+        }
+        if (j < NOTCH_NPEAK) peak[j] = k;
+    }
+    float freq[NOTCH_NPEAK];
+    for (int p=0; p<nPeak; ++p) {
+        int k = peak[p];
+        float den = power[k-1] - 2*power[k] + power[k+1];
+        float d = den < 0 ? 0.5f*(power[k-1] - power[k+1])/den : 0;
+        freq[p] = (k + d) * fs / NOTCH_FFT_SIZE;
+    }
+    Drone_Notch_track(notch, freq, nPeak);
+
+    // Notch of the cookbook of R. Bristow-Johnson
+    notchCoef coef;
+    for (int s=0; s<NOTCH_NPEAK; ++s) {
+        float f = notch->track[s];
+        coef.freq[s] = f > 0 && f < 0.5f*fs ? f : 0;
+        if (coef.freq[s] > 0) {
+            float w0 = 2*(float)M_PI*f/fs;
+            float alpha = sinf(w0)/(2*NOTCH_Q);
+            coef.b[s][0] = 1;
+            coef.b[s][1] = -2*cosf(w0);
+            coef.b[s][2] = 1;
+            coef.a[s][0] = 1 + alpha;
+            coef.a[s][1] = -2*cosf(w0);
+            coef.a[s][2] = 1 - alpha;
+        } else {
+            coef.b[s][0] = coef.a[s][0] = 1;
+            coef.b[s][1] = coef.b[s][2] = coef.a[s][1] = coef.a[s][2] = 0;
+        }
+    }
+    Drone_RingBuffer_Push(notch->coefRing, &coef);
+    ++notch->nFFT;
+    notch->fftTime += get_nsec_mono() - start;
+}
+
+static void Drone_Notch_track(Drone_Notch* notch, float* freq, int nPeak)
+{
+    // From the highest peak : the nearest notch within 25 %, else a free one, else the one lost for longest
+    int used[NOTCH_NPEAK] = {0};
+    for (int p=0; p<nPeak; ++p) {
+        int best = -1;
+        for (int s=0; s<NOTCH_NPEAK; ++s) {
+            if (used[s] || !notch->track[s] || fabsf(notch->track[s] - freq[p]) > 0.25f*freq[p]) continue;
+            if (best < 0 || fabsf(notch->track[s] - freq[p]) < fabsf(notch->track[best] - freq[p])) best = s;
+        }
+        if (best >= 0) {
+            notch->track[best] += NOTCH_SMOOTH * (freq[p] - notch->track[best]);
+        } else {
+            for (int s=0; s<NOTCH_NPEAK; ++s) {
+                if (used[s]) continue;
+                if (best < 0 || !notch->track[s] || (notch->track[best] && notch->miss[s] > notch->miss[best])) best = s;
+            }
+            notch->track[best] = freq[p];
+        }
+        notch->miss[best] = 0;
+        used[best] = 1;
+    }
+    for (int s=0; s<NOTCH_NPEAK; ++s) {
+        if (!used[s] && notch->track[s] && ++notch->miss[s] > NOTCH_HOLD) notch->track[s] = 0;
+    }
+}
+
+static void Drone_Notch_fft(Drone_Notch* notch, float (*z)[2])
+{
+    // Bit reversal, then the butterflies : exp(-2 pi i k / len) is twiddle[k * NOTCH_FFT_SIZE / len]
+    for (int i=1, j=0; i<NOTCH_NBIN; ++i) {
+        int bit = NOTCH_NBIN >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            float t[2] = {z[i][0], z[i][1]};
+            z[i][0] = z[j][0];
+            z[i][1] = z[j][1];
+            z[j][0] = t[0];
+            z[j][1] = t[1];
+        }
+    }
+    for (int len=2; len<=NOTCH_NBIN; len<<=1) {
+        int step = NOTCH_FFT_SIZE / len;
+        for (int i=0; i<NOTCH_NBIN; i+=len) {
+            for (int k=0; k<len/2; ++k) {
+                const float* w = notch->twiddle[k*step];
+                float* a = z[i+k];
+                float* b = z[i+k+len/2];
+                float tr = b[0]*w[0] - b[1]*w[1], ti = b[0]*w[1] + b[1]*w[0];
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
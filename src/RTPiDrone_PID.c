@@ -51,7 +51,7 @@ void Drone_PID_update(Drone_PID* pid, float* angle_expect, float* angle_measured
         pid->outP[i] = pid->Kp_out * pid->angle_err[i];
         pid->outI[i] = pid->Ki_out * pid->angle_integ[i];
         pid->outD[i] = pid->Kd_out * pid->angle_deriv[i];
-        pid->output[i] = (int) round(pid->outP[i] + pid->outI[i] + pid->outD[i]);
+        pid->output[i] = (int) lroundf(pid->outP[i] + pid->outI[i] + pid->outD[i]);
     }
     /*
     pwm[0] += ( pid->output[1] - pid->output[0] + pid->output[2] );    //M0
@@ -1,36 +1,40 @@
 #include "RTPiDrone_Quaternion.h"
 #include "Common.h"
+#include "FastMath.h"
+#include "Vec4.h"
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define DEG_TO_RAD      (M_PI/180)
-#define RAD_TO_DEG      (180/M_PI)
-
+//! Mahony filter on 4-lane vectors (Vec4.h) : the 3D vectors keep 0 in their last lane
 struct Drone_Quaternion {
-    float q[4], qp[4];
-    float half_dt;
-    float norm;
-    float anorm[3], mnorm[3];
-    float v[3], h[3], b[3], w[3];
-    float e[3];
-    float eInt[3];
-    float Kp, Ki;
-    float angVel[3];
+    vec4 q;                     //!< \private Quaternion (q0, q1, q2, q3)
+    vec4 m, b;                  //!< \private Normalized magnetic field, and its direction on the earth frame (bx, 0, bz)
+    vec4 e;                     //!< \private Error of the gravity and of the magnetic field
+    vec4 eInt;                  //!< \private Integral of the error
+    float Kp, Ki;               //!< \private Gains of the correction
 };
 
+static void Drone_Quaternion_error(Drone_Quaternion*, float*, float*);   //!< \private Error from the gravity and the magnetic field
+static void Drone_Quaternion_integrate(Drone_Quaternion*, float, float*);   //!< \private One step of the corrected angular velocity
+static void Drone_Quaternion_split(Drone_Quaternion*, vec4*, float*, float*);   //!< \private Vector part (q1, q2, q3), q0 and q0*q0 - |(q1, q2, q3)|^2
+static vec4 Drone_Quaternion_rotate(vec4, float, float, vec4, float);   //!< \private Rotation of a vector, to the earth frame (+1) or to the body frame (-1)
+
 int Drone_Quaternion_Init(Drone_Quaternion** Q, float* angle, float* pi)
 {
-    *Q = calloc(1, sizeof(Drone_Quaternion));
+    // The vectors need 16 bytes, calloc() only gives 8 on the 32-bit ARM
+    *Q = aligned_alloc(16, sizeof(Drone_Quaternion));
+    memset(*Q, 0, sizeof(Drone_Quaternion));
     float dCos[3], dSin[3];
     for (int i=0; i<3; ++i) {
-        dCos[i] = cos(angle[i]*DEG_TO_RAD * 0.5);
-        dSin[i] = sin(angle[i]*DEG_TO_RAD * 0.5);
+        dCos[i] = cosf(angle[i]*FAST_DEG_TO_RAD * 0.5f);
+        dSin[i] = sinf(angle[i]*FAST_DEG_TO_RAD * 0.5f);
     }
 
-    (*Q)->q[0] = dCos[0] * dCos[1] * dCos[2] + dSin[0] * dSin[1] * dSin[2];
-    (*Q)->q[1] = dSin[0] * dCos[1] * dCos[2] - dCos[0] * dSin[1] * dSin[2];
-    (*Q)->q[2] = dCos[0] * dSin[1] * dCos[2] + dSin[0] * dCos[1] * dSin[2];
-    (*Q)->q[3] = dCos[0] * dCos[1] * dSin[2] - dSin[0] * dSin[1] * dCos[2];
+    (*Q)->q = vec4_set(dCos[0] * dCos[1] * dCos[2] + dSin[0] * dSin[1] * dSin[2],
+                       dSin[0] * dCos[1] * dCos[2] - dCos[0] * dSin[1] * dSin[2],
+                       dCos[0] * dSin[1] * dCos[2] + dSin[0] * dCos[1] * dSin[2],
+                       dCos[0] * dCos[1] * dSin[2] - dSin[0] * dSin[1] * dCos[2]);
 
     (*Q)->Kp = pi[0];
     (*Q)->Ki = pi[1];
@@ -52,64 +56,84 @@ void Drone_Quaternion_SetPI(Drone_Quaternion* Q, float Kp, float Ki)
 
 void Drone_Quaternion_getAngle(Drone_Quaternion* Q, float* angle)
 {
-    angle[0] = atan2(2*Q->q[2]*Q->q[3] + 2*Q->q[0]*Q->q[1], -2*Q->q[1]*Q->q[1] - 2*Q->q[2]*Q->q[2] + 1) * RAD_TO_DEG; // roll
-    angle[1] = asin(-2*Q->q[1]*Q->q[3] + 2*Q->q[0]*Q->q[2]) * RAD_TO_DEG; // pitch
-    angle[2] = atan2(2*Q->q[1]*Q->q[2] + 2*Q->q[0]*Q->q[3], -2*Q->q[2]*Q->q[2] - 2*Q->q[3]*Q->q[3] + 1) * RAD_TO_DEG; // yaw
+    float q[4];
+    vec4_store(q, Q->q, 4);
+    angle[0] = fastAtan2(2*q[2]*q[3] + 2*q[0]*q[1], -2*q[1]*q[1] - 2*q[2]*q[2] + 1) * FAST_RAD_TO_DEG; // roll
+    angle[1] = fastAsin(-2*q[1]*q[3] + 2*q[0]*q[2]) * FAST_RAD_TO_DEG; // pitch
+    angle[2] = fastAtan2(2*q[1]*q[2] + 2*q[0]*q[3], -2*q[2]*q[2] - 2*q[3]*q[3] + 1) * FAST_RAD_TO_DEG; // yaw
 }
 
 void Drone_Quaternion_calculate_MagField_Earth(Drone_Quaternion* Q, float* magn)
 {
-    Q->norm = getSqrt(magn, 3);
-    for (int i=0; i<3; ++i) Q->mnorm[i] = magn[i] / Q->norm;
-
-    Q->h[0] = 2 * (Q->mnorm[0]*(0.5 - Q->q[2]*Q->q[2] - Q->q[3]*Q->q[3]) + Q->mnorm[1]*(Q->q[1]*Q->q[2] - Q->q[0]*Q->q[3])
-                   + Q->mnorm[2]*(Q->q[1]*Q->q[3] + Q->q[0]*Q->q[2]) );
-    Q->h[1] = 2 * (Q->mnorm[0]*(Q->q[1]*Q->q[2] + Q->q[0]*Q->q[3]) + Q->mnorm[1]*(0.5 - Q->q[1]*Q->q[1] - Q->q[3]*Q->q[3])
-                   + Q->mnorm[2]*(Q->q[2]*Q->q[3] - Q->q[0]*Q->q[1]) );
-    Q->h[2] = 2 * (Q->mnorm[0]*(Q->q[1]*Q->q[3] - Q->q[0]*Q->q[2]) + Q->mnorm[1]*(Q->q[2]*Q->q[3] + Q->q[0]*Q->q[1])
-                   + Q->mnorm[2]*(0.5 - Q->q[1]*Q->q[1] - Q->q[2]*Q->q[2]) );
-
-    Q->b[0] = getSqrt(Q->h, 2);
-    Q->b[2] = Q->h[2];
+    vec4 qv;
+    float q0, s;
+    Drone_Quaternion_split(Q, &qv, &q0, &s);
+    Q->m = vec4_normalize(vec4_load3(magn));
+
+    float h[3];
+    vec4_store(h, Drone_Quaternion_rotate(qv, q0, s, Q->m, 1.0f), 3);
+    Q->b = vec4_set(getSqrt(h, 2), 0.0f, h[2], 0.0f);
 }
 
 void Drone_Quaternion_renew(Drone_Quaternion* Q, float deltaT, float* accl, float* gyro, float* magn)
 {
-    Q->half_dt = deltaT/2;
+    Drone_Quaternion_error(Q, accl, magn);
+    Drone_Quaternion_integrate(Q, deltaT, gyro);
+}
 
-    Q->norm = getSqrt(accl, 3);
-    for (int i=0; i<3; ++i) Q->anorm[i] = accl[i] / Q->norm;
-    Q->v[0] = 2*(Q->q[1]*Q->q[3] - Q->q[0]*Q->q[2]);
-    Q->v[1] = 2*(Q->q[0]*Q->q[1] + Q->q[2]*Q->q[3]);
-    Q->v[2] = 1 - 2*(Q->q[1]*Q->q[1] - Q->q[2]*Q->q[2]);
-    Q->e[0] = (Q->anorm[1] * Q->v[2] - Q->anorm[2] * Q->v[1]);
-    Q->e[1] = (Q->anorm[2] * Q->v[0] - Q->anorm[0] * Q->v[2]);
-    Q->e[2] = (Q->anorm[0] * Q->v[1] - Q->anorm[1] * Q->v[0]);
+void Drone_Quaternion_renewSamples(Drone_Quaternion* Q, float* accl, float (*gyro)[3], float* deltaT, int n, float* magn)
+{
+    // One correction per cycle, each gyro sample over its own interval
+    Drone_Quaternion_error(Q, accl, magn);
+    for (int k=0; k<n; ++k) Drone_Quaternion_integrate(Q, deltaT[k], gyro[k]);
+}
 
-    Drone_Quaternion_calculate_MagField_Earth(Q, magn);
+static void Drone_Quaternion_split(Drone_Quaternion* Q, vec4* qv, float* q0, float* s)
+{
+    float q[4];
+    vec4_store(q, Q->q, 4);
+    *qv = vec4_set(q[1], q[2], q[3], 0.0f);
+    *q0 = q[0];
+    *s = q[0]*q[0] - vec4_dot(*qv, *qv);
+}
 
-    Q->w[0] = 2*( Q->b[0]*(0.5 - Q->q[2]*Q->q[2] - Q->q[3]*Q->q[3]) + Q->b[2]*(Q->q[1]*Q->q[3] - Q->q[0]*Q->q[2]) );
-    Q->w[1] = 2*( Q->b[0]*(Q->q[1]*Q->q[2] - Q->q[0]*Q->q[3]) + Q->b[2]*(Q->q[0]*Q->q[1] + Q->q[2]*Q->q[3]) );
-    Q->w[2] = 2*( Q->b[0]*(Q->q[0]*Q->q[2] + Q->q[1]*Q->q[3]) + Q->b[2]*(0.5 - Q->q[1]*Q->q[1] - Q->q[2]*Q->q[2]) );
+static vec4 Drone_Quaternion_rotate(vec4 qv, float q0, float s, vec4 x, float dir)
+{
+    // R x = (q0^2 - |qv|^2) x + 2 (qv.x) qv + 2 q0 qv^x, the transpose has -2 q0
+    vec4 r = vec4_mul(x, vec4_splat(s));
+    r = vec4_madd(r, qv, 2*vec4_dot(qv, x));
+    return vec4_madd(r, vec4_cross(qv, x), dir*2*q0);
+}
 
-    Q->e[0] += (Q->mnorm[1]*Q->w[2] - Q->mnorm[2]*Q->w[1]);
-    Q->e[1] += (Q->mnorm[2]*Q->w[0] - Q->mnorm[0]*Q->w[2]);
-    Q->e[2] += (Q->mnorm[0]*Q->w[1] - Q->mnorm[1]*Q->w[0]);
+static void Drone_Quaternion_error(Drone_Quaternion* Q, float* accl, float* magn)
+{
+    vec4 qv;
+    float q0, s;
+    Drone_Quaternion_split(Q, &qv, &q0, &s);
 
-    for (int i=0; i<3; ++i) {
-        Q->eInt[i] += Q->e[i] * Q->Ki;
-        Q->angVel[i] = gyro[i] + Q->Kp * Q->e[i] + Q->eInt[i];
-    }
+    // Gravity : the measured direction against the vertical of the earth frame seen from the body
+    vec4 a = vec4_normalize(vec4_load3(accl));
+    vec4 v = Drone_Quaternion_rotate(qv, q0, s, vec4_set(0.0f, 0.0f, 1.0f, 0.0f), -1.0f);
+    Q->e = vec4_cross(a, v);
 
-    Q->qp[0] = Q->q[0] - Q->half_dt*(Q->q[1]*Q->angVel[0] + Q->q[2]*Q->angVel[1] + Q->q[3]*Q->angVel[2]);
-    Q->qp[1] = Q->q[1] + Q->half_dt*(Q->q[0]*Q->angVel[0] + Q->q[2]*Q->angVel[2] - Q->q[3]*Q->angVel[1]);
-    Q->qp[2] = Q->q[2] + Q->half_dt*(Q->q[0]*Q->angVel[1] - Q->q[1]*Q->angVel[2] + Q->q[3]*Q->angVel[0]);
-    Q->qp[3] = Q->q[3] + Q->half_dt*(Q->q[0]*Q->angVel[2] + Q->q[1]*Q->angVel[1] - Q->q[2]*Q->angVel[0]);
+    // Magnetic field : the same with its direction on the earth frame
+    Drone_Quaternion_calculate_MagField_Earth(Q, magn);
+    vec4 w = Drone_Quaternion_rotate(qv, q0, s, Q->b, -1.0f);
+    Q->e = vec4_add(Q->e, vec4_cross(Q->m, w));
 
-    for (int i=0; i<4; ++i) Q->q[i] = Q->qp[i];
+    Q->eInt = vec4_madd(Q->eInt, Q->e, Q->Ki);
+}
 
-    Q->norm = getSqrt(Q->q, 4);
+static void Drone_Quaternion_integrate(Drone_Quaternion* Q, float deltaT, float* gyro)
+{
+    float w[3];
+    vec4_store(w, vec4_add(vec4_madd(vec4_load3(gyro), Q->e, Q->Kp), Q->eInt), 3);
 
-    for (int i=0; i<4; ++i) Q->q[i] /= Q->norm;
+    // dq/dt = q (0, w) / 2 : one shuffle of q per component of w
+    vec4 p = vec4_swapPairs(Q->q);
+    vec4 qDot = vec4_mul(vec4_mul(p, vec4_set(-1.0f, 1.0f, 1.0f, -1.0f)), vec4_splat(w[0]));
+    qDot = vec4_madd(qDot, vec4_mul(vec4_swapHalves(Q->q), vec4_set(-1.0f, -1.0f, 1.0f, 1.0f)), w[1]);
+    qDot = vec4_madd(qDot, vec4_mul(vec4_swapHalves(p), vec4_set(-1.0f, 1.0f, -1.0f, 1.0f)), w[2]);
 
+    Q->q = vec4_normalize(vec4_madd(Q->q, qDot, deltaT*0.5f));
 }
@@ -0,0 +1,96 @@
+/*! \file RTPiDrone_RingBuffer.c
+    \brief Lock-free single-producer/single-consumer ring buffer
+ */
+#include "RTPiDrone_RingBuffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+/*!
+ * \struct Drone_RingBuffer
+ * \brief Drone_RingBuffer structure.
+ * head is only written by the producer and tail only by the consumer, each one lives on its own cache line.
+ */
+struct Drone_RingBuffer {
+    alignas(DRONE_CACHELINE) atomic_uint_fast32_t head;     //!< \private Next slot to write (producer)
+    uint32_t        tailCache;                              //!< \private Producer copy of tail
+    uint64_t        overflow;                               //!< \private Number of dropped elements
+    alignas(DRONE_CACHELINE) atomic_uint_fast32_t tail;     //!< \private Next slot to read (consumer)
+    uint32_t        headCache;                              //!< \private Consumer copy of head
+    alignas(DRONE_CACHELINE) char* buf;                     //!< \private Storage
+    size_t          elemSize;                               //!< \private Size of one element
+    uint32_t        mask;                                   //!< \private capacity - 1 (capacity is a power of 2)
+};
+
+int Drone_RingBuffer_Init(Drone_RingBuffer** ring, size_t elemSize, uint32_t capacity)
+{
+    uint32_t n = 2;
+    while (n < capacity) n <<= 1;
+
+    *ring = (Drone_RingBuffer*) aligned_alloc(DRONE_CACHELINE, sizeof(Drone_RingBuffer));
+    if (!*ring) {
+        perror("Ring buffer allocation");
+        return -1;
+    }
+    memset(*ring, 0, sizeof(Drone_RingBuffer));
+    size_t size = (elemSize * n + DRONE_CACHELINE - 1) / DRONE_CACHELINE * DRONE_CACHELINE;
+    (*ring)->buf = (char*) aligned_alloc(DRONE_CACHELINE, size);
+    if (!(*ring)->buf) {
+        perror("Ring buffer storage allocation");
+        free(*ring);
+        *ring = NULL;
+        return -2;
+    }
+    memset((*ring)->buf, 0, size);              // Touch every page now, not in the control loop
+    (*ring)->elemSize = elemSize;
+    (*ring)->mask = n - 1;
+    atomic_init(&(*ring)->head, 0);
+    atomic_init(&(*ring)->tail, 0);
+    return 0;
+}
+
+void Drone_RingBuffer_End(Drone_RingBuffer** ring)
+{
+    free((*ring)->buf);
+    free(*ring);
+    *ring = NULL;
+}
+
+int Drone_RingBuffer_Push(Drone_RingBuffer* ring, const void* elem)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->tailCache > ring->mask) {
+        ring->tailCache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->tailCache > ring->mask) {
+            ++ring->overflow;
+            return -1;
+        }
+    }
+    memcpy(ring->buf + (head & ring->mask) * ring->elemSize, elem, ring->elemSize);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 0;
+}
+
+int Drone_RingBuffer_Pop(Drone_RingBuffer* ring, void* elem)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == ring->headCache) {
+        ring->headCache = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == ring->headCache) return -1;
+    }
+    memcpy(elem, ring->buf + (tail & ring->mask) * ring->elemSize, ring->elemSize);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+uint64_t Drone_RingBuffer_GetOverflow(Drone_RingBuffer* ring)
+{
+    return ring->overflow;
+}
+
+uint32_t Drone_RingBuffer_GetCapacity(Drone_RingBuffer* ring)
+{
+    return ring->mask + 1;
+}
@@ -7,6 +7,7 @@
 #include "RTPiDrone_Device.h"
 #include "RTPiDrone_SPI_Device_MCP3008.h"
 #include "RTPiDrone_SPI_Device_RF24.h"
+#include "RTPiDrone_Bus.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +20,8 @@
 #define FILENAMESIZE            64                      //!< Length of file name
 #define N_SAMPLE_CALIBRATION    2000                    //!< Max number of sample taken during the calibration
 #define NUM_CALI_THREADS        2                       //!< Number of threads created in the calibration
+#define COST_RF24               50                      //!< Estimated SPI time of one RF24 poll (us)
+#define COST_MCP3008            10                      //!< Estimated SPI time of one MCP3008 conversion (us)
 
 /*!
  * \brief \private tempCali type
@@ -71,7 +74,15 @@ void Drone_SPI_Start(Drone_SPI* spi, Drone_DataExchange* data)
         lastUpdate = get_nsec();
         RF24_getDecodeValue(spi->RF24, &lastUpdate, &data->comm);
         _usleep(10000);
-    } while (!data->comm.switchValue);
+    } while (!data->comm.switchValue && !Drone_Bus_Replay_IsOver());
+}
+
+int Drone_SPI_Schedule(Drone_SPI* spi, Drone_Scheduler* sched)
+{
+    int ret = 0;
+    ret += Drone_Scheduler_Add(sched, (Drone_Device*)spi->RF24, SCHEDULER_SPI, COST_RF24);
+    ret += Drone_Scheduler_Add(sched, (Drone_Device*)spi->MCP3008, SCHEDULER_SPI, COST_MCP3008);
+    return ret;
 }
 
 int Drone_SPI_End(Drone_SPI** spi)
@@ -93,15 +104,16 @@ int Drone_SPI_End(Drone_SPI** spi)
     return 0;
 }
 
-int Drone_SPI_Calibration(Drone_SPI* spi)
+int Drone_SPI_Calibration(Drone_SPI* spi, int quick)
 {
+    int nSample = quick ? N_SAMPLE_CALIBRATION/CALI_CACHE_DIVIDE : N_SAMPLE_CALIBRATION;
     pthread_t thread_spi[NUM_CALI_THREADS];
-    tempCali adcTemp = {spi, Calibration_Single_MCP3008, N_SAMPLE_CALIBRATION,
+    tempCali adcTemp = {spi, Calibration_Single_MCP3008, nSample,
                         Drone_Device_GetName((Drone_Device*)(spi->MCP3008))
                        };
     pthread_create(&thread_spi[0], NULL, Calibration_Single_Thread, (void*) &adcTemp);
 
-    tempCali rfTemp = {spi, Calibration_Single_RF24, N_SAMPLE_CALIBRATION,
+    tempCali rfTemp = {spi, Calibration_Single_RF24, nSample,
                        Drone_Device_GetName((Drone_Device*)(spi->RF24))
                       };
     pthread_create(&thread_spi[1], NULL, Calibration_Single_Thread, (void*) &rfTemp);
@@ -1,7 +1,7 @@
 #include "RTPiDrone_header.h"
 #include "RTPiDrone_SPI_Device_MCP3008.h"
 #include "RTPiDrone_Device.h"
-#include <bcm2835.h>
+#include "RTPiDrone_Bus.h"
 #include <stdio.h>
 #include <stdlib.h>
 #define FULLVALUE   1024
@@ -40,8 +40,8 @@ void MCP3008_delete(Drone_SPI_Device_MCP3008** MCP3008)
 
 static int MCP3008_init(void* spi_dev)
 {
-    bcm2835_spi_chipSelect(BCM2835_SPI_CS1);                    //Slave Select on CS1
-    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS1, LOW);
+    Drone_Bus_SPI_ChipSelect(DRONE_BUS_SPI_CS1);                //Slave Select on CS1
+    Drone_Bus_SPI_SetChipSelectPolarity(DRONE_BUS_SPI_CS1, DRONE_BUS_LOW);
 #ifdef  DEBUG
     puts("MCP3008 init!");
 #endif
@@ -50,9 +50,9 @@ static int MCP3008_init(void* spi_dev)
 
 static int MCP3008_getRawValue(void* spi_dev)
 {
-    bcm2835_spi_chipSelect(BCM2835_SPI_CS1); //Slave Select on CS1
-    bcm2835_spi_transfernb(send_buf, ((Drone_SPI_Device_MCP3008*)spi_dev)->receive_buf, 3);
-    bcm2835_spi_chipSelect(BCM2835_SPI_CS0); //Slave Select on CS0
+    Drone_Bus_SPI_ChipSelect(DRONE_BUS_SPI_CS1); //Slave Select on CS1
+    Drone_Bus_SPI_TransferNB(send_buf, ((Drone_SPI_Device_MCP3008*)spi_dev)->receive_buf, 3);
+    Drone_Bus_SPI_ChipSelect(DRONE_BUS_SPI_CS0); //Slave Select on CS0
     return 0;
 }
 
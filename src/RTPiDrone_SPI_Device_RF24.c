@@ -2,7 +2,6 @@
 #include "RTPiDrone_SPI_Device_RF24.h"
 #include "RTPiDrone_Device.h"
 #include "RF24_Interface.h"
-#include <bcm2835.h>
 #include <stdio.h>
 #include <stdlib.h>
 #define FULLVALUE   1024
@@ -54,8 +53,7 @@ static int RF24_convertRawToReal(void* spi_dev)
 
 int RF24_getDecodeValue(Drone_SPI_Device_RF24* RF24, uint64_t* lastUpdate, Drone_Command* comm)
 {
-    if (*lastUpdate-RF24->dev.lastUpdate > RF24->dev.period) {
-        RF24->dev.lastUpdate = *lastUpdate;
+    if (Drone_Device_IsDue(&RF24->dev, lastUpdate)) {
         if ( !RF24_getRawValue(RF24) ) comm->zeroCount++;
         else {
             comm->zeroCount = 0;
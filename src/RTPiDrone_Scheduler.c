@@ -0,0 +1,169 @@
+/*! \file RTPiDrone_Scheduler.c
+    \brief Multi-rate scheduler of the devices
+ */
+#include "RTPiDrone_header.h"
+#include "RTPiDrone_Scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SCHEDULER_MAXDEVICE     16              //!< Max number of scheduled devices
+#define SCHEDULER_HORIZON       64              //!< Number of cycles considered when the slots are assigned
+
+/*!
+ * \struct Drone_Scheduler_Entry
+ * \brief One scheduled device
+ */
+typedef struct {
+    Drone_Device*       dev;                    //!< \private Device
+    Drone_Scheduler_Bus bus;                    //!< \private Bus used by the device
+    uint32_t            cost;                   //!< \private Estimated bus time of one refresh (us)
+    uint32_t            phase;                  //!< \private Slot of the device
+    uint64_t            next;                   //!< \private Cycle in which the device is due
+    int                 served;                 //!< \private Device has been marked in the previous cycle
+    uint64_t            deferred;               //!< \private Number of times the device has been deferred
+    uint64_t            forced;                 //!< \private Number of times the device has run over the budget
+} Drone_Scheduler_Entry;
+
+/*!
+ * \struct Drone_Scheduler
+ * \brief Drone_Scheduler structure
+ */
+struct Drone_Scheduler {
+    uint64_t                cyclePeriod;                    //!< \private Period of the control loop (ns)
+    uint64_t                cycle;                          //!< \private Current cycle
+    uint32_t                budget[SCHEDULER_NBUS];         //!< \private Bus time available per cycle (us)
+    uint32_t                peak[SCHEDULER_NBUS];           //!< \private Peak bus time per cycle of the plan (us)
+    int                     nEntry;                         //!< \private Number of scheduled devices
+    Drone_Scheduler_Entry   entry[SCHEDULER_MAXDEVICE];     //!< \private Devices, sorted by period
+};
+
+static uint64_t Drone_Scheduler_Cycles(Drone_Scheduler*, uint64_t);    //!< \private \memberof Drone_Scheduler: period in cycles
+
+int Drone_Scheduler_Init(Drone_Scheduler** sched, uint64_t cyclePeriod)
+{
+    *sched = (Drone_Scheduler*) calloc(1, sizeof(Drone_Scheduler));
+    if (!*sched) return -1;
+    (*sched)->cyclePeriod = cyclePeriod;
+    (*sched)->budget[SCHEDULER_I2C] = SCHEDULER_I2C_BUDGET;
+    (*sched)->budget[SCHEDULER_SPI] = SCHEDULER_SPI_BUDGET;
+    return 0;
+}
+
+void Drone_Scheduler_End(Drone_Scheduler** sched)
+{
+#ifdef  DEBUG
+    for (int i=0; i<(*sched)->nEntry; ++i) {
+        Drone_Scheduler_Entry* e = &(*sched)->entry[i];
+        printf("Scheduler : %s deferred %llu times, run over the budget %llu times\n", Drone_Device_GetName(e->dev),
+               (unsigned long long)e->deferred, (unsigned long long)e->forced);
+    }
+#endif
+    free(*sched);
+    *sched = NULL;
+}
+
+int Drone_Scheduler_Add(Drone_Scheduler* sched, Drone_Device* dev, Drone_Scheduler_Bus bus, uint32_t cost)
+{
+    if (sched->nEntry >= SCHEDULER_MAXDEVICE) {
+        fprintf(stderr, "Scheduler : too many devices (%s)\n", Drone_Device_GetName(dev));
+        return -1;
+    }
+    // Insertion sort : shortest period first, then most expensive first
+    int i = sched->nEntry++;
+    while (i > 0 && (sched->entry[i-1].dev->period > dev->period ||
+                     (sched->entry[i-1].dev->period == dev->period && sched->entry[i-1].cost < cost))) {
+        sched->entry[i] = sched->entry[i-1];
+        --i;
+    }
+    Drone_Scheduler_Entry e = {dev, bus, cost, 0, 0, 0, 0, 0};
+    sched->entry[i] = e;
+    return 0;
+}
+
+int Drone_Scheduler_Plan(Drone_Scheduler* sched)
+{
+    int ret = 0;
+    uint32_t load[SCHEDULER_NBUS][SCHEDULER_HORIZON] = {{0}};
+    for (int i=0; i<sched->nEntry; ++i) {
+        Drone_Scheduler_Entry* e = &sched->entry[i];
+        uint64_t period = Drone_Scheduler_Cycles(sched, e->dev->period);
+        uint32_t nPhase = period < SCHEDULER_HORIZON ? period : SCHEDULER_HORIZON;
+        uint32_t bestPeak = UINT32_MAX, bestSum = UINT32_MAX;
+        // Keep the slot which minimizes the peak load (then the total load) of the cycles it touches
+        for (uint32_t phase=0; phase<nPhase; ++phase) {
+            uint32_t peak = 0, sum = 0;
+            for (uint64_t c=phase; c<SCHEDULER_HORIZON; c+=period) {
+                if (load[e->bus][c] > peak) peak = load[e->bus][c];
+                sum += load[e->bus][c];
+            }
+            if (peak < bestPeak || (peak == bestPeak && sum < bestSum)) {
+                bestPeak = peak;
+                bestSum = sum;
+                e->phase = phase;
+            }
+        }
+        for (uint64_t c=e->phase; c<SCHEDULER_HORIZON; c+=period) load[e->bus][c] += e->cost;
+        e->next = sched->cycle + 1 + e->phase;
+        e->served = 0;
+        e->dev->due = 0;
+        e->dev->scheduled = 1;
+#ifdef  DEBUG
+        printf("Scheduler : %-10s bus %d, every %3llu cycles, slot %2u, %4u us\n", Drone_Device_GetName(e->dev),
+               e->bus, (unsigned long long)period, e->phase, e->cost);
+#endif
+    }
+    for (int b=0; b<SCHEDULER_NBUS; ++b) {
+        uint32_t peak = 0;
+        for (int c=0; c<SCHEDULER_HORIZON; ++c) if (load[b][c] > peak) peak = load[b][c];
+#ifdef  DEBUG
+        printf("Scheduler : bus %d peak load %u us (budget %u us)\n", b, peak, sched->budget[b]);
+#endif
+        sched->peak[b] = peak;
+        if (peak > sched->budget[b]) ret = -1;
+    }
+    return ret;
+}
+
+uint32_t Drone_Scheduler_GetPeak(Drone_Scheduler* sched, Drone_Scheduler_Bus bus)
+{
+    return sched->peak[bus];
+}
+
+uint32_t Drone_Scheduler_GetBudget(Drone_Scheduler* sched, Drone_Scheduler_Bus bus)
+{
+    return sched->budget[bus];
+}
+
+void Drone_Scheduler_NextCycle(Drone_Scheduler* sched)
+{
+    uint32_t used[SCHEDULER_NBUS] = {0};
+    uint64_t cycle = ++sched->cycle;
+    for (int i=0; i<sched->nEntry; ++i) {
+        Drone_Scheduler_Entry* e = &sched->entry[i];
+        if (e->served) {
+            // The period is read after the refresh since some devices (BMP085) change it at each conversion
+            uint64_t period = Drone_Scheduler_Cycles(sched, e->dev->period);
+            do e->next += period;
+            while (e->next < cycle);
+            e->served = 0;
+        }
+        if (e->next > cycle) continue;
+        if (used[e->bus] && used[e->bus] + e->cost > sched->budget[e->bus]) {
+            // A device deferred for a whole period runs anyway : its data would be one refresh behind
+            if (cycle - e->next < Drone_Scheduler_Cycles(sched, e->dev->period)) {
+                ++e->deferred;
+                continue;
+            }
+            ++e->forced;
+        }
+        used[e->bus] += e->cost;
+        atomic_store_explicit(&e->dev->due, 1, memory_order_relaxed);
+        e->served = 1;
+    }
+}
+
+static uint64_t Drone_Scheduler_Cycles(Drone_Scheduler* sched, uint64_t period)
+{
+    uint64_t n = (period + sched->cyclePeriod - 1) / sched->cyclePeriod;
+    return n ? n : 1;
+}
@@ -20,18 +20,86 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #define __USE_GNU
 #include <sched.h>
 #include <sys/mman.h>
+#include "RTPiDrone_header.h"
 #include "RTPiDrone.h"
+#include "RTPiDrone_Bus.h"
+#include "Common.h"
 
 /*!
  * Main function.
  *
  * Ref Drone_Init(), Drone_Start(), Drone_Calibration(), and Drone_End().
+ *
+ * Options of the simulated bus:
+ *  -s                          use the simulated bus (default when built with SIMULATION)
+ *  -l i2c,i2cByte,spi,spiByte  latency (ns) of one transaction and of one byte, see Drone_Bus_Sim_SetLatency()
+ *  -t second                   flight time, from the first control cycle, before the simulated remote control turns the switch off
+ *
+ * Bus of the Raspberry Pi:
+ *  -i device                   I2C through the Linux i2c-dev driver (e.g. /dev/i2c-1), see Drone_Bus_I2CDev (built with I2CDEV)
+ *
+ * Loop:
+ *  -P                          pipelined loop, see Drone_SetPipelined()
+ *
+ * Attitude:
+ *  -e estimator                mahony (default), ekf or madgwick, see Drone_SetEstimator()
+ *
+ * Record and replay of the bus:
+ *  -r file                     record every read of the drivers and the control cycles in file
+ *  -p file                     replay file as fast as possible (virtual clock), see Drone_Bus_Replay_Open()
  */
-int main(void)
+int main(int argc, char* argv[])
 {
+    int opt;
+    unsigned int lat[4];
+    int pipelined = 0;
+    const char* estimator = NULL;
+    while ((opt = getopt(argc, argv, "Pe:si:l:t:r:p:")) != -1) {
+        switch (opt) {
+            case 'P':
+                pipelined = 1;
+                break;
+            case 'e':
+                estimator = optarg;
+                break;
+            case 's':
+                Drone_Bus_SetBackend(&Drone_Bus_Sim);
+                break;
+            case 'i':
+#ifndef DRONE_I2CDEV
+                fprintf(stderr, "-i : built without I2CDEV, no i2c-dev backend\n");
+                return -3;
+#else
+                Drone_Bus_I2CDev_SetDevice(optarg);
+                Drone_Bus_SetBackend(&Drone_Bus_I2CDev);
+                break;
+#endif
+            case 'l':
+                if (sscanf(optarg, "%u,%u,%u,%u", &lat[0], &lat[1], &lat[2], &lat[3]) != 4) {
+                    fprintf(stderr, "-l i2c,i2cByte,spi,spiByte\n");
+                    return -3;
+                }
+                Drone_Bus_Sim_SetLatency(lat[0], lat[1], lat[2], lat[3]);
+                break;
+            case 't':
+                Drone_Bus_Sim_SetFlightTime(atoi(optarg));
+                break;
+            case 'r':
+                if (Drone_Bus_Record(optarg)) return -3;
+                break;
+            case 'p':
+                if (Drone_Bus_Replay_Open(optarg)) return -3;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-P] [-e estimator] [-s | -i device] [-l i2c,i2cByte,spi,spiByte] [-t second] [-r file | -p file]\n", argv[0]);
+                return -3;
+        }
+    }
+
     cpu_set_t cmask;
     unsigned long len = sizeof(cmask);
     CPU_ZERO(&cmask); /* 初始化 cmask */
@@ -52,6 +120,8 @@ int main(void)
         perror("Error at Dron_init");
         return -1;
     }
+    Drone_SetPipelined(rpiDrone, pipelined);
+    if (estimator && Drone_SetEstimator(rpiDrone, estimator)) return -3;
     if (Drone_Calibration(rpiDrone)) {
         perror("Error at Dron_Calibration");
         return -2;